@@ -28,6 +28,7 @@
 #include<opencv2/core/core.hpp>
 
 #include"System.h"
+#include<FrameSource.h>
 
 using namespace std;
 
@@ -60,19 +61,19 @@ int main(int argc, char **argv)
     cout << "Start processing sequence ..." << endl;
     cout << "Images in the sequence: " << nImages << endl << endl;
 
+    // Images are decoded and converted to grayscale ahead of the tracking loop
+    ORB_SLAM2::FrameSource source(argv[2]);
+    source.SetFiles(vstrImageFilenames,vector<string>(),vTimestamps);
+
     // Main loop
-    cv::Mat im;
+    ORB_SLAM2::InputFrame frame;
     for(int ni=0; ni<nImages; ni++)
     {
-        // Read image from file
-        im = cv::imread(vstrImageFilenames[ni],CV_LOAD_IMAGE_UNCHANGED);
-        double tframe = vTimestamps[ni];
-
-        if(im.empty())
-        {
-            cerr << endl << "Failed to load image at: " << vstrImageFilenames[ni] << endl;
+        // Get the next decoded image
+        if(!source.Pop(frame) || frame.im.empty())
             return 1;
-        }
+
+        double tframe = frame.timestamp;
 
 #ifdef COMPILEDWITHC11
         std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
@@ -81,7 +82,7 @@ int main(int argc, char **argv)
 #endif
 
         // Pass the image to the SLAM system
-        SLAM.TrackMonocular(im,tframe);
+        SLAM.TrackMonocular(frame.im,tframe);
 
 #ifdef COMPILEDWITHC11
         std::chrono::steady_clock::time_point t2 = std::chrono::steady_clock::now();
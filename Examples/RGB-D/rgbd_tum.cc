@@ -27,6 +27,7 @@
 #include<opencv2/core/core.hpp>
 
 #include<System.h>
+#include<FrameSource.h>
 
 using namespace std;
 
@@ -72,21 +73,25 @@ int main(int argc, char **argv)
     cout << "Start processing sequence ..." << endl;
     cout << "Images in the sequence: " << nImages << endl << endl;
 
-    // Main loop
-    cv::Mat imRGB, imD;
+    // Images and depthmaps are decoded ahead of the tracking loop
     for(int ni=0; ni<nImages; ni++)
     {
-        // Read image and depthmap from file
-        imRGB = cv::imread(string(argv[3])+"/"+vstrImageFilenamesRGB[ni],CV_LOAD_IMAGE_UNCHANGED);
-        imD = cv::imread(string(argv[3])+"/"+vstrImageFilenamesD[ni],CV_LOAD_IMAGE_UNCHANGED);
-        double tframe = vTimestamps[ni];
+        vstrImageFilenamesRGB[ni] = string(argv[3])+"/"+vstrImageFilenamesRGB[ni];
+        vstrImageFilenamesD[ni] = string(argv[3])+"/"+vstrImageFilenamesD[ni];
+    }
 
-        if(imRGB.empty())
-        {
-            cerr << endl << "Failed to load image at: "
-                 << string(argv[3]) << "/" << vstrImageFilenamesRGB[ni] << endl;
+    ORB_SLAM2::FrameSource source(argv[2]);
+    source.SetFiles(vstrImageFilenamesRGB,vstrImageFilenamesD,vTimestamps);
+
+    // Main loop
+    ORB_SLAM2::InputFrame frame;
+    for(int ni=0; ni<nImages; ni++)
+    {
+        // Get the next image and depthmap
+        if(!source.Pop(frame) || frame.im.empty())
             return 1;
-        }
+
+        double tframe = frame.timestamp;
 
 #ifdef COMPILEDWITHC11
         std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
@@ -95,7 +100,7 @@ int main(int argc, char **argv)
 #endif
 
         // Pass the image to the SLAM system
-        SLAM.TrackRGBD(imRGB,imD,tframe);
+        SLAM.TrackRGBD(frame.im,frame.im2,tframe);
 
 #ifdef COMPILEDWITHC11
         std::chrono::steady_clock::time_point t2 = std::chrono::steady_clock::now();
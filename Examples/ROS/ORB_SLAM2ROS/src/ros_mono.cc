@@ -23,6 +23,7 @@
 #include<algorithm>
 #include<fstream>
 #include<chrono>
+#include<thread>
 
 #include<ros/ros.h>
 #include <cv_bridge/cv_bridge.h>
@@ -31,19 +32,28 @@
 #include<opencv2/core/core.hpp>
 
 #include"../../../include/System.h"
+#include"../../../include/FrameSource.h"
 
 using namespace std;
 
 class ImageGrabber
 {
 public:
-    ImageGrabber(ORB_SLAM2::System* pSLAM):mpSLAM(pSLAM){}
+    ImageGrabber(ORB_SLAM2::FrameSource* pSource):mpSource(pSource){}
 
     void GrabImage(const sensor_msgs::ImageConstPtr& msg);
 
-    ORB_SLAM2::System* mpSLAM;
+    ORB_SLAM2::FrameSource* mpSource;
 };
 
+// Tracks the frames of the source until it is finished
+void Track(ORB_SLAM2::System* pSLAM, ORB_SLAM2::FrameSource* pSource)
+{
+    ORB_SLAM2::InputFrame frame;
+    while(pSource->Pop(frame))
+        pSLAM->TrackMonocular(frame.im,frame.timestamp);
+}
+
 int main(int argc, char **argv)
 {
     ros::init(argc, argv, "Mono");
@@ -61,12 +71,19 @@ int main(int argc, char **argv)
     // Create SLAM system. It initializes all system threads and gets ready to process frames.
     ORB_SLAM2::System SLAM(argv[1],argv[2],ORB_SLAM2::System::MONOCULAR, &nodeHandler,true);
 
-    ImageGrabber igb(&SLAM);
+    // The callback only queues the image. It is converted to grayscale on a worker thread
+    // and tracked in its own thread. Only the most recent frames are kept.
+    ORB_SLAM2::FrameSource source(argv[2],2);
+    ImageGrabber igb(&source);
+    thread tTracking(Track,&SLAM,&source);
 
     ros::Subscriber sub = nodeHandler.subscribe("/camera/image_raw", 1, &ImageGrabber::GrabImage,&igb);
 
     ros::spin();
 
+    source.RequestFinish();
+    tTracking.join();
+
     // Stop all threads
     SLAM.Shutdown();
 
@@ -80,17 +97,16 @@ int main(int argc, char **argv)
 
 void ImageGrabber::GrabImage(const sensor_msgs::ImageConstPtr& msg)
 {
-    // Copy the ros image message to cv::Mat.
+    // Copy the ros image message to cv::Mat. The copy outlives the message until it is tracked.
     cv_bridge::CvImageConstPtr cv_ptr;
     try
     {
-        cv_ptr = cv_bridge::toCvShare(msg);
+        cv_ptr = cv_bridge::toCvCopy(msg);
     }
     catch (cv_bridge::Exception& e)
     {
         ROS_ERROR("cv_bridge exception: %s", e.what());
         return;
     }
-    //std::cout << "ros_mono.cc: " << cv_ptr->header.stamp.toSec() << std::endl;
-    mpSLAM->TrackMonocular(cv_ptr->image,cv_ptr->header.stamp.toSec());
+    mpSource->Push(cv_ptr->image,cv::Mat(),cv_ptr->header.stamp.toSec());
 }
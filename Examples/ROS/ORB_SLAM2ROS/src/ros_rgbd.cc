@@ -23,6 +23,7 @@
 #include<algorithm>
 #include<fstream>
 #include<chrono>
+#include<thread>
 
 #include<ros/ros.h>
 #include <cv_bridge/cv_bridge.h>
@@ -33,19 +34,28 @@
 #include<opencv2/core/core.hpp>
 
 #include"../../../include/System.h"
+#include"../../../include/FrameSource.h"
 
 using namespace std;
 
 class ImageGrabber
 {
 public:
-    ImageGrabber(ORB_SLAM2::System* pSLAM):mpSLAM(pSLAM){}
+    ImageGrabber(ORB_SLAM2::FrameSource* pSource):mpSource(pSource){}
 
     void GrabRGBD(const sensor_msgs::ImageConstPtr& msgRGB,const sensor_msgs::ImageConstPtr& msgD);
 
-    ORB_SLAM2::System* mpSLAM;
+    ORB_SLAM2::FrameSource* mpSource;
 };
 
+// Tracks the frames of the source until it is finished
+void Track(ORB_SLAM2::System* pSLAM, ORB_SLAM2::FrameSource* pSource)
+{
+    ORB_SLAM2::InputFrame frame;
+    while(pSource->Pop(frame))
+        pSLAM->TrackRGBD(frame.im,frame.im2,frame.timestamp);
+}
+
 int main(int argc, char **argv)
 {
     ros::init(argc, argv, "RGBD");
@@ -61,7 +71,11 @@ int main(int argc, char **argv)
     // Create SLAM system. It initializes all system threads and gets ready to process frames.
     ORB_SLAM2::System SLAM(argv[1],argv[2],ORB_SLAM2::System::RGBD,true);
 
-    ImageGrabber igb(&SLAM);
+    // The callback only queues the images. They are converted on a worker thread
+    // and tracked in their own thread. Only the most recent frames are kept.
+    ORB_SLAM2::FrameSource source(argv[2],2);
+    ImageGrabber igb(&source);
+    thread tTracking(Track,&SLAM,&source);
 
     ros::NodeHandle nh;
 
@@ -73,6 +87,9 @@ int main(int argc, char **argv)
 
     ros::spin();
 
+    source.RequestFinish();
+    tTracking.join();
+
     // Stop all threads
     SLAM.Shutdown();
 
@@ -86,11 +103,11 @@ int main(int argc, char **argv)
 
 void ImageGrabber::GrabRGBD(const sensor_msgs::ImageConstPtr& msgRGB,const sensor_msgs::ImageConstPtr& msgD)
 {
-    // Copy the ros image message to cv::Mat.
+    // Copy the ros image messages to cv::Mat. The copies outlive the messages until they are tracked.
     cv_bridge::CvImageConstPtr cv_ptrRGB;
     try
     {
-        cv_ptrRGB = cv_bridge::toCvShare(msgRGB);
+        cv_ptrRGB = cv_bridge::toCvCopy(msgRGB);
     }
     catch (cv_bridge::Exception& e)
     {
@@ -101,7 +118,7 @@ void ImageGrabber::GrabRGBD(const sensor_msgs::ImageConstPtr& msgRGB,const senso
     cv_bridge::CvImageConstPtr cv_ptrD;
     try
     {
-        cv_ptrD = cv_bridge::toCvShare(msgD);
+        cv_ptrD = cv_bridge::toCvCopy(msgD);
     }
     catch (cv_bridge::Exception& e)
     {
@@ -109,7 +126,7 @@ void ImageGrabber::GrabRGBD(const sensor_msgs::ImageConstPtr& msgRGB,const senso
         return;
     }
 
-    mpSLAM->TrackRGBD(cv_ptrRGB->image,cv_ptrD->image,cv_ptrRGB->header.stamp.toSec());
+    mpSource->Push(cv_ptrRGB->image,cv_ptrD->image,cv_ptrRGB->header.stamp.toSec());
 }
 
 
@@ -23,6 +23,7 @@
 #include<algorithm>
 #include<fstream>
 #include<chrono>
+#include<thread>
 
 #include<ros/ros.h>
 #include <cv_bridge/cv_bridge.h>
@@ -33,21 +34,30 @@
 #include<opencv2/core/core.hpp>
 
 #include"../../../include/System.h"
+#include"../../../include/FrameSource.h"
 
 using namespace std;
 
 class ImageGrabber
 {
 public:
-    ImageGrabber(ORB_SLAM2::System* pSLAM):mpSLAM(pSLAM){}
+    ImageGrabber(ORB_SLAM2::FrameSource* pSource):mpSource(pSource){}
 
     void GrabStereo(const sensor_msgs::ImageConstPtr& msgLeft,const sensor_msgs::ImageConstPtr& msgRight);
 
-    ORB_SLAM2::System* mpSLAM;
+    ORB_SLAM2::FrameSource* mpSource;
     bool do_rectify;
     cv::Mat M1l,M2l,M1r,M2r;
 };
 
+// Tracks the frames of the source until it is finished
+void Track(ORB_SLAM2::System* pSLAM, ORB_SLAM2::FrameSource* pSource)
+{
+    ORB_SLAM2::InputFrame frame;
+    while(pSource->Pop(frame))
+        pSLAM->TrackStereo(frame.im,frame.im2,frame.timestamp);
+}
+
 int main(int argc, char **argv)
 {
     ros::init(argc, argv, "RGBD");
@@ -63,7 +73,10 @@ int main(int argc, char **argv)
     // Create SLAM system. It initializes all system threads and gets ready to process frames.
     ORB_SLAM2::System SLAM(argv[1],argv[2],ORB_SLAM2::System::STEREO,true);
 
-    ImageGrabber igb(&SLAM);
+    // The callback only queues the images. They are rectified and converted on worker threads
+    // and tracked in their own thread. Only the most recent frames are kept.
+    ORB_SLAM2::FrameSource source(argv[2],2);
+    ImageGrabber igb(&source);
 
     stringstream ss(argv[3]);
 	ss >> boolalpha >> igb.do_rectify;
@@ -105,8 +118,12 @@ int main(int argc, char **argv)
 
         cv::initUndistortRectifyMap(K_l,D_l,R_l,P_l.rowRange(0,3).colRange(0,3),cv::Size(cols_l,rows_l),CV_32F,igb.M1l,igb.M2l);
         cv::initUndistortRectifyMap(K_r,D_r,R_r,P_r.rowRange(0,3).colRange(0,3),cv::Size(cols_r,rows_r),CV_32F,igb.M1r,igb.M2r);
+
+        source.SetRectification(igb.M1l,igb.M2l,igb.M1r,igb.M2r);
     }
 
+    thread tTracking(Track,&SLAM,&source);
+
     ros::NodeHandle nh;
 
     message_filters::Subscriber<sensor_msgs::Image> left_sub(nh, "/camera/left/image_raw", 1);
@@ -117,6 +134,9 @@ int main(int argc, char **argv)
 
     ros::spin();
 
+    source.RequestFinish();
+    tTracking.join();
+
     // Stop all threads
     SLAM.Shutdown();
 
@@ -132,11 +152,11 @@ int main(int argc, char **argv)
 
 void ImageGrabber::GrabStereo(const sensor_msgs::ImageConstPtr& msgLeft,const sensor_msgs::ImageConstPtr& msgRight)
 {
-    // Copy the ros image message to cv::Mat.
+    // Copy the ros image messages to cv::Mat. The copies outlive the messages until they are tracked.
     cv_bridge::CvImageConstPtr cv_ptrLeft;
     try
     {
-        cv_ptrLeft = cv_bridge::toCvShare(msgLeft);
+        cv_ptrLeft = cv_bridge::toCvCopy(msgLeft);
     }
     catch (cv_bridge::Exception& e)
     {
@@ -147,7 +167,7 @@ void ImageGrabber::GrabStereo(const sensor_msgs::ImageConstPtr& msgLeft,const se
     cv_bridge::CvImageConstPtr cv_ptrRight;
     try
     {
-        cv_ptrRight = cv_bridge::toCvShare(msgRight);
+        cv_ptrRight = cv_bridge::toCvCopy(msgRight);
     }
     catch (cv_bridge::Exception& e)
     {
@@ -155,17 +175,8 @@ void ImageGrabber::GrabStereo(const sensor_msgs::ImageConstPtr& msgLeft,const se
         return;
     }
 
-    if(do_rectify)
-    {
-        cv::Mat imLeft, imRight;
-        cv::remap(cv_ptrLeft->image,imLeft,M1l,M2l,cv::INTER_LINEAR);
-        cv::remap(cv_ptrRight->image,imRight,M1r,M2r,cv::INTER_LINEAR);
-        mpSLAM->TrackStereo(imLeft,imRight,cv_ptrLeft->header.stamp.toSec());
-    }
-    else
-    {
-        mpSLAM->TrackStereo(cv_ptrLeft->image,cv_ptrRight->image,cv_ptrLeft->header.stamp.toSec());
-    }
+    // Rectification (if enabled) is done by the frame source
+    mpSource->Push(cv_ptrLeft->image,cv_ptrRight->image,cv_ptrLeft->header.stamp.toSec());
 
 }
 
@@ -28,6 +28,7 @@
 #include<opencv2/core/core.hpp>
 
 #include<System.h>
+#include<FrameSource.h>
 
 using namespace std;
 
@@ -111,32 +112,20 @@ int main(int argc, char **argv)
     cout << "Start processing sequence ..." << endl;
     cout << "Images in the sequence: " << nImages << endl << endl;
 
+    // Images are decoded, rectified and converted to grayscale ahead of the tracking loop
+    ORB_SLAM2::FrameSource source(argv[2]);
+    source.SetRectification(M1l,M2l,M1r,M2r);
+    source.SetFiles(vstrImageLeft,vstrImageRight,vTimeStamp);
+
     // Main loop
-    cv::Mat imLeft, imRight, imLeftRect, imRightRect;
+    ORB_SLAM2::InputFrame frame;
     for(int ni=0; ni<nImages; ni++)
     {
-        // Read left and right images from file
-        imLeft = cv::imread(vstrImageLeft[ni],CV_LOAD_IMAGE_UNCHANGED);
-        imRight = cv::imread(vstrImageRight[ni],CV_LOAD_IMAGE_UNCHANGED);
-
-        if(imLeft.empty())
-        {
-            cerr << endl << "Failed to load image at: "
-                 << string(vstrImageLeft[ni]) << endl;
+        // Get the next rectified pair
+        if(!source.Pop(frame) || frame.im.empty())
             return 1;
-        }
-
-        if(imRight.empty())
-        {
-            cerr << endl << "Failed to load image at: "
-                 << string(vstrImageRight[ni]) << endl;
-            return 1;
-        }
-
-        cv::remap(imLeft,imLeftRect,M1l,M2l,cv::INTER_LINEAR);
-        cv::remap(imRight,imRightRect,M1r,M2r,cv::INTER_LINEAR);
 
-        double tframe = vTimeStamp[ni];
+        double tframe = frame.timestamp;
 
 
 #ifdef COMPILEDWITHC11
@@ -146,7 +135,7 @@ int main(int argc, char **argv)
 #endif
 
         // Pass the images to the SLAM system
-        SLAM.TrackStereo(imLeftRect,imRightRect,tframe);
+        SLAM.TrackStereo(frame.im,frame.im2,tframe);
 
 #ifdef COMPILEDWITHC11
         std::chrono::steady_clock::time_point t2 = std::chrono::steady_clock::now();
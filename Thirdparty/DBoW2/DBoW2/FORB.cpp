@@ -13,6 +13,7 @@
 #include <vector>
 #include <string>
 #include <sstream>
+#include <cstring>
 #include <stdint-gcc.h>
 
 #include "FORB.h"
@@ -136,6 +137,20 @@ void FORB::fromString(FORB::TDescriptor &a, const std::string &s)
 
 // --------------------------------------------------------------------------
 
+void FORB::fromArray(FORB::TDescriptor &a, const unsigned char *p)
+{
+  a = cv::Mat(1, FORB::L, CV_8U, const_cast<unsigned char*>(p));
+}
+
+// --------------------------------------------------------------------------
+
+void FORB::toArray(const FORB::TDescriptor &a, unsigned char *p)
+{
+  memcpy(p, a.ptr<unsigned char>(), FORB::L);
+}
+
+// --------------------------------------------------------------------------
+
 void FORB::toMat32F(const std::vector<TDescriptor> &descriptors, 
   cv::Mat &mat)
 {
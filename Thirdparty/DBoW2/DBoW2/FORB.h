@@ -60,6 +60,21 @@ public:
    */
   static void fromString(TDescriptor &a, const std::string &s);
 
+  /**
+   * Returns a descriptor that points to L bytes of memory, without copying.
+   * The memory must outlive the descriptor
+   * @param a descriptor
+   * @param p packed descriptor
+   */
+  static void fromArray(TDescriptor &a, const unsigned char *p);
+
+  /**
+   * Packs a descriptor into L bytes
+   * @param a descriptor
+   * @param p (out) packed descriptor
+   */
+  static void toArray(const TDescriptor &a, unsigned char *p);
+
   /**
    * Returns a mat with the descriptors in float format
    * @param descriptors
@@ -3,6 +3,9 @@
  * Added functions: Save and Load from text files without using cv::FileStorage.
  * Date: August 2015
  * Raúl Mur-Artal
+ *
+ * Added functions: Save and Load from a binary file that is memory mapped
+ * and used in place (descriptors are not copied).
  */
 
 /**
@@ -26,6 +29,13 @@
 #include <algorithm>
 #include <opencv2/core/core.hpp>
 #include <limits>
+#include <cstring>
+#include <stdint.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "FeatureVector.h"
 #include "BowVector.h"
@@ -246,6 +256,22 @@ public:
    */
   void saveToTextFile(const std::string &filename) const;  
 
+  /**
+   * Loads the vocabulary from a binary file (see saveToBinaryFile).
+   * The file is memory mapped and node descriptors point into the mapping.
+   * @param filename
+   * @return false if the file is missing or is not a binary vocabulary
+   */
+  bool loadFromBinaryFile(const std::string &filename);
+
+  /**
+   * Saves the vocabulary into a binary file that can be loaded with
+   * loadFromBinaryFile
+   * @param filename
+   * @return false if the file could not be written
+   */
+  bool saveToBinaryFile(const std::string &filename) const;
+
   /**
    * Saves the vocabulary into a file
    * @param filename
@@ -330,6 +356,49 @@ protected:
 
 protected:
 
+  /// Header of the binary vocabulary file (64 bytes).
+  /// It is followed by the flat arrays, in this order:
+  /// parent ids (uint32), leaf flags (uint8), weights (double, 8-byte aligned)
+  /// and descriptors (nNodes rows of F::L bytes, 64-byte aligned).
+  struct BinaryHeader
+  {
+    char magic[8];
+    uint32_t version;
+    uint32_t descriptorBytes;
+    int32_t k;
+    int32_t L;
+    int32_t scoring;
+    int32_t weighting;
+    uint64_t nNodes;
+    uint64_t nWords;
+    uint64_t reserved[2];
+  };
+
+  /// Memory mapped binary file, shared by the copies of a vocabulary
+  struct BinaryMapping
+  {
+    void *addr;
+    size_t size;
+    int refs;
+  };
+
+  /**
+   * Computes the offsets of the arrays of a binary file
+   * @param nNodes number of nodes, including the root
+   * @param offLeaves (out) offset of the leaf flags
+   * @param offWeights (out) offset of the weights
+   * @param offDescriptors (out) offset of the descriptors
+   * @return total size of the file
+   */
+  static size_t binaryLayout(uint64_t nNodes, size_t &offLeaves,
+    size_t &offWeights, size_t &offDescriptors);
+
+  /**
+   * Drops the reference to the memory mapped file, if any. Must be called
+   * before the nodes that point into the mapping are replaced
+   */
+  void releaseMapping();
+
   /**
    * Creates an instance of the scoring object accoring to m_scoring
    */
@@ -425,6 +494,9 @@ protected:
   /// Words of the vocabulary (tree leaves)
   /// this condition holds: m_words[wid]->word_id == wid
   std::vector<Node*> m_words;
+
+  /// Binary file the node descriptors point into (NULL if they own their data)
+  BinaryMapping *m_mapping;
   
 };
 
@@ -434,7 +506,7 @@ template<class TDescriptor, class F>
 TemplatedVocabulary<TDescriptor,F>::TemplatedVocabulary
   (int k, int L, WeightingType weighting, ScoringType scoring)
   : m_k(k), m_L(L), m_weighting(weighting), m_scoring(scoring),
-  m_scoring_object(NULL)
+  m_scoring_object(NULL), m_mapping(NULL)
 {
   createScoringObject();
 }
@@ -443,7 +515,7 @@ TemplatedVocabulary<TDescriptor,F>::TemplatedVocabulary
 
 template<class TDescriptor, class F>
 TemplatedVocabulary<TDescriptor,F>::TemplatedVocabulary
-  (const std::string &filename): m_scoring_object(NULL)
+  (const std::string &filename): m_scoring_object(NULL), m_mapping(NULL)
 {
   load(filename);
 }
@@ -452,7 +524,7 @@ TemplatedVocabulary<TDescriptor,F>::TemplatedVocabulary
 
 template<class TDescriptor, class F>
 TemplatedVocabulary<TDescriptor,F>::TemplatedVocabulary
-  (const char *filename): m_scoring_object(NULL)
+  (const char *filename): m_scoring_object(NULL), m_mapping(NULL)
 {
   load(filename);
 }
@@ -516,7 +588,7 @@ void TemplatedVocabulary<TDescriptor,F>::setWeightingType(WeightingType type)
 template<class TDescriptor, class F>
 TemplatedVocabulary<TDescriptor,F>::TemplatedVocabulary(
   const TemplatedVocabulary<TDescriptor, F> &voc)
-  : m_scoring_object(NULL)
+  : m_scoring_object(NULL), m_mapping(NULL)
 {
   *this = voc;
 }
@@ -527,6 +599,23 @@ template<class TDescriptor, class F>
 TemplatedVocabulary<TDescriptor,F>::~TemplatedVocabulary()
 {
   delete m_scoring_object;
+  releaseMapping();
+}
+
+// --------------------------------------------------------------------------
+
+template<class TDescriptor, class F>
+void TemplatedVocabulary<TDescriptor,F>::releaseMapping()
+{
+  if(m_mapping)
+  {
+    if(--m_mapping->refs == 0)
+    {
+      munmap(m_mapping->addr, m_mapping->size);
+      delete m_mapping;
+    }
+    m_mapping = NULL;
+  }
 }
 
 // --------------------------------------------------------------------------
@@ -543,8 +632,15 @@ TemplatedVocabulary<TDescriptor,F>::operator=
 
   this->createScoringObject();
   
+  // copied descriptors may point into the mapped file of voc
+  if(voc.m_mapping)
+    voc.m_mapping->refs++;
+  BinaryMapping *mapping = voc.m_mapping;
+
   this->m_nodes.clear();
   this->m_words.clear();
+  this->releaseMapping();
+  this->m_mapping = mapping;
   
   this->m_nodes = voc.m_nodes;
   this->createWords();
@@ -560,6 +656,7 @@ void TemplatedVocabulary<TDescriptor,F>::create(
 {
   m_nodes.clear();
   m_words.clear();
+  releaseMapping();
   
   // expected_nodes = Sum_{i=0..L} ( k^i )
 	int expected_nodes = 
@@ -1345,6 +1442,7 @@ bool TemplatedVocabulary<TDescriptor,F>::loadFromTextFile(const std::string &fil
 
     m_words.clear();
     m_nodes.clear();
+    releaseMapping();
 
     string s;
     getline(f,s);
@@ -1450,6 +1548,175 @@ void TemplatedVocabulary<TDescriptor,F>::saveToTextFile(const std::string &filen
 
 // --------------------------------------------------------------------------
 
+template<class TDescriptor, class F>
+size_t TemplatedVocabulary<TDescriptor,F>::binaryLayout(uint64_t nNodes,
+  size_t &offLeaves, size_t &offWeights, size_t &offDescriptors)
+{
+    const size_t offParents = sizeof(BinaryHeader);
+    offLeaves = offParents + nNodes*sizeof(uint32_t);
+    offWeights = (offLeaves + nNodes + 7) & ~(size_t)7;
+    offDescriptors = (offWeights + nNodes*sizeof(double) + 63) & ~(size_t)63;
+    return offDescriptors + nNodes*F::L;
+}
+
+// --------------------------------------------------------------------------
+
+template<class TDescriptor, class F>
+bool TemplatedVocabulary<TDescriptor,F>::loadFromBinaryFile(const std::string &filename)
+{
+    int fd = open(filename.c_str(), O_RDONLY);
+    if(fd<0)
+        return false;
+
+    struct stat st;
+    if(fstat(fd,&st)!=0 || (size_t)st.st_size<sizeof(BinaryHeader))
+    {
+        close(fd);
+        return false;
+    }
+
+    const size_t fileSize = st.st_size;
+    void *addr = mmap(NULL, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(addr==MAP_FAILED)
+        return false;
+
+    const unsigned char *data = static_cast<const unsigned char*>(addr);
+
+    BinaryHeader header;
+    memcpy(&header, data, sizeof(header));
+
+    // The node count comes from the file: it is checked against the bytes after the header
+    // before computing the layout, so that a corrupted count cannot overflow the offsets.
+    const size_t nodeBytes = sizeof(uint32_t) + 1 + sizeof(double) + F::L;
+    size_t offLeaves=0, offWeights=0, offDescriptors=0;
+    bool bValid = memcmp(header.magic, "DBoW2bin", 8)==0 && header.version==1 &&
+                  header.descriptorBytes==(uint32_t)F::L && header.nNodes>0 &&
+                  header.k>=0 && header.k<=20 && header.L>=1 && header.L<=10 &&
+                  header.scoring>=0 && header.scoring<=5 && header.weighting>=0 && header.weighting<=3 &&
+                  header.nNodes<=(fileSize-sizeof(BinaryHeader))/nodeBytes &&
+                  binaryLayout(header.nNodes,offLeaves,offWeights,offDescriptors)<=fileSize;
+
+    const uint32_t *parents = reinterpret_cast<const uint32_t*>(data+sizeof(BinaryHeader));
+    const unsigned char *leaves = data+offLeaves;
+    const double *weights = reinterpret_cast<const double*>(data+offWeights);
+    const unsigned char *descriptors = data+offDescriptors;
+
+    // Nodes are stored parents first, check it before building the tree
+    const size_t nNodes = bValid ? header.nNodes : 0;
+    vector<unsigned int> vnChildren(nNodes,0);
+    uint64_t nLeaves = 0;
+    for(size_t i=1; i<nNodes && bValid; i++)
+    {
+        if(parents[i]>=i)
+            bValid = false;
+        else
+            vnChildren[parents[i]]++;
+        if(leaves[i])
+            nLeaves++;
+    }
+
+    if(!bValid || nLeaves!=header.nWords)
+    {
+        if(memcmp(header.magic, "DBoW2bin", 8)==0)
+            std::cerr << "Vocabulary loading failure: corrupted binary file!" << endl;
+        munmap(addr, fileSize);
+        return false;
+    }
+
+    m_words.clear();
+    m_nodes.clear();
+    releaseMapping();
+
+    m_k = header.k;
+    m_L = header.L;
+    m_scoring = (ScoringType)header.scoring;
+    m_weighting = (WeightingType)header.weighting;
+    createScoringObject();
+
+    m_nodes.resize(nNodes);
+    m_words.resize(header.nWords);
+
+    for(size_t i=0; i<nNodes; i++)
+    {
+        m_nodes[i].id = i;
+        m_nodes[i].children.reserve(vnChildren[i]);
+    }
+
+    WordId wid = 0;
+    for(size_t i=1; i<nNodes; i++)
+    {
+        Node &node = m_nodes[i];
+        node.parent = parents[i];
+        m_nodes[node.parent].children.push_back(i);
+        F::fromArray(node.descriptor, descriptors+i*F::L);
+        node.weight = weights[i];
+
+        if(leaves[i])
+        {
+            node.word_id = wid;
+            m_words[wid] = &node;
+            wid++;
+        }
+    }
+
+    m_mapping = new BinaryMapping;
+    m_mapping->addr = addr;
+    m_mapping->size = fileSize;
+    m_mapping->refs = 1;
+
+    return true;
+}
+
+// --------------------------------------------------------------------------
+
+template<class TDescriptor, class F>
+bool TemplatedVocabulary<TDescriptor,F>::saveToBinaryFile(const std::string &filename) const
+{
+    ofstream f(filename.c_str(), ios_base::out | ios_base::binary);
+    if(!f.is_open())
+        return false;
+
+    BinaryHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, "DBoW2bin", 8);
+    header.version = 1;
+    header.descriptorBytes = F::L;
+    header.k = m_k;
+    header.L = m_L;
+    header.scoring = m_scoring;
+    header.weighting = m_weighting;
+    header.nNodes = m_nodes.size();
+    header.nWords = m_words.size();
+
+    size_t offLeaves, offWeights, offDescriptors;
+    const size_t fileSize = binaryLayout(header.nNodes,offLeaves,offWeights,offDescriptors);
+
+    vector<unsigned char> buffer(fileSize,0);
+    memcpy(&buffer[0], &header, sizeof(header));
+
+    uint32_t *parents = reinterpret_cast<uint32_t*>(&buffer[sizeof(BinaryHeader)]);
+    unsigned char *leaves = &buffer[offLeaves];
+    double *weights = reinterpret_cast<double*>(&buffer[offWeights]);
+    unsigned char *descriptors = &buffer[offDescriptors];
+
+    for(size_t i=1; i<m_nodes.size(); i++)
+    {
+        const Node& node = m_nodes[i];
+        parents[i] = node.parent;
+        leaves[i] = node.isLeaf() ? 1 : 0;
+        weights[i] = node.weight;
+        F::toArray(node.descriptor, descriptors+i*F::L);
+    }
+
+    f.write(reinterpret_cast<const char*>(&buffer[0]), fileSize);
+    f.close();
+
+    return !f.fail();
+}
+
+// --------------------------------------------------------------------------
+
 template<class TDescriptor, class F>
 void TemplatedVocabulary<TDescriptor,F>::save(const std::string &filename) const
 {
@@ -1575,6 +1842,7 @@ void TemplatedVocabulary<TDescriptor,F>::load(const cv::FileStorage &fs,
 {
   m_words.clear();
   m_nodes.clear();
+  releaseMapping();
   
   cv::FileNode fvoc = fs[name];
   
@@ -22,6 +22,8 @@
 #define FRAME_H
 
 #include<vector>
+#include<memory>
+#include<mutex>
 
 #include "MapPoint.h"
 #include "Thirdparty/DBoW2/DBoW2/BowVector.h"
@@ -31,6 +33,7 @@
 #include "ORBextractor.h"
 
 #include <opencv2/opencv.hpp>
+#include <Eigen/Core>
 
 namespace ORB_SLAM2
 {
@@ -40,48 +43,136 @@ namespace ORB_SLAM2
 class MapPoint;
 class KeyFrame;
 
+// Map points in structure-of-arrays layout, to check them at once (Frame::ProjectInFrustum)
+struct MapPointsSoA
+{
+    // World position
+    std::vector<float> x, y, z;
+    // Mean viewing direction
+    std::vector<float> nx, ny, nz;
+    // Scale invariance region
+    std::vector<float> minDist, maxDist;
+    // Maximum distance, used to predict the scale
+    std::vector<float> scaleDist;
+
+    size_t size() const { return x.size(); }
+
+    void clear()
+    {
+        x.clear(); y.clear(); z.clear();
+        nx.clear(); ny.clear(); nz.clear();
+        minDist.clear(); maxDist.clear(); scaleDist.clear();
+    }
+
+    void push_back(MapPoint* pMP);
+};
+
+// Keypoints of a frame and the data computed from them, which do not change once the frame is built.
+// They are shared by the Frame, its copies and the KeyFrame created from it.
+struct FeatureData
+{
+    // Vector of keypoints (original for visualization) and undistorted (actually used by the system).
+    // In the stereo case, mvKeysUn is redundant as images must be rectified.
+    // In the RGB-D case, RGB images can be distorted.
+    std::vector<cv::KeyPoint> mvKeys;
+    std::vector<cv::KeyPoint> mvKeysUn;
+
+    // Corresponding stereo coordinate and depth for each keypoint.
+    // "Monocular" keypoints have a negative value.
+    std::vector<float> mvuRight;
+    std::vector<float> mvDepth;
+
+    // Keypoints are assigned to cells in a grid to reduce matching complexity when projecting MapPoints.
+    // The grid is stored in compressed rows: the keypoints of cell (ix,iy) are
+    // mGridIndices[mGridStart[c]] ... mGridIndices[mGridStart[c+1]-1], with c = ix*FRAME_GRID_ROWS+iy.
+    std::vector<unsigned int> mGridStart;
+    std::vector<unsigned int> mGridIndices;
+
+    // Bag of Words Vector structures. They are filled on demand by ComputeBoW.
+    mutable DBoW2::BowVector mBowVec;
+    mutable DBoW2::FeatureVector mFeatVec;
+
+    // Compute the Bag of Words representation of the descriptors, if it is not there yet.
+    // The Frame and the KeyFrame sharing the data can call it from different threads.
+    void ComputeBoW(ORBVocabulary* pVoc, const cv::Mat &descriptors) const;
+
+private:
+    mutable std::once_flag mBowFlag;
+};
+
+// Projection of a map point that is in the frustum of a frame
+struct MapPointProjection
+{
+    // Index of the point in the projected MapPointsSoA
+    int idx;
+    float u, v, uR;
+    int level;
+    float viewCos;
+};
+
 class Frame
 {
+    friend class MapSerializer;
+
 public:
     Frame();
 
-    // Copy constructor.
+    // Copy constructor and assignment. Keypoint data and descriptors are shared, they are never
+    // modified after extraction. The assignment reuses the memory of the destination vectors.
     Frame(const Frame &frame);
+    Frame& operator=(const Frame &frame);
+
+    // Move constructor and assignment, used to hand a new frame to the Tracking without copies.
+    Frame(Frame &&frame) = default;
+    Frame& operator=(Frame &&frame) = default;
 
     // Constructor for stereo cameras.
     Frame(const cv::Mat &imLeft, const cv::Mat &imRight, const double &timeStamp, ORBextractor* extractorLeft, ORBextractor* extractorRight, ORBVocabulary* voc, cv::Mat &K, cv::Mat &distCoef, const float &bf, const float &thDepth);
 
     // Constructor for RGB-D cameras.
-    Frame(const cv::Mat &imGray, const cv::Mat &imDepth, const double &timeStamp, ORBextractor* extractor,ORBVocabulary* voc, cv::Mat &K, cv::Mat &distCoef, const float &bf, const float &thDepth);
+    // The depthmap is metric (CV_32F) or raw (CV_16U), and is scaled by depthFactor where it is sampled.
+    Frame(const cv::Mat &imGray, const cv::Mat &imDepth, const double &timeStamp, ORBextractor* extractor,ORBVocabulary* voc, cv::Mat &K, cv::Mat &distCoef, const float &bf, const float &thDepth, const float &depthFactor=1.0f);
 
     // Constructor for Monocular cameras.
     Frame(const cv::Mat &imGray, const double &timeStamp, ORBextractor* extractor,ORBVocabulary* voc, cv::Mat &K, cv::Mat &distCoef, const float &bf, const float &thDepth);
 
     // Extract ORB on the image. 0 for left image and 1 for right image.
-    void ExtractORB(int flag, const cv::Mat &im);
+    void ExtractORB(int flag, const cv::Mat &im, std::vector<cv::KeyPoint> &vKeys);
 
     // Compute Bag of Words representation.
     void ComputeBoW();
 
-    // Set the camera pose.
-    void SetPose(cv::Mat Tcw);
+    // Set the camera pose (world to camera).
+    void SetPose(const Eigen::Matrix3f &Rcw, const Eigen::Vector3f &tcw);
+
+    // Returns true if the pose of the frame has been set.
+    inline bool HasPose() const {
+        return mbHasPose;
+    }
+
+    // Returns rotation and translation of the camera pose.
+    inline Eigen::Matrix3f GetRotation() const {
+        return mRcw;
+    }
 
-    // Computes rotation, translation and camera center matrices from the camera pose.
-    void UpdatePoseMatrices();
+    inline Eigen::Vector3f GetTranslation() const {
+        return mtcw;
+    }
 
     // Returns the camera center.
-    inline cv::Mat GetCameraCenter(){
-        return mOw.clone();
+    inline Eigen::Vector3f GetCameraCenter() const {
+        return mOw;
     }
 
     // Returns inverse of rotation
-    inline cv::Mat GetRotationInverse(){
-        return mRwc.clone();
+    inline Eigen::Matrix3f GetRotationInverse() const {
+        return mRwc;
     }
 
-    // Check if a MapPoint is in the frustum of the camera
-    // and fill variables of the MapPoint to be used by the tracking
-    bool isInFrustum(MapPoint* pMP, float viewingCosLimit);
+    // Check which MapPoints are in the frustum of the camera: positive depth, inside the image,
+    // within the scale invariance distances and with a viewing angle below the limit. The
+    // projections of the points in the frustum are returned in order.
+    void ProjectInFrustum(const MapPointsSoA &points, const float viewingCosLimit, std::vector<MapPointProjection> &vProjections);
 
     // Compute the cell of a keypoint (return false if outside the grid)
     bool PosInGrid(const cv::KeyPoint &kp, int &posX, int &posY);
@@ -90,13 +181,14 @@ public:
 
     // Search a match for each keypoint in the left image to a keypoint in the right image.
     // If there is a match, depth is computed and the right coordinate associated to the left keypoint is stored.
-    void ComputeStereoMatches();
+    void ComputeStereoMatches(FeatureData &features);
 
     // Associate a "right" coordinate to a keypoint if there is valid depth in the depthmap.
-    void ComputeStereoFromRGBD(const cv::Mat &imDepth);
+    // Only the depth at the keypoints is read and scaled.
+    void ComputeStereoFromRGBD(FeatureData &features, const cv::Mat &imDepth, const float &depthFactor);
 
-    // Backprojects a keypoint (if stereo/depth info available) into 3D world coordinates.
-    cv::Mat UnprojectStereo(const int &i);
+    // Backprojects a keypoint with stereo/depth info (mvDepth[i]>0) into 3D world coordinates.
+    Eigen::Vector3f UnprojectStereo(const int &i);
 
 public:
     // Vocabulary used for relocalization.
@@ -131,20 +223,11 @@ public:
     // Number of KeyPoints.
     int N;
 
-    // Vector of keypoints (original for visualization) and undistorted (actually used by the system).
-    // In the stereo case, mvKeysUn is redundant as images must be rectified.
-    // In the RGB-D case, RGB images can be distorted.
-    std::vector<cv::KeyPoint> mvKeys, mvKeysRight;
-    std::vector<cv::KeyPoint> mvKeysUn;
-
-    // Corresponding stereo coordinate and depth for each keypoint.
-    // "Monocular" keypoints have a negative value.
-    std::vector<float> mvuRight;
-    std::vector<float> mvDepth;
+    // Keypoints, stereo coordinates, grid and Bag of Words of the frame.
+    std::shared_ptr<const FeatureData> mpFeatures;
 
-    // Bag of Words Vector structures.
-    DBoW2::BowVector mBowVec;
-    DBoW2::FeatureVector mFeatVec;
+    // Keypoints of the right image, only used to build the frame.
+    std::vector<cv::KeyPoint> mvKeysRight;
 
     // ORB descriptor, each row associated to a keypoint.
     cv::Mat mDescriptors, mDescriptorsRight;
@@ -155,13 +238,9 @@ public:
     // Flag to identify outlier associations.
     std::vector<bool> mvbOutlier;
 
-    // Keypoints are assigned to cells in a grid to reduce matching complexity when projecting MapPoints.
+    // Size of the cells of the keypoint grid (FeatureData).
     static float mfGridElementWidthInv;
     static float mfGridElementHeightInv;
-    std::vector<std::size_t> mGrid[FRAME_GRID_COLS][FRAME_GRID_ROWS];
-
-    // Camera pose.
-    cv::Mat mTcw;
 
     // Current and Next Frame id.
     static long unsigned int nNextId;
@@ -187,25 +266,32 @@ public:
 
     static bool mbInitialComputations;
 
+    // Undistorted position of a grid of image points, interpolated to undistort keypoints (computed once).
+    static cv::Mat mUndistortMap;
+
 
 private:
 
     // Undistort keypoints given OpenCV distortion parameters.
     // Only for the RGB-D case. Stereo must be already rectified!
     // (called in the constructor).
-    void UndistortKeyPoints();
+    void UndistortKeyPoints(FeatureData &features);
+
+    // Computes the undistortion map for an image of the given size (called in UndistortKeyPoints).
+    void ComputeUndistortMap(const int cols, const int rows);
 
     // Computes image bounds for the undistorted image (called in the constructor).
     void ComputeImageBounds(const cv::Mat &imLeft);
 
     // Assign keypoints to the grid for speed up feature matching (called in the constructor).
-    void AssignFeaturesToGrid();
-
-    // Rotation, translation and camera center
-    cv::Mat mRcw;
-    cv::Mat mtcw;
-    cv::Mat mRwc;
-    cv::Mat mOw; //==mtwc
+    void AssignFeaturesToGrid(FeatureData &features);
+
+    // Camera pose: rotation, translation and camera center
+    Eigen::Matrix3f mRcw;
+    Eigen::Vector3f mtcw;
+    Eigen::Matrix3f mRwc;
+    Eigen::Vector3f mOw; //==mtwc
+    bool mbHasPose;
 };
 
 }// namespace ORB_SLAM
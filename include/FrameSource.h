@@ -0,0 +1,129 @@
+/**
+* This file is part of ORB-SLAM2.
+*
+* Copyright (C) 2014-2016 Raúl Mur-Artal <raulmur at unizar dot es> (University of Zaragoza)
+* For more information see <https://github.com/raulmur/ORB_SLAM2>
+*
+* ORB-SLAM2 is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM2 is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with ORB-SLAM2. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef FRAMESOURCE_H
+#define FRAMESOURCE_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
+
+#include <opencv2/core/core.hpp>
+
+
+namespace ORB_SLAM2
+{
+
+// Images of one frame, ready to be passed to System
+struct InputFrame
+{
+    // Grayscale image (left image for stereo)
+    cv::Mat im;
+    // Right image (stereo) or depthmap (RGB-D). Empty for monocular input.
+    cv::Mat im2;
+    double timestamp;
+};
+
+// Bounded producer/consumer queue that decodes, rectifies and converts images to grayscale
+// on worker threads, ahead of the tracking thread. Frames are delivered in order.
+// Images come either from a list of files (datasets) or from Push (live input).
+class FrameSource
+{
+public:
+
+    // The color order is read from Camera.RGB in the settings file, as Tracking does.
+    // At most nCapacity frames are queued or being decoded.
+    FrameSource(const std::string &strSettingsFile, const int nCapacity=8, const int nThreads=2);
+
+    ~FrameSource();
+
+    // Stereo rectification maps, applied before the grayscale conversion. Call it before the first frame.
+    void SetRectification(const cv::Mat &M1l, const cv::Mat &M2l, const cv::Mat &M1r, const cv::Mat &M2r);
+
+    // Decode the files of a sequence. vstrImages2 holds the right images or depthmaps (empty for monocular).
+    // Decoding stops when the queue is full and resumes as frames are popped.
+    void SetFiles(const std::vector<std::string> &vstrImages, const std::vector<std::string> &vstrImages2,
+                  const std::vector<double> &vTimestamps);
+
+    // Queue a live frame. The images must own their data. If the queue is full the oldest frame is dropped.
+    void Push(const cv::Mat &im, const cv::Mat &im2, const double &timestamp);
+
+    // Next frame in order, moved into frame. Blocks until it is ready.
+    // Returns false at the end of the files or after RequestFinish.
+    // The image is empty if its file could not be read.
+    bool Pop(InputFrame &frame);
+
+    // Blocks until the queue is full or all the files have been decoded
+    void WaitUntilFull();
+
+    // Wakes up Pop and stops the workers
+    void RequestFinish();
+
+    // Number of live frames dropped because the consumer was slower than the producer
+    int GetDropped();
+
+protected:
+
+    struct Slot
+    {
+        std::string strFile;
+        std::string strFile2;
+        InputFrame frame;
+        bool bTaken;
+        bool bReady;
+    };
+
+    void Run();
+
+    void Process(Slot &slot);
+
+    void ToGray(cv::Mat &im);
+
+    bool mbRGB;
+    const size_t mnCapacity;
+
+    cv::Mat mM1l, mM2l, mM1r, mM2r;
+
+    std::vector<std::string> mvstrFiles;
+    std::vector<std::string> mvstrFiles2;
+    std::vector<double> mvTimestamps;
+    size_t mnNextFile;
+    bool mbFiles;
+
+    // Frames in order: pending, being decoded or ready. Workers keep a reference to the
+    // slot they decode, so a live frame can be dropped while it is being decoded.
+    std::deque<std::shared_ptr<Slot> > mdSlots;
+    int mnDropped;
+    bool mbFinish;
+
+    std::mutex mMutex;
+    std::condition_variable mcvWork;
+    std::condition_variable mcvReady;
+
+    std::vector<std::thread> mvThreads;
+};
+
+} //namespace ORB_SLAM
+
+#endif // FRAMESOURCE_H
@@ -30,6 +30,9 @@
 #include "KeyFrameDatabase.h"
 
 #include <mutex>
+#include <atomic>
+#include <memory>
+#include <Eigen/Core>
 
 
 namespace ORB_SLAM2
@@ -38,21 +41,23 @@ namespace ORB_SLAM2
 class Map;
 class MapPoint;
 class Frame;
+struct FeatureData;
 class KeyFrameDatabase;
 
 class KeyFrame
 {
+    friend class MapSerializer;
+
 public:
     KeyFrame(Frame &F, Map* pMap, KeyFrameDatabase* pKFDB);
 
     // Pose functions
-    void SetPose(const cv::Mat &Tcw);
-    cv::Mat GetPose();
-    cv::Mat GetPoseInverse();
-    cv::Mat GetCameraCenter();
-    cv::Mat GetStereoCenter();
-    cv::Mat GetRotation();
-    cv::Mat GetTranslation();
+    void SetPose(const Eigen::Matrix3f &Rcw, const Eigen::Vector3f &tcw);
+    void GetPose(Eigen::Matrix3f &Rcw, Eigen::Vector3f &tcw);
+    Eigen::Matrix3f GetRotation();
+    Eigen::Vector3f GetTranslation();
+    Eigen::Vector3f GetCameraCenter();
+    Eigen::Vector3f GetStereoCenter();
 
     // Bag of Words Representation
     void ComputeBoW();
@@ -87,12 +92,18 @@ public:
     void ReplaceMapPointMatch(const size_t &idx, MapPoint* pMP);
     std::set<MapPoint*> GetMapPoints();
     std::vector<MapPoint*> GetMapPointMatches();
+    // Matches that are not NULL, in order, and the version of the matches, read under a single lock
+    void GetMapPointMatches(std::vector<MapPoint*> &vpMPs, long unsigned int &nVersion);
+    // Version of the matches, changed by every modification (used to cache them in Tracking).
+    // Versions are unique among all KeyFrames.
+    long unsigned int GetMapPointsVersion();
     int TrackedMapPoints(const int &minObs);
     MapPoint* GetMapPoint(const size_t &idx);
 
     // KeyPoint functions
     std::vector<size_t> GetFeaturesInArea(const float &x, const float  &y, const float  &r) const;
-    cv::Mat UnprojectStereo(int i);
+    // Backprojects a keypoint with stereo/depth info (mvDepth[i]>0) into 3D world coordinates.
+    Eigen::Vector3f UnprojectStereo(int i);
 
     // Image
     bool IsInImage(const float &x, const float &y) const;
@@ -149,8 +160,10 @@ public:
     float mRelocScore;
 
     // Variables used by loop closing
-    cv::Mat mTcwGBA;
-    cv::Mat mTcwBefGBA;
+    Eigen::Matrix3f mRcwGBA;
+    Eigen::Vector3f mtcwGBA;
+    Eigen::Matrix3f mRcwBefGBA;
+    Eigen::Vector3f mtcwBefGBA;
     long unsigned int mnBAGlobalForKF;
 
     // Calibration parameters
@@ -159,19 +172,23 @@ public:
     // Number of KeyPoints
     const int N;
 
+    // Keypoint data of the Frame the keyframe was created from, shared without copies
+    const std::shared_ptr<const FeatureData> mpFeatures;
+
     // KeyPoints, stereo coordinate and descriptors (all associated by an index)
-    const std::vector<cv::KeyPoint> mvKeys;
-    const std::vector<cv::KeyPoint> mvKeysUn;
-    const std::vector<float> mvuRight; // negative value for monocular points
-    const std::vector<float> mvDepth; // negative value for monocular points
+    const std::vector<cv::KeyPoint> &mvKeys;
+    const std::vector<cv::KeyPoint> &mvKeysUn;
+    const std::vector<float> &mvuRight; // negative value for monocular points
+    const std::vector<float> &mvDepth; // negative value for monocular points
     const cv::Mat mDescriptors;
 
-    //BoW
-    DBoW2::BowVector mBowVec;
-    DBoW2::FeatureVector mFeatVec;
+    //BoW (filled by ComputeBoW)
+    const DBoW2::BowVector &mBowVec;
+    const DBoW2::FeatureVector &mFeatVec;
 
     // Pose relative to parent (this is computed when bad flag is activated)
-    cv::Mat mTcp;
+    Eigen::Matrix3f mRcp;
+    Eigen::Vector3f mtcp;
 
     // Scale
     const int mnScaleLevels;
@@ -187,27 +204,32 @@ public:
     const int mnMaxX;
     const int mnMaxY;
     const cv::Mat mK;
+    const cv::Mat mDistCoef;
 
 
     // The following variables need to be accessed trough a mutex to be thread safe.
 protected:
 
     // SE3 Pose and camera center
-    cv::Mat Tcw;
-    cv::Mat Twc;
-    cv::Mat Ow;
+    Eigen::Matrix3f Rcw;
+    Eigen::Vector3f tcw;
+    Eigen::Matrix3f Rwc;
+    Eigen::Vector3f Ow;
 
-    cv::Mat Cw; // Stereo middel point. Only for visualization
+    Eigen::Vector3f Cw; // Stereo middel point. Only for visualization
 
     // MapPoints associated to keypoints
     std::vector<MapPoint*> mvpMapPoints;
+    long unsigned int mnMapPointsVersion;
+    static std::atomic<long unsigned int> nNextMapPointsVersion;
 
     // BoW
     KeyFrameDatabase* mpKeyFrameDB;
     ORBVocabulary* mpORBvocabulary;
 
-    // Grid over the image to speed up feature matching
-    std::vector< std::vector <std::vector<size_t> > > mGrid;
+    // Grid over the image to speed up feature matching (compressed rows, as in Frame)
+    const std::vector<unsigned int> &mGridStart;
+    const std::vector<unsigned int> &mGridIndices;
 
     std::map<KeyFrame*,int> mConnectedKeyFrameWeights;
     std::vector<KeyFrame*> mvpOrderedConnectedKeyFrames;
@@ -28,6 +28,7 @@
 #include "KeyFrameDatabase.h"
 
 #include <mutex>
+#include <condition_variable>
 
 
 namespace ORB_SLAM2
@@ -67,6 +68,13 @@ public:
     void RequestFinish();
     bool isFinished();
 
+    // Block the caller until Local Mapping has stopped (after RequestStop) or finished
+    void WaitUntilStopped();
+    void WaitUntilFinished();
+
+    // Block the caller until every queued keyframe has been processed (or Local Mapping is stopped)
+    void WaitUntilIdle();
+
     int KeyframesInQueue(){
         unique_lock<std::mutex> lock(mMutexNewKFs);
         return mlNewKeyFrames.size();
@@ -83,9 +91,9 @@ protected:
 
     void KeyFrameCulling();
 
-    cv::Mat ComputeF12(KeyFrame* &pKF1, KeyFrame* &pKF2);
+    Eigen::Matrix3f ComputeF12(KeyFrame* &pKF1, KeyFrame* &pKF2);
 
-    cv::Mat SkewSymmetricMatrix(const cv::Mat &v);
+    Eigen::Matrix3f SkewSymmetricMatrix(const Eigen::Vector3f &v);
 
     bool mbMonocular;
 
@@ -121,6 +129,13 @@ protected:
 
     bool mbAcceptKeyFrames;
     std::mutex mMutexAccept;
+
+    // Signaled on every change of the queue or the state flags (new keyframe, stop, release,
+    // reset, finish). The state mutexes are never held while locking mMutexEvents.
+    void NotifyEvents();
+    bool HasWork();
+    std::mutex mMutexEvents;
+    std::condition_variable mcvEvents;
 };
 
 } //namespace ORB_SLAM
@@ -31,6 +31,7 @@
 
 #include <thread>
 #include <mutex>
+#include <condition_variable>
 #include "Thirdparty/g2o/g2o/types/types_seven_dof_expmap.h"
 
 namespace ORB_SLAM2
@@ -80,6 +81,9 @@ public:
 
     bool isFinished();
 
+    // Block the caller until Loop Closing and any Global BA have finished
+    void WaitUntilFinished();
+
     EIGEN_MAKE_ALIGNED_OPERATOR_NEW
 
 protected:
@@ -127,7 +131,6 @@ protected:
     std::vector<KeyFrame*> mvpCurrentConnectedKFs;
     std::vector<MapPoint*> mvpCurrentMatchedPoints;
     std::vector<MapPoint*> mvpLoopMapPoints;
-    cv::Mat mScw;
     g2o::Sim3 mg2oScw;
 
     long unsigned int mLastLoopKFid;
@@ -144,6 +147,12 @@ protected:
 
 
     bool mnFullBAIdx;
+
+    // Signaled on new keyframes, reset/finish requests and the end of a Global BA.
+    // The state mutexes are never held while locking mMutexEvents.
+    void NotifyEvents();
+    std::mutex mMutexEvents;
+    std::condition_variable mcvEvents;
 };
 
 } //namespace ORB_SLAM
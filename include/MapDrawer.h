@@ -41,7 +41,7 @@ public:
     void DrawMapPoints();
     void DrawKeyFrames(const bool bDrawKF, const bool bDrawGraph);
     void DrawCurrentCamera(pangolin::OpenGlMatrix &Twc);
-    void SetCurrentCameraPose(const cv::Mat &Tcw);
+    void SetCurrentCameraPose(const Eigen::Matrix3f &Rcw, const Eigen::Vector3f &tcw);
     void SetReferenceKeyFrame(KeyFrame *pKF);
     void GetCurrentOpenGLCameraMatrix(pangolin::OpenGlMatrix &M);
 
@@ -54,7 +54,10 @@ private:
     float mCameraSize;
     float mCameraLineWidth;
 
-    cv::Mat mCameraPose;
+    // Current camera pose (camera to world)
+    Eigen::Matrix3f mCameraRwc;
+    Eigen::Vector3f mCameraOw;
+    bool mbCameraPose;
 
     std::mutex mMutexCamera;
 };
@@ -26,7 +26,9 @@
 #include"Map.h"
 
 #include<opencv2/core/core.hpp>
+#include<Eigen/Core>
 #include<mutex>
+#include<atomic>
 
 namespace ORB_SLAM2
 {
@@ -38,14 +40,17 @@ class Frame;
 
 class MapPoint
 {
+    friend class MapSerializer;
+
 public:
-    MapPoint(const cv::Mat &Pos, KeyFrame* pRefKF, Map* pMap);
-    MapPoint(const cv::Mat &Pos,  Map* pMap, Frame* pFrame, const int &idxF);
+    MapPoint(const Eigen::Vector3f &Pos, KeyFrame* pRefKF, Map* pMap);
+    MapPoint(const Eigen::Vector3f &Pos,  Map* pMap, Frame* pFrame, const int &idxF);
 
-    void SetWorldPos(const cv::Mat &Pos);
-    cv::Mat GetWorldPos();
+    void SetWorldPos(const Eigen::Vector3f &Pos);
+    Eigen::Vector3f GetWorldPos();
+    void GetWorldPos(float &x, float &y, float &z);
+    Eigen::Vector3f GetNormal();
 
-    cv::Mat GetNormal();
     KeyFrame* GetReferenceKeyFrame();
 
     std::map<KeyFrame*,size_t> GetObservations();
@@ -54,6 +59,12 @@ public:
     void AddObservation(KeyFrame* pKF,size_t idx);
     void EraseObservation(KeyFrame* pKF);
 
+    // Version of the observations, changed by every modification (used to cache them in Tracking).
+    // Versions are unique among all MapPoints.
+    long unsigned int GetObservationsVersion();
+    // Keyframes observing the point and the version of the observations, read under a single lock
+    void GetObservingKeyFrames(std::vector<KeyFrame*> &vpKFs, long unsigned int &nVersion);
+
     int GetIndexInKeyFrame(KeyFrame* pKF);
     bool IsInKeyFrame(KeyFrame* pKF);
 
@@ -78,6 +89,9 @@ public:
 
     float GetMinDistanceInvariance();
     float GetMaxDistanceInvariance();
+    // Position, normal, scale invariance region and maximum distance read under a single lock,
+    // for the batched frustum test of the tracking
+    void GetProjectionData(Eigen::Vector3f &Pw, Eigen::Vector3f &normal, float &minDistance, float &maxDistance, float &scaleDistance);
     int PredictScale(const float &currentDist, KeyFrame*pKF);
     int PredictScale(const float &currentDist, Frame* pF);
 
@@ -89,12 +103,6 @@ public:
     int nObs;
 
     // Variables used by the tracking
-    float mTrackProjX;
-    float mTrackProjY;
-    float mTrackProjXR;
-    bool mbTrackInView;
-    int mnTrackScaleLevel;
-    float mTrackViewCos;
     long unsigned int mnTrackReferenceForFrame;
     long unsigned int mnLastFrameSeen;
 
@@ -106,7 +114,7 @@ public:
     long unsigned int mnLoopPointForKF;
     long unsigned int mnCorrectedByKF;
     long unsigned int mnCorrectedReference;    
-    cv::Mat mPosGBA;
+    Eigen::Vector3f mPosGBA;
     long unsigned int mnBAGlobalForKF;
 
 
@@ -115,13 +123,15 @@ public:
 protected:    
 
      // Position in absolute coordinates
-     cv::Mat mWorldPos;
+     Eigen::Vector3f mWorldPos;
 
      // Keyframes observing the point and associated index in keyframe
      std::map<KeyFrame*,size_t> mObservations;
+     long unsigned int mnObservationsVersion;
+     static std::atomic<long unsigned int> nNextVersion;
 
      // Mean viewing direction
-     cv::Mat mNormalVector;
+     Eigen::Vector3f mNormalVector;
 
      // Best descriptor to fast matching
      cv::Mat mDescriptor;
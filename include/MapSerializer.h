@@ -0,0 +1,58 @@
+/**
+* This file is part of ORB-SLAM2.
+*
+* Copyright (C) 2014-2016 Raúl Mur-Artal <raulmur at unizar dot es> (University of Zaragoza)
+* For more information see <https://github.com/raulmur/ORB_SLAM2>
+*
+* ORB-SLAM2 is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM2 is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with ORB-SLAM2. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef MAPSERIALIZER_H
+#define MAPSERIALIZER_H
+
+#include "Map.h"
+#include "KeyFrame.h"
+#include "MapPoint.h"
+#include "KeyFrameDatabase.h"
+#include "ORBVocabulary.h"
+
+#include <string>
+
+namespace ORB_SLAM2
+{
+
+class Map;
+class KeyFrameDatabase;
+
+// Binary map file. Good KeyFrames and MapPoints are written as a header followed by
+// flat arrays (one record per KeyFrame/MapPoint, then keypoints, descriptors, BoW,
+// covisibility and spanning tree), so that saving and loading are bulk reads/writes.
+// The file is not portable between machines with different endianness.
+class MapSerializer
+{
+public:
+
+    static const unsigned int VERSION;
+
+    static bool Save(const std::string &filename, Map* pMap);
+
+    // The map must be empty. The KeyFrameDatabase is filled with the loaded KeyFrames.
+    // K, DistCoef and bf are the current calibration: a map built with a different one is rejected.
+    static bool Load(const std::string &filename, Map* pMap, KeyFrameDatabase* pKFDB, ORBVocabulary* pVoc,
+                     const cv::Mat &K, const cv::Mat &DistCoef, const float bf);
+};
+
+} //namespace ORB_SLAM
+
+#endif // MAPSERIALIZER_H
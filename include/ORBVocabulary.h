@@ -25,11 +25,53 @@
 #include"Thirdparty/DBoW2/DBoW2/FORB.h"
 #include"Thirdparty/DBoW2/DBoW2/TemplatedVocabulary.h"
 
+#include<string>
+#include<vector>
+#include<opencv2/core/core.hpp>
+
+#include"ThreadPool.h"
+
 namespace ORB_SLAM2
 {
 
 typedef DBoW2::TemplatedVocabulary<DBoW2::FORB::TDescriptor, DBoW2::FORB>
-  ORBVocabulary;
+  ORBVocabularyBase;
+
+class ORBVocabulary : public ORBVocabularyBase
+{
+public:
+
+    ORBVocabulary();
+
+    // Loaders of DBoW2, followed by the construction of the flat tree used by Transform
+    bool loadFromTextFile(const std::string &filename);
+    bool loadFromBinaryFile(const std::string &filename);
+
+    // Descriptors are transformed in parallel on pThreadPool if given
+    void SetThreadPool(ThreadPool* pThreadPool);
+
+    // Batched version of transform(descriptors,v,fv,levelsup), with the same result.
+    // Each descriptor (row of CV_8U descriptors) is compared with all the children of a node
+    // at once by the Hamming kernel of ORBmatcher. Words and nodes are collected in flat arrays
+    // and then gathered into v and fv.
+    void Transform(const cv::Mat &descriptors, DBoW2::BowVector &v, DBoW2::FeatureVector &fv, int levelsup) const;
+
+protected:
+
+    // Maximum number of children of a node in the flat tree
+    static const unsigned int MAX_FLAT_CHILDREN = 256;
+
+    // Not created (and Transform uses DBoW2) if a node has more than MAX_FLAT_CHILDREN children
+    void CreateFlatTree();
+
+    // Children of node i are mvChildren[mvFirstChild[i]] to mvChildren[mvFirstChild[i+1]-1].
+    // mvChildDescriptors points to their descriptors, in the same order.
+    std::vector<unsigned int> mvFirstChild;
+    std::vector<DBoW2::NodeId> mvChildren;
+    std::vector<const uchar*> mvChildDescriptors;
+
+    ThreadPool* mpThreadPool;
+};
 
 } //namespace ORB_SLAM
 
@@ -23,33 +23,78 @@
 
 #include <vector>
 #include <list>
+#include <functional>
 #include <opencv/cv.h>
 
+#include "ThreadPool.h"
+
 
 namespace ORB_SLAM2
 {
 
+// Node of the quadtree that distributes the keypoints of a level. Nodes live in an
+// ExtractorNodePool and are referred to by their index in it.
 class ExtractorNode
 {
 public:
-    ExtractorNode():bNoMore(false){}
+    ExtractorNode():nBegin(0),nEnd(0),nPrev(-1),nNext(-1),bNoMore(false){}
 
-    void DivideNode(ExtractorNode &n1, ExtractorNode &n2, ExtractorNode &n3, ExtractorNode &n4);
+    int Size() const{
+        return nEnd-nBegin;
+    }
 
-    std::vector<cv::KeyPoint> vKeys;
     cv::Point2i UL, UR, BL, BR;
-    std::list<ExtractorNode>::iterator lit;
+    // The keypoints of the node are vKeys[nBegin,nEnd) of the pool
+    int nBegin, nEnd;
+    // Previous and next node in the list of leaves (-1 at the ends)
+    int nPrev, nNext;
     bool bNoMore;
 };
 
+// Storage of the quadtree. Children take the keypoints of their parent by partitioning its
+// range in place, and all vectors keep their capacity, so after the first frames building
+// the tree does not allocate.
+class ExtractorNodePool
+{
+public:
+    // Empties the pool, the keypoints are given as indices into vAllKeys
+    void Reset(const std::vector<cv::KeyPoint> &vAllKeys);
+
+    // Creates a node that is not in the list of leaves
+    int NewNode(const cv::Point2i &UL, const cv::Point2i &UR, const cv::Point2i &BL, const cv::Point2i &BR,
+                const int nBegin, const int nEnd);
+
+    // Splits a node in four. vChildren gets the new nodes, or -1 for children without keypoints.
+    void DivideNode(const int idx, int vChildren[4]);
+
+    void PushFront(const int idx);
+    void Erase(const int idx);
+
+    const std::vector<cv::KeyPoint>* mpAllKeys;
+    std::vector<ExtractorNode> mvNodes;
+    std::vector<int> mvKeys;
+    // Scratch space of DivideNode
+    std::vector<int> mvBuffer;
+    std::vector<unsigned char> mvChild;
+
+    // List of leaves
+    int mnHead;
+    int mnLeaves;
+
+    // Nodes with more than one keypoint created in the last subdivision
+    std::vector<std::pair<int,int> > mvSizeAndNode;
+    std::vector<std::pair<int,int> > mvPrevSizeAndNode;
+};
+
 class ORBextractor
 {
 public:
     
     enum {HARRIS_SCORE=0, FAST_SCORE=1 };
 
+    // Pyramid levels and FAST cells are processed on pThreadPool if given
     ORBextractor(int nfeatures, float scaleFactor, int nlevels,
-                 int iniThFAST, int minThFAST);
+                 int iniThFAST, int minThFAST, ThreadPool* pThreadPool=NULL);
 
     ~ORBextractor(){}
 
@@ -82,16 +127,27 @@ public:
         return mvInvLevelSigma2;
     }
 
+    // Runs f(i) for i in [begin,end), on the thread pool if there is one
+    void ParallelFor(int begin, int end, const std::function<void(int)> &f);
+
+    // Descriptors of keypoints on a blurred level image with the scalar code, or with the AVX2
+    // kernel if bAVX2. Returns false if the AVX2 kernel is not available (build or CPU).
+    // Used by tools/orb_descriptor_check to check that both give the same output.
+    bool ComputeDescriptors(const cv::Mat &image, std::vector<cv::KeyPoint> &keypoints,
+                            cv::Mat &descriptors, const bool bAVX2);
+
     std::vector<cv::Mat> mvImagePyramid;
 
 protected:
 
     void ComputePyramid(cv::Mat image);
     void ComputeKeyPointsOctTree(std::vector<std::vector<cv::KeyPoint> >& allKeypoints);    
+    void ComputeKeyPointsOctTree(const int level, std::vector<cv::KeyPoint>& keypoints);
     std::vector<cv::KeyPoint> DistributeOctTree(const std::vector<cv::KeyPoint>& vToDistributeKeys, const int &minX,
                                            const int &maxX, const int &minY, const int &maxY, const int &nFeatures, const int &level);
 
     void ComputeKeyPointsOld(std::vector<std::vector<cv::KeyPoint> >& allKeypoints);
+
     std::vector<cv::Point> pattern;
 
     int nfeatures;
@@ -108,6 +164,17 @@ protected:
     std::vector<float> mvInvScaleFactor;    
     std::vector<float> mvLevelSigma2;
     std::vector<float> mvInvLevelSigma2;
+
+    ThreadPool* mpThreadPool;
+
+    // Padded pyramid images (mvImagePyramid are views into them) and blurred levels.
+    // They are kept across frames and only reallocated if the image size changes.
+    std::vector<cv::Mat> mvPyramidBuffer;
+    std::vector<cv::Mat> mvBlurBuffer;
+    // FAST scores of each level, see ComputeKeyPointsOctTree
+    std::vector<cv::Mat> mvScoreBuffer;
+    // Quadtree of each level, see DistributeOctTree
+    std::vector<ExtractorNodePool> mvNodePools;
 };
 
 } //namespace ORB_SLAM
@@ -29,6 +29,7 @@
 #include"MapPoint.h"
 #include"KeyFrame.h"
 #include"Frame.h"
+#include"Thirdparty/g2o/g2o/types/types_seven_dof_expmap.h"
 
 
 namespace ORB_SLAM2
@@ -42,10 +43,21 @@ public:
 
     // Computes the Hamming distance between two ORB descriptors
     static int DescriptorDistance(const cv::Mat &a, const cv::Mat &b);
+    static int DescriptorDistance(const uchar *a, const uchar *b);
+
+    // Computes the Hamming distances between one descriptor and N candidates.
+    // The kernel (POPCNT, AVX2 or AVX-512 VPOPCNTDQ) is selected at runtime.
+    static void DescriptorDistances(const uchar *a, const uchar* const* vpB, const int N, int* vDist);
+
+    // Best and second best candidates for one descriptor (index -1 and distance 256 if none).
+    // Ties are resolved as in a sequential search: the first candidate wins.
+    static void SearchBestTwo(const uchar *a, const uchar* const* vpB, const int N,
+                              int &bestIdx, int &bestDist, int &bestIdx2, int &bestDist2);
 
     // Search matches between Frame keypoints and projected MapPoints. Returns number of matches
+    // vProjections are the projections of vpMapPoints in F (see Frame::ProjectInFrustum)
     // Used to track the local map (Tracking)
-    int SearchByProjection(Frame &F, const std::vector<MapPoint*> &vpMapPoints, const float th=3);
+    int SearchByProjection(Frame &F, const std::vector<MapPoint*> &vpMapPoints, const std::vector<MapPointProjection> &vProjections, const float th=3);
 
     // Project MapPoints tracked in last frame into the current frame and search matches.
     // Used to track from previous frame (Tracking)
@@ -57,7 +69,7 @@ public:
 
     // Project MapPoints using a Similarity Transformation and search matches.
     // Used in loop detection (Loop Closing)
-     int SearchByProjection(KeyFrame* pKF, cv::Mat Scw, const std::vector<MapPoint*> &vpPoints, std::vector<MapPoint*> &vpMatched, int th);
+     int SearchByProjection(KeyFrame* pKF, const g2o::Sim3 &Scw, const std::vector<MapPoint*> &vpPoints, std::vector<MapPoint*> &vpMatched, int th);
 
     // Search matches between MapPoints in a KeyFrame and ORB in a Frame.
     // Brute force constrained to ORB that belong to the same vocabulary node (at a certain level)
@@ -69,18 +81,18 @@ public:
     int SearchForInitialization(Frame &F1, Frame &F2, std::vector<cv::Point2f> &vbPrevMatched, std::vector<int> &vnMatches12, int windowSize=10);
 
     // Matching to triangulate new MapPoints. Check Epipolar Constraint.
-    int SearchForTriangulation(KeyFrame *pKF1, KeyFrame* pKF2, cv::Mat F12,
+    int SearchForTriangulation(KeyFrame *pKF1, KeyFrame* pKF2, const Eigen::Matrix3f &F12,
                                std::vector<pair<size_t, size_t> > &vMatchedPairs, const bool bOnlyStereo);
 
     // Search matches between MapPoints seen in KF1 and KF2 transforming by a Sim3 [s12*R12|t12]
     // In the stereo and RGB-D case, s12=1
-    int SearchBySim3(KeyFrame* pKF1, KeyFrame* pKF2, std::vector<MapPoint *> &vpMatches12, const float &s12, const cv::Mat &R12, const cv::Mat &t12, const float th);
+    int SearchBySim3(KeyFrame* pKF1, KeyFrame* pKF2, std::vector<MapPoint *> &vpMatches12, const float &s12, const Eigen::Matrix3f &R12, const Eigen::Vector3f &t12, const float th);
 
     // Project MapPoints into KeyFrame and search for duplicated MapPoints.
     int Fuse(KeyFrame* pKF, const vector<MapPoint *> &vpMapPoints, const float th=3.0);
 
     // Project MapPoints into KeyFrame using a given Sim3 and search for duplicated MapPoints.
-    int Fuse(KeyFrame* pKF, cv::Mat Scw, const std::vector<MapPoint*> &vpPoints, float th, vector<MapPoint *> &vpReplacePoint);
+    int Fuse(KeyFrame* pKF, const g2o::Sim3 &Scw, const std::vector<MapPoint*> &vpPoints, float th, vector<MapPoint *> &vpReplacePoint);
 
 public:
 
@@ -91,7 +103,7 @@ public:
 
 protected:
 
-    bool CheckDistEpipolarLine(const cv::KeyPoint &kp1, const cv::KeyPoint &kp2, const cv::Mat &F12, const KeyFrame *pKF);
+    bool CheckDistEpipolarLine(const cv::KeyPoint &kp1, const cv::KeyPoint &kp2, const Eigen::Matrix3f &F12, const KeyFrame *pKF);
 
     float RadiusByViewingCos(const float &viewCos);
 
@@ -52,6 +52,7 @@
 #define PNPSOLVER_H
 
 #include <opencv2/core/core.hpp>
+#include <random>
 #include "MapPoint.h"
 #include "Frame.h"
 
@@ -60,10 +61,19 @@ namespace ORB_SLAM2
 
 class PnPsolver {
  public:
+  PnPsolver();
   PnPsolver(const Frame &F, const vector<MapPoint*> &vpMapPointMatches);
 
   ~PnPsolver();
 
+  // Sets up the solver for new matches, restarting RANSAC. The buffers are kept, so a solver
+  // can be reused from one relocalization to the next.
+  void SetMatches(const Frame &F, const vector<MapPoint*> &vpMapPointMatches);
+
+  // Seeds the generator of the RANSAC samples. Each solver has its own generator, so the
+  // hypotheses only depend on the seeds and not on the solvers running on other threads.
+  void SetSeed(const unsigned int seed0, const unsigned int seed1);
+
   void SetRansacParameters(double probability = 0.99, int minInliers = 8 , int maxIterations = 300, int minSet = 4, float epsilon = 0.4,
                            float th2 = 5.991);
 
@@ -170,6 +180,9 @@ class PnPsolver {
   // Indices for random selection [0 .. N-1]
   vector<size_t> mvAllIndices;
 
+  // Generator of the random selection
+  std::mt19937 mRng;
+
   // RANSAC probability
   double mRansacProb;
 
@@ -0,0 +1,96 @@
+/**
+* This file is part of ORB-SLAM2.
+*
+* Copyright (C) 2014-2016 Raúl Mur-Artal <raulmur at unizar dot es> (University of Zaragoza)
+* For more information see <https://github.com/raulmur/ORB_SLAM2>
+*
+* ORB-SLAM2 is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM2 is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with ORB-SLAM2. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef POINTSPUBLISHER_H
+#define POINTSPUBLISHER_H
+
+#include "Frame.h"
+
+#include "ros/ros.h"
+#include "ORB_SLAM2/Points.h"
+
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+
+namespace ORB_SLAM2
+{
+
+class Frame;
+
+// Publishes the keypoints tracked in each frame and the distance of their MapPoints
+// (ORB_SLAM2::Points) from its own thread, so that Tracking only copies them.
+// By default the distances are measured from the first three elements of Tcw, as the original
+// output did. With PointsPublisher.cameraDistance they are measured from the camera centre
+// and frames without a pose are not published.
+class PointsPublisher
+{
+public:
+    PointsPublisher(ros::Publisher* pPublisher, const string &strSettingPath);
+
+    // Called by Tracking after each frame. Copies the tracked points of the frame
+    // and wakes up the publisher. A frame not yet published is replaced by the new one.
+    void Update(Frame &F);
+
+    // Main thread function
+    void Run();
+
+    void RequestFinish();
+
+    bool isEnabled(){
+        return mbEnabled;
+    }
+
+protected:
+
+    // Tracked points of a frame: keypoint (u,v) and MapPoint position (x,y,z),
+    // and the point the distances are measured from
+    struct Snapshot
+    {
+        double mTimeStamp;
+        float mOrigin[3];
+        std::vector<float> mvData;
+    };
+
+    ros::Publisher* mpPublisher;
+
+    // Settings: publish one out of mnEveryNFrames frames, distances from the camera centre
+    bool mbEnabled;
+    int mnEveryNFrames;
+    bool mbCameraDistance;
+    int mnFrames;
+
+    // Filled by Tracking, pending to be published, and being published
+    Snapshot mTracked;
+    Snapshot mPending;
+    Snapshot mPublishing;
+    bool mbPending;
+    std::mutex mMutexPending;
+    std::condition_variable mcvPending;
+
+    // Reused between frames to avoid reallocations
+    ORB_SLAM2::Points mMsg;
+
+    bool mbFinishRequested;
+};
+
+} //namespace ORB_SLAM
+
+#endif // POINTSPUBLISHER_H
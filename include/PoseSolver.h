@@ -0,0 +1,110 @@
+/**
+* This file is part of ORB-SLAM2.
+*
+* Copyright (C) 2014-2016 Raúl Mur-Artal <raulmur at unizar dot es> (University of Zaragoza)
+* For more information see <https://github.com/raulmur/ORB_SLAM2>
+*
+* ORB-SLAM2 is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM2 is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with ORB-SLAM2. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef POSESOLVER_H
+#define POSESOLVER_H
+
+#include <vector>
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+
+namespace ORB_SLAM2
+{
+
+// Observations of 3D points in the image, stored by components
+struct PoseObservations
+{
+    // World coordinates
+    std::vector<double> X, Y, Z;
+    // Undistorted keypoint and right coordinate (stereo only)
+    std::vector<double> u, v, uR;
+    // The information matrix is invSigma2*Identity
+    std::vector<double> invSigma2;
+    // 1 if the observation takes part in the optimization, 0 otherwise (an outlier)
+    std::vector<double> active;
+    // Squared error weighted by the information, computed by the last evaluation
+    std::vector<double> chi2;
+    // Index given by the caller (the keypoint)
+    std::vector<int> idx;
+
+    size_t size() const { return X.size(); }
+    void clear();
+    void push_back(const Eigen::Vector3f &Xw, const float &u_, const float &v_, const float &uR_,
+                   const float &invSigma2_, const int idx_);
+};
+
+// Optimizes the camera pose alone from 3D-2D (monocular) and 3D-3D (stereo) observations.
+// It reproduces the pose optimization of g2o (VertexSE3Expmap with EdgeSE3ProjectXYZOnlyPose and
+// EdgeStereoSE3ProjectXYZOnlyPose edges, Huber kernel and Levenberg-Marquardt) on a fixed 6x6 system.
+// The observation arrays keep their capacity, so a solver that is reused does not allocate.
+class PoseSolver
+{
+public:
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    PoseSolver();
+
+    void SetCalibration(const float &fx, const float &fy, const float &cx, const float &cy, const float &bf);
+
+    // Removes all observations
+    void Clear();
+
+    void AddMonocular(const Eigen::Vector3f &Xw, const float &u, const float &v, const float &invSigma2, const int idx);
+    void AddStereo(const Eigen::Vector3f &Xw, const float &u, const float &v, const float &uR, const float &invSigma2, const int idx);
+
+    // Huber kernel with the given thresholds (on the error, not the squared error)
+    void SetRobustKernel(const double &deltaMono, const double &deltaStereo);
+    void RemoveRobustKernel();
+
+    void SetPose(const Eigen::Matrix3d &Rcw, const Eigen::Vector3d &tcw);
+    Eigen::Matrix3d GetRotation() const;
+    Eigen::Vector3d GetTranslation() const;
+
+    // Levenberg-Marquardt iterations on the active observations
+    void Optimize(const int nIterations);
+
+    // Updates the chi2 of one observation at the current pose
+    double ComputeChi2Monocular(const size_t i);
+    double ComputeChi2Stereo(const size_t i);
+
+    PoseObservations mMono;
+    PoseObservations mStereo;
+
+protected:
+
+    // Residuals of all observations at the current pose. Returns the robust chi2 of the active ones.
+    // With H and b not NULL it also adds their normal equations.
+    double Evaluate(Eigen::Matrix<double,6,6> *H, Eigen::Matrix<double,6,1> *b);
+
+    // Left multiplies the pose by exp(x)
+    void Update(const Eigen::Matrix<double,6,1> &x);
+
+    Eigen::Quaterniond mq;
+    Eigen::Vector3d mt;
+
+    double fx, fy, cx, cy, bf;
+
+    bool mbRobust;
+    double mDeltaMono, mDeltaStereo;
+};
+
+} //namespace ORB_SLAM
+
+#endif // POSESOLVER_H
@@ -0,0 +1,144 @@
+/**
+* This file is part of ORB-SLAM2.
+*
+* Copyright (C) 2014-2016 Raúl Mur-Artal <raulmur at unizar dot es> (University of Zaragoza)
+* For more information see <https://github.com/raulmur/ORB_SLAM2>
+*
+* ORB-SLAM2 is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM2 is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with ORB-SLAM2. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <string>
+#include <vector>
+#include <chrono>
+
+namespace ORB_SLAM2
+{
+
+// Latency histograms and event counters of the SLAM pipeline.
+// Every thread records into its own histograms (relaxed atomics, no locks), which are
+// merged when statistics are requested. Times are in milliseconds.
+class Stats
+{
+public:
+
+    enum eStage{
+        // Tracking: BUILD_FRAME is the Frame construction (ORB extraction, stereo matching) and
+        // TRACK_FRAME the tracking of the built frame, in both the synchronous and the pipelined mode
+        BUILD_FRAME=0,
+        TRACK_FRAME,
+        EXTRACT_ORB,
+        STEREO_MATCHING,
+        COMPUTE_BOW,
+        TRACK_REFERENCE_KF,
+        TRACK_MOTION_MODEL,
+        RELOCALIZATION,
+        TRACK_LOCAL_MAP,
+        POSE_OPTIMIZATION,
+        NEED_NEW_KF,
+        CREATE_NEW_KF,
+        // Local Mapping
+        PROCESS_NEW_KF,
+        MAPPOINT_CULLING,
+        CREATE_NEW_MAPPOINTS,
+        SEARCH_IN_NEIGHBORS,
+        LOCAL_BA,
+        KF_CULLING,
+        // Loop Closing
+        DETECT_LOOP,
+        COMPUTE_SIM3,
+        CORRECT_LOOP,
+        ESSENTIAL_GRAPH,
+        GLOBAL_BA,
+        N_STAGES
+    };
+
+    enum eCounter{
+        FRAMES=0,
+        LOST_FRAMES,
+        RELOCALIZATIONS,
+        KEYFRAMES,
+        CULLED_KEYFRAMES,
+        LOOPS,
+        N_COUNTERS
+    };
+
+    struct StageSummary
+    {
+        std::string name;
+        unsigned long count;
+        double mean;
+        double p50;
+        double p90;
+        double p99;
+        double max;
+    };
+
+    struct CounterSummary
+    {
+        std::string name;
+        unsigned long count;
+    };
+
+    static void AddTime(const eStage stage, const double ms);
+    static void Count(const eCounter counter, const unsigned long n=1);
+
+    static std::vector<StageSummary> GetStageSummaries();
+    static std::vector<CounterSummary> GetCounterSummaries();
+
+    // Clear all histograms and counters. Threads that are recording are not paused, so a
+    // sample recorded during the reset may be partly kept (e.g. its count but not its time).
+    static void Reset();
+
+    // Write the summaries. The format is JSON if the file name ends in ".json", CSV otherwise.
+    static bool Save(const std::string &filename);
+
+    // Rewrite the file every period seconds from a background thread, until StopPeriodicSave
+    static void StartPeriodicSave(const std::string &filename, const double period);
+    static void StopPeriodicSave();
+
+    static const char* StageName(const eStage stage);
+    static const char* CounterName(const eCounter counter);
+};
+
+// Records the time between its construction and destruction (or Stop) in a stage
+class ScopedTimer
+{
+public:
+    ScopedTimer(const Stats::eStage stage): mStage(stage), mbRunning(true),
+        mt0(std::chrono::steady_clock::now()){}
+
+    ~ScopedTimer(){
+        Stop();
+    }
+
+    void Stop(){
+        if(!mbRunning)
+            return;
+        mbRunning = false;
+        std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+        Stats::AddTime(mStage,std::chrono::duration_cast<std::chrono::duration<double,std::milli> >(t1-mt0).count());
+    }
+
+private:
+    const Stats::eStage mStage;
+    bool mbRunning;
+    const std::chrono::steady_clock::time_point mt0;
+};
+
+} //namespace ORB_SLAM
+
+#endif // STATS_H
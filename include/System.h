@@ -24,6 +24,8 @@
 
 #include<string>
 #include<thread>
+#include<future>
+#include<functional>
 #include<opencv2/core/core.hpp>
 
 #include"ros/ros.h"
@@ -38,6 +40,9 @@
 #include "KeyFrameDatabase.h"
 #include "ORBVocabulary.h"
 #include "Viewer.h"
+#include "PointsPublisher.h"
+#include "Stats.h"
+#include "TrackingPipeline.h"
 
 namespace ORB_SLAM2
 {
@@ -48,6 +53,7 @@ class Map;
 class Tracking;
 class LocalMapping;
 class LoopClosing;
+class PointsPublisher;
 
 class System
 {
@@ -59,6 +65,13 @@ public:
         RGBD=2
     };
 
+    // Layout of raw camera buffers passed to LumaPlane
+    enum eImageFormat{
+        GRAY=0,
+        NV12=1,
+        YUYV=2
+    };
+
     ros::Publisher pub;
     ros::NodeHandle nh;
 
@@ -78,7 +91,8 @@ public:
 
     // Process the given rgbd frame. Depthmap must be registered to the RGB frame.
     // Input image: RGB (CV_8UC3) or grayscale (CV_8U). RGB is converted to grayscale.
-    // Input depthmap: Float (CV_32F).
+    // Input depthmap: Float (CV_32F) or raw sensor units (CV_16U). Both are used in place and
+    // scaled by DepthMapFactor only at the keypoints.
     // Returns the camera pose (empty if tracking fails).
     cv::Mat TrackRGBD(const cv::Mat &im, const cv::Mat &depthmap, const double &timestamp);
 
@@ -87,11 +101,42 @@ public:
     // Returns the camera pose (empty if tracking fails).
     cv::Mat TrackMonocular(const cv::Mat &im, const double &timestamp);
 
+    // Pipelined tracking. The Frame of each image (ORB extraction, undistortion, stereo matching) is built
+    // on a front-end thread while the previous frame is tracked on another thread, so the throughput is
+    // bounded by the slowest of both stages instead of their sum. Poses are delivered in order through
+    // the futures returned by the Track*Async functions and, if given, the callback, which is called from
+    // the tracking thread. At most nMaxFrames frames are in the pipeline: the Async calls block beyond that.
+    // Frames built (or being built) before a requested reset is done are not tracked and get an empty pose.
+    // Mode changes apply from the next frame built after the request.
+    typedef std::function<void(const double &timestamp, const cv::Mat &Tcw)> PoseCallback;
+    void EnablePipelining(const int nMaxFrames=2, const PoseCallback &callback=PoseCallback());
+
+    // Queue a frame for pipelined tracking (enabled with the default settings if it was not).
+    // Same input as the synchronous functions. The images must not be modified until the future is ready.
+    // The future gives the camera pose (empty if tracking fails).
+    std::future<cv::Mat> TrackStereoAsync(const cv::Mat &imLeft, const cv::Mat &imRight, const double &timestamp);
+    std::future<cv::Mat> TrackRGBDAsync(const cv::Mat &im, const cv::Mat &depthmap, const double &timestamp);
+    std::future<cv::Mat> TrackMonocularAsync(const cv::Mat &im, const double &timestamp);
+
+    // Blocks until all the queued frames have been tracked.
+    // The synchronous Track functions and Shutdown call it first.
+    void WaitForPipeline();
+
+    // Luma plane of a raw camera buffer, to be passed as grayscale input to the Track functions.
+    // NV12: single channel buffer of rows*3/2 x cols. The Y plane is returned as a view, without copy.
+    // YUYV: CV_8UC2 buffer. Luma is interleaved with chroma and is extracted in a single pass.
+    // GRAY: the image is returned as it is.
+    static cv::Mat LumaPlane(const cv::Mat &im, const eImageFormat format);
+
     // This stops local mapping thread (map building) and performs only camera tracking.
     void ActivateLocalizationMode();
     // This resumes local mapping thread and performs SLAM again.
     void DeactivateLocalizationMode();
 
+    // Blocks until Local Mapping has processed all the keyframes created so far.
+    // Calling it after each frame makes the keyframe decisions independent of the thread timing.
+    void WaitForLocalMapping();
+
     // Returns true if there have been a big map change (loop closure, global BA)
     // since last call to this function
     bool MapChanged();
@@ -122,9 +167,13 @@ public:
     // See format details at: http://www.cvlibs.net/datasets/kitti/eval_odometry.php
     void SaveTrajectoryKITTI(const string &filename);
 
-    // TODO: Save/Load functions
-    // SaveMap(const string &filename);
-    // LoadMap(const string &filename);
+    // Save the map (KeyFrames, MapPoints, covisibility graph and spanning tree) in binary format.
+    // Call first Shutdown()
+    bool SaveMap(const string &filename);
+
+    // Load a map saved with SaveMap. Call it before processing the first frame.
+    // Tracking starts lost and relocalizes in the loaded map, so localization mode can be activated right away.
+    bool LoadMap(const string &filename);
 
     // Information from most recent processed frame
     // You can call this right after TrackMonocular (or stereo or RGBD)
@@ -132,8 +181,31 @@ public:
     std::vector<MapPoint*> GetTrackedMapPoints();
     std::vector<cv::KeyPoint> GetTrackedKeyPointsUn();
 
+    // Latency of each stage of Tracking, Local Mapping and Loop Closing (count, mean, percentiles in ms)
+    // and event counters, accumulated since the system started or the last ResetStats
+    std::vector<Stats::StageSummary> GetStageStats();
+    std::vector<Stats::CounterSummary> GetCounterStats();
+    void ResetStats();
+
+    // Save the statistics in JSON (if the file name ends in .json) or CSV format.
+    // They are also saved periodically if Stats.file and Stats.period are given in the settings file.
+    bool SaveStats(const string &filename);
+
 private:
 
+    void StartStats(cv::FileStorage &fsSettings);
+
+    // Applies the pending mode changes and resets. The tracker must be idle.
+    void CheckModeAndReset();
+    bool ModeOrResetPending();
+
+    // Copies the state of the last tracked frame
+    void UpdateTrackingState();
+
+    // Stages of the pipeline
+    void BuildPipelineFrame(PipelineFrame &f);
+    void TrackPipelineFrame(PipelineFrame &f);
+
     // Input sensor
     eSensor mSensor;
 
@@ -161,6 +233,9 @@ private:
     // The viewer draws the map and the current camera pose. It uses Pangolin.
     Viewer* mpViewer;
 
+    // Publishes the tracked points on ROS (only with the ROS constructor)
+    PointsPublisher* mpPointsPublisher;
+
     FrameDrawer* mpFrameDrawer;
     MapDrawer* mpMapDrawer;
 
@@ -169,6 +244,7 @@ private:
     std::thread* mptLocalMapping;
     std::thread* mptLoopClosing;
     std::thread* mptViewer;
+    std::thread* mptPointsPublisher;
 
     // Reset flag
     std::mutex mMutexReset;
@@ -185,6 +261,13 @@ private:
     std::vector<cv::KeyPoint> mTrackedKeyPointsUn;
     std::mutex mMutexState;
 
+    // Periodic statistics output (empty if disabled)
+    string mStrStatsFile;
+
+    // Pipelined tracking (NULL if disabled)
+    TrackingPipeline* mpPipeline;
+    PoseCallback mPoseCallback;
+
 };
 
 }// namespace ORB_SLAM
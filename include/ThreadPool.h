@@ -0,0 +1,90 @@
+/**
+* This file is part of ORB-SLAM2.
+*
+* Copyright (C) 2014-2016 Raúl Mur-Artal <raulmur at unizar dot es> (University of Zaragoza)
+* For more information see <https://github.com/raulmur/ORB_SLAM2>
+*
+* ORB-SLAM2 is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM2 is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with ORB-SLAM2. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+
+
+namespace ORB_SLAM2
+{
+
+class ThreadPool
+{
+public:
+    // Starts nThreads persistent workers. With nThreads<0 one worker per core is
+    // started, except for the calling thread which also takes part in ParallelFor.
+    ThreadPool(int nThreads=-1);
+
+    ~ThreadPool();
+
+    // Number of threads that run a ParallelFor (workers plus the caller)
+    int GetNumThreads() const{
+        return mvThreads.size()+1;
+    }
+
+    // Runs f(i) for every i in [begin,end) and returns when all of them are done.
+    // The calling thread processes indices too, so it can be nested inside a task.
+    // If f throws, the other indices are still run and the first exception is rethrown here.
+    void ParallelFor(int begin, int end, const std::function<void(int)> &f);
+
+    // Queues a task to be run by a worker
+    template<class F>
+    std::future<typename std::result_of<F()>::type> Enqueue(F f)
+    {
+        typedef typename std::result_of<F()>::type R;
+        std::shared_ptr<std::packaged_task<R()> > pTask = std::make_shared<std::packaged_task<R()> >(f);
+        std::future<R> result = pTask->get_future();
+        if(mvThreads.empty())
+        {
+            (*pTask)();
+            return result;
+        }
+        {
+            std::unique_lock<std::mutex> lock(mMutexQueue);
+            mqTasks.push_back([pTask](){ (*pTask)(); });
+        }
+        mcvQueue.notify_one();
+        return result;
+    }
+
+protected:
+
+    void Run();
+
+    std::vector<std::thread> mvThreads;
+
+    std::deque<std::function<void()> > mqTasks;
+    std::mutex mMutexQueue;
+    std::condition_variable mcvQueue;
+    bool mbFinish;
+};
+
+} //namespace ORB_SLAM
+
+#endif // THREADPOOL_H
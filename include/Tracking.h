@@ -39,8 +39,10 @@
 #include "Initializer.h"
 #include "MapDrawer.h"
 #include "System.h"
+#include "PointsPublisher.h"
 
 #include <mutex>
+#include <memory>
 
 namespace ORB_SLAM2
 {
@@ -51,6 +53,8 @@ class Map;
 class LocalMapping;
 class LoopClosing;
 class System;
+class PointsPublisher;
+class PnPsolver;
 
 class Tracking
 {
@@ -59,23 +63,42 @@ public:
     Tracking(System* pSys, ORBVocabulary* pVoc, FrameDrawer* pFrameDrawer, MapDrawer* pMapDrawer, Map* pMap,
              KeyFrameDatabase* pKFDB, const string &strSettingPath, const int sensor);
 
+    ~Tracking();
+
     // Preprocess the input and call Track(). Extract features and performs stereo matching.
     cv::Mat GrabImageStereo(const cv::Mat &imRectLeft,const cv::Mat &imRectRight, const double &timestamp);
     cv::Mat GrabImageRGBD(const cv::Mat &imRGB,const cv::Mat &imD, const double &timestamp);
     cv::Mat GrabImageMonocular(const cv::Mat &im, const double &timestamp);
 
+    // The two halves of the Grab functions, so that they can run on different threads.
+    // BuildFrame converts the input to grayscale and builds the Frame, without touching the tracking state.
+    // im2 is the right image (stereo) or the depthmap (RGB-D). In monocular, bInitializing selects the
+    // extractor used for the initialization. imGray is the image shown by the frame drawer.
+    Frame BuildFrame(const cv::Mat &im, const cv::Mat &im2, const double &timestamp, const bool bInitializing, cv::Mat &imGray);
+    // Tracks a frame built by BuildFrame. Returns the camera pose (empty if tracking fails).
+    cv::Mat TrackFrame(Frame &frame, const cv::Mat &imGray);
+
     void SetLocalMapper(LocalMapping* pLocalMapper);
     void SetLoopClosing(LoopClosing* pLoopClosing);
     void SetViewer(Viewer* pViewer);
+    void SetPointsPublisher(PointsPublisher* pPointsPublisher);
 
     // Load new settings
     // The focal lenght should be similar or scale prediction will fail when projecting points
     // TODO: Modify MapPoint::PredictScale to take into account focal lenght
     void ChangeCalibration(const string &strSettingPath);
 
+    // Current calibration: intrinsics, distortion coefficients and stereo baseline times fx
+    const cv::Mat& GetK() const { return mK; }
+    const cv::Mat& GetDistCoef() const { return mDistCoef; }
+    float GetBf() const { return mbf; }
+
     // Use this function if you have deactivated local mapping and you only want to localize the camera.
     void InformOnlyTracking(const bool &flag);
 
+    // Use this function after a map has been loaded. Tracking starts by relocalizing in it.
+    void InformMapLoaded();
+
 
 public:
 
@@ -110,7 +133,9 @@ public:
 
     // Lists used to recover the full camera trajectory at the end of the execution.
     // Basically we store the reference keyframe for each frame and its relative transformation
-    list<cv::Mat> mlRelativeFramePoses;
+    // (rotation and translation in parallel lists)
+    list<Eigen::Matrix3f> mlRelativeFrameRotations;
+    list<Eigen::Vector3f> mlRelativeFrameTranslations;
     list<KeyFrame*> mlpReferences;
     list<double> mlFrameTimes;
     list<bool> mlbLost;
@@ -132,16 +157,25 @@ protected:
     void MonocularInitialization();
     void CreateInitialMapMonocular();
 
+    // Grayscale conversion of the input images
+    void ToGray(cv::Mat &im);
+
     void CheckReplacedInLastFrame();
     bool TrackReferenceKeyFrame();
     void UpdateLastFrame();
     bool TrackWithMotionModel();
 
     bool Relocalization();
+    // 5 P4P RANSAC iterations with the matches of one relocalization candidate and refinement of
+    // the pose on F, a copy of the current frame made by the first round that gives a pose.
+    // Returns true if the pose is supported by enough inliers. bNoMore is set when RANSAC is over.
+    bool RelocalizationRound(KeyFrame* pKF, PnPsolver* pSolver, const std::vector<MapPoint*> &vpMapPointMatches,
+                             Frame &F, bool &bNoMore);
 
     void UpdateLocalMap();
     void UpdateLocalPoints();
     void UpdateLocalKeyFrames();
+    void AddKeyFrameVotes(const std::vector<KeyFrame*> &vpKFs, const int n);
 
     bool TrackLocalMap();
     void SearchLocalPoints();
@@ -163,6 +197,9 @@ protected:
     ORBextractor* mpORBextractorLeft, *mpORBextractorRight;
     ORBextractor* mpIniORBextractor;
 
+    // Threads used by the ORB extractors
+    ThreadPool* mpThreadPool;
+
     //BoW
     ORBVocabulary* mpORBVocabulary;
     KeyFrameDatabase* mpKeyFrameDB;
@@ -170,16 +207,49 @@ protected:
     // Initalization (only for monocular)
     Initializer* mpInitializer;
 
+    // PnP solvers of the relocalization candidates, reused from one relocalization to the next
+    std::vector<std::unique_ptr<PnPsolver> > mvpPnPsolvers;
+
     //Local Map
     KeyFrame* mpReferenceKF;
     std::vector<KeyFrame*> mvpLocalKeyFrames;
     std::vector<MapPoint*> mvpLocalMapPoints;
+    // Positions, normals and distances of mvpLocalMapPoints, in the same order. Rebuilt whenever
+    // mvpLocalMapPoints is assigned (UpdateLocalPoints, map initialization, Reset).
+    MapPointsSoA mLocalMapPointsSoA;
+    std::vector<MapPointProjection> mvLocalMapProjections;
+
+    // The local map is updated incrementally from one frame to the next. The result is the same
+    // as rebuilding it: cached observations and matches are refreshed when their version changes.
+    struct VotingPoint
+    {
+        // Times the point is matched in the current frame
+        int nCount;
+        long unsigned int nVersion;
+        std::vector<KeyFrame*> vpKFs;
+    };
+    struct LocalKeyFrameMatches
+    {
+        long unsigned int nVersion;
+        long unsigned int nLastFrameId;
+        std::vector<MapPoint*> vpMPs;
+        LocalKeyFrameMatches(): nVersion(0), nLastFrameId(0){}
+    };
+    // Tracked map points with the keyframes they voted for, and the votes of each keyframe
+    std::map<MapPoint*,VotingPoint> mmVotingPoints;
+    std::map<KeyFrame*,int> mmLocalKeyFrameVotes;
+    // Map point matches of the local keyframes
+    std::map<KeyFrame*,LocalKeyFrameMatches> mmLocalKeyFrameMatches;
 
     // System
     System* mpSystem;
 
     //Drawers
     Viewer* mpViewer;
+
+    //Tracked points output (only with ROS)
+    PointsPublisher* mpPointsPublisher;
+
     FrameDrawer* mpFrameDrawer;
     MapDrawer* mpMapDrawer;
 
@@ -212,8 +282,10 @@ protected:
     unsigned int mnLastKeyFrameId;
     unsigned int mnLastRelocFrameId;
 
-    //Motion Model
-    cv::Mat mVelocity;
+    //Motion Model (pose of the current frame relative to the last one)
+    Eigen::Matrix3f mRVelocity;
+    Eigen::Vector3f mtVelocity;
+    bool mbVelocity;
 
     //Color order (true RGB, false BGR, ignored if grayscale)
     bool mbRGB;
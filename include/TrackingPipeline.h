@@ -0,0 +1,112 @@
+/**
+* This file is part of ORB-SLAM2.
+*
+* Copyright (C) 2014-2016 Raúl Mur-Artal <raulmur at unizar dot es> (University of Zaragoza)
+* For more information see <https://github.com/raulmur/ORB_SLAM2>
+*
+* ORB-SLAM2 is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM2 is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with ORB-SLAM2. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TRACKINGPIPELINE_H
+#define TRACKINGPIPELINE_H
+
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+
+#include <opencv2/core/core.hpp>
+
+#include "Frame.h"
+
+
+namespace ORB_SLAM2
+{
+
+// A frame on its way through the pipeline
+struct PipelineFrame
+{
+    // Input images: im2 is the right image (stereo) or the depthmap (RGB-D), empty for monocular
+    cv::Mat im;
+    cv::Mat im2;
+    double timestamp;
+
+    // Set by the front-end
+    Frame frame;
+    cv::Mat imGray;
+
+    // Set by the back-end
+    cv::Mat Tcw;
+    std::promise<cv::Mat> pose;
+};
+
+// Two stage pipeline: the front-end builds the Frame of the next image (ORB extraction, undistortion,
+// stereo matching) on its own thread while the back-end tracks the previous one on another thread.
+// Each stage processes one frame at a time and frames go through both stages in order.
+class TrackingPipeline
+{
+public:
+    typedef std::function<void(PipelineFrame&)> Stage;
+
+    // At most nMaxFrames frames are in the pipeline (waiting, being built or being tracked).
+    // With nMaxFrames=2 the front-end builds one frame while the back-end tracks the previous one.
+    TrackingPipeline(const Stage &frontEnd, const Stage &backEnd, const int nMaxFrames=2);
+
+    // Processes the frames already pushed and stops the threads
+    ~TrackingPipeline();
+
+    // Queues a frame. Blocks while the pipeline is full. The future gives the pose set by the back-end,
+    // or rethrows the exception thrown by a stage on this frame (the pipeline goes on with the next ones).
+    // The images must not be modified until the front-end has processed them.
+    std::future<cv::Mat> Push(const cv::Mat &im, const cv::Mat &im2, const double &timestamp);
+
+    // Blocks until all the frames pushed so far have been tracked
+    void WaitUntilIdle();
+
+    // Blocks until the back-end has tracked all the frames built so far.
+    // Called from the front-end when it needs the tracker idle (reset, mode change).
+    void WaitUntilBackEndIdle();
+
+protected:
+
+    void RunFrontEnd();
+    void RunBackEnd();
+
+    Stage mFrontEnd;
+    Stage mBackEnd;
+    const size_t mnMaxFrames;
+
+    // Frames waiting for the front-end and frames built waiting for the back-end
+    std::deque<std::shared_ptr<PipelineFrame> > mdInput;
+    std::deque<std::shared_ptr<PipelineFrame> > mdBuilt;
+    // Frames pushed and not tracked yet
+    size_t mnFrames;
+    bool mbBackEndBusy;
+    bool mbFinish;
+
+    std::mutex mMutex;
+    std::condition_variable mcvInput;
+    std::condition_variable mcvBuilt;
+    std::condition_variable mcvDone;
+
+    std::thread mtFrontEnd;
+    std::thread mtBackEnd;
+};
+
+} //namespace ORB_SLAM
+
+#endif // TRACKINGPIPELINE_H
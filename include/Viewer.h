@@ -28,6 +28,7 @@
 #include "System.h"
 
 #include <mutex>
+#include <condition_variable>
 
 namespace ORB_SLAM2
 {
@@ -56,6 +57,10 @@ public:
 
     void Release();
 
+    // Block the caller until the viewer has stopped (after RequestStop) or finished
+    void WaitUntilStopped();
+    void WaitUntilFinished();
+
 private:
 
     bool Stop();
@@ -81,6 +86,11 @@ private:
     bool mbStopRequested;
     std::mutex mMutexStop;
 
+    // Signaled when the viewer stops, is released or finishes
+    void NotifyEvents();
+    std::mutex mMutexEvents;
+    std::condition_variable mcvEvents;
+
 };
 
 }
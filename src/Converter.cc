@@ -46,6 +46,11 @@ g2o::SE3Quat Converter::toSE3Quat(const cv::Mat &cvT)
     return g2o::SE3Quat(R,t);
 }
 
+g2o::SE3Quat Converter::toSE3Quat(const Eigen::Matrix3f &R, const Eigen::Vector3f &t)
+{
+    return g2o::SE3Quat(R.cast<double>(),t.cast<double>());
+}
+
 cv::Mat Converter::toCvMat(const g2o::SE3Quat &SE3)
 {
     Eigen::Matrix<double,4,4> eigMat = SE3.to_homogeneous_matrix();
@@ -107,6 +112,34 @@ cv::Mat Converter::toCvSE3(const Eigen::Matrix<double,3,3> &R, const Eigen::Matr
     return cvMat.clone();
 }
 
+cv::Mat Converter::toCvMat(const Eigen::Matrix3f &m)
+{
+    cv::Mat cvMat(3,3,CV_32F);
+    for(int i=0;i<3;i++)
+        for(int j=0; j<3; j++)
+            cvMat.at<float>(i,j)=m(i,j);
+
+    return cvMat;
+}
+
+cv::Mat Converter::toCvMat(const Eigen::Vector3f &m)
+{
+    return (cv::Mat_<float>(3,1) << m(0), m(1), m(2));
+}
+
+cv::Mat Converter::toCvSE3(const Eigen::Matrix3f &R, const Eigen::Vector3f &t)
+{
+    cv::Mat cvMat = cv::Mat::eye(4,4,CV_32F);
+    for(int i=0;i<3;i++)
+    {
+        for(int j=0;j<3;j++)
+            cvMat.at<float>(i,j)=R(i,j);
+        cvMat.at<float>(i,3)=t(i);
+    }
+
+    return cvMat;
+}
+
 Eigen::Matrix<double,3,1> Converter::toVector3d(const cv::Mat &cvVector)
 {
     Eigen::Matrix<double,3,1> v;
@@ -134,6 +167,22 @@ Eigen::Matrix<double,3,3> Converter::toMatrix3d(const cv::Mat &cvMat3)
     return M;
 }
 
+Eigen::Vector3f Converter::toVector3f(const cv::Mat &cvVector)
+{
+    return Eigen::Vector3f(cvVector.at<float>(0), cvVector.at<float>(1), cvVector.at<float>(2));
+}
+
+Eigen::Matrix3f Converter::toMatrix3f(const cv::Mat &cvMat3)
+{
+    Eigen::Matrix3f M;
+
+    M << cvMat3.at<float>(0,0), cvMat3.at<float>(0,1), cvMat3.at<float>(0,2),
+         cvMat3.at<float>(1,0), cvMat3.at<float>(1,1), cvMat3.at<float>(1,2),
+         cvMat3.at<float>(2,0), cvMat3.at<float>(2,1), cvMat3.at<float>(2,2);
+
+    return M;
+}
+
 std::vector<float> Converter::toQuaternion(const cv::Mat &M)
 {
     Eigen::Matrix<double,3,3> eigMat = toMatrix3d(M);
@@ -148,4 +197,17 @@ std::vector<float> Converter::toQuaternion(const cv::Mat &M)
     return v;
 }
 
+std::vector<float> Converter::toQuaternion(const Eigen::Matrix3f &M)
+{
+    Eigen::Quaterniond q(M.cast<double>());
+
+    std::vector<float> v(4);
+    v[0] = q.x();
+    v[1] = q.y();
+    v[2] = q.z();
+    v[3] = q.w();
+
+    return v;
+}
+
 } //namespace ORB_SLAM
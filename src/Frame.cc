@@ -19,10 +19,13 @@
 */
 
 #include "Frame.h"
-#include "Converter.h"
 #include "ORBmatcher.h"
-#include <thread>
+#include "Stats.h"
 #include <iostream>
+#include <climits>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 namespace ORB_SLAM2
 {
@@ -32,36 +35,255 @@ bool Frame::mbInitialComputations=true;
 float Frame::cx, Frame::cy, Frame::fx, Frame::fy, Frame::invfx, Frame::invfy;
 float Frame::mnMinX, Frame::mnMinY, Frame::mnMaxX, Frame::mnMaxY;
 float Frame::mfGridElementWidthInv, Frame::mfGridElementHeightInv;
+cv::Mat Frame::mUndistortMap;
+
+// Spacing in pixels of the points of the undistortion map. The error of the bilinear
+// interpolation stays below 0.01 pixels for the distortion of the TUM cameras.
+const int UNDISTORT_MAP_STEP = 4;
+
+// Undistorted position of the image point (x,y), interpolated from the undistortion map
+static inline cv::Point2f InterpolateUndistortMap(const cv::Mat &map, const float x, const float y)
+{
+    const float u = x/UNDISTORT_MAP_STEP;
+    const float v = y/UNDISTORT_MAP_STEP;
+    const int u0 = min(max(static_cast<int>(floor(u)),0),map.cols-2);
+    const int v0 = min(max(static_cast<int>(floor(v)),0),map.rows-2);
+    const float au = u-u0;
+    const float av = v-v0;
+
+    const cv::Vec2f* row0 = map.ptr<cv::Vec2f>(v0)+u0;
+    const cv::Vec2f* row1 = map.ptr<cv::Vec2f>(v0+1)+u0;
+    const cv::Vec2f p0 = row0[0]*(1.0f-au)+row0[1]*au;
+    const cv::Vec2f p1 = row1[0]*(1.0f-au)+row1[1]*au;
+    const cv::Vec2f p = p0*(1.0f-av)+p1*av;
+
+    return cv::Point2f(p[0],p[1]);
+}
+
+// Half size of the patches and of the search range of the stereo subpixel matching
+const int STEREO_PATCH_W = 5;
+const int STEREO_SEARCH_L = 5;
+
+// L1 distances between the left patch centred at pL and the right patches centred at
+// pR+inc, for inc in [-L,L]. The central intensity is subtracted from each patch.
+static void StereoPatchDistances(const uchar* pL, const size_t stepL, const uchar* pR, const size_t stepR, int* vDists)
+{
+    const int w = STEREO_PATCH_W;
+    const int L = STEREO_SEARCH_L;
+
+#ifdef __SSE2__
+    // A patch row is 11 pixels: columns 0-7 in one register and 8-10 in the first lanes of another.
+    // Rows are visited once and accumulated for all the offsets.
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i maskHi = _mm_setr_epi16(-1,-1,-1,0,0,0,0,0);
+
+    const __m128i cL = _mm_set1_epi16(pL[0]);
+    __m128i vcR[2*L+1], vAcc[2*L+1];
+    for(int inc=-L; inc<=L; inc++)
+    {
+        vcR[L+inc] = _mm_set1_epi16(pR[inc]);
+        vAcc[L+inc] = zero;
+    }
+
+    for(int r=-w; r<=w; r++)
+    {
+        const uchar* rowL = pL+r*(ptrdiff_t)stepL-w;
+        const __m128i lLo = _mm_sub_epi16(_mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)rowL),zero),cL);
+        const __m128i lHi = _mm_sub_epi16(_mm_unpacklo_epi8(_mm_srli_si128(_mm_loadl_epi64((const __m128i*)(rowL+3)),5),zero),cL);
+
+        const uchar* rowR = pR+r*(ptrdiff_t)stepR-w;
+        for(int inc=-L; inc<=L; inc++)
+        {
+            const __m128i rLo = _mm_sub_epi16(_mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(rowR+inc)),zero),vcR[L+inc]);
+            const __m128i rHi = _mm_sub_epi16(_mm_unpacklo_epi8(_mm_srli_si128(_mm_loadl_epi64((const __m128i*)(rowR+inc+3)),5),zero),vcR[L+inc]);
+            const __m128i dLo = _mm_max_epi16(_mm_sub_epi16(lLo,rLo),_mm_sub_epi16(rLo,lLo));
+            const __m128i dHi = _mm_max_epi16(_mm_sub_epi16(lHi,rHi),_mm_sub_epi16(rHi,lHi));
+            vAcc[L+inc] = _mm_add_epi16(vAcc[L+inc],_mm_add_epi16(dLo,_mm_and_si128(dHi,maskHi)));
+        }
+    }
+
+    // At most 11 rows x 2 x 510 per lane, the sums fit in 16 bits
+    const __m128i ones = _mm_set1_epi16(1);
+    for(int inc=-L; inc<=L; inc++)
+    {
+        __m128i sum = _mm_madd_epi16(vAcc[L+inc],ones);
+        sum = _mm_add_epi32(sum,_mm_shuffle_epi32(sum,_MM_SHUFFLE(1,0,3,2)));
+        sum = _mm_add_epi32(sum,_mm_shuffle_epi32(sum,_MM_SHUFFLE(2,3,0,1)));
+        vDists[L+inc] = _mm_cvtsi128_si32(sum);
+    }
+#else
+    const int cL = pL[0];
+    for(int inc=-L; inc<=L; inc++)
+    {
+        const int cR = pR[inc];
+        int dist = 0;
+        for(int r=-w; r<=w; r++)
+        {
+            const uchar* rowL = pL+r*(ptrdiff_t)stepL;
+            const uchar* rowR = pR+r*(ptrdiff_t)stepR+inc;
+            for(int c=-w; c<=w; c++)
+                dist += abs((rowL[c]-cL)-(rowR[c]-cR));
+        }
+        vDists[L+inc] = dist;
+    }
+#endif
+}
+
+// Pose, calibration and image bounds used by the batched frustum test
+struct FrustumCamera
+{
+    float r[9], t[3], O[3];
+    float fx, fy, cx, cy;
+    float minX, maxX, minY, maxY;
+    float viewingCosLimit;
+};
+
+// Frustum test of Frame::ProjectInFrustum for the points [i0,i1): projection, distance to the camera
+// center, viewing cosine and whether the point passes all the checks
+static void ProjectPoints(const MapPointsSoA &points, const int i0, const int i1, const FrustumCamera &cam,
+                          float* vU, float* vV, float* vInvZ, float* vDist, float* vViewCos, unsigned char* vbIn)
+{
+    int i=i0;
+
+#ifdef __SSE2__
+    const __m128 r00=_mm_set1_ps(cam.r[0]), r01=_mm_set1_ps(cam.r[1]), r02=_mm_set1_ps(cam.r[2]);
+    const __m128 r10=_mm_set1_ps(cam.r[3]), r11=_mm_set1_ps(cam.r[4]), r12=_mm_set1_ps(cam.r[5]);
+    const __m128 r20=_mm_set1_ps(cam.r[6]), r21=_mm_set1_ps(cam.r[7]), r22=_mm_set1_ps(cam.r[8]);
+    const __m128 t0=_mm_set1_ps(cam.t[0]), t1=_mm_set1_ps(cam.t[1]), t2=_mm_set1_ps(cam.t[2]);
+    const __m128 ox=_mm_set1_ps(cam.O[0]), oy=_mm_set1_ps(cam.O[1]), oz=_mm_set1_ps(cam.O[2]);
+    const __m128 fx=_mm_set1_ps(cam.fx), fy=_mm_set1_ps(cam.fy), cx=_mm_set1_ps(cam.cx), cy=_mm_set1_ps(cam.cy);
+    const __m128 minX=_mm_set1_ps(cam.minX), maxX=_mm_set1_ps(cam.maxX);
+    const __m128 minY=_mm_set1_ps(cam.minY), maxY=_mm_set1_ps(cam.maxY);
+    const __m128 cosLimit=_mm_set1_ps(cam.viewingCosLimit);
+    const __m128 one=_mm_set1_ps(1.0f), zero=_mm_setzero_ps();
+
+    for(; i+4<=i1; i+=4)
+    {
+        const __m128 X=_mm_loadu_ps(&points.x[i]), Y=_mm_loadu_ps(&points.y[i]), Z=_mm_loadu_ps(&points.z[i]);
+
+        // 3D in camera coordinates
+        const __m128 PcX=_mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(r00,X),_mm_mul_ps(r01,Y)),_mm_mul_ps(r02,Z)),t0);
+        const __m128 PcY=_mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(r10,X),_mm_mul_ps(r11,Y)),_mm_mul_ps(r12,Z)),t1);
+        const __m128 PcZ=_mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(r20,X),_mm_mul_ps(r21,Y)),_mm_mul_ps(r22,Z)),t2);
+
+        const __m128 invz=_mm_div_ps(one,PcZ);
+        const __m128 u=_mm_add_ps(_mm_mul_ps(_mm_mul_ps(fx,PcX),invz),cx);
+        const __m128 v=_mm_add_ps(_mm_mul_ps(_mm_mul_ps(fy,PcY),invz),cy);
+
+        const __m128 POx=_mm_sub_ps(X,ox), POy=_mm_sub_ps(Y,oy), POz=_mm_sub_ps(Z,oz);
+        const __m128 dist=_mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(POx,POx),_mm_mul_ps(POy,POy)),_mm_mul_ps(POz,POz)));
+        const __m128 dot=_mm_add_ps(_mm_add_ps(_mm_mul_ps(POx,_mm_loadu_ps(&points.nx[i])),
+                                               _mm_mul_ps(POy,_mm_loadu_ps(&points.ny[i]))),
+                                    _mm_mul_ps(POz,_mm_loadu_ps(&points.nz[i])));
+        const __m128 viewCos=_mm_div_ps(dot,dist);
+
+        _mm_storeu_ps(vU+i,u);
+        _mm_storeu_ps(vV+i,v);
+        _mm_storeu_ps(vInvZ+i,invz);
+        _mm_storeu_ps(vDist+i,dist);
+        _mm_storeu_ps(vViewCos+i,viewCos);
+
+        __m128 in=_mm_cmpge_ps(PcZ,zero);
+        in=_mm_and_ps(in,_mm_and_ps(_mm_cmpge_ps(u,minX),_mm_cmple_ps(u,maxX)));
+        in=_mm_and_ps(in,_mm_and_ps(_mm_cmpge_ps(v,minY),_mm_cmple_ps(v,maxY)));
+        in=_mm_and_ps(in,_mm_and_ps(_mm_cmpge_ps(dist,_mm_loadu_ps(&points.minDist[i])),
+                                    _mm_cmple_ps(dist,_mm_loadu_ps(&points.maxDist[i]))));
+        in=_mm_and_ps(in,_mm_cmpge_ps(viewCos,cosLimit));
+
+        const int mask=_mm_movemask_ps(in);
+        for(int j=0; j<4; j++)
+            vbIn[i+j] = (mask>>j)&1;
+    }
+#endif
+
+    for(; i<i1; i++)
+    {
+        const float X = points.x[i], Y = points.y[i], Z = points.z[i];
+
+        const float PcX = cam.r[0]*X+cam.r[1]*Y+cam.r[2]*Z+cam.t[0];
+        const float PcY = cam.r[3]*X+cam.r[4]*Y+cam.r[5]*Z+cam.t[1];
+        const float PcZ = cam.r[6]*X+cam.r[7]*Y+cam.r[8]*Z+cam.t[2];
+
+        const float invz = 1.0f/PcZ;
+        const float u = cam.fx*PcX*invz+cam.cx;
+        const float v = cam.fy*PcY*invz+cam.cy;
+
+        const float POx = X-cam.O[0], POy = Y-cam.O[1], POz = Z-cam.O[2];
+        const float dist = sqrt(POx*POx+POy*POy+POz*POz);
+        const float viewCos = (POx*points.nx[i]+POy*points.ny[i]+POz*points.nz[i])/dist;
+
+        vU[i] = u;
+        vV[i] = v;
+        vInvZ[i] = invz;
+        vDist[i] = dist;
+        vViewCos[i] = viewCos;
+        vbIn[i] = PcZ>=0.0f && u>=cam.minX && u<=cam.maxX && v>=cam.minY && v<=cam.maxY &&
+                  dist>=points.minDist[i] && dist<=points.maxDist[i] && viewCos>=cam.viewingCosLimit;
+    }
+}
 
 Frame::Frame()
+    :mpFeatures(make_shared<FeatureData>()), mbHasPose(false)
 {}
 
 //Copy Constructor
 Frame::Frame(const Frame &frame)
     :mpORBvocabulary(frame.mpORBvocabulary), mpORBextractorLeft(frame.mpORBextractorLeft), mpORBextractorRight(frame.mpORBextractorRight),
      mTimeStamp(frame.mTimeStamp), mK(frame.mK.clone()), mDistCoef(frame.mDistCoef.clone()),
-     mbf(frame.mbf), mb(frame.mb), mThDepth(frame.mThDepth), N(frame.N), mvKeys(frame.mvKeys),
-     mvKeysRight(frame.mvKeysRight), mvKeysUn(frame.mvKeysUn),  mvuRight(frame.mvuRight),
-     mvDepth(frame.mvDepth), mBowVec(frame.mBowVec), mFeatVec(frame.mFeatVec),
-     mDescriptors(frame.mDescriptors.clone()), mDescriptorsRight(frame.mDescriptorsRight.clone()),
+     mbf(frame.mbf), mb(frame.mb), mThDepth(frame.mThDepth), N(frame.N), mpFeatures(frame.mpFeatures),
+     mvKeysRight(frame.mvKeysRight), mDescriptors(frame.mDescriptors), mDescriptorsRight(frame.mDescriptorsRight),
      mvpMapPoints(frame.mvpMapPoints), mvbOutlier(frame.mvbOutlier), mnId(frame.mnId),
      mpReferenceKF(frame.mpReferenceKF), mnScaleLevels(frame.mnScaleLevels),
      mfScaleFactor(frame.mfScaleFactor), mfLogScaleFactor(frame.mfLogScaleFactor),
      mvScaleFactors(frame.mvScaleFactors), mvInvScaleFactors(frame.mvInvScaleFactors),
-     mvLevelSigma2(frame.mvLevelSigma2), mvInvLevelSigma2(frame.mvInvLevelSigma2)
+     mvLevelSigma2(frame.mvLevelSigma2), mvInvLevelSigma2(frame.mvInvLevelSigma2), mbHasPose(false)
 {
-    for(int i=0;i<FRAME_GRID_COLS;i++)
-        for(int j=0; j<FRAME_GRID_ROWS; j++)
-            mGrid[i][j]=frame.mGrid[i][j];
+    if(frame.mbHasPose)
+        SetPose(frame.mRcw,frame.mtcw);
+}
 
-    if(!frame.mTcw.empty())
-        SetPose(frame.mTcw);
+Frame& Frame::operator=(const Frame &frame)
+{
+    if(this==&frame)
+        return *this;
+
+    mpORBvocabulary = frame.mpORBvocabulary;
+    mpORBextractorLeft = frame.mpORBextractorLeft;
+    mpORBextractorRight = frame.mpORBextractorRight;
+    mTimeStamp = frame.mTimeStamp;
+    mK = frame.mK.clone();
+    mDistCoef = frame.mDistCoef.clone();
+    mbf = frame.mbf;
+    mb = frame.mb;
+    mThDepth = frame.mThDepth;
+    N = frame.N;
+    mpFeatures = frame.mpFeatures;
+    mvKeysRight = frame.mvKeysRight;
+    mDescriptors = frame.mDescriptors;
+    mDescriptorsRight = frame.mDescriptorsRight;
+    mvpMapPoints = frame.mvpMapPoints;
+    mvbOutlier = frame.mvbOutlier;
+    mnId = frame.mnId;
+    mpReferenceKF = frame.mpReferenceKF;
+    mnScaleLevels = frame.mnScaleLevels;
+    mfScaleFactor = frame.mfScaleFactor;
+    mfLogScaleFactor = frame.mfLogScaleFactor;
+    mvScaleFactors = frame.mvScaleFactors;
+    mvInvScaleFactors = frame.mvInvScaleFactors;
+    mvLevelSigma2 = frame.mvLevelSigma2;
+    mvInvLevelSigma2 = frame.mvInvLevelSigma2;
+
+    mbHasPose = false;
+    if(frame.mbHasPose)
+        SetPose(frame.mRcw,frame.mtcw);
+
+    return *this;
 }
 
 
 Frame::Frame(const cv::Mat &imLeft, const cv::Mat &imRight, const double &timeStamp, ORBextractor* extractorLeft, ORBextractor* extractorRight, ORBVocabulary* voc, cv::Mat &K, cv::Mat &distCoef, const float &bf, const float &thDepth)
     :mpORBvocabulary(voc),mpORBextractorLeft(extractorLeft),mpORBextractorRight(extractorRight), mTimeStamp(timeStamp), mK(K.clone()),mDistCoef(distCoef.clone()), mbf(bf), mThDepth(thDepth),
-     mpReferenceKF(static_cast<KeyFrame*>(NULL))
+     mpReferenceKF(static_cast<KeyFrame*>(NULL)), mbHasPose(false)
 {
     // Frame ID
     mnId=nNextId++;
@@ -75,20 +297,24 @@ Frame::Frame(const cv::Mat &imLeft, const cv::Mat &imRight, const double &timeSt
     mvLevelSigma2 = mpORBextractorLeft->GetScaleSigmaSquares();
     mvInvLevelSigma2 = mpORBextractorLeft->GetInverseScaleSigmaSquares();
 
-    // ORB extraction
-    thread threadLeft(&Frame::ExtractORB,this,0,imLeft);
-    thread threadRight(&Frame::ExtractORB,this,1,imRight);
-    threadLeft.join();
-    threadRight.join();
+    // The keypoint data is only written here, before it can be shared
+    FeatureData* pFeatures = new FeatureData();
+    mpFeatures.reset(pFeatures);
+
+    // ORB extraction of both images, on the persistent threads of the extractor's pool
+    mpORBextractorLeft->ParallelFor(0,2,[&](int flag)
+    {
+        ExtractORB(flag,flag==0 ? imLeft : imRight,flag==0 ? pFeatures->mvKeys : mvKeysRight);
+    });
 
-    N = mvKeys.size();
+    N = pFeatures->mvKeys.size();
 
-    if(mvKeys.empty())
+    if(pFeatures->mvKeys.empty())
         return;
 
-    UndistortKeyPoints();
+    UndistortKeyPoints(*pFeatures);
 
-    ComputeStereoMatches();
+    ComputeStereoMatches(*pFeatures);
 
     mvpMapPoints = vector<MapPoint*>(N,static_cast<MapPoint*>(NULL));
     mvbOutlier = vector<bool>(N,false);
@@ -114,12 +340,12 @@ Frame::Frame(const cv::Mat &imLeft, const cv::Mat &imRight, const double &timeSt
 
     mb = mbf/fx;
 
-    AssignFeaturesToGrid();
+    AssignFeaturesToGrid(*pFeatures);
 }
 
-Frame::Frame(const cv::Mat &imGray, const cv::Mat &imDepth, const double &timeStamp, ORBextractor* extractor,ORBVocabulary* voc, cv::Mat &K, cv::Mat &distCoef, const float &bf, const float &thDepth)
+Frame::Frame(const cv::Mat &imGray, const cv::Mat &imDepth, const double &timeStamp, ORBextractor* extractor,ORBVocabulary* voc, cv::Mat &K, cv::Mat &distCoef, const float &bf, const float &thDepth, const float &depthFactor)
     :mpORBvocabulary(voc),mpORBextractorLeft(extractor),mpORBextractorRight(static_cast<ORBextractor*>(NULL)),
-     mTimeStamp(timeStamp), mK(K.clone()),mDistCoef(distCoef.clone()), mbf(bf), mThDepth(thDepth)
+     mTimeStamp(timeStamp), mK(K.clone()),mDistCoef(distCoef.clone()), mbf(bf), mThDepth(thDepth), mbHasPose(false)
 {
     // Frame ID
     mnId=nNextId++;
@@ -133,17 +359,20 @@ Frame::Frame(const cv::Mat &imGray, const cv::Mat &imDepth, const double &timeSt
     mvLevelSigma2 = mpORBextractorLeft->GetScaleSigmaSquares();
     mvInvLevelSigma2 = mpORBextractorLeft->GetInverseScaleSigmaSquares();
 
+    FeatureData* pFeatures = new FeatureData();
+    mpFeatures.reset(pFeatures);
+
     // ORB extraction
-    ExtractORB(0,imGray);
+    ExtractORB(0,imGray,pFeatures->mvKeys);
 
-    N = mvKeys.size();
+    N = pFeatures->mvKeys.size();
 
-    if(mvKeys.empty())
+    if(pFeatures->mvKeys.empty())
         return;
 
-    UndistortKeyPoints();
+    UndistortKeyPoints(*pFeatures);
 
-    ComputeStereoFromRGBD(imDepth);
+    ComputeStereoFromRGBD(*pFeatures,imDepth,depthFactor);
 
     mvpMapPoints = vector<MapPoint*>(N,static_cast<MapPoint*>(NULL));
     mvbOutlier = vector<bool>(N,false);
@@ -168,13 +397,13 @@ Frame::Frame(const cv::Mat &imGray, const cv::Mat &imDepth, const double &timeSt
 
     mb = mbf/fx;
 
-    AssignFeaturesToGrid();
+    AssignFeaturesToGrid(*pFeatures);
 }
 
 
 Frame::Frame(const cv::Mat &imGray, const double &timeStamp, ORBextractor* extractor,ORBVocabulary* voc, cv::Mat &K, cv::Mat &distCoef, const float &bf, const float &thDepth)
     :mpORBvocabulary(voc),mpORBextractorLeft(extractor),mpORBextractorRight(static_cast<ORBextractor*>(NULL)),
-     mTimeStamp(timeStamp), mK(K.clone()),mDistCoef(distCoef.clone()), mbf(bf), mThDepth(thDepth)
+     mTimeStamp(timeStamp), mK(K.clone()),mDistCoef(distCoef.clone()), mbf(bf), mThDepth(thDepth), mbHasPose(false)
 {
     // Frame ID
     mnId=nNextId++;
@@ -188,19 +417,22 @@ Frame::Frame(const cv::Mat &imGray, const double &timeStamp, ORBextractor* extra
     mvLevelSigma2 = mpORBextractorLeft->GetScaleSigmaSquares();
     mvInvLevelSigma2 = mpORBextractorLeft->GetInverseScaleSigmaSquares();
 
+    FeatureData* pFeatures = new FeatureData();
+    mpFeatures.reset(pFeatures);
+
     // ORB extraction
-    ExtractORB(0,imGray);
+    ExtractORB(0,imGray,pFeatures->mvKeys);
 
-    N = mvKeys.size();
+    N = pFeatures->mvKeys.size();
 
-    if(mvKeys.empty())
+    if(pFeatures->mvKeys.empty())
         return;
 
-    UndistortKeyPoints();
+    UndistortKeyPoints(*pFeatures);
 
     // Set no stereo information
-    mvuRight = vector<float>(N,-1);
-    mvDepth = vector<float>(N,-1);
+    pFeatures->mvuRight = vector<float>(N,-1);
+    pFeatures->mvDepth = vector<float>(N,-1);
 
     mvpMapPoints = vector<MapPoint*>(N,static_cast<MapPoint*>(NULL));
     mvbOutlier = vector<bool>(N,false);
@@ -225,104 +457,119 @@ Frame::Frame(const cv::Mat &imGray, const double &timeStamp, ORBextractor* extra
 
     mb = mbf/fx;
 
-    AssignFeaturesToGrid();
+    AssignFeaturesToGrid(*pFeatures);
 }
 
-void Frame::AssignFeaturesToGrid()
+void Frame::AssignFeaturesToGrid(FeatureData &features)
 {
-    int nReserve = 0.5f*N/(FRAME_GRID_COLS*FRAME_GRID_ROWS);
-    for(unsigned int i=0; i<FRAME_GRID_COLS;i++)
-        for (unsigned int j=0; j<FRAME_GRID_ROWS;j++)
-            mGrid[i][j].reserve(nReserve);
+    // Counting sort of the keypoints by cell. Keypoints keep their order inside each cell.
+    const int nCells = FRAME_GRID_COLS*FRAME_GRID_ROWS;
+    features.mGridStart.assign(nCells+1,0);
 
+    int nGridPosX, nGridPosY;
     for(int i=0;i<N;i++)
     {
-        const cv::KeyPoint &kp = mvKeysUn[i];
+        if(PosInGrid(features.mvKeysUn[i],nGridPosX,nGridPosY))
+            features.mGridStart[nGridPosX*FRAME_GRID_ROWS+nGridPosY+1]++;
+    }
+
+    for(int c=0; c<nCells; c++)
+        features.mGridStart[c+1] += features.mGridStart[c];
 
-        int nGridPosX, nGridPosY;
-        if(PosInGrid(kp,nGridPosX,nGridPosY))
-            mGrid[nGridPosX][nGridPosY].push_back(i);
+    // mGridStart[c] is used as the insertion point of cell c, which leaves it at the start of cell c+1
+    features.mGridIndices.resize(features.mGridStart[nCells]);
+    for(int i=0;i<N;i++)
+    {
+        if(PosInGrid(features.mvKeysUn[i],nGridPosX,nGridPosY))
+            features.mGridIndices[features.mGridStart[nGridPosX*FRAME_GRID_ROWS+nGridPosY]++] = i;
     }
+
+    for(int c=nCells; c>0; c--)
+        features.mGridStart[c] = features.mGridStart[c-1];
+    features.mGridStart[0] = 0;
 }
 
-void Frame::ExtractORB(int flag, const cv::Mat &im)
+void Frame::ExtractORB(int flag, const cv::Mat &im, vector<cv::KeyPoint> &vKeys)
 {
+    ScopedTimer timer(Stats::EXTRACT_ORB);
+
     if(flag==0)
-        (*mpORBextractorLeft)(im,cv::Mat(),mvKeys,mDescriptors);
+        (*mpORBextractorLeft)(im,cv::Mat(),vKeys,mDescriptors);
     else
-        (*mpORBextractorRight)(im,cv::Mat(),mvKeysRight,mDescriptorsRight);
+        (*mpORBextractorRight)(im,cv::Mat(),vKeys,mDescriptorsRight);
 }
 
-void Frame::SetPose(cv::Mat Tcw)
+void Frame::SetPose(const Eigen::Matrix3f &Rcw, const Eigen::Vector3f &tcw)
 {
-    mTcw = Tcw.clone();
-    UpdatePoseMatrices();
+    mRcw = Rcw;
+    mtcw = tcw;
+    mRwc = mRcw.transpose();
+    mOw = -mRwc*mtcw;
+    mbHasPose = true;
 }
 
-void Frame::UpdatePoseMatrices()
+void MapPointsSoA::push_back(MapPoint* pMP)
 {
-    mRcw = mTcw.rowRange(0,3).colRange(0,3);
-    mRwc = mRcw.t();
-    mtcw = mTcw.rowRange(0,3).col(3);
-    mOw = -mRcw.t()*mtcw;
+    Eigen::Vector3f P, n;
+    float minD, maxD, scaleD;
+    pMP->GetProjectionData(P,n,minD,maxD,scaleD);
+
+    x.push_back(P(0)); y.push_back(P(1)); z.push_back(P(2));
+    nx.push_back(n(0)); ny.push_back(n(1)); nz.push_back(n(2));
+    minDist.push_back(minD); maxDist.push_back(maxD); scaleDist.push_back(scaleD);
 }
 
-bool Frame::isInFrustum(MapPoint *pMP, float viewingCosLimit)
+void Frame::ProjectInFrustum(const MapPointsSoA &points, const float viewingCosLimit, vector<MapPointProjection> &vProjections)
 {
-    pMP->mbTrackInView = false;
-
-    // 3D in absolute coordinates
-    cv::Mat P = pMP->GetWorldPos();
-
-    // 3D in camera coordinates
-    const cv::Mat Pc = mRcw*P+mtcw;
-    const float &PcX = Pc.at<float>(0);
-    const float &PcY= Pc.at<float>(1);
-    const float &PcZ = Pc.at<float>(2);
-
-    // Check positive depth
-    if(PcZ<0.0f)
-        return false;
-
-    // Project in image and check it is not outside
-    const float invz = 1.0f/PcZ;
-    const float u=fx*PcX*invz+cx;
-    const float v=fy*PcY*invz+cy;
+    vProjections.clear();
 
-    if(u<mnMinX || u>mnMaxX)
-        return false;
-    if(v<mnMinY || v>mnMaxY)
-        return false;
-
-    // Check distance is in the scale invariance region of the MapPoint
-    const float maxDistance = pMP->GetMaxDistanceInvariance();
-    const float minDistance = pMP->GetMinDistanceInvariance();
-    const cv::Mat PO = P-mOw;
-    const float dist = cv::norm(PO);
-
-    if(dist<minDistance || dist>maxDistance)
-        return false;
+    const int nPoints = points.size();
 
-   // Check viewing angle
-    cv::Mat Pn = pMP->GetNormal();
-
-    const float viewCos = PO.dot(Pn)/dist;
+    FrustumCamera cam;
+    for(int i=0; i<3; i++)
+    {
+        for(int j=0; j<3; j++)
+            cam.r[3*i+j] = mRcw(i,j);
+        cam.t[i] = mtcw(i);
+        cam.O[i] = mOw(i);
+    }
+    cam.fx = fx; cam.fy = fy; cam.cx = cx; cam.cy = cy;
+    cam.minX = mnMinX; cam.maxX = mnMaxX; cam.minY = mnMinY; cam.maxY = mnMaxY;
+    cam.viewingCosLimit = viewingCosLimit;
 
-    if(viewCos<viewingCosLimit)
-        return false;
+    // Projection, distance and viewing angle of every point, in blocks processed in parallel
+    vector<float> vU(nPoints), vV(nPoints), vInvZ(nPoints), vDist(nPoints), vViewCos(nPoints);
+    vector<unsigned char> vbIn(nPoints);
 
-    // Predict scale in the image
-    const int nPredictedLevel = pMP->PredictScale(dist,this);
+    const int nBlockSize = 1024;
+    mpORBextractorLeft->ParallelFor(0,(nPoints+nBlockSize-1)/nBlockSize,[&](int iBlock)
+    {
+        const int i0 = iBlock*nBlockSize;
+        ProjectPoints(points,i0,min(nPoints,i0+nBlockSize),cam,vU.data(),vV.data(),vInvZ.data(),vDist.data(),vViewCos.data(),vbIn.data());
+    });
 
-    // Data used by the tracking
-    pMP->mbTrackInView = true;
-    pMP->mTrackProjX = u;
-    pMP->mTrackProjXR = u - mbf*invz;
-    pMP->mTrackProjY = v;
-    pMP->mnTrackScaleLevel= nPredictedLevel;
-    pMP->mTrackViewCos = viewCos;
+    for(int i=0; i<nPoints; i++)
+    {
+        if(!vbIn[i])
+            continue;
 
-    return true;
+        // Predict scale in the image (as MapPoint::PredictScale)
+        const float ratio = points.scaleDist[i]/vDist[i];
+        int nScale = ceil(log(ratio)/mfLogScaleFactor);
+        if(nScale<0)
+            nScale = 0;
+        else if(nScale>=mnScaleLevels)
+            nScale = mnScaleLevels-1;
+
+        MapPointProjection proj;
+        proj.idx = i;
+        proj.u = vU[i];
+        proj.v = vV[i];
+        proj.uR = vU[i] - mbf*vInvZ[i];
+        proj.level = nScale;
+        proj.viewCos = vViewCos[i];
+        vProjections.push_back(proj);
+    }
 }
 
 vector<size_t> Frame::GetFeaturesInArea(const float &x, const float  &y, const float  &r, const int minLevel, const int maxLevel) const
@@ -346,34 +593,36 @@ vector<size_t> Frame::GetFeaturesInArea(const float &x, const float  &y, const f
     if(nMaxCellY<0)
         return vIndices;
 
+    const FeatureData &features = *mpFeatures;
+    if(features.mGridStart.empty())
+        return vIndices;
+
     const bool bCheckLevels = (minLevel>0) || (maxLevel>=0);
 
+    // The cells nMinCellY..nMaxCellY of a column are contiguous
     for(int ix = nMinCellX; ix<=nMaxCellX; ix++)
     {
-        for(int iy = nMinCellY; iy<=nMaxCellY; iy++)
-        {
-            const vector<size_t> vCell = mGrid[ix][iy];
-            if(vCell.empty())
-                continue;
+        const unsigned int jbegin = features.mGridStart[ix*FRAME_GRID_ROWS+nMinCellY];
+        const unsigned int jend = features.mGridStart[ix*FRAME_GRID_ROWS+nMaxCellY+1];
 
-            for(size_t j=0, jend=vCell.size(); j<jend; j++)
+        for(unsigned int j=jbegin; j<jend; j++)
+        {
+            const size_t idx = features.mGridIndices[j];
+            const cv::KeyPoint &kpUn = features.mvKeysUn[idx];
+            if(bCheckLevels)
             {
-                const cv::KeyPoint &kpUn = mvKeysUn[vCell[j]];
-                if(bCheckLevels)
-                {
-                    if(kpUn.octave<minLevel)
+                if(kpUn.octave<minLevel)
+                    continue;
+                if(maxLevel>=0)
+                    if(kpUn.octave>maxLevel)
                         continue;
-                    if(maxLevel>=0)
-                        if(kpUn.octave>maxLevel)
-                            continue;
-                }
+            }
 
-                const float distx = kpUn.pt.x-x;
-                const float disty = kpUn.pt.y-y;
+            const float distx = kpUn.pt.x-x;
+            const float disty = kpUn.pt.y-y;
 
-                if(fabs(distx)<r && fabs(disty)<r)
-                    vIndices.push_back(vCell[j]);
-            }
+            if(fabs(distx)<r && fabs(disty)<r)
+                vIndices.push_back(idx);
         }
     }
 
@@ -393,66 +642,90 @@ bool Frame::PosInGrid(const cv::KeyPoint &kp, int &posX, int &posY)
 }
 
 
-void Frame::ComputeBoW()
+void FeatureData::ComputeBoW(ORBVocabulary* pVoc, const cv::Mat &descriptors) const
 {
-    if(mBowVec.empty())
+    call_once(mBowFlag,[&]
     {
-        vector<cv::Mat> vCurrentDesc = Converter::toDescriptorVector(mDescriptors);
-        mpORBvocabulary->transform(vCurrentDesc,mBowVec,mFeatVec,4);
-    }
+        // A loaded map already has it
+        if(!mBowVec.empty())
+            return;
+
+        // Feature vector associate features with nodes in the 4th level (from leaves up)
+        // We assume the vocabulary tree has 6 levels, change the 4 otherwise
+        pVoc->Transform(descriptors,mBowVec,mFeatVec,4);
+    });
 }
 
-void Frame::UndistortKeyPoints()
+void Frame::ComputeBoW()
+{
+    ScopedTimer timer(Stats::COMPUTE_BOW);
+    mpFeatures->ComputeBoW(mpORBvocabulary,mDescriptors);
+}
+
+void Frame::UndistortKeyPoints(FeatureData &features)
 {
     if(mDistCoef.at<float>(0)==0.0)
     {
-        mvKeysUn=mvKeys;
+        features.mvKeysUn=features.mvKeys;
         return;
     }
 
-    // Fill matrix with points
-    cv::Mat mat(N,2,CV_32F);
-    for(int i=0; i<N; i++)
+    // The map is computed for the first Frame (or after a change in the calibration)
+    if(mbInitialComputations || mUndistortMap.empty())
     {
-        mat.at<float>(i,0)=mvKeys[i].pt.x;
-        mat.at<float>(i,1)=mvKeys[i].pt.y;
+        const cv::Mat &im = mpORBextractorLeft->mvImagePyramid[0];
+        ComputeUndistortMap(im.cols,im.rows);
     }
 
-    // Undistort points
-    mat=mat.reshape(2);
-    cv::undistortPoints(mat,mat,mK,mDistCoef,cv::Mat(),mK);
-    mat=mat.reshape(1);
-
     // Fill undistorted keypoint vector
-    mvKeysUn.resize(N);
+    features.mvKeysUn.resize(N);
     for(int i=0; i<N; i++)
     {
-        cv::KeyPoint kp = mvKeys[i];
-        kp.pt.x=mat.at<float>(i,0);
-        kp.pt.y=mat.at<float>(i,1);
-        mvKeysUn[i]=kp;
+        cv::KeyPoint kp = features.mvKeys[i];
+        kp.pt = InterpolateUndistortMap(mUndistortMap,kp.pt.x,kp.pt.y);
+        features.mvKeysUn[i]=kp;
     }
 }
 
+void Frame::ComputeUndistortMap(const int cols, const int rows)
+{
+    const int mapCols = (cols+UNDISTORT_MAP_STEP-1)/UNDISTORT_MAP_STEP+1;
+    const int mapRows = (rows+UNDISTORT_MAP_STEP-1)/UNDISTORT_MAP_STEP+1;
+
+    // Fill matrix with the points of the map, which covers the whole image
+    cv::Mat mat(mapRows*mapCols,2,CV_32F);
+    for(int r=0, i=0; r<mapRows; r++)
+    {
+        for(int c=0; c<mapCols; c++, i++)
+        {
+            mat.at<float>(i,0)=c*UNDISTORT_MAP_STEP;
+            mat.at<float>(i,1)=r*UNDISTORT_MAP_STEP;
+        }
+    }
+
+    // Undistort points
+    mat=mat.reshape(2);
+    cv::undistortPoints(mat,mat,mK,mDistCoef,cv::Mat(),mK);
+    mUndistortMap=mat.reshape(2,mapRows);
+}
+
 void Frame::ComputeImageBounds(const cv::Mat &imLeft)
 {
     if(mDistCoef.at<float>(0)!=0.0)
     {
-        cv::Mat mat(4,2,CV_32F);
-        mat.at<float>(0,0)=0.0; mat.at<float>(0,1)=0.0;
-        mat.at<float>(1,0)=imLeft.cols; mat.at<float>(1,1)=0.0;
-        mat.at<float>(2,0)=0.0; mat.at<float>(2,1)=imLeft.rows;
-        mat.at<float>(3,0)=imLeft.cols; mat.at<float>(3,1)=imLeft.rows;
+        if(mUndistortMap.empty())
+            ComputeUndistortMap(imLeft.cols,imLeft.rows);
 
         // Undistort corners
-        mat=mat.reshape(2);
-        cv::undistortPoints(mat,mat,mK,mDistCoef,cv::Mat(),mK);
-        mat=mat.reshape(1);
+        const cv::Point2f p00 = InterpolateUndistortMap(mUndistortMap,0.0f,0.0f);
+        const cv::Point2f p10 = InterpolateUndistortMap(mUndistortMap,imLeft.cols,0.0f);
+        const cv::Point2f p01 = InterpolateUndistortMap(mUndistortMap,0.0f,imLeft.rows);
+        const cv::Point2f p11 = InterpolateUndistortMap(mUndistortMap,imLeft.cols,imLeft.rows);
 
-        mnMinX = min(mat.at<float>(0,0),mat.at<float>(2,0));
-        mnMaxX = max(mat.at<float>(1,0),mat.at<float>(3,0));
-        mnMinY = min(mat.at<float>(0,1),mat.at<float>(1,1));
-        mnMaxY = max(mat.at<float>(2,1),mat.at<float>(3,1));
+        mnMinX = min(p00.x,p01.x);
+        mnMaxX = max(p10.x,p11.x);
+        mnMinY = min(p00.y,p10.y);
+        mnMaxY = max(p01.y,p11.y);
 
     }
     else
@@ -464,33 +737,49 @@ void Frame::ComputeImageBounds(const cv::Mat &imLeft)
     }
 }
 
-void Frame::ComputeStereoMatches()
+void Frame::ComputeStereoMatches(FeatureData &features)
 {
-    mvuRight = vector<float>(N,-1.0f);
-    mvDepth = vector<float>(N,-1.0f);
+    ScopedTimer timer(Stats::STEREO_MATCHING);
+
+    features.mvuRight = vector<float>(N,-1.0f);
+    features.mvDepth = vector<float>(N,-1.0f);
 
     const int thOrbDist = (ORBmatcher::TH_HIGH+ORBmatcher::TH_LOW)/2;
 
     const int nRows = mpORBextractorLeft->mvImagePyramid[0].rows;
 
-    //Assign keypoints to row table
-    vector<vector<size_t> > vRowIndices(nRows,vector<size_t>());
+    //Assign keypoints to row table: count the keypoints of each row, then fill the rows in order.
+    //Right keypoints that can match a left keypoint in row v: vRowKeys[vRowStart[v]] to
+    //vRowKeys[vRowStart[v+1]-1]. The buffers are kept across the frames built by each thread.
+    const int Nr = mvKeysRight.size();
 
-    for(int i=0; i<nRows; i++)
-        vRowIndices[i].reserve(200);
+    static thread_local vector<int> vRowStart;
+    static thread_local vector<int> vRowKeys;
 
-    const int Nr = mvKeysRight.size();
+    vRowStart.assign(nRows+1,0);
 
+    vector<int> vMinRow(Nr), vMaxRow(Nr);
     for(int iR=0; iR<Nr; iR++)
     {
         const cv::KeyPoint &kp = mvKeysRight[iR];
         const float &kpY = kp.pt.y;
-        const float r = 2.0f*mvScaleFactors[mvKeysRight[iR].octave];
-        const int maxr = ceil(kpY+r);
-        const int minr = floor(kpY-r);
+        const float r = 2.0f*mvScaleFactors[kp.octave];
+        vMaxRow[iR] = min(static_cast<int>(ceil(kpY+r)),nRows-1);
+        vMinRow[iR] = max(static_cast<int>(floor(kpY-r)),0);
+
+        for(int yi=vMinRow[iR];yi<=vMaxRow[iR];yi++)
+            vRowStart[yi+1]++;
+    }
 
-        for(int yi=minr;yi<=maxr;yi++)
-            vRowIndices[yi].push_back(iR);
+    for(int yi=0; yi<nRows; yi++)
+        vRowStart[yi+1] += vRowStart[yi];
+
+    vRowKeys.resize(vRowStart[nRows]);
+    {
+        vector<int> vNext(vRowStart.begin(),vRowStart.end()-1);
+        for(int iR=0; iR<Nr; iR++)
+            for(int yi=vMinRow[iR];yi<=vMaxRow[iR];yi++)
+                vRowKeys[vNext[yi]++] = iR;
     }
 
     // Set limits for search
@@ -498,37 +787,46 @@ void Frame::ComputeStereoMatches()
     const float minD = 0;
     const float maxD = mbf/minZ;
 
-    // For each left keypoint search a match in the right image
-    vector<pair<int, int> > vDistIdx;
-    vDistIdx.reserve(N);
+    const int w = STEREO_PATCH_W;
+    const int L = STEREO_SEARCH_L;
 
-    for(int iL=0; iL<N; iL++)
+    // The loop below may run on other threads, which must read the tables of this one
+    const int* pRowStart = vRowStart.data();
+    const int* pRowKeys = vRowKeys.data();
+
+    // Correlation distance of the match of each left keypoint (-1 if none)
+    vector<int> vMatchDist(N,-1);
+
+    // For each left keypoint search a match in the right image (keypoints are independent)
+    mpORBextractorLeft->ParallelFor(0,N,[&](int iL)
     {
-        const cv::KeyPoint &kpL = mvKeys[iL];
+        const cv::KeyPoint &kpL = features.mvKeys[iL];
         const int &levelL = kpL.octave;
         const float &vL = kpL.pt.y;
         const float &uL = kpL.pt.x;
 
-        const vector<size_t> &vCandidates = vRowIndices[vL];
+        const int row = vL;
+        const int* pCandidates = pRowKeys+pRowStart[row];
+        const int nCandidates = pRowStart[row+1]-pRowStart[row];
 
-        if(vCandidates.empty())
-            continue;
+        if(nCandidates==0)
+            return;
 
         const float minU = uL-maxD;
         const float maxU = uL-minD;
 
         if(maxU<0)
-            continue;
+            return;
 
         int bestDist = ORBmatcher::TH_HIGH;
         size_t bestIdxR = 0;
 
-        const cv::Mat &dL = mDescriptors.row(iL);
+        const uchar* dL = mDescriptors.ptr<uchar>(iL);
 
         // Compare descriptor to right keypoints
-        for(size_t iC=0; iC<vCandidates.size(); iC++)
+        for(int iC=0; iC<nCandidates; iC++)
         {
-            const size_t iR = vCandidates[iC];
+            const size_t iR = pCandidates[iC];
             const cv::KeyPoint &kpR = mvKeysRight[iR];
 
             if(kpR.octave<levelL-1 || kpR.octave>levelL+1)
@@ -538,8 +836,7 @@ void Frame::ComputeStereoMatches()
 
             if(uR>=minU && uR<=maxU)
             {
-                const cv::Mat &dR = mDescriptorsRight.row(iR);
-                const int dist = ORBmatcher::DescriptorDistance(dL,dR);
+                const int dist = ORBmatcher::DescriptorDistance(dL,mDescriptorsRight.ptr<uchar>(iR));
 
                 if(dist<bestDist)
                 {
@@ -559,41 +856,32 @@ void Frame::ComputeStereoMatches()
             const float scaledvL = round(kpL.pt.y*scaleFactor);
             const float scaleduR0 = round(uR0*scaleFactor);
 
-            // sliding window search
-            const int w = 5;
-            cv::Mat IL = mpORBextractorLeft->mvImagePyramid[kpL.octave].rowRange(scaledvL-w,scaledvL+w+1).colRange(scaleduL-w,scaleduL+w+1);
-            IL.convertTo(IL,CV_32F);
-            IL = IL - IL.at<float>(w,w) *cv::Mat::ones(IL.rows,IL.cols,CV_32F);
-
-            int bestDist = INT_MAX;
-            int bestincR = 0;
-            const int L = 5;
-            vector<float> vDists;
-            vDists.resize(2*L+1);
+            const cv::Mat &imL = mpORBextractorLeft->mvImagePyramid[kpL.octave];
+            const cv::Mat &imR = mpORBextractorRight->mvImagePyramid[kpL.octave];
 
             const float iniu = scaleduR0+L-w;
             const float endu = scaleduR0+L+w+1;
-            if(iniu<0 || endu >= mpORBextractorRight->mvImagePyramid[kpL.octave].cols)
-                continue;
+            if(iniu<0 || endu >= imR.cols)
+                return;
+
+            // sliding window search
+            int vDists[2*STEREO_SEARCH_L+1];
+            StereoPatchDistances(imL.ptr<uchar>((int)scaledvL)+(int)scaleduL,imL.step,
+                                 imR.ptr<uchar>((int)scaledvL)+(int)scaleduR0,imR.step,vDists);
 
+            int bestDist = INT_MAX;
+            int bestincR = 0;
             for(int incR=-L; incR<=+L; incR++)
             {
-                cv::Mat IR = mpORBextractorRight->mvImagePyramid[kpL.octave].rowRange(scaledvL-w,scaledvL+w+1).colRange(scaleduR0+incR-w,scaleduR0+incR+w+1);
-                IR.convertTo(IR,CV_32F);
-                IR = IR - IR.at<float>(w,w) *cv::Mat::ones(IR.rows,IR.cols,CV_32F);
-
-                float dist = cv::norm(IL,IR,cv::NORM_L1);
-                if(dist<bestDist)
+                if(vDists[L+incR]<bestDist)
                 {
-                    bestDist =  dist;
+                    bestDist = vDists[L+incR];
                     bestincR = incR;
                 }
-
-                vDists[L+incR] = dist;
             }
 
             if(bestincR==-L || bestincR==L)
-                continue;
+                return;
 
             // Sub-pixel match (Parabola fitting)
             const float dist1 = vDists[L+bestincR-1];
@@ -603,7 +891,7 @@ void Frame::ComputeStereoMatches()
             const float deltaR = (dist1-dist3)/(2.0f*(dist1+dist3-2.0f*dist2));
 
             if(deltaR<-1 || deltaR>1)
-                continue;
+                return;
 
             // Re-scaled coordinate
             float bestuR = mvScaleFactors[kpL.octave]*((float)scaleduR0+(float)bestincR+deltaR);
@@ -617,12 +905,21 @@ void Frame::ComputeStereoMatches()
                     disparity=0.01;
                     bestuR = uL-0.01;
                 }
-                mvDepth[iL]=mbf/disparity;
-                mvuRight[iL] = bestuR;
-                vDistIdx.push_back(pair<int,int>(bestDist,iL));
+                features.mvDepth[iL]=mbf/disparity;
+                features.mvuRight[iL] = bestuR;
+                vMatchDist[iL] = bestDist;
             }
         }
-    }
+    });
+
+    vector<pair<int, int> > vDistIdx;
+    vDistIdx.reserve(N);
+    for(int iL=0; iL<N; iL++)
+        if(vMatchDist[iL]>=0)
+            vDistIdx.push_back(pair<int,int>(vMatchDist[iL],iL));
+
+    if(vDistIdx.empty())
+        return;
 
     sort(vDistIdx.begin(),vDistIdx.end());
     const float median = vDistIdx[vDistIdx.size()/2].first;
@@ -634,50 +931,46 @@ void Frame::ComputeStereoMatches()
             break;
         else
         {
-            mvuRight[vDistIdx[i].second]=-1;
-            mvDepth[vDistIdx[i].second]=-1;
+            features.mvuRight[vDistIdx[i].second]=-1;
+            features.mvDepth[vDistIdx[i].second]=-1;
         }
     }
 }
 
 
-void Frame::ComputeStereoFromRGBD(const cv::Mat &imDepth)
+void Frame::ComputeStereoFromRGBD(FeatureData &features, const cv::Mat &imDepth, const float &depthFactor)
 {
-    mvuRight = vector<float>(N,-1);
-    mvDepth = vector<float>(N,-1);
+    features.mvuRight = vector<float>(N,-1);
+    features.mvDepth = vector<float>(N,-1);
+
+    const bool bRaw = imDepth.type()==CV_16U;
 
     for(int i=0; i<N; i++)
     {
-        const cv::KeyPoint &kp = mvKeys[i];
-        const cv::KeyPoint &kpU = mvKeysUn[i];
+        const cv::KeyPoint &kp = features.mvKeys[i];
+        const cv::KeyPoint &kpU = features.mvKeysUn[i];
 
         const float &v = kp.pt.y;
         const float &u = kp.pt.x;
 
-        const float d = imDepth.at<float>(v,u);
+        const float d = depthFactor*(bRaw ? static_cast<float>(imDepth.at<ushort>(v,u)) : imDepth.at<float>(v,u));
 
         if(d>0)
         {
-            mvDepth[i] = d;
-            mvuRight[i] = kpU.pt.x-mbf/d;
+            features.mvDepth[i] = d;
+            features.mvuRight[i] = kpU.pt.x-mbf/d;
         }
     }
 }
 
-cv::Mat Frame::UnprojectStereo(const int &i)
+Eigen::Vector3f Frame::UnprojectStereo(const int &i)
 {
-    const float z = mvDepth[i];
-    if(z>0)
-    {
-        const float u = mvKeysUn[i].pt.x;
-        const float v = mvKeysUn[i].pt.y;
-        const float x = (u-cx)*z*invfx;
-        const float y = (v-cy)*z*invfy;
-        cv::Mat x3Dc = (cv::Mat_<float>(3,1) << x, y, z);
-        return mRwc*x3Dc+mOw;
-    }
-    else
-        return cv::Mat();
+    const float z = mpFeatures->mvDepth[i];
+    const float u = mpFeatures->mvKeysUn[i].pt.x;
+    const float v = mpFeatures->mvKeysUn[i].pt.y;
+    const float x = (u-cx)*z*invfx;
+    const float y = (v-cy)*z*invfy;
+    return mRwc*Eigen::Vector3f(x,y,z)+mOw;
 }
 
 } //namespace ORB_SLAM
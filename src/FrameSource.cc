@@ -0,0 +1,276 @@
+/**
+* This file is part of ORB-SLAM2.
+*
+* Copyright (C) 2014-2016 Raúl Mur-Artal <raulmur at unizar dot es> (University of Zaragoza)
+* For more information see <https://github.com/raulmur/ORB_SLAM2>
+*
+* ORB-SLAM2 is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM2 is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with ORB-SLAM2. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "FrameSource.h"
+
+#include <iostream>
+
+#include <opencv2/imgproc/imgproc.hpp>
+#include <opencv2/highgui/highgui.hpp>
+
+using namespace std;
+
+namespace ORB_SLAM2
+{
+
+FrameSource::FrameSource(const string &strSettingsFile, const int nCapacity, const int nThreads):
+    mbRGB(false), mnCapacity(max(nCapacity,1)), mnNextFile(0), mbFiles(false), mnDropped(0), mbFinish(false)
+{
+    cv::FileStorage fSettings(strSettingsFile.c_str(), cv::FileStorage::READ);
+    if(fSettings.isOpened())
+    {
+        int nRGB = fSettings["Camera.RGB"];
+        mbRGB = nRGB;
+    }
+
+    const int N = max(nThreads,1);
+    mvThreads.reserve(N);
+    for(int i=0; i<N; i++)
+        mvThreads.push_back(thread(&FrameSource::Run,this));
+}
+
+FrameSource::~FrameSource()
+{
+    RequestFinish();
+    for(size_t i=0; i<mvThreads.size(); i++)
+        mvThreads[i].join();
+}
+
+void FrameSource::SetRectification(const cv::Mat &M1l, const cv::Mat &M2l, const cv::Mat &M1r, const cv::Mat &M2r)
+{
+    unique_lock<mutex> lock(mMutex);
+    mM1l = M1l;
+    mM2l = M2l;
+    mM1r = M1r;
+    mM2r = M2r;
+}
+
+void FrameSource::SetFiles(const vector<string> &vstrImages, const vector<string> &vstrImages2,
+                           const vector<double> &vTimestamps)
+{
+    {
+        unique_lock<mutex> lock(mMutex);
+        mvstrFiles = vstrImages;
+        mvstrFiles2 = vstrImages2;
+        mvTimestamps = vTimestamps;
+        mnNextFile = 0;
+        mbFiles = true;
+    }
+    mcvWork.notify_all();
+}
+
+void FrameSource::Push(const cv::Mat &im, const cv::Mat &im2, const double &timestamp)
+{
+    shared_ptr<Slot> pSlot = make_shared<Slot>();
+    pSlot->frame.im = im;
+    pSlot->frame.im2 = im2;
+    pSlot->frame.timestamp = timestamp;
+    pSlot->bTaken = false;
+    pSlot->bReady = false;
+
+    {
+        unique_lock<mutex> lock(mMutex);
+        if(mdSlots.size()>=mnCapacity)
+        {
+            mdSlots.pop_front();
+            mnDropped++;
+        }
+        mdSlots.push_back(pSlot);
+    }
+    mcvWork.notify_one();
+}
+
+bool FrameSource::Pop(InputFrame &frame)
+{
+    shared_ptr<Slot> pSlot;
+    {
+        unique_lock<mutex> lock(mMutex);
+        while(1)
+        {
+            if(mbFinish)
+                return false;
+
+            if(!mdSlots.empty() && mdSlots.front()->bReady)
+                break;
+
+            if(mbFiles && mdSlots.empty() && mnNextFile>=mvstrFiles.size())
+                return false;
+
+            mcvReady.wait(lock);
+        }
+
+        pSlot = mdSlots.front();
+        mdSlots.pop_front();
+    }
+
+    // There is room for one more frame
+    mcvWork.notify_one();
+
+    frame = std::move(pSlot->frame);
+    return true;
+}
+
+void FrameSource::WaitUntilFull()
+{
+    unique_lock<mutex> lock(mMutex);
+    while(!mbFinish)
+    {
+        bool bAllReady = true;
+        for(deque<shared_ptr<Slot> >::iterator it=mdSlots.begin(); it!=mdSlots.end(); it++)
+            bAllReady = bAllReady && (*it)->bReady;
+
+        if(bAllReady && (mdSlots.size()>=mnCapacity || (mbFiles && mnNextFile>=mvstrFiles.size())))
+            break;
+
+        mcvReady.wait(lock);
+    }
+}
+
+void FrameSource::RequestFinish()
+{
+    {
+        unique_lock<mutex> lock(mMutex);
+        mbFinish = true;
+    }
+    mcvWork.notify_all();
+    mcvReady.notify_all();
+}
+
+int FrameSource::GetDropped()
+{
+    unique_lock<mutex> lock(mMutex);
+    return mnDropped;
+}
+
+void FrameSource::Run()
+{
+    while(1)
+    {
+        shared_ptr<Slot> pSlot;
+        {
+            unique_lock<mutex> lock(mMutex);
+            while(!mbFinish)
+            {
+                // Oldest frame that nobody is decoding
+                for(deque<shared_ptr<Slot> >::iterator it=mdSlots.begin(); it!=mdSlots.end(); it++)
+                {
+                    if(!(*it)->bTaken)
+                    {
+                        pSlot = *it;
+                        break;
+                    }
+                }
+
+                if(pSlot)
+                    break;
+
+                // Next file of the sequence, if there is room for it
+                if(mnNextFile<mvstrFiles.size() && mdSlots.size()<mnCapacity)
+                {
+                    pSlot = make_shared<Slot>();
+                    pSlot->strFile = mvstrFiles[mnNextFile];
+                    if(!mvstrFiles2.empty())
+                        pSlot->strFile2 = mvstrFiles2[mnNextFile];
+                    pSlot->frame.timestamp = mvTimestamps[mnNextFile];
+                    pSlot->bReady = false;
+                    mdSlots.push_back(pSlot);
+                    mnNextFile++;
+                    break;
+                }
+
+                mcvWork.wait(lock);
+            }
+
+            if(mbFinish)
+                return;
+
+            pSlot->bTaken = true;
+        }
+
+        // The slot is only touched by this worker until it is marked as ready
+        Process(*pSlot);
+
+        {
+            unique_lock<mutex> lock(mMutex);
+            pSlot->bReady = true;
+        }
+        mcvReady.notify_all();
+    }
+}
+
+void FrameSource::Process(Slot &slot)
+{
+    InputFrame &frame = slot.frame;
+
+    if(!slot.strFile.empty())
+    {
+        frame.im = cv::imread(slot.strFile,CV_LOAD_IMAGE_UNCHANGED);
+        if(frame.im.empty())
+        {
+            cerr << endl << "Failed to load image at: " << slot.strFile << endl;
+            return;
+        }
+
+        if(!slot.strFile2.empty())
+        {
+            frame.im2 = cv::imread(slot.strFile2,CV_LOAD_IMAGE_UNCHANGED);
+            if(frame.im2.empty())
+            {
+                cerr << endl << "Failed to load image at: " << slot.strFile2 << endl;
+                frame.im.release();
+                return;
+            }
+        }
+    }
+
+    if(!mM1l.empty() && !frame.im.empty() && !frame.im2.empty())
+    {
+        cv::Mat imRect, imRect2;
+        cv::remap(frame.im,imRect,mM1l,mM2l,cv::INTER_LINEAR);
+        cv::remap(frame.im2,imRect2,mM1r,mM2r,cv::INTER_LINEAR);
+        frame.im = imRect;
+        frame.im2 = imRect2;
+    }
+
+    // Same conversion as Tracking, which then uses the images as they are.
+    // Depthmaps have a single channel and are left untouched.
+    ToGray(frame.im);
+    ToGray(frame.im2);
+}
+
+void FrameSource::ToGray(cv::Mat &im)
+{
+    if(im.channels()==3)
+    {
+        if(mbRGB)
+            cvtColor(im,im,CV_RGB2GRAY);
+        else
+            cvtColor(im,im,CV_BGR2GRAY);
+    }
+    else if(im.channels()==4)
+    {
+        if(mbRGB)
+            cvtColor(im,im,CV_RGBA2GRAY);
+        else
+            cvtColor(im,im,CV_BGRA2GRAY);
+    }
+}
+
+} //namespace ORB_SLAM
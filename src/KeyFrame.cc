@@ -19,7 +19,6 @@
 */
 
 #include "KeyFrame.h"
-#include "Converter.h"
 #include "ORBmatcher.h"
 #include<mutex>
 
@@ -27,6 +26,7 @@ namespace ORB_SLAM2
 {
 
 long unsigned int KeyFrame::nNextId=0;
+atomic<long unsigned int> KeyFrame::nNextMapPointsVersion(0);
 
 KeyFrame::KeyFrame(Frame &F, Map *pMap, KeyFrameDatabase *pKFDB):
     mnFrameId(F.mnId),  mTimeStamp(F.mTimeStamp), mnGridCols(FRAME_GRID_COLS), mnGridRows(FRAME_GRID_ROWS),
@@ -34,90 +34,67 @@ KeyFrame::KeyFrame(Frame &F, Map *pMap, KeyFrameDatabase *pKFDB):
     mnTrackReferenceForFrame(0), mnFuseTargetForKF(0), mnBALocalForKF(0), mnBAFixedForKF(0),
     mnLoopQuery(0), mnLoopWords(0), mnRelocQuery(0), mnRelocWords(0), mnBAGlobalForKF(0),
     fx(F.fx), fy(F.fy), cx(F.cx), cy(F.cy), invfx(F.invfx), invfy(F.invfy),
-    mbf(F.mbf), mb(F.mb), mThDepth(F.mThDepth), N(F.N), mvKeys(F.mvKeys), mvKeysUn(F.mvKeysUn),
-    mvuRight(F.mvuRight), mvDepth(F.mvDepth), mDescriptors(F.mDescriptors.clone()),
-    mBowVec(F.mBowVec), mFeatVec(F.mFeatVec), mnScaleLevels(F.mnScaleLevels), mfScaleFactor(F.mfScaleFactor),
+    mbf(F.mbf), mb(F.mb), mThDepth(F.mThDepth), N(F.N), mpFeatures(F.mpFeatures),
+    mvKeys(mpFeatures->mvKeys), mvKeysUn(mpFeatures->mvKeysUn), mvuRight(mpFeatures->mvuRight),
+    mvDepth(mpFeatures->mvDepth), mDescriptors(F.mDescriptors),
+    mBowVec(mpFeatures->mBowVec), mFeatVec(mpFeatures->mFeatVec), mnScaleLevels(F.mnScaleLevels), mfScaleFactor(F.mfScaleFactor),
     mfLogScaleFactor(F.mfLogScaleFactor), mvScaleFactors(F.mvScaleFactors), mvLevelSigma2(F.mvLevelSigma2),
     mvInvLevelSigma2(F.mvInvLevelSigma2), mnMinX(F.mnMinX), mnMinY(F.mnMinY), mnMaxX(F.mnMaxX),
-    mnMaxY(F.mnMaxY), mK(F.mK), mvpMapPoints(F.mvpMapPoints), mpKeyFrameDB(pKFDB),
-    mpORBvocabulary(F.mpORBvocabulary), mbFirstConnection(true), mpParent(NULL), mbNotErase(false),
+    mnMaxY(F.mnMaxY), mK(F.mK), mDistCoef(F.mDistCoef), mvpMapPoints(F.mvpMapPoints), mpKeyFrameDB(pKFDB),
+    mpORBvocabulary(F.mpORBvocabulary), mGridStart(mpFeatures->mGridStart), mGridIndices(mpFeatures->mGridIndices),
+    mbFirstConnection(true), mpParent(NULL), mbNotErase(false),
     mbToBeErased(false), mbBad(false), mHalfBaseline(F.mb/2), mpMap(pMap)
 {
     mnId=nNextId++;
+    mnMapPointsVersion = ++nNextMapPointsVersion;
 
-    mGrid.resize(mnGridCols);
-    for(int i=0; i<mnGridCols;i++)
-    {
-        mGrid[i].resize(mnGridRows);
-        for(int j=0; j<mnGridRows; j++)
-            mGrid[i][j] = F.mGrid[i][j];
-    }
-
-    SetPose(F.mTcw);    
+    SetPose(F.GetRotation(),F.GetTranslation());
 }
 
 void KeyFrame::ComputeBoW()
 {
-    if(mBowVec.empty() || mFeatVec.empty())
-    {
-        vector<cv::Mat> vCurrentDesc = Converter::toDescriptorVector(mDescriptors);
-        // Feature vector associate features with nodes in the 4th level (from leaves up)
-        // We assume the vocabulary tree has 6 levels, change the 4 otherwise
-        mpORBvocabulary->transform(vCurrentDesc,mBowVec,mFeatVec,4);
-    }
+    mpFeatures->ComputeBoW(mpORBvocabulary,mDescriptors);
 }
 
-void KeyFrame::SetPose(const cv::Mat &Tcw_)
+void KeyFrame::SetPose(const Eigen::Matrix3f &Rcw_, const Eigen::Vector3f &tcw_)
 {
     unique_lock<mutex> lock(mMutexPose);
-    Tcw_.copyTo(Tcw);
-    cv::Mat Rcw = Tcw.rowRange(0,3).colRange(0,3);
-    cv::Mat tcw = Tcw.rowRange(0,3).col(3);
-    cv::Mat Rwc = Rcw.t();
+    Rcw = Rcw_;
+    tcw = tcw_;
+    Rwc = Rcw.transpose();
     Ow = -Rwc*tcw;
-
-    Twc = cv::Mat::eye(4,4,Tcw.type());
-    Rwc.copyTo(Twc.rowRange(0,3).colRange(0,3));
-    Ow.copyTo(Twc.rowRange(0,3).col(3));
-    cv::Mat center = (cv::Mat_<float>(4,1) << mHalfBaseline, 0 , 0, 1);
-    Cw = Twc*center;
-}
-
-cv::Mat KeyFrame::GetPose()
-{
-    unique_lock<mutex> lock(mMutexPose);
-    return Tcw.clone();
+    Cw = Rwc.col(0)*mHalfBaseline+Ow;
 }
 
-cv::Mat KeyFrame::GetPoseInverse()
+void KeyFrame::GetPose(Eigen::Matrix3f &Rcw_, Eigen::Vector3f &tcw_)
 {
     unique_lock<mutex> lock(mMutexPose);
-    return Twc.clone();
+    Rcw_ = Rcw;
+    tcw_ = tcw;
 }
 
-cv::Mat KeyFrame::GetCameraCenter()
+Eigen::Matrix3f KeyFrame::GetRotation()
 {
     unique_lock<mutex> lock(mMutexPose);
-    return Ow.clone();
+    return Rcw;
 }
 
-cv::Mat KeyFrame::GetStereoCenter()
+Eigen::Vector3f KeyFrame::GetTranslation()
 {
     unique_lock<mutex> lock(mMutexPose);
-    return Cw.clone();
+    return tcw;
 }
 
-
-cv::Mat KeyFrame::GetRotation()
+Eigen::Vector3f KeyFrame::GetCameraCenter()
 {
     unique_lock<mutex> lock(mMutexPose);
-    return Tcw.rowRange(0,3).colRange(0,3).clone();
+    return Ow;
 }
 
-cv::Mat KeyFrame::GetTranslation()
+Eigen::Vector3f KeyFrame::GetStereoCenter()
 {
     unique_lock<mutex> lock(mMutexPose);
-    return Tcw.rowRange(0,3).col(3).clone();
+    return Cw;
 }
 
 void KeyFrame::AddConnection(KeyFrame *pKF, const int &weight)
@@ -211,25 +188,33 @@ void KeyFrame::AddMapPoint(MapPoint *pMP, const size_t &idx)
 {
     unique_lock<mutex> lock(mMutexFeatures);
     mvpMapPoints[idx]=pMP;
+    mnMapPointsVersion = ++nNextMapPointsVersion;
 }
 
 void KeyFrame::EraseMapPointMatch(const size_t &idx)
 {
     unique_lock<mutex> lock(mMutexFeatures);
     mvpMapPoints[idx]=static_cast<MapPoint*>(NULL);
+    mnMapPointsVersion = ++nNextMapPointsVersion;
 }
 
 void KeyFrame::EraseMapPointMatch(MapPoint* pMP)
 {
     int idx = pMP->GetIndexInKeyFrame(this);
     if(idx>=0)
+    {
+        unique_lock<mutex> lock(mMutexFeatures);
         mvpMapPoints[idx]=static_cast<MapPoint*>(NULL);
+        mnMapPointsVersion = ++nNextMapPointsVersion;
+    }
 }
 
 
 void KeyFrame::ReplaceMapPointMatch(const size_t &idx, MapPoint* pMP)
 {
+    unique_lock<mutex> lock(mMutexFeatures);
     mvpMapPoints[idx]=pMP;
+    mnMapPointsVersion = ++nNextMapPointsVersion;
 }
 
 set<MapPoint*> KeyFrame::GetMapPoints()
@@ -280,6 +265,22 @@ vector<MapPoint*> KeyFrame::GetMapPointMatches()
     return mvpMapPoints;
 }
 
+void KeyFrame::GetMapPointMatches(vector<MapPoint*> &vpMPs, long unsigned int &nVersion)
+{
+    unique_lock<mutex> lock(mMutexFeatures);
+    vpMPs.clear();
+    for(size_t i=0, iend=mvpMapPoints.size(); i<iend; i++)
+        if(mvpMapPoints[i])
+            vpMPs.push_back(mvpMapPoints[i]);
+    nVersion = mnMapPointsVersion;
+}
+
+long unsigned int KeyFrame::GetMapPointsVersion()
+{
+    unique_lock<mutex> lock(mMutexFeatures);
+    return mnMapPointsVersion;
+}
+
 MapPoint* KeyFrame::GetMapPoint(const size_t &idx)
 {
     unique_lock<mutex> lock(mMutexFeatures);
@@ -535,7 +536,16 @@ void KeyFrame::SetBadFlag()
             }
 
         mpParent->EraseChild(this);
-        mTcp = Tcw*mpParent->GetPoseInverse();
+        // Tcp = Tcw*Tpw^-1
+        Eigen::Matrix3f Rpw;
+        Eigen::Vector3f tpw;
+        mpParent->GetPose(Rpw,tpw);
+        Eigen::Matrix3f Rcw_, Rcp;
+        Eigen::Vector3f tcw_;
+        GetPose(Rcw_,tcw_);
+        Rcp = Rcw_*Rpw.transpose();
+        mRcp = Rcp;
+        mtcp = tcw_-Rcp*tpw;
         mbBad = true;
     }
 
@@ -587,20 +597,24 @@ vector<size_t> KeyFrame::GetFeaturesInArea(const float &x, const float &y, const
     if(nMaxCellY<0)
         return vIndices;
 
+    if(mGridStart.empty())
+        return vIndices;
+
+    // The cells nMinCellY..nMaxCellY of a column are contiguous
     for(int ix = nMinCellX; ix<=nMaxCellX; ix++)
     {
-        for(int iy = nMinCellY; iy<=nMaxCellY; iy++)
+        const unsigned int jbegin = mGridStart[ix*mnGridRows+nMinCellY];
+        const unsigned int jend = mGridStart[ix*mnGridRows+nMaxCellY+1];
+
+        for(unsigned int j=jbegin; j<jend; j++)
         {
-            const vector<size_t> vCell = mGrid[ix][iy];
-            for(size_t j=0, jend=vCell.size(); j<jend; j++)
-            {
-                const cv::KeyPoint &kpUn = mvKeysUn[vCell[j]];
-                const float distx = kpUn.pt.x-x;
-                const float disty = kpUn.pt.y-y;
+            const size_t idx = mGridIndices[j];
+            const cv::KeyPoint &kpUn = mvKeysUn[idx];
+            const float distx = kpUn.pt.x-x;
+            const float disty = kpUn.pt.y-y;
 
-                if(fabs(distx)<r && fabs(disty)<r)
-                    vIndices.push_back(vCell[j]);
-            }
+            if(fabs(distx)<r && fabs(disty)<r)
+                vIndices.push_back(idx);
         }
     }
 
@@ -612,46 +626,40 @@ bool KeyFrame::IsInImage(const float &x, const float &y) const
     return (x>=mnMinX && x<mnMaxX && y>=mnMinY && y<mnMaxY);
 }
 
-cv::Mat KeyFrame::UnprojectStereo(int i)
+Eigen::Vector3f KeyFrame::UnprojectStereo(int i)
 {
     const float z = mvDepth[i];
-    if(z>0)
-    {
-        const float u = mvKeys[i].pt.x;
-        const float v = mvKeys[i].pt.y;
-        const float x = (u-cx)*z*invfx;
-        const float y = (v-cy)*z*invfy;
-        cv::Mat x3Dc = (cv::Mat_<float>(3,1) << x, y, z);
-
-        unique_lock<mutex> lock(mMutexPose);
-        return Twc.rowRange(0,3).colRange(0,3)*x3Dc+Twc.rowRange(0,3).col(3);
-    }
-    else
-        return cv::Mat();
+    const float u = mvKeys[i].pt.x;
+    const float v = mvKeys[i].pt.y;
+    const float x = (u-cx)*z*invfx;
+    const float y = (v-cy)*z*invfy;
+    const Eigen::Vector3f x3Dc(x,y,z);
+
+    unique_lock<mutex> lock(mMutexPose);
+    return Rwc*x3Dc+Ow;
 }
 
 float KeyFrame::ComputeSceneMedianDepth(const int q)
 {
     vector<MapPoint*> vpMapPoints;
-    cv::Mat Tcw_;
+    Eigen::Vector3f Rcw2;
+    float zcw;
     {
         unique_lock<mutex> lock(mMutexFeatures);
         unique_lock<mutex> lock2(mMutexPose);
         vpMapPoints = mvpMapPoints;
-        Tcw_ = Tcw.clone();
+        Rcw2 = Rcw.row(2).transpose();
+        zcw = tcw(2);
     }
 
     vector<float> vDepths;
     vDepths.reserve(N);
-    cv::Mat Rcw2 = Tcw_.row(2).colRange(0,3);
-    Rcw2 = Rcw2.t();
-    float zcw = Tcw_.at<float>(2,3);
     for(int i=0; i<N; i++)
     {
         if(mvpMapPoints[i])
         {
             MapPoint* pMP = mvpMapPoints[i];
-            cv::Mat x3Dw = pMP->GetWorldPos();
+            const Eigen::Vector3f x3Dw = pMP->GetWorldPos();
             float z = Rcw2.dot(x3Dw)+zcw;
             vDepths.push_back(z);
         }
@@ -22,6 +22,8 @@
 #include "LoopClosing.h"
 #include "ORBmatcher.h"
 #include "Optimizer.h"
+#include "Converter.h"
+#include "Stats.h"
 
 #include<mutex>
 
@@ -89,9 +91,10 @@ void LocalMapping::Run()
         else if(Stop())
         {
             // Safe area to stop
-            while(isStopped() && !CheckFinish())
             {
-                usleep(3000);
+                unique_lock<mutex> lock(mMutexEvents);
+                while(isStopped() && !CheckFinish())
+                    mcvEvents.wait(lock);
             }
             if(CheckFinish())
                 break;
@@ -105,17 +108,44 @@ void LocalMapping::Run()
         if(CheckFinish())
             break;
 
-        usleep(3000);
+        // Sleep until there is something to do
+        unique_lock<mutex> lock(mMutexEvents);
+        while(!HasWork())
+            mcvEvents.wait(lock);
     }
 
     SetFinish();
 }
 
+bool LocalMapping::HasWork()
+{
+    if(CheckNewKeyFrames() || CheckFinish())
+        return true;
+
+    {
+        unique_lock<mutex> lock(mMutexReset);
+        if(mbResetRequested)
+            return true;
+    }
+
+    unique_lock<mutex> lock(mMutexStop);
+    return mbStopRequested && !mbNotStop;
+}
+
+void LocalMapping::NotifyEvents()
+{
+    unique_lock<mutex> lock(mMutexEvents);
+    mcvEvents.notify_all();
+}
+
 void LocalMapping::InsertKeyFrame(KeyFrame *pKF)
 {
-    unique_lock<mutex> lock(mMutexNewKFs);
-    mlNewKeyFrames.push_back(pKF);
-    mbAbortBA=true;
+    {
+        unique_lock<mutex> lock(mMutexNewKFs);
+        mlNewKeyFrames.push_back(pKF);
+        mbAbortBA=true;
+    }
+    NotifyEvents();
 }
 
 
@@ -127,6 +157,8 @@ bool LocalMapping::CheckNewKeyFrames()
 
 void LocalMapping::ProcessNewKeyFrame()
 {
+    ScopedTimer timer(Stats::PROCESS_NEW_KF);
+
     {
         unique_lock<mutex> lock(mMutexNewKFs);
         mpCurrentKeyFrame = mlNewKeyFrames.front();
@@ -169,6 +201,8 @@ void LocalMapping::ProcessNewKeyFrame()
 
 void LocalMapping::MapPointCulling()
 {
+    ScopedTimer timer(Stats::MAPPOINT_CULLING);
+
     // Check Recent Added MapPoints
     list<MapPoint*>::iterator lit = mlpRecentAddedMapPoints.begin();
     const unsigned long int nCurrentKFid = mpCurrentKeyFrame->mnId;
@@ -206,6 +240,8 @@ void LocalMapping::MapPointCulling()
 
 void LocalMapping::CreateNewMapPoints()
 {
+    ScopedTimer timer(Stats::CREATE_NEW_MAPPOINTS);
+
     // Retrieve neighbor keyframes in covisibility graph
     int nn = 10;
     if(mbMonocular)
@@ -214,13 +250,13 @@ void LocalMapping::CreateNewMapPoints()
 
     ORBmatcher matcher(0.6,false);
 
-    cv::Mat Rcw1 = mpCurrentKeyFrame->GetRotation();
-    cv::Mat Rwc1 = Rcw1.t();
-    cv::Mat tcw1 = mpCurrentKeyFrame->GetTranslation();
-    cv::Mat Tcw1(3,4,CV_32F);
-    Rcw1.copyTo(Tcw1.colRange(0,3));
-    tcw1.copyTo(Tcw1.col(3));
-    cv::Mat Ow1 = mpCurrentKeyFrame->GetCameraCenter();
+    Eigen::Matrix3f Rcw1;
+    Eigen::Vector3f tcw1;
+    mpCurrentKeyFrame->GetPose(Rcw1,tcw1);
+    const Eigen::Matrix3f Rwc1 = Rcw1.transpose();
+    Eigen::Matrix<float,3,4> Tcw1;
+    Tcw1 << Rcw1, tcw1;
+    const Eigen::Vector3f Ow1 = mpCurrentKeyFrame->GetCameraCenter();
 
     const float &fx1 = mpCurrentKeyFrame->fx;
     const float &fy1 = mpCurrentKeyFrame->fy;
@@ -242,9 +278,8 @@ void LocalMapping::CreateNewMapPoints()
         KeyFrame* pKF2 = vpNeighKFs[i];
 
         // Check first that baseline is not too short
-        cv::Mat Ow2 = pKF2->GetCameraCenter();
-        cv::Mat vBaseline = Ow2-Ow1;
-        const float baseline = cv::norm(vBaseline);
+        const Eigen::Vector3f Ow2 = pKF2->GetCameraCenter();
+        const float baseline = (Ow2-Ow1).norm();
 
         if(!mbMonocular)
         {
@@ -261,18 +296,18 @@ void LocalMapping::CreateNewMapPoints()
         }
 
         // Compute Fundamental Matrix
-        cv::Mat F12 = ComputeF12(mpCurrentKeyFrame,pKF2);
+        const Eigen::Matrix3f F12 = ComputeF12(mpCurrentKeyFrame,pKF2);
 
         // Search matches that fullfil epipolar constraint
         vector<pair<size_t,size_t> > vMatchedIndices;
         matcher.SearchForTriangulation(mpCurrentKeyFrame,pKF2,F12,vMatchedIndices,false);
 
-        cv::Mat Rcw2 = pKF2->GetRotation();
-        cv::Mat Rwc2 = Rcw2.t();
-        cv::Mat tcw2 = pKF2->GetTranslation();
-        cv::Mat Tcw2(3,4,CV_32F);
-        Rcw2.copyTo(Tcw2.colRange(0,3));
-        tcw2.copyTo(Tcw2.col(3));
+        Eigen::Matrix3f Rcw2;
+        Eigen::Vector3f tcw2;
+        pKF2->GetPose(Rcw2,tcw2);
+        const Eigen::Matrix3f Rwc2 = Rcw2.transpose();
+        Eigen::Matrix<float,3,4> Tcw2;
+        Tcw2 << Rcw2, tcw2;
 
         const float &fx2 = pKF2->fx;
         const float &fy2 = pKF2->fy;
@@ -297,12 +332,12 @@ void LocalMapping::CreateNewMapPoints()
             bool bStereo2 = kp2_ur>=0;
 
             // Check parallax between rays
-            cv::Mat xn1 = (cv::Mat_<float>(3,1) << (kp1.pt.x-cx1)*invfx1, (kp1.pt.y-cy1)*invfy1, 1.0);
-            cv::Mat xn2 = (cv::Mat_<float>(3,1) << (kp2.pt.x-cx2)*invfx2, (kp2.pt.y-cy2)*invfy2, 1.0);
+            const Eigen::Vector3f xn1((kp1.pt.x-cx1)*invfx1, (kp1.pt.y-cy1)*invfy1, 1.0f);
+            const Eigen::Vector3f xn2((kp2.pt.x-cx2)*invfx2, (kp2.pt.y-cy2)*invfy2, 1.0f);
 
-            cv::Mat ray1 = Rwc1*xn1;
-            cv::Mat ray2 = Rwc2*xn2;
-            const float cosParallaxRays = ray1.dot(ray2)/(cv::norm(ray1)*cv::norm(ray2));
+            const Eigen::Vector3f ray1 = Rwc1*xn1;
+            const Eigen::Vector3f ray2 = Rwc2*xn2;
+            const float cosParallaxRays = ray1.dot(ray2)/(ray1.norm()*ray2.norm());
 
             float cosParallaxStereo = cosParallaxRays+1;
             float cosParallaxStereo1 = cosParallaxStereo;
@@ -315,26 +350,24 @@ void LocalMapping::CreateNewMapPoints()
 
             cosParallaxStereo = min(cosParallaxStereo1,cosParallaxStereo2);
 
-            cv::Mat x3D;
+            Eigen::Vector3f x3D;
             if(cosParallaxRays<cosParallaxStereo && cosParallaxRays>0 && (bStereo1 || bStereo2 || cosParallaxRays<0.9998))
             {
                 // Linear Triangulation Method
-                cv::Mat A(4,4,CV_32F);
-                A.row(0) = xn1.at<float>(0)*Tcw1.row(2)-Tcw1.row(0);
-                A.row(1) = xn1.at<float>(1)*Tcw1.row(2)-Tcw1.row(1);
-                A.row(2) = xn2.at<float>(0)*Tcw2.row(2)-Tcw2.row(0);
-                A.row(3) = xn2.at<float>(1)*Tcw2.row(2)-Tcw2.row(1);
+                Eigen::Matrix4f A;
+                A.row(0) = xn1(0)*Tcw1.row(2)-Tcw1.row(0);
+                A.row(1) = xn1(1)*Tcw1.row(2)-Tcw1.row(1);
+                A.row(2) = xn2(0)*Tcw2.row(2)-Tcw2.row(0);
+                A.row(3) = xn2(1)*Tcw2.row(2)-Tcw2.row(1);
 
-                cv::Mat w,u,vt;
-                cv::SVD::compute(A,w,u,vt,cv::SVD::MODIFY_A| cv::SVD::FULL_UV);
+                Eigen::JacobiSVD<Eigen::Matrix4f> svd(A,Eigen::ComputeFullV);
+                const Eigen::Vector4f x3Dh = svd.matrixV().col(3);
 
-                x3D = vt.row(3).t();
-
-                if(x3D.at<float>(3)==0)
+                if(x3Dh(3)==0)
                     continue;
 
                 // Euclidean coordinates
-                x3D = x3D.rowRange(0,3)/x3D.at<float>(3);
+                x3D = x3Dh.head<3>()/x3Dh(3);
 
             }
             else if(bStereo1 && cosParallaxStereo1<cosParallaxStereo2)
@@ -348,21 +381,19 @@ void LocalMapping::CreateNewMapPoints()
             else
                 continue; //No stereo and very low parallax
 
-            cv::Mat x3Dt = x3D.t();
-
             //Check triangulation in front of cameras
-            float z1 = Rcw1.row(2).dot(x3Dt)+tcw1.at<float>(2);
+            float z1 = Rcw1.row(2).dot(x3D)+tcw1(2);
             if(z1<=0)
                 continue;
 
-            float z2 = Rcw2.row(2).dot(x3Dt)+tcw2.at<float>(2);
+            float z2 = Rcw2.row(2).dot(x3D)+tcw2(2);
             if(z2<=0)
                 continue;
 
             //Check reprojection error in first keyframe
             const float &sigmaSquare1 = mpCurrentKeyFrame->mvLevelSigma2[kp1.octave];
-            const float x1 = Rcw1.row(0).dot(x3Dt)+tcw1.at<float>(0);
-            const float y1 = Rcw1.row(1).dot(x3Dt)+tcw1.at<float>(1);
+            const float x1 = Rcw1.row(0).dot(x3D)+tcw1(0);
+            const float y1 = Rcw1.row(1).dot(x3D)+tcw1(1);
             const float invz1 = 1.0/z1;
 
             if(!bStereo1)
@@ -388,8 +419,8 @@ void LocalMapping::CreateNewMapPoints()
 
             //Check reprojection error in second keyframe
             const float sigmaSquare2 = pKF2->mvLevelSigma2[kp2.octave];
-            const float x2 = Rcw2.row(0).dot(x3Dt)+tcw2.at<float>(0);
-            const float y2 = Rcw2.row(1).dot(x3Dt)+tcw2.at<float>(1);
+            const float x2 = Rcw2.row(0).dot(x3D)+tcw2(0);
+            const float y2 = Rcw2.row(1).dot(x3D)+tcw2(1);
             const float invz2 = 1.0/z2;
             if(!bStereo2)
             {
@@ -413,11 +444,9 @@ void LocalMapping::CreateNewMapPoints()
             }
 
             //Check scale consistency
-            cv::Mat normal1 = x3D-Ow1;
-            float dist1 = cv::norm(normal1);
+            float dist1 = (x3D-Ow1).norm();
 
-            cv::Mat normal2 = x3D-Ow2;
-            float dist2 = cv::norm(normal2);
+            float dist2 = (x3D-Ow2).norm();
 
             if(dist1==0 || dist2==0)
                 continue;
@@ -453,6 +482,8 @@ void LocalMapping::CreateNewMapPoints()
 
 void LocalMapping::SearchInNeighbors()
 {
+    ScopedTimer timer(Stats::SEARCH_IN_NEIGHBORS);
+
     // Retrieve neighbor keyframes
     int nn = 10;
     if(mbMonocular)
@@ -533,44 +564,48 @@ void LocalMapping::SearchInNeighbors()
     mpCurrentKeyFrame->UpdateConnections();
 }
 
-cv::Mat LocalMapping::ComputeF12(KeyFrame *&pKF1, KeyFrame *&pKF2)
+Eigen::Matrix3f LocalMapping::ComputeF12(KeyFrame *&pKF1, KeyFrame *&pKF2)
 {
-    cv::Mat R1w = pKF1->GetRotation();
-    cv::Mat t1w = pKF1->GetTranslation();
-    cv::Mat R2w = pKF2->GetRotation();
-    cv::Mat t2w = pKF2->GetTranslation();
+    Eigen::Matrix3f R1w, R2w;
+    Eigen::Vector3f t1w, t2w;
+    pKF1->GetPose(R1w,t1w);
+    pKF2->GetPose(R2w,t2w);
 
-    cv::Mat R12 = R1w*R2w.t();
-    cv::Mat t12 = -R1w*R2w.t()*t2w+t1w;
+    const Eigen::Matrix3f R12 = R1w*R2w.transpose();
+    const Eigen::Vector3f t12 = -R12*t2w+t1w;
 
-    cv::Mat t12x = SkewSymmetricMatrix(t12);
+    const Eigen::Matrix3f t12x = SkewSymmetricMatrix(t12);
 
-    const cv::Mat &K1 = pKF1->mK;
-    const cv::Mat &K2 = pKF2->mK;
+    const Eigen::Matrix3f K1 = Converter::toMatrix3f(pKF1->mK);
+    const Eigen::Matrix3f K2 = Converter::toMatrix3f(pKF2->mK);
 
 
-    return K1.t().inv()*t12x*R12*K2.inv();
+    return K1.transpose().inverse()*t12x*R12*K2.inverse();
 }
 
 void LocalMapping::RequestStop()
 {
-    unique_lock<mutex> lock(mMutexStop);
-    mbStopRequested = true;
-    unique_lock<mutex> lock2(mMutexNewKFs);
-    mbAbortBA = true;
+    {
+        unique_lock<mutex> lock(mMutexStop);
+        mbStopRequested = true;
+        unique_lock<mutex> lock2(mMutexNewKFs);
+        mbAbortBA = true;
+    }
+    NotifyEvents();
 }
 
 bool LocalMapping::Stop()
 {
-    unique_lock<mutex> lock(mMutexStop);
-    if(mbStopRequested && !mbNotStop)
     {
+        unique_lock<mutex> lock(mMutexStop);
+        if(!mbStopRequested || mbNotStop)
+            return false;
+
         mbStopped = true;
         cout << "Local Mapping STOP" << endl;
-        return true;
     }
-
-    return false;
+    NotifyEvents();
+    return true;
 }
 
 bool LocalMapping::isStopped()
@@ -587,17 +622,20 @@ bool LocalMapping::stopRequested()
 
 void LocalMapping::Release()
 {
-    unique_lock<mutex> lock(mMutexStop);
-    unique_lock<mutex> lock2(mMutexFinish);
-    if(mbFinished)
-        return;
-    mbStopped = false;
-    mbStopRequested = false;
-    for(list<KeyFrame*>::iterator lit = mlNewKeyFrames.begin(), lend=mlNewKeyFrames.end(); lit!=lend; lit++)
-        delete *lit;
-    mlNewKeyFrames.clear();
+    {
+        unique_lock<mutex> lock(mMutexStop);
+        unique_lock<mutex> lock2(mMutexFinish);
+        if(mbFinished)
+            return;
+        mbStopped = false;
+        mbStopRequested = false;
+        for(list<KeyFrame*>::iterator lit = mlNewKeyFrames.begin(), lend=mlNewKeyFrames.end(); lit!=lend; lit++)
+            delete *lit;
+        mlNewKeyFrames.clear();
 
-    cout << "Local Mapping RELEASE" << endl;
+        cout << "Local Mapping RELEASE" << endl;
+    }
+    NotifyEvents();
 }
 
 bool LocalMapping::AcceptKeyFrames()
@@ -608,18 +646,30 @@ bool LocalMapping::AcceptKeyFrames()
 
 void LocalMapping::SetAcceptKeyFrames(bool flag)
 {
-    unique_lock<mutex> lock(mMutexAccept);
-    mbAcceptKeyFrames=flag;
+    {
+        unique_lock<mutex> lock(mMutexAccept);
+        mbAcceptKeyFrames=flag;
+    }
+
+    // Local Mapping has finished an iteration, wake up WaitUntilIdle
+    if(flag)
+        NotifyEvents();
 }
 
 bool LocalMapping::SetNotStop(bool flag)
 {
-    unique_lock<mutex> lock(mMutexStop);
+    {
+        unique_lock<mutex> lock(mMutexStop);
 
-    if(flag && mbStopped)
-        return false;
+        if(flag && mbStopped)
+            return false;
 
-    mbNotStop = flag;
+        mbNotStop = flag;
+    }
+
+    // A pending stop request can be served now
+    if(!flag)
+        NotifyEvents();
 
     return true;
 }
@@ -631,6 +681,8 @@ void LocalMapping::InterruptBA()
 
 void LocalMapping::KeyFrameCulling()
 {
+    ScopedTimer timer(Stats::KF_CULLING);
+
     // Check redundant keyframes (only local keyframes)
     // A keyframe is considered redundant if the 90% of the MapPoints it sees, are seen
     // in at least other 3 keyframes (in the same or finer scale)
@@ -691,15 +743,20 @@ void LocalMapping::KeyFrameCulling()
         }  
 
         if(nRedundantObservations>0.9*nMPs)
+        {
             pKF->SetBadFlag();
+            Stats::Count(Stats::CULLED_KEYFRAMES);
+        }
     }
 }
 
-cv::Mat LocalMapping::SkewSymmetricMatrix(const cv::Mat &v)
+Eigen::Matrix3f LocalMapping::SkewSymmetricMatrix(const Eigen::Vector3f &v)
 {
-    return (cv::Mat_<float>(3,3) <<             0, -v.at<float>(2), v.at<float>(1),
-            v.at<float>(2),               0,-v.at<float>(0),
-            -v.at<float>(1),  v.at<float>(0),              0);
+    Eigen::Matrix3f m;
+    m <<     0, -v(2),  v(1),
+          v(2),     0, -v(0),
+         -v(1),  v(0),     0;
+    return m;
 }
 
 void LocalMapping::RequestReset()
@@ -708,7 +765,10 @@ void LocalMapping::RequestReset()
         unique_lock<mutex> lock(mMutexReset);
         mbResetRequested = true;
     }
+    NotifyEvents();
 
+    // Wait until Local Mapping has served the request
+    unique_lock<mutex> lock(mMutexEvents);
     while(1)
     {
         {
@@ -716,25 +776,31 @@ void LocalMapping::RequestReset()
             if(!mbResetRequested)
                 break;
         }
-        usleep(3000);
+        mcvEvents.wait(lock);
     }
 }
 
 void LocalMapping::ResetIfRequested()
 {
-    unique_lock<mutex> lock(mMutexReset);
-    if(mbResetRequested)
     {
+        unique_lock<mutex> lock(mMutexReset);
+        if(!mbResetRequested)
+            return;
+
         mlNewKeyFrames.clear();
         mlpRecentAddedMapPoints.clear();
         mbResetRequested=false;
     }
+    NotifyEvents();
 }
 
 void LocalMapping::RequestFinish()
 {
-    unique_lock<mutex> lock(mMutexFinish);
-    mbFinishRequested = true;
+    {
+        unique_lock<mutex> lock(mMutexFinish);
+        mbFinishRequested = true;
+    }
+    NotifyEvents();
 }
 
 bool LocalMapping::CheckFinish()
@@ -745,10 +811,13 @@ bool LocalMapping::CheckFinish()
 
 void LocalMapping::SetFinish()
 {
-    unique_lock<mutex> lock(mMutexFinish);
-    mbFinished = true;    
-    unique_lock<mutex> lock2(mMutexStop);
-    mbStopped = true;
+    {
+        unique_lock<mutex> lock(mMutexFinish);
+        mbFinished = true;
+        unique_lock<mutex> lock2(mMutexStop);
+        mbStopped = true;
+    }
+    NotifyEvents();
 }
 
 bool LocalMapping::isFinished()
@@ -757,4 +826,27 @@ bool LocalMapping::isFinished()
     return mbFinished;
 }
 
+void LocalMapping::WaitUntilStopped()
+{
+    unique_lock<mutex> lock(mMutexEvents);
+    while(!isStopped())
+        mcvEvents.wait(lock);
+}
+
+void LocalMapping::WaitUntilFinished()
+{
+    unique_lock<mutex> lock(mMutexEvents);
+    while(!isFinished())
+        mcvEvents.wait(lock);
+}
+
+void LocalMapping::WaitUntilIdle()
+{
+    // The queue is popped after AcceptKeyFrames is cleared, so an empty queue with
+    // AcceptKeyFrames set means that the last keyframe has been completely processed.
+    unique_lock<mutex> lock(mMutexEvents);
+    while(!isStopped() && (CheckNewKeyFrames() || !AcceptKeyFrames()))
+        mcvEvents.wait(lock);
+}
+
 } //namespace ORB_SLAM
@@ -22,11 +22,10 @@
 
 #include "Sim3Solver.h"
 
-#include "Converter.h"
-
 #include "Optimizer.h"
 
 #include "ORBmatcher.h"
+#include "Stats.h"
 
 #include<mutex>
 #include<thread>
@@ -81,17 +80,38 @@ void LoopClosing::Run()
         if(CheckFinish())
             break;
 
-        usleep(5000);
+        // Sleep until a keyframe or a request arrives
+        unique_lock<mutex> lock(mMutexEvents);
+        while(!CheckNewKeyFrames() && !CheckFinish())
+        {
+            {
+                unique_lock<mutex> lock2(mMutexReset);
+                if(mbResetRequested)
+                    break;
+            }
+            mcvEvents.wait(lock);
+        }
     }
 
     SetFinish();
 }
 
+void LoopClosing::NotifyEvents()
+{
+    unique_lock<mutex> lock(mMutexEvents);
+    mcvEvents.notify_all();
+}
+
 void LoopClosing::InsertKeyFrame(KeyFrame *pKF)
 {
-    unique_lock<mutex> lock(mMutexLoopQueue);
-    if(pKF->mnId!=0)
+    if(pKF->mnId==0)
+        return;
+
+    {
+        unique_lock<mutex> lock(mMutexLoopQueue);
         mlpLoopKeyFrameQueue.push_back(pKF);
+    }
+    NotifyEvents();
 }
 
 bool LoopClosing::CheckNewKeyFrames()
@@ -102,6 +122,8 @@ bool LoopClosing::CheckNewKeyFrames()
 
 bool LoopClosing::DetectLoop()
 {
+    ScopedTimer timer(Stats::DETECT_LOOP);
+
     {
         unique_lock<mutex> lock(mMutexLoopQueue);
         mpCurrentKF = mlpLoopKeyFrameQueue.front();
@@ -230,6 +252,8 @@ bool LoopClosing::DetectLoop()
 
 bool LoopClosing::ComputeSim3()
 {
+    ScopedTimer timer(Stats::COMPUTE_SIM3);
+
     // For each consistent loop candidate we try to compute a Sim3
 
     const int nInitialCandidates = mvpEnoughConsistentCandidates.size();
@@ -298,7 +322,7 @@ bool LoopClosing::ComputeSim3()
             bool bNoMore;
 
             Sim3Solver* pSolver = vpSim3Solvers[i];
-            cv::Mat Scm  = pSolver->iterate(5,bNoMore,vbInliers,nInliers);
+            const bool bFound = pSolver->iterate(5,bNoMore,vbInliers,nInliers);
 
             // If Ransac reachs max. iterations discard keyframe
             if(bNoMore)
@@ -308,7 +332,7 @@ bool LoopClosing::ComputeSim3()
             }
 
             // If RANSAC returns a Sim3, perform a guided matching and optimize with all correspondences
-            if(!Scm.empty())
+            if(bFound)
             {
                 vector<MapPoint*> vpMapPointMatches(vvpMapPointMatches[i].size(), static_cast<MapPoint*>(NULL));
                 for(size_t j=0, jend=vbInliers.size(); j<jend; j++)
@@ -317,12 +341,12 @@ bool LoopClosing::ComputeSim3()
                        vpMapPointMatches[j]=vvpMapPointMatches[i][j];
                 }
 
-                cv::Mat R = pSolver->GetEstimatedRotation();
-                cv::Mat t = pSolver->GetEstimatedTranslation();
+                const Eigen::Matrix3f R = pSolver->GetEstimatedRotation();
+                const Eigen::Vector3f t = pSolver->GetEstimatedTranslation();
                 const float s = pSolver->GetEstimatedScale();
                 matcher.SearchBySim3(mpCurrentKF,pKF,vpMapPointMatches,s,R,t,7.5);
 
-                g2o::Sim3 gScm(Converter::toMatrix3d(R),Converter::toVector3d(t),s);
+                g2o::Sim3 gScm(R.cast<double>(),t.cast<double>(),s);
                 const int nInliers = Optimizer::OptimizeSim3(mpCurrentKF, pKF, vpMapPointMatches, gScm, 10, mbFixScale);
 
                 // If optimization is succesful stop ransacs and continue
@@ -330,9 +354,11 @@ bool LoopClosing::ComputeSim3()
                 {
                     bMatch = true;
                     mpMatchedKF = pKF;
-                    g2o::Sim3 gSmw(Converter::toMatrix3d(pKF->GetRotation()),Converter::toVector3d(pKF->GetTranslation()),1.0);
+                    Eigen::Matrix3f Rmw;
+                    Eigen::Vector3f tmw;
+                    pKF->GetPose(Rmw,tmw);
+                    g2o::Sim3 gSmw(Rmw.cast<double>(),tmw.cast<double>(),1.0);
                     mg2oScw = gScm*gSmw;
-                    mScw = Converter::toCvMat(mg2oScw);
 
                     mvpCurrentMatchedPoints = vpMapPointMatches;
                     break;
@@ -372,7 +398,7 @@ bool LoopClosing::ComputeSim3()
     }
 
     // Find more matches projecting with the computed Sim3
-    matcher.SearchByProjection(mpCurrentKF, mScw, mvpLoopMapPoints, mvpCurrentMatchedPoints,10);
+    matcher.SearchByProjection(mpCurrentKF, mg2oScw, mvpLoopMapPoints, mvpCurrentMatchedPoints,10);
 
     // If enough matches accept Loop
     int nTotalMatches = 0;
@@ -401,6 +427,9 @@ bool LoopClosing::ComputeSim3()
 
 void LoopClosing::CorrectLoop()
 {
+    ScopedTimer timer(Stats::CORRECT_LOOP);
+    Stats::Count(Stats::LOOPS);
+
     cout << "Loop detected!" << endl;
 
     // Send a stop signal to Local Mapping
@@ -423,10 +452,7 @@ void LoopClosing::CorrectLoop()
     }
 
     // Wait until Local Mapping has effectively stopped
-    while(!mpLocalMapper->isStopped())
-    {
-        usleep(1000);
-    }
+    mpLocalMapper->WaitUntilStopped();
 
     // Ensure current keyframe is updated
     mpCurrentKF->UpdateConnections();
@@ -437,7 +463,9 @@ void LoopClosing::CorrectLoop()
 
     KeyFrameAndPose CorrectedSim3, NonCorrectedSim3;
     CorrectedSim3[mpCurrentKF]=mg2oScw;
-    cv::Mat Twc = mpCurrentKF->GetPoseInverse();
+    Eigen::Matrix3f Rcw;
+    Eigen::Vector3f tcw;
+    mpCurrentKF->GetPose(Rcw,tcw);
 
 
     {
@@ -448,22 +476,22 @@ void LoopClosing::CorrectLoop()
         {
             KeyFrame* pKFi = *vit;
 
-            cv::Mat Tiw = pKFi->GetPose();
+            Eigen::Matrix3f Riw;
+            Eigen::Vector3f tiw;
+            pKFi->GetPose(Riw,tiw);
 
             if(pKFi!=mpCurrentKF)
             {
-                cv::Mat Tic = Tiw*Twc;
-                cv::Mat Ric = Tic.rowRange(0,3).colRange(0,3);
-                cv::Mat tic = Tic.rowRange(0,3).col(3);
-                g2o::Sim3 g2oSic(Converter::toMatrix3d(Ric),Converter::toVector3d(tic),1.0);
+                // Tic = Tiw*Twc
+                const Eigen::Matrix3f Ric = Riw*Rcw.transpose();
+                const Eigen::Vector3f tic = tiw-Ric*tcw;
+                g2o::Sim3 g2oSic(Ric.cast<double>(),tic.cast<double>(),1.0);
                 g2o::Sim3 g2oCorrectedSiw = g2oSic*mg2oScw;
                 //Pose corrected with the Sim3 of the loop closure
                 CorrectedSim3[pKFi]=g2oCorrectedSiw;
             }
 
-            cv::Mat Riw = Tiw.rowRange(0,3).colRange(0,3);
-            cv::Mat tiw = Tiw.rowRange(0,3).col(3);
-            g2o::Sim3 g2oSiw(Converter::toMatrix3d(Riw),Converter::toVector3d(tiw),1.0);
+            g2o::Sim3 g2oSiw(Riw.cast<double>(),tiw.cast<double>(),1.0);
             //Pose without correction
             NonCorrectedSim3[pKFi]=g2oSiw;
         }
@@ -489,12 +517,10 @@ void LoopClosing::CorrectLoop()
                     continue;
 
                 // Project with non-corrected pose and project back with corrected pose
-                cv::Mat P3Dw = pMPi->GetWorldPos();
-                Eigen::Matrix<double,3,1> eigP3Dw = Converter::toVector3d(P3Dw);
+                Eigen::Matrix<double,3,1> eigP3Dw = pMPi->GetWorldPos().cast<double>();
                 Eigen::Matrix<double,3,1> eigCorrectedP3Dw = g2oCorrectedSwi.map(g2oSiw.map(eigP3Dw));
 
-                cv::Mat cvCorrectedP3Dw = Converter::toCvMat(eigCorrectedP3Dw);
-                pMPi->SetWorldPos(cvCorrectedP3Dw);
+                pMPi->SetWorldPos(Eigen::Vector3f(eigCorrectedP3Dw.cast<float>()));
                 pMPi->mnCorrectedByKF = mpCurrentKF->mnId;
                 pMPi->mnCorrectedReference = pKFi->mnId;
                 pMPi->UpdateNormalAndDepth();
@@ -507,9 +533,7 @@ void LoopClosing::CorrectLoop()
 
             eigt *=(1./s); //[R t/s;0 1]
 
-            cv::Mat correctedTiw = Converter::toCvSE3(eigR,eigt);
-
-            pKFi->SetPose(correctedTiw);
+            pKFi->SetPose(eigR.cast<float>(),eigt.cast<float>());
 
             // Make sure connections are updated
             pKFi->UpdateConnections();
@@ -592,11 +616,10 @@ void LoopClosing::SearchAndFuse(const KeyFrameAndPose &CorrectedPosesMap)
     {
         KeyFrame* pKF = mit->first;
 
-        g2o::Sim3 g2oScw = mit->second;
-        cv::Mat cvScw = Converter::toCvMat(g2oScw);
+        const g2o::Sim3 &g2oScw = mit->second;
 
         vector<MapPoint*> vpReplacePoints(mvpLoopMapPoints.size(),static_cast<MapPoint*>(NULL));
-        matcher.Fuse(pKF,cvScw,mvpLoopMapPoints,4,vpReplacePoints);
+        matcher.Fuse(pKF,g2oScw,mvpLoopMapPoints,4,vpReplacePoints);
 
         // Get Map Mutex
         unique_lock<mutex> lock(mpMap->mMutexMapUpdate);
@@ -619,7 +642,10 @@ void LoopClosing::RequestReset()
         unique_lock<mutex> lock(mMutexReset);
         mbResetRequested = true;
     }
+    NotifyEvents();
 
+    // Wait until Loop Closing has served the request
+    unique_lock<mutex> lock(mMutexEvents);
     while(1)
     {
         {
@@ -627,19 +653,22 @@ void LoopClosing::RequestReset()
         if(!mbResetRequested)
             break;
         }
-        usleep(5000);
+        mcvEvents.wait(lock);
     }
 }
 
 void LoopClosing::ResetIfRequested()
 {
-    unique_lock<mutex> lock(mMutexReset);
-    if(mbResetRequested)
     {
+        unique_lock<mutex> lock(mMutexReset);
+        if(!mbResetRequested)
+            return;
+
         mlpLoopKeyFrameQueue.clear();
         mLastLoopKFid=0;
         mbResetRequested=false;
     }
+    NotifyEvents();
 }
 
 void LoopClosing::RunGlobalBundleAdjustment(unsigned long nLoopKF)
@@ -663,12 +692,8 @@ void LoopClosing::RunGlobalBundleAdjustment(unsigned long nLoopKF)
             cout << "Global Bundle Adjustment finished" << endl;
             cout << "Updating map ..." << endl;
             mpLocalMapper->RequestStop();
-            // Wait until Local Mapping has effectively stopped
-
-            while(!mpLocalMapper->isStopped() && !mpLocalMapper->isFinished())
-            {
-                usleep(1000);
-            }
+            // Wait until Local Mapping has effectively stopped (or finished)
+            mpLocalMapper->WaitUntilStopped();
 
             // Get Map Mutex
             unique_lock<mutex> lock(mpMap->mMutexMapUpdate);
@@ -680,22 +705,31 @@ void LoopClosing::RunGlobalBundleAdjustment(unsigned long nLoopKF)
             {
                 KeyFrame* pKF = lpKFtoCheck.front();
                 const set<KeyFrame*> sChilds = pKF->GetChilds();
-                cv::Mat Twc = pKF->GetPoseInverse();
+                Eigen::Matrix3f Rcw;
+                Eigen::Vector3f tcw;
+                pKF->GetPose(Rcw,tcw);
                 for(set<KeyFrame*>::const_iterator sit=sChilds.begin();sit!=sChilds.end();sit++)
                 {
                     KeyFrame* pChild = *sit;
                     if(pChild->mnBAGlobalForKF!=nLoopKF)
                     {
-                        cv::Mat Tchildc = pChild->GetPose()*Twc;
-                        pChild->mTcwGBA = Tchildc*pKF->mTcwGBA;//*Tcorc*pKF->mTcwGBA;
+                        // Tchildc = Tchildw*Twc
+                        Eigen::Matrix3f Rchildw;
+                        Eigen::Vector3f tchildw;
+                        pChild->GetPose(Rchildw,tchildw);
+                        const Eigen::Matrix3f Rchildc = Rchildw*Rcw.transpose();
+                        const Eigen::Vector3f tchildc = tchildw-Rchildc*tcw;
+                        pChild->mRcwGBA = Rchildc*pKF->mRcwGBA;
+                        pChild->mtcwGBA = Rchildc*pKF->mtcwGBA+tchildc;
                         pChild->mnBAGlobalForKF=nLoopKF;
 
                     }
                     lpKFtoCheck.push_back(pChild);
                 }
 
-                pKF->mTcwBefGBA = pKF->GetPose();
-                pKF->SetPose(pKF->mTcwGBA);
+                pKF->mRcwBefGBA = Rcw;
+                pKF->mtcwBefGBA = tcw;
+                pKF->SetPose(pKF->mRcwGBA,pKF->mtcwGBA);
                 lpKFtoCheck.pop_front();
             }
 
@@ -723,16 +757,14 @@ void LoopClosing::RunGlobalBundleAdjustment(unsigned long nLoopKF)
                         continue;
 
                     // Map to non-corrected camera
-                    cv::Mat Rcw = pRefKF->mTcwBefGBA.rowRange(0,3).colRange(0,3);
-                    cv::Mat tcw = pRefKF->mTcwBefGBA.rowRange(0,3).col(3);
-                    cv::Mat Xc = Rcw*pMP->GetWorldPos()+tcw;
+                    const Eigen::Vector3f Xc = pRefKF->mRcwBefGBA*pMP->GetWorldPos()+pRefKF->mtcwBefGBA;
 
                     // Backproject using corrected camera
-                    cv::Mat Twc = pRefKF->GetPoseInverse();
-                    cv::Mat Rwc = Twc.rowRange(0,3).colRange(0,3);
-                    cv::Mat twc = Twc.rowRange(0,3).col(3);
+                    Eigen::Matrix3f Rcw;
+                    Eigen::Vector3f tcw;
+                    pRefKF->GetPose(Rcw,tcw);
 
-                    pMP->SetWorldPos(Rwc*Xc+twc);
+                    pMP->SetWorldPos(Eigen::Vector3f(Rcw.transpose()*(Xc-tcw)));
                 }
             }            
 
@@ -746,12 +778,16 @@ void LoopClosing::RunGlobalBundleAdjustment(unsigned long nLoopKF)
         mbFinishedGBA = true;
         mbRunningGBA = false;
     }
+    NotifyEvents();
 }
 
 void LoopClosing::RequestFinish()
 {
-    unique_lock<mutex> lock(mMutexFinish);
-    mbFinishRequested = true;
+    {
+        unique_lock<mutex> lock(mMutexFinish);
+        mbFinishRequested = true;
+    }
+    NotifyEvents();
 }
 
 bool LoopClosing::CheckFinish()
@@ -762,8 +798,11 @@ bool LoopClosing::CheckFinish()
 
 void LoopClosing::SetFinish()
 {
-    unique_lock<mutex> lock(mMutexFinish);
-    mbFinished = true;
+    {
+        unique_lock<mutex> lock(mMutexFinish);
+        mbFinished = true;
+    }
+    NotifyEvents();
 }
 
 bool LoopClosing::isFinished()
@@ -772,5 +811,12 @@ bool LoopClosing::isFinished()
     return mbFinished;
 }
 
+void LoopClosing::WaitUntilFinished()
+{
+    unique_lock<mutex> lock(mMutexEvents);
+    while(!isFinished() || isRunningGBA())
+        mcvEvents.wait(lock);
+}
+
 
 } //namespace ORB_SLAM
@@ -29,16 +29,18 @@ namespace ORB_SLAM2
 {
 
 long unsigned int MapPoint::nNextId=0;
+atomic<long unsigned int> MapPoint::nNextVersion(0);
 mutex MapPoint::mGlobalMutex;
 
-MapPoint::MapPoint(const cv::Mat &Pos, KeyFrame *pRefKF, Map* pMap):
+MapPoint::MapPoint(const Eigen::Vector3f &Pos, KeyFrame *pRefKF, Map* pMap):
     mnFirstKFid(pRefKF->mnId), mnFirstFrame(pRefKF->mnFrameId), nObs(0), mnTrackReferenceForFrame(0),
     mnLastFrameSeen(0), mnBALocalForKF(0), mnFuseCandidateForKF(0), mnLoopPointForKF(0), mnCorrectedByKF(0),
     mnCorrectedReference(0), mnBAGlobalForKF(0), mpRefKF(pRefKF), mnVisible(1), mnFound(1), mbBad(false),
     mpReplaced(static_cast<MapPoint*>(NULL)), mfMinDistance(0), mfMaxDistance(0), mpMap(pMap)
 {
-    Pos.copyTo(mWorldPos);
-    mNormalVector = cv::Mat::zeros(3,1,CV_32F);
+    mnObservationsVersion = ++nNextVersion;
+    mWorldPos = Pos;
+    mNormalVector.setZero();
 
     //std::cout << "MapPoint 1" << std::endl;
 
@@ -47,20 +49,19 @@ MapPoint::MapPoint(const cv::Mat &Pos, KeyFrame *pRefKF, Map* pMap):
     mnId=nNextId++;
 }
 
-MapPoint::MapPoint(const cv::Mat &Pos, Map* pMap, Frame* pFrame, const int &idxF):
+MapPoint::MapPoint(const Eigen::Vector3f &Pos, Map* pMap, Frame* pFrame, const int &idxF):
     mnFirstKFid(-1), mnFirstFrame(pFrame->mnId), nObs(0), mnTrackReferenceForFrame(0), mnLastFrameSeen(0),
     mnBALocalForKF(0), mnFuseCandidateForKF(0),mnLoopPointForKF(0), mnCorrectedByKF(0),
     mnCorrectedReference(0), mnBAGlobalForKF(0), mpRefKF(static_cast<KeyFrame*>(NULL)), mnVisible(1),
     mnFound(1), mbBad(false), mpReplaced(NULL), mpMap(pMap)
 {
-    Pos.copyTo(mWorldPos);
-    cv::Mat Ow = pFrame->GetCameraCenter();
-    mNormalVector = mWorldPos - Ow;
-    mNormalVector = mNormalVector/cv::norm(mNormalVector);
-
-    cv::Mat PC = Pos - Ow;
-    const float dist = cv::norm(PC);
-    const int level = pFrame->mvKeysUn[idxF].octave;
+    mnObservationsVersion = ++nNextVersion;
+    mWorldPos = Pos;
+    const Eigen::Vector3f PC = Pos - pFrame->GetCameraCenter();
+    const float dist = PC.norm();
+    mNormalVector = PC/dist;
+
+    const int level = pFrame->mpFeatures->mvKeysUn[idxF].octave;
     const float levelScaleFactor =  pFrame->mvScaleFactors[level];
     const int nLevels = pFrame->mnScaleLevels;
 
@@ -74,23 +75,31 @@ MapPoint::MapPoint(const cv::Mat &Pos, Map* pMap, Frame* pFrame, const int &idxF
     mnId=nNextId++;
 }
 
-void MapPoint::SetWorldPos(const cv::Mat &Pos)
+void MapPoint::SetWorldPos(const Eigen::Vector3f &Pos)
 {
     unique_lock<mutex> lock2(mGlobalMutex);
     unique_lock<mutex> lock(mMutexPos);
-    Pos.copyTo(mWorldPos);
+    mWorldPos = Pos;
+}
+
+Eigen::Vector3f MapPoint::GetWorldPos()
+{
+    unique_lock<mutex> lock(mMutexPos);
+    return mWorldPos;
 }
 
-cv::Mat MapPoint::GetWorldPos()
+void MapPoint::GetWorldPos(float &x, float &y, float &z)
 {
     unique_lock<mutex> lock(mMutexPos);
-    return mWorldPos.clone();
+    x = mWorldPos(0);
+    y = mWorldPos(1);
+    z = mWorldPos(2);
 }
 
-cv::Mat MapPoint::GetNormal()
+Eigen::Vector3f MapPoint::GetNormal()
 {
     unique_lock<mutex> lock(mMutexPos);
-    return mNormalVector.clone();
+    return mNormalVector;
 }
 
 KeyFrame* MapPoint::GetReferenceKeyFrame()
@@ -105,6 +114,7 @@ void MapPoint::AddObservation(KeyFrame* pKF, size_t idx)
     if(mObservations.count(pKF))
         return;
     mObservations[pKF]=idx;
+    mnObservationsVersion = ++nNextVersion;
 
     if(pKF->mvuRight[idx]>=0)
         nObs+=2;
@@ -126,6 +136,7 @@ void MapPoint::EraseObservation(KeyFrame* pKF)
                 nObs--;
 
             mObservations.erase(pKF);
+            mnObservationsVersion = ++nNextVersion;
 
             if(mpRefKF==pKF)
                 mpRefKF=mObservations.begin()->first;
@@ -146,6 +157,22 @@ map<KeyFrame*, size_t> MapPoint::GetObservations()
     return mObservations;
 }
 
+long unsigned int MapPoint::GetObservationsVersion()
+{
+    unique_lock<mutex> lock(mMutexFeatures);
+    return mnObservationsVersion;
+}
+
+void MapPoint::GetObservingKeyFrames(vector<KeyFrame*> &vpKFs, long unsigned int &nVersion)
+{
+    unique_lock<mutex> lock(mMutexFeatures);
+    vpKFs.clear();
+    vpKFs.reserve(mObservations.size());
+    for(map<KeyFrame*,size_t>::const_iterator mit=mObservations.begin(), mend=mObservations.end(); mit!=mend; mit++)
+        vpKFs.push_back(mit->first);
+    nVersion = mnObservationsVersion;
+}
+
 int MapPoint::Observations()
 {
     unique_lock<mutex> lock(mMutexFeatures);
@@ -161,6 +188,7 @@ void MapPoint::SetBadFlag()
         mbBad=true;
         obs = mObservations;
         mObservations.clear();
+        mnObservationsVersion = ++nNextVersion;
     }
     for(map<KeyFrame*,size_t>::iterator mit=obs.begin(), mend=obs.end(); mit!=mend; mit++)
     {
@@ -190,6 +218,7 @@ void MapPoint::Replace(MapPoint* pMP)
         unique_lock<mutex> lock2(mMutexPos);
         obs=mObservations;
         mObservations.clear();
+        mnObservationsVersion = ++nNextVersion;
         mbBad=true;
         nvisible = mnVisible;
         nfound = mnFound;
@@ -335,7 +364,7 @@ void MapPoint::UpdateNormalAndDepth()
 {
     map<KeyFrame*,size_t> observations;
     KeyFrame* pRefKF;
-    cv::Mat Pos;
+    Eigen::Vector3f Pos;
     {
         unique_lock<mutex> lock1(mMutexFeatures);
         unique_lock<mutex> lock2(mMutexPos);
@@ -343,25 +372,24 @@ void MapPoint::UpdateNormalAndDepth()
             return;
         observations=mObservations;
         pRefKF=mpRefKF;
-        Pos = mWorldPos.clone();
+        Pos = mWorldPos;
     }
 
     if(observations.empty())
         return;
 
-    cv::Mat normal = cv::Mat::zeros(3,1,CV_32F);
+    Eigen::Vector3f normal = Eigen::Vector3f::Zero();
     int n=0;
     for(map<KeyFrame*,size_t>::iterator mit=observations.begin(), mend=observations.end(); mit!=mend; mit++)
     {
         KeyFrame* pKF = mit->first;
-        cv::Mat Owi = pKF->GetCameraCenter();
-        cv::Mat normali = mWorldPos - Owi;
-        normal = normal + normali/cv::norm(normali);
+        const Eigen::Vector3f normali = Pos - pKF->GetCameraCenter();
+        normal += normali/normali.norm();
         n++;
     }
 
-    cv::Mat PC = Pos - pRefKF->GetCameraCenter();
-    const float dist = cv::norm(PC);
+    const Eigen::Vector3f PC = Pos - pRefKF->GetCameraCenter();
+    const float dist = PC.norm();
     const int level = pRefKF->mvKeysUn[observations[pRefKF]].octave;
     const float levelScaleFactor =  pRefKF->mvScaleFactors[level];
     const int nLevels = pRefKF->mnScaleLevels;
@@ -386,6 +414,16 @@ float MapPoint::GetMaxDistanceInvariance()
     return 1.2f*mfMaxDistance;
 }
 
+void MapPoint::GetProjectionData(Eigen::Vector3f &Pw, Eigen::Vector3f &normal, float &minDistance, float &maxDistance, float &scaleDistance)
+{
+    unique_lock<mutex> lock(mMutexPos);
+    Pw = mWorldPos;
+    normal = mNormalVector;
+    minDistance = 0.8f*mfMinDistance;
+    maxDistance = 1.2f*mfMaxDistance;
+    scaleDistance = mfMaxDistance;
+}
+
 int MapPoint::PredictScale(const float &currentDist, KeyFrame* pKF)
 {
     float ratio;
@@ -0,0 +1,699 @@
+/**
+* This file is part of ORB-SLAM2.
+*
+* Copyright (C) 2014-2016 Raúl Mur-Artal <raulmur at unizar dot es> (University of Zaragoza)
+* For more information see <https://github.com/raulmur/ORB_SLAM2>
+*
+* ORB-SLAM2 is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM2 is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with ORB-SLAM2. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "MapSerializer.h"
+
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <cstring>
+#include <cmath>
+#include <stdint.h>
+
+using namespace std;
+
+namespace ORB_SLAM2
+{
+
+const unsigned int MapSerializer::VERSION = 2;
+
+namespace
+{
+
+const int DESCRIPTOR_BYTES = 32;
+
+struct Header
+{
+    char magic[8];
+    uint32_t version;
+    // Record sizes, to reject files written with a different layout
+    uint32_t keyFrameBytes;
+    uint32_t mapPointBytes;
+    uint32_t keyPointBytes;
+    uint32_t descriptorBytes;
+
+    uint32_t nKeyFrames;
+    uint32_t nMapPoints;
+    uint32_t nKeyPoints;
+    uint32_t nBowEntries;
+    uint32_t nFeatNodes;
+    uint32_t nFeatIndices;
+    uint32_t nConnections;
+    uint32_t nLoopEdges;
+
+    // Calibration and grid, shared by all KeyFrames
+    float fx, fy, cx, cy;
+    float k1, k2, p1, p2, k3;
+    float minX, maxX, minY, maxY;
+    float gridElementWidthInv, gridElementHeightInv;
+
+    int32_t nLevels;
+    float scaleFactor;
+};
+
+struct KeyFrameRecord
+{
+    uint64_t mnId;
+    uint64_t mnFrameId;
+    double mTimeStamp;
+    float Tcw[12];
+    float mbf, mb, mThDepth;
+    int32_t N;
+    int32_t parent;
+    uint32_t nBow;
+    uint32_t nFeatNodes;
+    uint32_t nConnections;
+    uint32_t nLoopEdges;
+    int32_t reserved;
+};
+
+struct MapPointRecord
+{
+    uint64_t mnId;
+    int64_t mnFirstKFid;
+    int64_t mnFirstFrame;
+    float pos[3];
+    float normal[3];
+    float mfMinDistance, mfMaxDistance;
+    int32_t mnVisible, mnFound;
+    int32_t refKF;
+    int32_t reserved;
+    unsigned char descriptor[DESCRIPTOR_BYTES];
+};
+
+const char MAGIC[8] = {'O','R','B','S','L','A','M','M'};
+
+bool SameValue(const float a, const float b)
+{
+    return fabs(a-b)<=1e-5f*max(1.0f,max(fabs(a),fabs(b)));
+}
+
+template<class T>
+void WriteArray(ofstream &f, const vector<T> &v)
+{
+    if(!v.empty())
+        f.write(reinterpret_cast<const char*>(&v[0]),v.size()*sizeof(T));
+}
+
+// Counts come from the file: they are checked against the bytes left before allocating,
+// so that a truncated or corrupted file is rejected instead of requesting huge arrays.
+template<class T>
+bool ReadArray(ifstream &f, vector<T> &v, const size_t n, const streamoff fileSize)
+{
+    const streamoff pos = f.tellg();
+    if(pos<0 || pos>fileSize || n>static_cast<size_t>(fileSize-pos)/sizeof(T))
+        return false;
+
+    v.resize(n);
+    if(n>0)
+        f.read(reinterpret_cast<char*>(&v[0]),n*sizeof(T));
+    return f.good();
+}
+
+} // namespace
+
+bool MapSerializer::Save(const string &filename, Map* pMap)
+{
+    vector<KeyFrame*> vpKFs;
+    vector<MapPoint*> vpMPs;
+    {
+        vector<KeyFrame*> vpAllKFs = pMap->GetAllKeyFrames();
+        for(size_t i=0; i<vpAllKFs.size(); i++)
+            if(!vpAllKFs[i]->isBad())
+                vpKFs.push_back(vpAllKFs[i]);
+
+        vector<MapPoint*> vpAllMPs = pMap->GetAllMapPoints();
+        for(size_t i=0; i<vpAllMPs.size(); i++)
+            if(!vpAllMPs[i]->isBad())
+                vpMPs.push_back(vpAllMPs[i]);
+    }
+
+    if(vpKFs.empty())
+    {
+        cerr << "There are no KeyFrames to save." << endl;
+        return false;
+    }
+
+    sort(vpKFs.begin(),vpKFs.end(),KeyFrame::lId);
+
+    map<KeyFrame*,int32_t> mKFIndices;
+    for(size_t i=0; i<vpKFs.size(); i++)
+        mKFIndices[vpKFs[i]] = i;
+    map<MapPoint*,int32_t> mMPIndices;
+    for(size_t i=0; i<vpMPs.size(); i++)
+        mMPIndices[vpMPs[i]] = i;
+
+    KeyFrame* pKF0 = vpKFs[0];
+
+    Header header;
+    memset(&header,0,sizeof(header));
+    memcpy(header.magic,MAGIC,sizeof(MAGIC));
+    header.version = VERSION;
+    header.keyFrameBytes = sizeof(KeyFrameRecord);
+    header.mapPointBytes = sizeof(MapPointRecord);
+    header.keyPointBytes = sizeof(cv::KeyPoint);
+    header.descriptorBytes = DESCRIPTOR_BYTES;
+    header.nKeyFrames = vpKFs.size();
+    header.nMapPoints = vpMPs.size();
+    header.fx = pKF0->fx;
+    header.fy = pKF0->fy;
+    header.cx = pKF0->cx;
+    header.cy = pKF0->cy;
+    header.k1 = pKF0->mDistCoef.at<float>(0);
+    header.k2 = pKF0->mDistCoef.at<float>(1);
+    header.p1 = pKF0->mDistCoef.at<float>(2);
+    header.p2 = pKF0->mDistCoef.at<float>(3);
+    header.k3 = pKF0->mDistCoef.total()>4 ? pKF0->mDistCoef.at<float>(4) : 0;
+    header.minX = pKF0->mnMinX;
+    header.maxX = pKF0->mnMaxX;
+    header.minY = pKF0->mnMinY;
+    header.maxY = pKF0->mnMaxY;
+    header.gridElementWidthInv = pKF0->mfGridElementWidthInv;
+    header.gridElementHeightInv = pKF0->mfGridElementHeightInv;
+    header.nLevels = pKF0->mnScaleLevels;
+    header.scaleFactor = pKF0->mfScaleFactor;
+
+    vector<KeyFrameRecord> vKFRecords(vpKFs.size());
+    vector<cv::KeyPoint> vKeys, vKeysUn;
+    vector<float> vuRight, vDepth;
+    vector<int32_t> vMapPointIndices;
+    vector<unsigned char> vDescriptors;
+    vector<uint32_t> vBowWords;
+    vector<double> vBowValues;
+    vector<uint32_t> vFeatNodes, vFeatCounts, vFeatIndices;
+    vector<int32_t> vConnectionKFs, vConnectionWeights;
+    vector<int32_t> vLoopEdges;
+
+    for(size_t i=0; i<vpKFs.size(); i++)
+    {
+        KeyFrame* pKF = vpKFs[i];
+        KeyFrameRecord &rec = vKFRecords[i];
+        memset(&rec,0,sizeof(rec));
+
+        if(pKF->N>0 && (pKF->mDescriptors.cols!=DESCRIPTOR_BYTES || pKF->mDescriptors.type()!=CV_8U))
+        {
+            cerr << "Unexpected descriptor size in KeyFrame " << pKF->mnId << endl;
+            return false;
+        }
+
+        rec.mnId = pKF->mnId;
+        rec.mnFrameId = pKF->mnFrameId;
+        rec.mTimeStamp = pKF->mTimeStamp;
+        Eigen::Matrix3f Rcw;
+        Eigen::Vector3f tcw;
+        pKF->GetPose(Rcw,tcw);
+        for(int r=0; r<3; r++)
+        {
+            for(int c=0; c<3; c++)
+                rec.Tcw[4*r+c] = Rcw(r,c);
+            rec.Tcw[4*r+3] = tcw(r);
+        }
+        rec.mbf = pKF->mbf;
+        rec.mb = pKF->mb;
+        rec.mThDepth = pKF->mThDepth;
+        rec.N = pKF->N;
+
+        KeyFrame* pParent = pKF->GetParent();
+        rec.parent = (pParent && mKFIndices.count(pParent)) ? mKFIndices[pParent] : -1;
+
+        // Keypoints, descriptors and associated MapPoints
+        vKeys.insert(vKeys.end(),pKF->mvKeys.begin(),pKF->mvKeys.end());
+        vKeysUn.insert(vKeysUn.end(),pKF->mvKeysUn.begin(),pKF->mvKeysUn.end());
+        vuRight.insert(vuRight.end(),pKF->mvuRight.begin(),pKF->mvuRight.end());
+        vDepth.insert(vDepth.end(),pKF->mvDepth.begin(),pKF->mvDepth.end());
+        for(int n=0; n<pKF->N; n++)
+        {
+            const unsigned char* pDesc = pKF->mDescriptors.ptr<unsigned char>(n);
+            vDescriptors.insert(vDescriptors.end(),pDesc,pDesc+DESCRIPTOR_BYTES);
+        }
+
+        const vector<MapPoint*> vpMapPointMatches = pKF->GetMapPointMatches();
+        for(int n=0; n<pKF->N; n++)
+        {
+            MapPoint* pMP = vpMapPointMatches[n];
+            map<MapPoint*,int32_t>::const_iterator mit = pMP ? mMPIndices.find(pMP) : mMPIndices.end();
+            vMapPointIndices.push_back(mit!=mMPIndices.end() ? mit->second : -1);
+        }
+
+        // Bag of Words
+        rec.nBow = pKF->mBowVec.size();
+        for(DBoW2::BowVector::const_iterator vit=pKF->mBowVec.begin(), vend=pKF->mBowVec.end(); vit!=vend; vit++)
+        {
+            vBowWords.push_back(vit->first);
+            vBowValues.push_back(vit->second);
+        }
+
+        rec.nFeatNodes = pKF->mFeatVec.size();
+        for(DBoW2::FeatureVector::const_iterator fit=pKF->mFeatVec.begin(), fend=pKF->mFeatVec.end(); fit!=fend; fit++)
+        {
+            vFeatNodes.push_back(fit->first);
+            vFeatCounts.push_back(fit->second.size());
+            vFeatIndices.insert(vFeatIndices.end(),fit->second.begin(),fit->second.end());
+        }
+
+        // Covisibility graph and loop edges
+        {
+            unique_lock<mutex> lock(pKF->mMutexConnections);
+            for(map<KeyFrame*,int>::const_iterator mit=pKF->mConnectedKeyFrameWeights.begin(), mend=pKF->mConnectedKeyFrameWeights.end(); mit!=mend; mit++)
+            {
+                map<KeyFrame*,int32_t>::const_iterator kit = mKFIndices.find(mit->first);
+                if(kit==mKFIndices.end())
+                    continue;
+                vConnectionKFs.push_back(kit->second);
+                vConnectionWeights.push_back(mit->second);
+                rec.nConnections++;
+            }
+
+            for(set<KeyFrame*>::const_iterator sit=pKF->mspLoopEdges.begin(), send=pKF->mspLoopEdges.end(); sit!=send; sit++)
+            {
+                map<KeyFrame*,int32_t>::const_iterator kit = mKFIndices.find(*sit);
+                if(kit==mKFIndices.end())
+                    continue;
+                vLoopEdges.push_back(kit->second);
+                rec.nLoopEdges++;
+            }
+        }
+    }
+
+    vector<MapPointRecord> vMPRecords(vpMPs.size());
+    for(size_t i=0; i<vpMPs.size(); i++)
+    {
+        MapPoint* pMP = vpMPs[i];
+        MapPointRecord &rec = vMPRecords[i];
+        memset(&rec,0,sizeof(rec));
+
+        rec.mnId = pMP->mnId;
+        rec.mnFirstKFid = pMP->mnFirstKFid;
+        rec.mnFirstFrame = pMP->mnFirstFrame;
+
+        {
+            unique_lock<mutex> lock(pMP->mMutexPos);
+            for(int k=0; k<3; k++)
+            {
+                rec.pos[k] = pMP->mWorldPos(k);
+                rec.normal[k] = pMP->mNormalVector(k);
+            }
+            rec.mfMinDistance = pMP->mfMinDistance;
+            rec.mfMaxDistance = pMP->mfMaxDistance;
+        }
+
+        {
+            unique_lock<mutex> lock(pMP->mMutexFeatures);
+            rec.mnVisible = pMP->mnVisible;
+            rec.mnFound = pMP->mnFound;
+            map<KeyFrame*,int32_t>::const_iterator kit = mKFIndices.find(pMP->mpRefKF);
+            rec.refKF = kit!=mKFIndices.end() ? kit->second : -1;
+            if(pMP->mDescriptor.cols==DESCRIPTOR_BYTES)
+                memcpy(rec.descriptor,pMP->mDescriptor.ptr<unsigned char>(0),DESCRIPTOR_BYTES);
+        }
+    }
+
+    header.nKeyPoints = vKeys.size();
+    header.nBowEntries = vBowWords.size();
+    header.nFeatNodes = vFeatNodes.size();
+    header.nFeatIndices = vFeatIndices.size();
+    header.nConnections = vConnectionKFs.size();
+    header.nLoopEdges = vLoopEdges.size();
+
+    vector<float> vScaleFactors = pKF0->mvScaleFactors;
+    vector<float> vLevelSigma2 = pKF0->mvLevelSigma2;
+    vector<float> vInvLevelSigma2 = pKF0->mvInvLevelSigma2;
+
+    ofstream f(filename.c_str(), ios::out | ios::binary | ios::trunc);
+    if(!f.is_open())
+        return false;
+
+    f.write(reinterpret_cast<const char*>(&header),sizeof(header));
+    WriteArray(f,vScaleFactors);
+    WriteArray(f,vLevelSigma2);
+    WriteArray(f,vInvLevelSigma2);
+    WriteArray(f,vKFRecords);
+    WriteArray(f,vMPRecords);
+    WriteArray(f,vKeys);
+    WriteArray(f,vKeysUn);
+    WriteArray(f,vuRight);
+    WriteArray(f,vDepth);
+    WriteArray(f,vMapPointIndices);
+    WriteArray(f,vDescriptors);
+    WriteArray(f,vBowWords);
+    WriteArray(f,vBowValues);
+    WriteArray(f,vFeatNodes);
+    WriteArray(f,vFeatCounts);
+    WriteArray(f,vFeatIndices);
+    WriteArray(f,vConnectionKFs);
+    WriteArray(f,vConnectionWeights);
+    WriteArray(f,vLoopEdges);
+
+    f.close();
+    if(f.fail())
+        return false;
+
+    cout << "Map saved: " << vpKFs.size() << " KeyFrames, " << vpMPs.size() << " MapPoints" << endl;
+    return true;
+}
+
+bool MapSerializer::Load(const string &filename, Map* pMap, KeyFrameDatabase* pKFDB, ORBVocabulary* pVoc,
+                         const cv::Mat &K, const cv::Mat &DistCoef, const float bf)
+{
+    ifstream f(filename.c_str(), ios::in | ios::binary);
+    if(!f.is_open())
+        return false;
+
+    f.seekg(0,ios::end);
+    const streamoff fileSize = f.tellg();
+    f.seekg(0,ios::beg);
+
+    Header header;
+    f.read(reinterpret_cast<char*>(&header),sizeof(header));
+    if(!f.good() || memcmp(header.magic,MAGIC,sizeof(MAGIC))!=0)
+    {
+        cerr << "Not a map file: " << filename << endl;
+        return false;
+    }
+
+    if(header.version!=VERSION || header.keyFrameBytes!=sizeof(KeyFrameRecord) ||
+       header.mapPointBytes!=sizeof(MapPointRecord) || header.keyPointBytes!=sizeof(cv::KeyPoint) ||
+       header.descriptorBytes!=DESCRIPTOR_BYTES)
+    {
+        cerr << "Unsupported map file version or layout: " << filename << endl;
+        return false;
+    }
+
+    if(header.nKeyFrames==0 || header.nLevels<=0 || header.nLevels>64)
+    {
+        cerr << "Corrupted map file: " << filename << endl;
+        return false;
+    }
+
+    // Read all arrays
+    vector<float> vScaleFactors, vLevelSigma2, vInvLevelSigma2;
+    vector<KeyFrameRecord> vKFRecords;
+    vector<MapPointRecord> vMPRecords;
+    vector<cv::KeyPoint> vKeys, vKeysUn;
+    vector<float> vuRight, vDepth;
+    vector<int32_t> vMapPointIndices;
+    vector<unsigned char> vDescriptors;
+    vector<uint32_t> vBowWords;
+    vector<double> vBowValues;
+    vector<uint32_t> vFeatNodes, vFeatCounts, vFeatIndices;
+    vector<int32_t> vConnectionKFs, vConnectionWeights;
+    vector<int32_t> vLoopEdges;
+
+    const size_t nKFs = header.nKeyFrames;
+    const size_t nMPs = header.nMapPoints;
+    const size_t nKPs = header.nKeyPoints;
+
+    bool bOK = ReadArray(f,vScaleFactors,header.nLevels,fileSize) &&
+               ReadArray(f,vLevelSigma2,header.nLevels,fileSize) &&
+               ReadArray(f,vInvLevelSigma2,header.nLevels,fileSize) &&
+               ReadArray(f,vKFRecords,nKFs,fileSize) &&
+               ReadArray(f,vMPRecords,nMPs,fileSize) &&
+               ReadArray(f,vKeys,nKPs,fileSize) &&
+               ReadArray(f,vKeysUn,nKPs,fileSize) &&
+               ReadArray(f,vuRight,nKPs,fileSize) &&
+               ReadArray(f,vDepth,nKPs,fileSize) &&
+               ReadArray(f,vMapPointIndices,nKPs,fileSize) &&
+               ReadArray(f,vDescriptors,nKPs*DESCRIPTOR_BYTES,fileSize) &&
+               ReadArray(f,vBowWords,header.nBowEntries,fileSize) &&
+               ReadArray(f,vBowValues,header.nBowEntries,fileSize) &&
+               ReadArray(f,vFeatNodes,header.nFeatNodes,fileSize) &&
+               ReadArray(f,vFeatCounts,header.nFeatNodes,fileSize) &&
+               ReadArray(f,vFeatIndices,header.nFeatIndices,fileSize) &&
+               ReadArray(f,vConnectionKFs,header.nConnections,fileSize) &&
+               ReadArray(f,vConnectionWeights,header.nConnections,fileSize) &&
+               ReadArray(f,vLoopEdges,header.nLoopEdges,fileSize);
+
+    // Check that all offsets and indices are consistent before creating anything
+    size_t nTotalKPs=0, nTotalBow=0, nTotalFeatNodes=0, nTotalConnections=0, nTotalLoopEdges=0;
+    for(size_t i=0; bOK && i<nKFs; i++)
+    {
+        const KeyFrameRecord &rec = vKFRecords[i];
+        bOK = rec.N>=0 && rec.parent>=-1 && rec.parent<(int32_t)nKFs;
+        nTotalKPs += rec.N;
+        nTotalBow += rec.nBow;
+        nTotalFeatNodes += rec.nFeatNodes;
+        nTotalConnections += rec.nConnections;
+        nTotalLoopEdges += rec.nLoopEdges;
+    }
+    bOK = bOK && nTotalKPs==nKPs && nTotalBow==header.nBowEntries && nTotalFeatNodes==header.nFeatNodes &&
+          nTotalConnections==header.nConnections && nTotalLoopEdges==header.nLoopEdges;
+
+    for(size_t i=0; bOK && i<nKPs; i++)
+        bOK = vMapPointIndices[i]>=-1 && vMapPointIndices[i]<(int32_t)nMPs;
+    for(size_t i=0; bOK && i<vBowWords.size(); i++)
+        bOK = vBowWords[i]<pVoc->size();
+    for(size_t i=0; bOK && i<vConnectionKFs.size(); i++)
+        bOK = vConnectionKFs[i]>=0 && vConnectionKFs[i]<(int32_t)nKFs;
+    for(size_t i=0; bOK && i<vLoopEdges.size(); i++)
+        bOK = vLoopEdges[i]>=0 && vLoopEdges[i]<(int32_t)nKFs;
+    for(size_t i=0; bOK && i<nMPs; i++)
+        bOK = vMPRecords[i].refKF>=-1 && vMPRecords[i].refKF<(int32_t)nKFs;
+
+    size_t nTotalFeatIndices=0;
+    for(size_t i=0, iFeat=0; bOK && i<nKFs; i++)
+    {
+        for(uint32_t j=0; bOK && j<vKFRecords[i].nFeatNodes; j++, iFeat++)
+        {
+            for(uint32_t k=0; bOK && k<vFeatCounts[iFeat]; k++)
+            {
+                bOK = nTotalFeatIndices+k<vFeatIndices.size() &&
+                      vFeatIndices[nTotalFeatIndices+k]<(uint32_t)vKFRecords[i].N;
+            }
+            nTotalFeatIndices += vFeatCounts[iFeat];
+        }
+    }
+    bOK = bOK && nTotalFeatIndices==header.nFeatIndices;
+
+    if(!bOK)
+    {
+        cerr << "Corrupted map file: " << filename << endl;
+        return false;
+    }
+
+    // The map can only be used with the camera it was built with: the calibration is shared
+    // by all frames, and the keypoints were undistorted with the saved coefficients
+    const float k3 = DistCoef.total()>4 ? DistCoef.at<float>(4) : 0;
+    if(!SameValue(header.fx,K.at<float>(0,0)) || !SameValue(header.fy,K.at<float>(1,1)) ||
+       !SameValue(header.cx,K.at<float>(0,2)) || !SameValue(header.cy,K.at<float>(1,2)) ||
+       !SameValue(header.k1,DistCoef.at<float>(0)) || !SameValue(header.k2,DistCoef.at<float>(1)) ||
+       !SameValue(header.p1,DistCoef.at<float>(2)) || !SameValue(header.p2,DistCoef.at<float>(3)) ||
+       !SameValue(header.k3,k3) || !SameValue(vKFRecords[0].mbf,bf))
+    {
+        cerr << "The map was built with a different camera calibration: " << filename << endl;
+        return false;
+    }
+
+    // Camera parameters are shared by all frames
+    Frame::fx = header.fx;
+    Frame::fy = header.fy;
+    Frame::cx = header.cx;
+    Frame::cy = header.cy;
+    Frame::invfx = 1.0f/header.fx;
+    Frame::invfy = 1.0f/header.fy;
+    Frame::mnMinX = header.minX;
+    Frame::mnMaxX = header.maxX;
+    Frame::mnMinY = header.minY;
+    Frame::mnMaxY = header.maxY;
+    Frame::mfGridElementWidthInv = header.gridElementWidthInv;
+    Frame::mfGridElementHeightInv = header.gridElementHeightInv;
+
+    cv::Mat KMap = cv::Mat::eye(3,3,CV_32F);
+    KMap.at<float>(0,0) = header.fx;
+    KMap.at<float>(1,1) = header.fy;
+    KMap.at<float>(0,2) = header.cx;
+    KMap.at<float>(1,2) = header.cy;
+
+    cv::Mat DistCoefMap(header.k3!=0 ? 5 : 4,1,CV_32F);
+    DistCoefMap.at<float>(0) = header.k1;
+    DistCoefMap.at<float>(1) = header.k2;
+    DistCoefMap.at<float>(2) = header.p1;
+    DistCoefMap.at<float>(3) = header.p2;
+    if(header.k3!=0)
+        DistCoefMap.at<float>(4) = header.k3;
+
+    vector<float> vInvScaleFactors(header.nLevels);
+    for(int i=0; i<header.nLevels; i++)
+        vInvScaleFactors[i] = 1.0f/vScaleFactors[i];
+
+    // KeyFrames are built through a Frame, as in Tracking
+    vector<KeyFrame*> vpKFs(nKFs);
+    vector<size_t> vKPOffsets(nKFs+1,0);
+    unsigned long maxKFid=0, maxFrameId=0;
+    for(size_t i=0, iBow=0, iFeat=0, iFeatIdx=0; i<nKFs; i++)
+    {
+        const KeyFrameRecord &rec = vKFRecords[i];
+        const size_t offset = vKPOffsets[i];
+        vKPOffsets[i+1] = offset+rec.N;
+
+        Frame F;
+        F.mpORBvocabulary = pVoc;
+        F.mpORBextractorLeft = F.mpORBextractorRight = static_cast<ORBextractor*>(NULL);
+        F.mnId = rec.mnFrameId;
+        F.mTimeStamp = rec.mTimeStamp;
+        F.mK = KMap;
+        F.mDistCoef = DistCoefMap;
+        F.mbf = rec.mbf;
+        F.mb = rec.mb;
+        F.mThDepth = rec.mThDepth;
+        F.N = rec.N;
+        FeatureData* pFeatures = new FeatureData();
+        F.mpFeatures.reset(pFeatures);
+        pFeatures->mvKeys.assign(vKeys.begin()+offset,vKeys.begin()+offset+rec.N);
+        pFeatures->mvKeysUn.assign(vKeysUn.begin()+offset,vKeysUn.begin()+offset+rec.N);
+        pFeatures->mvuRight.assign(vuRight.begin()+offset,vuRight.begin()+offset+rec.N);
+        pFeatures->mvDepth.assign(vDepth.begin()+offset,vDepth.begin()+offset+rec.N);
+        // KeyFrame shares the descriptors of the Frame, so they must own their data
+        if(rec.N>0)
+            F.mDescriptors = cv::Mat(rec.N,DESCRIPTOR_BYTES,CV_8U,&vDescriptors[offset*DESCRIPTOR_BYTES]).clone();
+        F.mvpMapPoints.assign(rec.N,static_cast<MapPoint*>(NULL));
+        F.mvbOutlier.assign(rec.N,false);
+
+        for(uint32_t j=0; j<rec.nBow; j++, iBow++)
+            pFeatures->mBowVec.insert(pFeatures->mBowVec.end(),make_pair(vBowWords[iBow],vBowValues[iBow]));
+        for(uint32_t j=0; j<rec.nFeatNodes; j++, iFeat++)
+        {
+            vector<unsigned int> &vIndices = pFeatures->mFeatVec[vFeatNodes[iFeat]];
+            vIndices.assign(vFeatIndices.begin()+iFeatIdx,vFeatIndices.begin()+iFeatIdx+vFeatCounts[iFeat]);
+            iFeatIdx += vFeatCounts[iFeat];
+        }
+
+        F.mnScaleLevels = header.nLevels;
+        F.mfScaleFactor = header.scaleFactor;
+        F.mfLogScaleFactor = log(header.scaleFactor);
+        F.mvScaleFactors = vScaleFactors;
+        F.mvInvScaleFactors = vInvScaleFactors;
+        F.mvLevelSigma2 = vLevelSigma2;
+        F.mvInvLevelSigma2 = vInvLevelSigma2;
+
+        F.AssignFeaturesToGrid(*pFeatures);
+
+        Eigen::Matrix3f Rcw;
+        Eigen::Vector3f tcw;
+        for(int r=0; r<3; r++)
+        {
+            for(int c=0; c<3; c++)
+                Rcw(r,c) = rec.Tcw[4*r+c];
+            tcw(r) = rec.Tcw[4*r+3];
+        }
+        F.SetPose(Rcw,tcw);
+
+        KeyFrame* pKF = new KeyFrame(F,pMap,pKFDB);
+        pKF->mnId = rec.mnId;
+        pKF->mbFirstConnection = false;
+        vpKFs[i] = pKF;
+
+        maxKFid = max(maxKFid,(unsigned long)rec.mnId);
+        maxFrameId = max(maxFrameId,(unsigned long)rec.mnFrameId);
+    }
+
+    // MapPoints (a point without a reference KeyFrame takes the first one observing it)
+    vector<int32_t> vRefKFs(nMPs,-1);
+    for(size_t i=0; i<nMPs; i++)
+        vRefKFs[i] = vMPRecords[i].refKF;
+    for(size_t i=0; i<nKFs; i++)
+    {
+        for(size_t n=vKPOffsets[i]; n<vKPOffsets[i+1]; n++)
+        {
+            const int32_t idx = vMapPointIndices[n];
+            if(idx>=0 && vRefKFs[idx]<0)
+                vRefKFs[idx] = i;
+        }
+    }
+
+    vector<MapPoint*> vpMPs(nMPs,static_cast<MapPoint*>(NULL));
+    unsigned long maxMPid=0;
+    for(size_t i=0; i<nMPs; i++)
+    {
+        const MapPointRecord &rec = vMPRecords[i];
+        if(vRefKFs[i]<0)
+            continue;
+
+        const Eigen::Vector3f Pos(rec.pos[0], rec.pos[1], rec.pos[2]);
+        MapPoint* pMP = new MapPoint(Pos,vpKFs[vRefKFs[i]],pMap);
+        pMP->mnId = rec.mnId;
+        pMP->mnFirstKFid = rec.mnFirstKFid;
+        pMP->mnFirstFrame = rec.mnFirstFrame;
+        pMP->mNormalVector = Eigen::Vector3f(rec.normal[0], rec.normal[1], rec.normal[2]);
+        pMP->mDescriptor = cv::Mat(1,DESCRIPTOR_BYTES,CV_8U,const_cast<unsigned char*>(rec.descriptor)).clone();
+        pMP->mfMinDistance = rec.mfMinDistance;
+        pMP->mfMaxDistance = rec.mfMaxDistance;
+        pMP->mnVisible = rec.mnVisible;
+        pMP->mnFound = rec.mnFound;
+        vpMPs[i] = pMP;
+
+        maxMPid = max(maxMPid,(unsigned long)rec.mnId);
+    }
+
+    // Observations, covisibility graph, spanning tree and loop edges
+    for(size_t i=0, iConn=0, iLoop=0; i<nKFs; i++)
+    {
+        KeyFrame* pKF = vpKFs[i];
+        const KeyFrameRecord &rec = vKFRecords[i];
+
+        for(size_t n=vKPOffsets[i]; n<vKPOffsets[i+1]; n++)
+        {
+            const int32_t idx = vMapPointIndices[n];
+            if(idx<0)
+                continue;
+            const size_t kpIdx = n-vKPOffsets[i];
+            pKF->AddMapPoint(vpMPs[idx],kpIdx);
+            vpMPs[idx]->AddObservation(pKF,kpIdx);
+        }
+
+        for(uint32_t j=0; j<rec.nConnections; j++, iConn++)
+            pKF->mConnectedKeyFrameWeights[vpKFs[vConnectionKFs[iConn]]] = vConnectionWeights[iConn];
+        pKF->UpdateBestCovisibles();
+
+        if(rec.parent>=0)
+            pKF->ChangeParent(vpKFs[rec.parent]);
+
+        for(uint32_t j=0; j<rec.nLoopEdges; j++, iLoop++)
+            pKF->AddLoopEdge(vpKFs[vLoopEdges[iLoop]]);
+    }
+
+    vector<MapPoint*> vpGoodMPs;
+    vpGoodMPs.reserve(nMPs);
+    for(size_t i=0; i<nKFs; i++)
+    {
+        pMap->AddKeyFrame(vpKFs[i]);
+        pKFDB->add(vpKFs[i]);
+    }
+    for(size_t i=0; i<nMPs; i++)
+    {
+        if(!vpMPs[i])
+            continue;
+        pMap->AddMapPoint(vpMPs[i]);
+        vpGoodMPs.push_back(vpMPs[i]);
+    }
+
+    // KeyFrames were saved sorted by id, the first one is the origin
+    pMap->mvpKeyFrameOrigins.push_back(vpKFs[0]);
+    pMap->SetReferenceMapPoints(vpGoodMPs);
+
+    // New KeyFrames, MapPoints and Frames continue after the loaded ids
+    KeyFrame::nNextId = maxKFid+1;
+    MapPoint::nNextId = maxMPid+1;
+    Frame::nNextId = maxFrameId+1;
+
+    cout << "Map loaded: " << nKFs << " KeyFrames, " << vpGoodMPs.size() << " MapPoints" << endl;
+    return true;
+}
+
+} //namespace ORB_SLAM
@@ -0,0 +1,225 @@
+/**
+* This file is part of ORB-SLAM2.
+*
+* Copyright (C) 2014-2016 Raúl Mur-Artal <raulmur at unizar dot es> (University of Zaragoza)
+* For more information see <https://github.com/raulmur/ORB_SLAM2>
+*
+* ORB-SLAM2 is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM2 is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with ORB-SLAM2. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "ORBVocabulary.h"
+#include "ORBmatcher.h"
+
+#include <algorithm>
+#include <iostream>
+
+using namespace std;
+
+namespace ORB_SLAM2
+{
+
+const unsigned int ORBVocabulary::MAX_FLAT_CHILDREN;
+
+ORBVocabulary::ORBVocabulary(): mpThreadPool(NULL)
+{
+}
+
+bool ORBVocabulary::loadFromTextFile(const string &filename)
+{
+    if(!ORBVocabularyBase::loadFromTextFile(filename))
+        return false;
+    CreateFlatTree();
+    return true;
+}
+
+bool ORBVocabulary::loadFromBinaryFile(const string &filename)
+{
+    if(!ORBVocabularyBase::loadFromBinaryFile(filename))
+        return false;
+    CreateFlatTree();
+    return true;
+}
+
+void ORBVocabulary::SetThreadPool(ThreadPool *pThreadPool)
+{
+    mpThreadPool = pThreadPool;
+}
+
+void ORBVocabulary::CreateFlatTree()
+{
+    const size_t nNodes = m_nodes.size();
+
+    mvFirstChild.clear();
+    mvChildren.clear();
+    mvChildDescriptors.clear();
+
+    // Without the flat tree Transform falls back to the transform of DBoW2
+    for(size_t i=0; i<nNodes; i++)
+    {
+        if(m_nodes[i].children.size()>MAX_FLAT_CHILDREN)
+        {
+            cerr << "Vocabulary node with more than " << MAX_FLAT_CHILDREN << " children: "
+                 << "the BoW transform of DBoW2 is used instead of the batched one." << endl;
+            return;
+        }
+    }
+
+    mvFirstChild.resize(nNodes+1);
+    mvChildren.reserve(nNodes);
+    mvChildDescriptors.reserve(nNodes);
+
+    for(size_t i=0; i<nNodes; i++)
+    {
+        mvFirstChild[i] = mvChildren.size();
+        const vector<DBoW2::NodeId> &vChildren = m_nodes[i].children;
+        for(size_t j=0; j<vChildren.size(); j++)
+        {
+            mvChildren.push_back(vChildren[j]);
+            mvChildDescriptors.push_back(m_nodes[vChildren[j]].descriptor.data);
+        }
+    }
+    mvFirstChild[nNodes] = mvChildren.size();
+}
+
+void ORBVocabulary::Transform(const cv::Mat &descriptors, DBoW2::BowVector &v, DBoW2::FeatureVector &fv, int levelsup) const
+{
+    // Vocabulary loaded through the base class
+    if(mvFirstChild.size()!=m_nodes.size()+1)
+    {
+        vector<cv::Mat> vDesc(descriptors.rows);
+        for(int i=0; i<descriptors.rows; i++)
+            vDesc[i] = descriptors.row(i);
+        transform(vDesc,v,fv,levelsup);
+        return;
+    }
+
+    v.clear();
+    fv.clear();
+
+    if(empty())
+        return;
+
+    const int N = descriptors.rows;
+
+    // level at which the node must be stored in the feature vector
+    const int nidLevel = m_L - levelsup;
+
+    // Word, weight and node of each descriptor
+    vector<DBoW2::WordId> vWordIds(N);
+    vector<DBoW2::WordValue> vWeights(N);
+    vector<DBoW2::NodeId> vNodeIds(N);
+
+    // Descriptors are independent, they are processed in blocks
+    const int nBlockSize = 64;
+    const int nBlocks = (N+nBlockSize-1)/nBlockSize;
+    const function<void(int)> f = [&](int iBlock)
+    {
+        int vDist[MAX_FLAT_CHILDREN];
+        const int iEnd = min(N,(iBlock+1)*nBlockSize);
+        for(int i=iBlock*nBlockSize; i<iEnd; i++)
+        {
+            const uchar* d = descriptors.ptr<uchar>(i);
+
+            DBoW2::NodeId nid = 0; // root
+            DBoW2::NodeId finalId = 0;
+            int currentLevel = 0;
+
+            do
+            {
+                ++currentLevel;
+
+                // Closest child, the first one on ties
+                const unsigned int first = mvFirstChild[finalId];
+                const int nChildren = mvFirstChild[finalId+1]-first;
+                ORBmatcher::DescriptorDistances(d,&mvChildDescriptors[first],nChildren,vDist);
+
+                int best = 0;
+                for(int j=1; j<nChildren; j++)
+                    if(vDist[j]<vDist[best])
+                        best = j;
+
+                finalId = mvChildren[first+best];
+
+                if(currentLevel==nidLevel)
+                    nid = finalId;
+
+            } while(mvFirstChild[finalId+1]>mvFirstChild[finalId]);
+
+            vWordIds[i] = m_nodes[finalId].word_id;
+            vWeights[i] = m_nodes[finalId].weight;
+            vNodeIds[i] = nid;
+        }
+    };
+
+    if(mpThreadPool)
+        mpThreadPool->ParallelFor(0,nBlocks,f);
+    else
+        for(int iBlock=0; iBlock<nBlocks; iBlock++)
+            f(iBlock);
+
+    // Gather the arrays into the vectors. The order of the features (and of the sums of weights) is
+    // kept by sorting (id, feature) pairs, as if they were added one by one.
+    vector<pair<unsigned int,unsigned int> > vIdFeature;
+    vIdFeature.reserve(N);
+
+    for(int i=0; i<N; i++)
+        if(vWeights[i]>0) // not stopped
+            vIdFeature.push_back(make_pair(vWordIds[i],i));
+    sort(vIdFeature.begin(),vIdFeature.end());
+
+    const bool bSum = m_weighting==DBoW2::TF || m_weighting==DBoW2::TF_IDF;
+    for(size_t i=0; i<vIdFeature.size();)
+    {
+        const DBoW2::WordId wid = vIdFeature[i].first;
+        DBoW2::WordValue w = vWeights[vIdFeature[i].second];
+        size_t j=i+1;
+        for(; j<vIdFeature.size() && vIdFeature[j].first==wid; j++)
+            if(bSum)
+                w += vWeights[vIdFeature[j].second];
+        v.insert(v.end(),make_pair(wid,w));
+        i=j;
+    }
+
+    for(size_t i=0; i<vIdFeature.size(); i++)
+        vIdFeature[i].first = vNodeIds[vIdFeature[i].second];
+    sort(vIdFeature.begin(),vIdFeature.end());
+
+    for(size_t i=0; i<vIdFeature.size();)
+    {
+        const DBoW2::NodeId nid = vIdFeature[i].first;
+        size_t j=i+1;
+        while(j<vIdFeature.size() && vIdFeature[j].first==nid)
+            j++;
+        vector<unsigned int> &vFeatures = fv.insert(fv.end(),make_pair(nid,vector<unsigned int>()))->second;
+        vFeatures.reserve(j-i);
+        for(; i<j; i++)
+            vFeatures.push_back(vIdFeature[i].second);
+    }
+
+    DBoW2::LNorm norm;
+    const bool bMustNormalize = m_scoring_object->mustNormalize(norm);
+
+    if(bSum && !v.empty() && !bMustNormalize)
+    {
+        // unnecessary when normalizing
+        const double nd = v.size();
+        for(DBoW2::BowVector::iterator vit = v.begin(); vit != v.end(); vit++)
+            vit->second /= nd;
+    }
+
+    if(bMustNormalize)
+        v.normalize(norm);
+}
+
+} //namespace ORB_SLAM
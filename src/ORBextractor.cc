@@ -59,6 +59,12 @@
 #include <opencv2/features2d/features2d.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
 #include <vector>
+#include <cstring>
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 #include "ORBextractor.h"
 
@@ -105,47 +111,90 @@ static float IC_Angle(const Mat& image, Point2f pt,  const vector<int> & u_max)
 
 
 const float factorPI = (float)(CV_PI/180.f);
-static void computeOrbDescriptor(const KeyPoint& kpt,
-                                 const Mat& img, const Point* pattern,
-                                 uchar* desc)
+
+// Offset from the keypoint center of a pattern point rotated by the keypoint angle (a=cos, b=sin)
+static inline int rotatedPatternOffset(const Point& p, const float a, const float b, const int step)
+{
+    return cvRound(p.x*b + p.y*a)*step + cvRound(p.x*a - p.y*b);
+}
+
+// Offsets of the 512 rotated pattern points: offsets[i] for the first point of test i and
+// offsets[256+i] for the second one. Both descriptor kernels sample the pixels given by this
+// scalar code, so their output does not depend on how the compiler rounds the float expressions.
+static void computeRotatedOffsets(const KeyPoint& kpt, const Point* pattern, const int step, int* offsets)
 {
     float angle = (float)kpt.angle*factorPI;
     float a = (float)cos(angle), b = (float)sin(angle);
 
-    const uchar* center = &img.at<uchar>(cvRound(kpt.pt.y), cvRound(kpt.pt.x));
-    const int step = (int)img.step;
+    for (int i = 0; i < 256; ++i)
+    {
+        offsets[i] = rotatedPatternOffset(pattern[2*i], a, b, step);
+        offsets[256+i] = rotatedPatternOffset(pattern[2*i+1], a, b, step);
+    }
+}
 
-    #define GET_VALUE(idx) \
-        center[cvRound(pattern[idx].x*b + pattern[idx].y*a)*step + \
-               cvRound(pattern[idx].x*a - pattern[idx].y*b)]
+static void computeOrbDescriptor(const KeyPoint& kpt,
+                                 const Mat& img, const Point* pattern,
+                                 uchar* desc)
+{
+    const uchar* center = &img.at<uchar>(cvRound(kpt.pt.y), cvRound(kpt.pt.x));
 
+    int offsets[512];
+    computeRotatedOffsets(kpt, pattern, (int)img.step, offsets);
 
-    for (int i = 0; i < 32; ++i, pattern += 16)
+    for (int i = 0; i < 32; ++i)
     {
-        int t0, t1, val;
-        t0 = GET_VALUE(0); t1 = GET_VALUE(1);
-        val = t0 < t1;
-        t0 = GET_VALUE(2); t1 = GET_VALUE(3);
-        val |= (t0 < t1) << 1;
-        t0 = GET_VALUE(4); t1 = GET_VALUE(5);
-        val |= (t0 < t1) << 2;
-        t0 = GET_VALUE(6); t1 = GET_VALUE(7);
-        val |= (t0 < t1) << 3;
-        t0 = GET_VALUE(8); t1 = GET_VALUE(9);
-        val |= (t0 < t1) << 4;
-        t0 = GET_VALUE(10); t1 = GET_VALUE(11);
-        val |= (t0 < t1) << 5;
-        t0 = GET_VALUE(12); t1 = GET_VALUE(13);
-        val |= (t0 < t1) << 6;
-        t0 = GET_VALUE(14); t1 = GET_VALUE(15);
-        val |= (t0 < t1) << 7;
+        int val = 0;
+        for (int k = 0; k < 8; ++k)
+        {
+            const int t = 8*i + k;
+            val |= (center[offsets[t]] < center[offsets[256+t]]) << k;
+        }
 
         desc[i] = (uchar)val;
     }
+}
+
+#if defined(__x86_64__) && defined(__GNUC__)
+
+// Same descriptor as computeOrbDescriptor, from the same rotated offsets.
+// The 256 tests are done 32 at a time with unsigned byte compares.
+__attribute__((target("avx2")))
+static void computeOrbDescriptorAVX2(const KeyPoint& kpt, const Mat& img, const Point* pattern, uchar* desc)
+{
+    const uchar* center = &img.at<uchar>(cvRound(kpt.pt.y), cvRound(kpt.pt.x));
+
+    alignas(32) int offsets[512];
+    computeRotatedOffsets(kpt, pattern, (int)img.step, offsets);
+
+    alignas(32) uchar t0[32], t1[32];
+    const __m256i sign = _mm256_set1_epi8((char)0x80);
+    for(int i=0; i<256; i+=32)
+    {
+        for(int j=0; j<32; j++)
+        {
+            t0[j] = center[offsets[i+j]];
+            t1[j] = center[offsets[256+i+j]];
+        }
+
+        // t0<t1 as unsigned bytes. Bit j of the mask is test i+j, which is the bit order of desc.
+        const __m256i v0 = _mm256_xor_si256(_mm256_load_si256(reinterpret_cast<const __m256i*>(t0)),sign);
+        const __m256i v1 = _mm256_xor_si256(_mm256_load_si256(reinterpret_cast<const __m256i*>(t1)),sign);
+        const unsigned int mask = (unsigned int)_mm256_movemask_epi8(_mm256_cmpgt_epi8(v1,v0));
+        memcpy(desc+i/8,&mask,4);
+    }
+}
 
-    #undef GET_VALUE
+static bool SelectDescriptorKernel()
+{
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
 }
 
+static const bool bDescriptorAVX2 = SelectDescriptorKernel();
+
+#endif
+
 
 static int bit_pattern_31_[256*4] =
 {
@@ -408,9 +457,9 @@ static int bit_pattern_31_[256*4] =
 };
 
 ORBextractor::ORBextractor(int _nfeatures, float _scaleFactor, int _nlevels,
-         int _iniThFAST, int _minThFAST):
+         int _iniThFAST, int _minThFAST, ThreadPool* pThreadPool):
     nfeatures(_nfeatures), scaleFactor(_scaleFactor), nlevels(_nlevels),
-    iniThFAST(_iniThFAST), minThFAST(_minThFAST)
+    iniThFAST(_iniThFAST), minThFAST(_minThFAST), mpThreadPool(pThreadPool)
 {
     mvScaleFactor.resize(nlevels);
     mvLevelSigma2.resize(nlevels);
@@ -431,6 +480,10 @@ ORBextractor::ORBextractor(int _nfeatures, float _scaleFactor, int _nlevels,
     }
 
     mvImagePyramid.resize(nlevels);
+    mvPyramidBuffer.resize(nlevels);
+    mvBlurBuffer.resize(nlevels);
+    mvScoreBuffer.resize(nlevels);
+    mvNodePools.resize(nlevels);
 
     mnFeaturesPerLevel.resize(nlevels);
     float factor = 1.0f / scaleFactor;
@@ -478,260 +531,218 @@ static void computeOrientation(const Mat& image, vector<KeyPoint>& keypoints, co
     }
 }
 
-void ExtractorNode::DivideNode(ExtractorNode &n1, ExtractorNode &n2, ExtractorNode &n3, ExtractorNode &n4)
+void ExtractorNodePool::Reset(const vector<cv::KeyPoint> &vAllKeys)
 {
-    const int halfX = ceil(static_cast<float>(UR.x-UL.x)/2);
-    const int halfY = ceil(static_cast<float>(BR.y-UL.y)/2);
+    mpAllKeys = &vAllKeys;
+    mvNodes.clear();
+    mvKeys.resize(vAllKeys.size());
+    mvBuffer.resize(vAllKeys.size());
+    mvChild.resize(vAllKeys.size());
+    mnHead = -1;
+    mnLeaves = 0;
+}
+
+int ExtractorNodePool::NewNode(const cv::Point2i &UL, const cv::Point2i &UR, const cv::Point2i &BL, const cv::Point2i &BR,
+                               const int nBegin, const int nEnd)
+{
+    ExtractorNode node;
+    node.UL = UL;
+    node.UR = UR;
+    node.BL = BL;
+    node.BR = BR;
+    node.nBegin = nBegin;
+    node.nEnd = nEnd;
+    node.bNoMore = (nEnd-nBegin)==1;
+    mvNodes.push_back(node);
+    return mvNodes.size()-1;
+}
+
+void ExtractorNodePool::DivideNode(const int idx, int vChildren[4])
+{
+    // Copy, as mvNodes grows below
+    const ExtractorNode node = mvNodes[idx];
+
+    const int halfX = ceil(static_cast<float>(node.UR.x-node.UL.x)/2);
+    const int halfY = ceil(static_cast<float>(node.BR.y-node.UL.y)/2);
 
     //Define boundaries of childs
-    n1.UL = UL;
-    n1.UR = cv::Point2i(UL.x+halfX,UL.y);
-    n1.BL = cv::Point2i(UL.x,UL.y+halfY);
-    n1.BR = cv::Point2i(UL.x+halfX,UL.y+halfY);
-    n1.vKeys.reserve(vKeys.size());
-
-    n2.UL = n1.UR;
-    n2.UR = UR;
-    n2.BL = n1.BR;
-    n2.BR = cv::Point2i(UR.x,UL.y+halfY);
-    n2.vKeys.reserve(vKeys.size());
-
-    n3.UL = n1.BL;
-    n3.UR = n1.BR;
-    n3.BL = BL;
-    n3.BR = cv::Point2i(n1.BR.x,BL.y);
-    n3.vKeys.reserve(vKeys.size());
-
-    n4.UL = n3.UR;
-    n4.UR = n2.BR;
-    n4.BL = n3.BR;
-    n4.BR = BR;
-    n4.vKeys.reserve(vKeys.size());
-
-    //Associate points to childs
-    for(size_t i=0;i<vKeys.size();i++)
+    const cv::Point2i UR1(node.UL.x+halfX,node.UL.y);
+    const cv::Point2i BL1(node.UL.x,node.UL.y+halfY);
+    const cv::Point2i BR1(node.UL.x+halfX,node.UL.y+halfY);
+    const cv::Point2i BR2(node.UR.x,node.UL.y+halfY);
+    const cv::Point2i BR3(BR1.x,node.BL.y);
+
+    //Associate points to childs (0:UL 1:UR 2:BL 3:BR, without branches as keypoints fall anywhere).
+    //The partition is stable, each child keeps the order of the parent.
+    const vector<cv::KeyPoint> &vAllKeys = *mpAllKeys;
+    const float x1 = UR1.x, y1 = BR1.y;
+    int vCount[4] = {0,0,0,0};
+    for(int i=node.nBegin; i<node.nEnd; i++)
     {
-        const cv::KeyPoint &kp = vKeys[i];
-        if(kp.pt.x<n1.UR.x)
-        {
-            if(kp.pt.y<n1.BR.y)
-                n1.vKeys.push_back(kp);
-            else
-                n3.vKeys.push_back(kp);
-        }
-        else if(kp.pt.y<n1.BR.y)
-            n2.vKeys.push_back(kp);
-        else
-            n4.vKeys.push_back(kp);
+        const cv::Point2f &pt = vAllKeys[mvKeys[i]].pt;
+        const int c = (pt.x>=x1) + 2*(pt.y>=y1);
+        mvChild[i] = c;
+        vCount[c]++;
     }
 
-    if(n1.vKeys.size()==1)
-        n1.bNoMore = true;
-    if(n2.vKeys.size()==1)
-        n2.bNoMore = true;
-    if(n3.vKeys.size()==1)
-        n3.bNoMore = true;
-    if(n4.vKeys.size()==1)
-        n4.bNoMore = true;
+    int vStart[4], vPos[4];
+    vStart[0] = vPos[0] = node.nBegin;
+    for(int c=1; c<4; c++)
+        vStart[c] = vPos[c] = vStart[c-1]+vCount[c-1];
 
+    for(int i=node.nBegin; i<node.nEnd; i++)
+        mvBuffer[vPos[mvChild[i]]++] = mvKeys[i];
+    std::copy(mvBuffer.begin()+node.nBegin, mvBuffer.begin()+node.nEnd, mvKeys.begin()+node.nBegin);
+
+    vChildren[0] = vCount[0] ? NewNode(node.UL,UR1,BL1,BR1,vStart[0],vPos[0]) : -1;
+    vChildren[1] = vCount[1] ? NewNode(UR1,node.UR,BR1,BR2,vStart[1],vPos[1]) : -1;
+    vChildren[2] = vCount[2] ? NewNode(BL1,BR1,node.BL,BR3,vStart[2],vPos[2]) : -1;
+    vChildren[3] = vCount[3] ? NewNode(BR1,BR2,BR3,node.BR,vStart[3],vPos[3]) : -1;
+}
+
+void ExtractorNodePool::PushFront(const int idx)
+{
+    ExtractorNode &node = mvNodes[idx];
+    node.nPrev = -1;
+    node.nNext = mnHead;
+    if(mnHead>=0)
+        mvNodes[mnHead].nPrev = idx;
+    mnHead = idx;
+    mnLeaves++;
+}
+
+void ExtractorNodePool::Erase(const int idx)
+{
+    ExtractorNode &node = mvNodes[idx];
+    if(node.nPrev>=0)
+        mvNodes[node.nPrev].nNext = node.nNext;
+    else
+        mnHead = node.nNext;
+    if(node.nNext>=0)
+        mvNodes[node.nNext].nPrev = node.nPrev;
+    mnLeaves--;
 }
 
 vector<cv::KeyPoint> ORBextractor::DistributeOctTree(const vector<cv::KeyPoint>& vToDistributeKeys, const int &minX,
                                        const int &maxX, const int &minY, const int &maxY, const int &N, const int &level)
 {
+    ExtractorNodePool &pool = mvNodePools[level];
+    pool.Reset(vToDistributeKeys);
+
     // Compute how many initial nodes   
     const int nIni = round(static_cast<float>(maxX-minX)/(maxY-minY));
 
     const float hX = static_cast<float>(maxX-minX)/nIni;
 
-    list<ExtractorNode> lNodes;
-
-    vector<ExtractorNode*> vpIniNodes;
-    vpIniNodes.resize(nIni);
-
+    //Associate points to the initial nodes, keeping their order
+    vector<int> vIniStart(nIni+1,0);
+    for(size_t i=0;i<vToDistributeKeys.size();i++)
+        vIniStart[static_cast<int>(vToDistributeKeys[i].pt.x/hX)+1]++;
     for(int i=0; i<nIni; i++)
-    {
-        ExtractorNode ni;
-        ni.UL = cv::Point2i(hX*static_cast<float>(i),0);
-        ni.UR = cv::Point2i(hX*static_cast<float>(i+1),0);
-        ni.BL = cv::Point2i(ni.UL.x,maxY-minY);
-        ni.BR = cv::Point2i(ni.UR.x,maxY-minY);
-        ni.vKeys.reserve(vToDistributeKeys.size());
-
-        lNodes.push_back(ni);
-        vpIniNodes[i] = &lNodes.back();
-    }
+        vIniStart[i+1] += vIniStart[i];
 
-    //Associate points to childs
+    vector<int> vIniPos(vIniStart.begin(),vIniStart.end()-1);
     for(size_t i=0;i<vToDistributeKeys.size();i++)
-    {
-        const cv::KeyPoint &kp = vToDistributeKeys[i];
-        vpIniNodes[kp.pt.x/hX]->vKeys.push_back(kp);
-    }
+        pool.mvKeys[vIniPos[static_cast<int>(vToDistributeKeys[i].pt.x/hX)]++] = i;
 
-    list<ExtractorNode>::iterator lit = lNodes.begin();
-
-    while(lit!=lNodes.end())
+    // Nodes without keypoints are not added. The list is built backwards to keep the order.
+    for(int i=nIni-1; i>=0; i--)
     {
-        if(lit->vKeys.size()==1)
-        {
-            lit->bNoMore=true;
-            lit++;
-        }
-        else if(lit->vKeys.empty())
-            lit = lNodes.erase(lit);
-        else
-            lit++;
+        if(vIniStart[i+1]==vIniStart[i])
+            continue;
+
+        const cv::Point2i UL(hX*static_cast<float>(i),0);
+        const cv::Point2i UR(hX*static_cast<float>(i+1),0);
+        const cv::Point2i BL(UL.x,maxY-minY);
+        const cv::Point2i BR(UR.x,maxY-minY);
+        pool.PushFront(pool.NewNode(UL,UR,BL,BR,vIniStart[i],vIniStart[i+1]));
     }
 
     bool bFinish = false;
 
     int iteration = 0;
 
-    vector<pair<int,ExtractorNode*> > vSizeAndPointerToNode;
-    vSizeAndPointerToNode.reserve(lNodes.size()*4);
+    vector<pair<int,int> > &vSizeAndNode = pool.mvSizeAndNode;
+    vector<pair<int,int> > &vPrevSizeAndNode = pool.mvPrevSizeAndNode;
+
+    // Adds the children of a divided node to the front of the list, and those that can be divided again to vSizeAndNode
+    int vChildren[4];
+    auto AddChildren = [&]() -> int
+    {
+        int nAdded = 0;
+        for(int c=0; c<4; c++)
+        {
+            if(vChildren[c]<0)
+                continue;
+            pool.PushFront(vChildren[c]);
+            const int nKeys = pool.mvNodes[vChildren[c]].Size();
+            if(nKeys>1)
+            {
+                vSizeAndNode.push_back(make_pair(nKeys,vChildren[c]));
+                nAdded++;
+            }
+        }
+        return nAdded;
+    };
 
     while(!bFinish)
     {
         iteration++;
 
-        int prevSize = lNodes.size();
-
-        lit = lNodes.begin();
+        int prevSize = pool.mnLeaves;
 
         int nToExpand = 0;
 
-        vSizeAndPointerToNode.clear();
+        vSizeAndNode.clear();
 
-        while(lit!=lNodes.end())
+        // Children are added at the front, so they are not visited in this pass
+        int idx = pool.mnHead;
+        while(idx>=0)
         {
-            if(lit->bNoMore)
-            {
-                // If node only contains one point do not subdivide and continue
-                lit++;
-                continue;
-            }
-            else
+            const int next = pool.mvNodes[idx].nNext;
+
+            // If node only contains one point do not subdivide and continue
+            if(!pool.mvNodes[idx].bNoMore)
             {
                 // If more than one point, subdivide
-                ExtractorNode n1,n2,n3,n4;
-                lit->DivideNode(n1,n2,n3,n4);
-
-                // Add childs if they contain points
-                if(n1.vKeys.size()>0)
-                {
-                    lNodes.push_front(n1);                    
-                    if(n1.vKeys.size()>1)
-                    {
-                        nToExpand++;
-                        vSizeAndPointerToNode.push_back(make_pair(n1.vKeys.size(),&lNodes.front()));
-                        lNodes.front().lit = lNodes.begin();
-                    }
-                }
-                if(n2.vKeys.size()>0)
-                {
-                    lNodes.push_front(n2);
-                    if(n2.vKeys.size()>1)
-                    {
-                        nToExpand++;
-                        vSizeAndPointerToNode.push_back(make_pair(n2.vKeys.size(),&lNodes.front()));
-                        lNodes.front().lit = lNodes.begin();
-                    }
-                }
-                if(n3.vKeys.size()>0)
-                {
-                    lNodes.push_front(n3);
-                    if(n3.vKeys.size()>1)
-                    {
-                        nToExpand++;
-                        vSizeAndPointerToNode.push_back(make_pair(n3.vKeys.size(),&lNodes.front()));
-                        lNodes.front().lit = lNodes.begin();
-                    }
-                }
-                if(n4.vKeys.size()>0)
-                {
-                    lNodes.push_front(n4);
-                    if(n4.vKeys.size()>1)
-                    {
-                        nToExpand++;
-                        vSizeAndPointerToNode.push_back(make_pair(n4.vKeys.size(),&lNodes.front()));
-                        lNodes.front().lit = lNodes.begin();
-                    }
-                }
-
-                lit=lNodes.erase(lit);
-                continue;
+                pool.DivideNode(idx,vChildren);
+                nToExpand += AddChildren();
+                pool.Erase(idx);
             }
-        }       
+
+            idx = next;
+        }
 
         // Finish if there are more nodes than required features
         // or all nodes contain just one point
-        if((int)lNodes.size()>=N || (int)lNodes.size()==prevSize)
+        if(pool.mnLeaves>=N || pool.mnLeaves==prevSize)
         {
             bFinish = true;
         }
-        else if(((int)lNodes.size()+nToExpand*3)>N)
+        else if((pool.mnLeaves+nToExpand*3)>N)
         {
 
             while(!bFinish)
             {
 
-                prevSize = lNodes.size();
+                prevSize = pool.mnLeaves;
 
-                vector<pair<int,ExtractorNode*> > vPrevSizeAndPointerToNode = vSizeAndPointerToNode;
-                vSizeAndPointerToNode.clear();
+                vPrevSizeAndNode.swap(vSizeAndNode);
+                vSizeAndNode.clear();
 
-                sort(vPrevSizeAndPointerToNode.begin(),vPrevSizeAndPointerToNode.end());
-                for(int j=vPrevSizeAndPointerToNode.size()-1;j>=0;j--)
+                // Largest nodes are divided first. Ties go to the node created last.
+                sort(vPrevSizeAndNode.begin(),vPrevSizeAndNode.end());
+                for(int j=vPrevSizeAndNode.size()-1;j>=0;j--)
                 {
-                    ExtractorNode n1,n2,n3,n4;
-                    vPrevSizeAndPointerToNode[j].second->DivideNode(n1,n2,n3,n4);
-
-                    // Add childs if they contain points
-                    if(n1.vKeys.size()>0)
-                    {
-                        lNodes.push_front(n1);
-                        if(n1.vKeys.size()>1)
-                        {
-                            vSizeAndPointerToNode.push_back(make_pair(n1.vKeys.size(),&lNodes.front()));
-                            lNodes.front().lit = lNodes.begin();
-                        }
-                    }
-                    if(n2.vKeys.size()>0)
-                    {
-                        lNodes.push_front(n2);
-                        if(n2.vKeys.size()>1)
-                        {
-                            vSizeAndPointerToNode.push_back(make_pair(n2.vKeys.size(),&lNodes.front()));
-                            lNodes.front().lit = lNodes.begin();
-                        }
-                    }
-                    if(n3.vKeys.size()>0)
-                    {
-                        lNodes.push_front(n3);
-                        if(n3.vKeys.size()>1)
-                        {
-                            vSizeAndPointerToNode.push_back(make_pair(n3.vKeys.size(),&lNodes.front()));
-                            lNodes.front().lit = lNodes.begin();
-                        }
-                    }
-                    if(n4.vKeys.size()>0)
-                    {
-                        lNodes.push_front(n4);
-                        if(n4.vKeys.size()>1)
-                        {
-                            vSizeAndPointerToNode.push_back(make_pair(n4.vKeys.size(),&lNodes.front()));
-                            lNodes.front().lit = lNodes.begin();
-                        }
-                    }
+                    pool.DivideNode(vPrevSizeAndNode[j].second,vChildren);
+                    AddChildren();
+                    pool.Erase(vPrevSizeAndNode[j].second);
 
-                    lNodes.erase(vPrevSizeAndPointerToNode[j].second->lit);
-
-                    if((int)lNodes.size()>=N)
+                    if(pool.mnLeaves>=N)
                         break;
                 }
 
-                if((int)lNodes.size()>=N || (int)lNodes.size()==prevSize)
+                if(pool.mnLeaves>=N || pool.mnLeaves==prevSize)
                     bFinish = true;
 
             }
@@ -741,115 +752,363 @@ vector<cv::KeyPoint> ORBextractor::DistributeOctTree(const vector<cv::KeyPoint>&
     // Retain the best point in each node
     vector<cv::KeyPoint> vResultKeys;
     vResultKeys.reserve(nfeatures);
-    for(list<ExtractorNode>::iterator lit=lNodes.begin(); lit!=lNodes.end(); lit++)
+    for(int idx=pool.mnHead; idx>=0; idx=pool.mvNodes[idx].nNext)
     {
-        vector<cv::KeyPoint> &vNodeKeys = lit->vKeys;
-        cv::KeyPoint* pKP = &vNodeKeys[0];
-        float maxResponse = pKP->response;
+        const ExtractorNode &node = pool.mvNodes[idx];
+        int bestKey = pool.mvKeys[node.nBegin];
+        float maxResponse = vToDistributeKeys[bestKey].response;
 
-        for(size_t k=1;k<vNodeKeys.size();k++)
+        for(int k=node.nBegin+1;k<node.nEnd;k++)
         {
-            if(vNodeKeys[k].response>maxResponse)
+            if(vToDistributeKeys[pool.mvKeys[k]].response>maxResponse)
             {
-                pKP = &vNodeKeys[k];
-                maxResponse = vNodeKeys[k].response;
+                bestKey = pool.mvKeys[k];
+                maxResponse = vToDistributeKeys[bestKey].response;
             }
         }
 
-        vResultKeys.push_back(*pKP);
+        vResultKeys.push_back(vToDistributeKeys[bestKey]);
     }
 
     return vResultKeys;
 }
 
-void ORBextractor::ComputeKeyPointsOctTree(vector<vector<KeyPoint> >& allKeypoints)
+// Offsets of the 16 pixels of the FAST circle, in the order of cv::FAST,
+// with the first 9 repeated so that every arc is contiguous
+static void makeFastOffsets(int pixel[25], int rowStride)
 {
-    allKeypoints.resize(nlevels);
+    static const int offsets16[16][2] =
+    {
+        {0,  3}, { 1,  3}, { 2,  2}, { 3,  1}, { 3, 0}, { 3, -1}, { 2, -2}, { 1, -3},
+        {0, -3}, {-1, -3}, {-2, -2}, {-3, -1}, {-3, 0}, {-3,  1}, {-2,  2}, {-1,  3}
+    };
+
+    for(int k=0; k<16; k++)
+        pixel[k] = offsets16[k][0] + offsets16[k][1]*rowStride;
+    for(int k=16; k<25; k++)
+        pixel[k] = pixel[k-16];
+}
 
-    const float W = 30;
+// Response of cv::FAST (cornerScore<16>). If the pixel is a corner at threshold th the response
+// is the highest threshold at which it still is one, otherwise it is lower than th.
+static int fastCornerScore(const uchar* ptr, const int pixel[], int threshold)
+{
+    const int K = 8, N = K*3 + 1;
+    int k, v = ptr[0];
+    short d[N];
+    for( k = 0; k < N; k++ )
+        d[k] = (short)(v - ptr[pixel[k]]);
+
+    int a0 = threshold;
+    for( k = 0; k < 16; k += 2 )
+    {
+        int a = std::min((int)d[k+1], (int)d[k+2]);
+        a = std::min(a, (int)d[k+3]);
+        if( a <= a0 )
+            continue;
+        a = std::min(a, (int)d[k+4]);
+        a = std::min(a, (int)d[k+5]);
+        a = std::min(a, (int)d[k+6]);
+        a = std::min(a, (int)d[k+7]);
+        a = std::min(a, (int)d[k+8]);
+        a0 = std::max(a0, std::min(a, (int)d[k]));
+        a0 = std::max(a0, std::min(a, (int)d[k+9]));
+    }
 
-    for (int level = 0; level < nlevels; ++level)
+    int b0 = -a0;
+    for( k = 0; k < 16; k += 2 )
     {
-        const int minBorderX = EDGE_THRESHOLD-3;
-        const int minBorderY = minBorderX;
-        const int maxBorderX = mvImagePyramid[level].cols-EDGE_THRESHOLD+3;
-        const int maxBorderY = mvImagePyramid[level].rows-EDGE_THRESHOLD+3;
+        int b = std::max((int)d[k+1], (int)d[k+2]);
+        b = std::max(b, (int)d[k+3]);
+        b = std::max(b, (int)d[k+4]);
+        b = std::max(b, (int)d[k+5]);
+        if( b >= b0 )
+            continue;
+        b = std::max(b, (int)d[k+6]);
+        b = std::max(b, (int)d[k+7]);
+        b = std::max(b, (int)d[k+8]);
 
-        vector<cv::KeyPoint> vToDistributeKeys;
-        vToDistributeKeys.reserve(nfeatures*10);
+        b0 = std::min(b0, std::max(b, (int)d[k]));
+        b0 = std::min(b0, std::max(b, (int)d[k+9]));
+    }
 
-        const float width = (maxBorderX-minBorderX);
-        const float height = (maxBorderY-minBorderY);
+    return -b0 - 1;
+}
 
-        const int nCols = width/W;
-        const int nRows = height/W;
-        const int wCell = ceil(width/nCols);
-        const int hCell = ceil(height/nRows);
+// Writes in scores, for rows [minY,maxY) and columns [minX,maxX) of img, the response that cv::FAST
+// gives to each pixel with threshold th, or 0 if it is not a corner. The response does not depend
+// on the threshold, so the corners at any threshold above th are the pixels with score>=threshold.
+static void computeFastScores(const Mat& img, Mat& scores, const int th,
+                              const int minX, const int maxX, const int minY, const int maxY)
+{
+    int pixel[25];
+    makeFastOffsets(pixel, (int)img.step);
 
-        for(int i=0; i<nRows; i++)
+    for(int y=minY; y<maxY; y++)
+    {
+        const uchar* ptr = img.ptr<uchar>(y);
+        uchar* pScores = scores.ptr<uchar>(y);
+        int x = minX;
+
+#ifdef __SSE2__
+        // A FAST-9 arc always contains two consecutive pixels out of 0,4,8,12. Pixels without such
+        // a pair (most of them) are discarded 16 at a time, otherwise the 16 responses are computed.
+        const __m128i delta = _mm_set1_epi8((char)-128), t = _mm_set1_epi8((char)th);
+        for(; x+16<=maxX; x+=16)
         {
-            const float iniY =minBorderY+i*hCell;
-            float maxY = iniY+hCell+6;
-
-            if(iniY>=maxBorderY-3)
+            const uchar* p = ptr+x;
+            const __m128i v = _mm_loadu_si128((const __m128i*)p);
+            const __m128i v0 = _mm_xor_si128(_mm_adds_epu8(v, t), delta);
+            const __m128i v1 = _mm_xor_si128(_mm_subs_epu8(v, t), delta);
+            const __m128i x0 = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(p + pixel[0])), delta);
+            const __m128i x1 = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(p + pixel[4])), delta);
+            const __m128i x2 = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(p + pixel[8])), delta);
+            const __m128i x3 = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(p + pixel[12])), delta);
+
+            const __m128i b0 = _mm_cmpgt_epi8(x0, v0), b1 = _mm_cmpgt_epi8(x1, v0);
+            const __m128i b2 = _mm_cmpgt_epi8(x2, v0), b3 = _mm_cmpgt_epi8(x3, v0);
+            const __m128i d0 = _mm_cmpgt_epi8(v1, x0), d1 = _mm_cmpgt_epi8(v1, x1);
+            const __m128i d2 = _mm_cmpgt_epi8(v1, x2), d3 = _mm_cmpgt_epi8(v1, x3);
+
+            __m128i m = _mm_or_si128(_mm_and_si128(b0, b1), _mm_and_si128(b1, b2));
+            m = _mm_or_si128(m, _mm_or_si128(_mm_and_si128(b2, b3), _mm_and_si128(b3, b0)));
+            m = _mm_or_si128(m, _mm_or_si128(_mm_and_si128(d0, d1), _mm_and_si128(d1, d2)));
+            m = _mm_or_si128(m, _mm_or_si128(_mm_and_si128(d2, d3), _mm_and_si128(d3, d0)));
+
+            if(_mm_movemask_epi8(m)==0)
+            {
+                _mm_storeu_si128((__m128i*)(pScores+x), _mm_setzero_si128());
                 continue;
-            if(maxY>maxBorderY)
-                maxY = maxBorderY;
+            }
 
-            for(int j=0; j<nCols; j++)
+            // Response of the 16 pixels as in fastCornerScore: the best arc of 9 pixels all darker
+            // (largest minimum of v-x) or all brighter (smallest maximum of v-x).
+            const __m128i zero = _mm_setzero_si128();
+            const __m128i th16 = _mm_set1_epi16((short)th);
+            __m128i vScores[2];
+            for(int h=0; h<2; h++)
             {
-                const float iniX =minBorderX+j*wCell;
-                float maxX = iniX+wCell+6;
-                if(iniX>=maxBorderX-6)
-                    continue;
-                if(maxX>maxBorderX)
-                    maxX = maxBorderX;
-
-                vector<cv::KeyPoint> vKeysCell;
-                FAST(mvImagePyramid[level].rowRange(iniY,maxY).colRange(iniX,maxX),
-                     vKeysCell,iniThFAST,true);
-
-                if(vKeysCell.empty())
+                const __m128i v16 = h==0 ? _mm_unpacklo_epi8(v, zero) : _mm_unpackhi_epi8(v, zero);
+                __m128i d[16], mn[16], mx[16];
+                for(int k=0; k<16; k++)
                 {
-                    FAST(mvImagePyramid[level].rowRange(iniY,maxY).colRange(iniX,maxX),
-                         vKeysCell,minThFAST,true);
+                    const __m128i xk = _mm_loadu_si128((const __m128i*)(p + pixel[k]));
+                    d[k] = _mm_sub_epi16(v16, h==0 ? _mm_unpacklo_epi8(xk, zero) : _mm_unpackhi_epi8(xk, zero));
                 }
 
-                if(!vKeysCell.empty())
+                // Minimum and maximum of the arcs [k,k+8], by doubling the arc length
+                for(int k=0; k<16; k++)
+                {
+                    mn[k] = _mm_min_epi16(d[k], d[(k+1)&15]);
+                    mx[k] = _mm_max_epi16(d[k], d[(k+1)&15]);
+                }
+                for(int l=2; l<8; l*=2)
                 {
-                    for(vector<cv::KeyPoint>::iterator vit=vKeysCell.begin(); vit!=vKeysCell.end();vit++)
+                    __m128i mn2[16], mx2[16];
+                    for(int k=0; k<16; k++)
                     {
-                        (*vit).pt.x+=j*wCell;
-                        (*vit).pt.y+=i*hCell;
-                        vToDistributeKeys.push_back(*vit);
+                        mn2[k] = _mm_min_epi16(mn[k], mn[(k+l)&15]);
+                        mx2[k] = _mm_max_epi16(mx[k], mx[(k+l)&15]);
                     }
+                    for(int k=0; k<16; k++)
+                    {
+                        mn[k] = mn2[k];
+                        mx[k] = mx2[k];
+                    }
+                }
+
+                __m128i a0 = th16, b0 = _mm_sub_epi16(zero, th16);
+                for(int k=0; k<16; k++)
+                {
+                    a0 = _mm_max_epi16(a0, _mm_min_epi16(mn[k], d[(k+8)&15]));
+                    b0 = _mm_min_epi16(b0, _mm_max_epi16(mx[k], d[(k+8)&15]));
                 }
 
+                // Corners have an arc over the threshold, their score is then the best arc minus one
+                const __m128i best = _mm_max_epi16(a0, _mm_sub_epi16(zero, b0));
+                const __m128i bCorner = _mm_cmpgt_epi16(best, th16);
+                vScores[h] = _mm_and_si128(bCorner, _mm_sub_epi16(best, _mm_set1_epi16(1)));
             }
+
+            _mm_storeu_si128((__m128i*)(pScores+x), _mm_packus_epi16(vScores[0], vScores[1]));
         }
+#endif
 
-        vector<KeyPoint> & keypoints = allKeypoints[level];
-        keypoints.reserve(nfeatures);
+        for(; x<maxX; x++)
+        {
+            const uchar* p = ptr+x;
+            const int vHi = p[0]+th, vLo = p[0]-th;
+            const int x0 = p[pixel[0]], x1 = p[pixel[4]], x2 = p[pixel[8]], x3 = p[pixel[12]];
 
-        keypoints = DistributeOctTree(vToDistributeKeys, minBorderX, maxBorderX,
-                                      minBorderY, maxBorderY,mnFeaturesPerLevel[level], level);
+            const bool bBright = (x0>vHi && x1>vHi) || (x1>vHi && x2>vHi) || (x2>vHi && x3>vHi) || (x3>vHi && x0>vHi);
+            const bool bDark = (x0<vLo && x1<vLo) || (x1<vLo && x2<vLo) || (x2<vLo && x3<vLo) || (x3<vLo && x0<vLo);
 
-        const int scaledPatchSize = PATCH_SIZE*mvScaleFactor[level];
+            pScores[x] = 0;
+            if(!bBright && !bDark)
+                continue;
 
-        // Add border to coordinates and scale information
-        const int nkps = keypoints.size();
-        for(int i=0; i<nkps ; i++)
+            const int score = fastCornerScore(p, pixel, th);
+            if(score>=th)
+                pScores[x] = (uchar)score;
+        }
+    }
+}
+
+// Appends the keypoints that cv::FAST with non maximum suppression returns on the image
+// region [minX,maxX)x[minY,maxY) with threshold th, given the scores of computeFastScores at a
+// threshold not above th. As in cv::FAST pixels out of the region do not suppress any corner.
+// Coordinates are relative to (offX,offY).
+static void collectFastCorners(const Mat& scores, int th, const int minX, const int maxX, const int minY, const int maxY,
+                               const int offX, const int offY, vector<KeyPoint>& keypoints)
+{
+    // A corner with response 0 is never a local maximum
+    th = std::max(std::min(th, 255), 1);
+
+    for(int y=minY; y<maxY; y++)
+    {
+        const uchar* prev = y>minY ? scores.ptr<uchar>(y-1) : NULL;
+        const uchar* curr = scores.ptr<uchar>(y);
+        const uchar* next = y+1<maxY ? scores.ptr<uchar>(y+1) : NULL;
+
+        int x = minX;
+        while(x<maxX)
         {
-            keypoints[i].pt.x+=minBorderX;
-            keypoints[i].pt.y+=minBorderY;
-            keypoints[i].octave=level;
-            keypoints[i].size = scaledPatchSize;
+#ifdef __SSE2__
+            // Most scores are below the threshold, skip them 16 at a time
+            const __m128i zero = _mm_setzero_si128();
+            if(x+16<=maxX &&
+               _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_subs_epu8(_mm_loadu_si128((const __m128i*)(curr+x)),
+                                                              _mm_set1_epi8((char)(th-1))), zero))==0xFFFF)
+            {
+                x += 16;
+                continue;
+            }
+#endif
+            for(const int end = std::min(x+16,maxX); x<end; x++)
+            {
+                const int score = curr[x];
+                if(score<th)
+                    continue;
+
+                const bool bLeft = x>minX, bRight = x+1<maxX;
+                if((bLeft && score<=curr[x-1]) || (bRight && score<=curr[x+1]))
+                    continue;
+                if(prev && ((bLeft && score<=prev[x-1]) || score<=prev[x] || (bRight && score<=prev[x+1])))
+                    continue;
+                if(next && ((bLeft && score<=next[x-1]) || score<=next[x] || (bRight && score<=next[x+1])))
+                    continue;
+
+                keypoints.push_back(KeyPoint((float)(x-offX), (float)(y-offY), 7.f, -1, (float)score));
+            }
         }
     }
+}
+
+void ORBextractor::ParallelFor(int begin, int end, const function<void(int)> &f)
+{
+    if(mpThreadPool)
+        mpThreadPool->ParallelFor(begin,end,f);
+    else
+        for(int i=begin; i<end; i++)
+            f(i);
+}
+
+void ORBextractor::ComputeKeyPointsOctTree(vector<vector<KeyPoint> >& allKeypoints)
+{
+    allKeypoints.resize(nlevels);
+
+    // Levels are independent
+    ParallelFor(0,nlevels,[&](int level)
+    {
+        ComputeKeyPointsOctTree(level,allKeypoints[level]);
+    });
+}
+
+void ORBextractor::ComputeKeyPointsOctTree(const int level, vector<KeyPoint>& keypoints)
+{
+    const float W = 30;
+
+    const int minBorderX = EDGE_THRESHOLD-3;
+    const int minBorderY = minBorderX;
+    const int maxBorderX = mvImagePyramid[level].cols-EDGE_THRESHOLD+3;
+    const int maxBorderY = mvImagePyramid[level].rows-EDGE_THRESHOLD+3;
+
+    const float width = (maxBorderX-minBorderX);
+    const float height = (maxBorderY-minBorderY);
+
+    const int nCols = width/W;
+    const int nRows = height/W;
+    const int wCell = ceil(width/nCols);
+    const int hCell = ceil(height/nRows);
+
+    // FAST is evaluated once per pixel at the lowest threshold. The corners of a cell at iniThFAST
+    // (or minThFAST if there are none) are then read from the scores, exactly as running cv::FAST
+    // on the cell with each threshold.
+    const int thLow = std::max(std::min(std::min(iniThFAST,minThFAST),255),0);
+    const Mat &image = mvImagePyramid[level];
+    Mat &scores = mvScoreBuffer[level];
+    scores.create(image.size(), CV_8U);
+
+    // Each row of cells is searched in parallel, then merged in order
+    vector<vector<cv::KeyPoint> > vRowKeys(nRows);
+
+    ParallelFor(0,nRows,[&](int i)
+    {
+        const int iniY =minBorderY+i*hCell;
+        int maxY = iniY+hCell+6;
+
+        if(iniY>=maxBorderY-3)
+            return;
+        if(maxY>maxBorderY)
+            maxY = maxBorderY;
+
+        // cv::FAST leaves a margin of 3 pixels in each cell, which makes cells tile the level
+        computeFastScores(image, scores, thLow, minBorderX+3, maxBorderX-3, iniY+3, maxY-3);
+
+        vector<cv::KeyPoint> &vRow = vRowKeys[i];
+
+        for(int j=0; j<nCols; j++)
+        {
+            const int iniX =minBorderX+j*wCell;
+            int maxX = iniX+wCell+6;
+            if(iniX>=maxBorderX-6)
+                continue;
+            if(maxX>maxBorderX)
+                maxX = maxBorderX;
+
+            const size_t nBefore = vRow.size();
+            collectFastCorners(scores, iniThFAST, iniX+3, maxX-3, iniY+3, maxY-3, minBorderX, minBorderY, vRow);
+
+            if(vRow.size()==nBefore)
+                collectFastCorners(scores, minThFAST, iniX+3, maxX-3, iniY+3, maxY-3, minBorderX, minBorderY, vRow);
+        }
+    });
+
+    vector<cv::KeyPoint> vToDistributeKeys;
+    vToDistributeKeys.reserve(nfeatures*10);
+
+    for(int i=0; i<nRows; i++)
+        vToDistributeKeys.insert(vToDistributeKeys.end(),vRowKeys[i].begin(),vRowKeys[i].end());
+
+    keypoints.reserve(nfeatures);
+
+    keypoints = DistributeOctTree(vToDistributeKeys, minBorderX, maxBorderX,
+                                  minBorderY, maxBorderY,mnFeaturesPerLevel[level], level);
+
+    const int scaledPatchSize = PATCH_SIZE*mvScaleFactor[level];
+
+    // Add border to coordinates and scale information
+    const int nkps = keypoints.size();
+    for(int i=0; i<nkps ; i++)
+    {
+        keypoints[i].pt.x+=minBorderX;
+        keypoints[i].pt.y+=minBorderY;
+        keypoints[i].octave=level;
+        keypoints[i].size = scaledPatchSize;
+    }
 
     // compute orientations
-    for (int level = 0; level < nlevels; ++level)
-        computeOrientation(mvImagePyramid[level], allKeypoints[level], umax);
+    computeOrientation(mvImagePyramid[level], keypoints, umax);
 }
 
 void ORBextractor::ComputeKeyPointsOld(std::vector<std::vector<KeyPoint> > &allKeypoints)
@@ -1036,8 +1295,40 @@ static void computeDescriptors(const Mat& image, vector<KeyPoint>& keypoints, Ma
 {
     descriptors = Mat::zeros((int)keypoints.size(), 32, CV_8UC1);
 
+#if defined(__x86_64__) && defined(__GNUC__)
+    if(bDescriptorAVX2)
+    {
+        for (size_t i = 0; i < keypoints.size(); i++)
+            computeOrbDescriptorAVX2(keypoints[i], image, &pattern[0], descriptors.ptr((int)i));
+        return;
+    }
+#endif
+
+    for (size_t i = 0; i < keypoints.size(); i++)
+        computeOrbDescriptor(keypoints[i], image, &pattern[0], descriptors.ptr((int)i));
+}
+
+bool ORBextractor::ComputeDescriptors(const Mat &image, vector<KeyPoint> &keypoints, Mat &descriptors, const bool bAVX2)
+{
+    descriptors = Mat::zeros((int)keypoints.size(), 32, CV_8UC1);
+
+    if(bAVX2)
+    {
+#if defined(__x86_64__) && defined(__GNUC__)
+        if(!bDescriptorAVX2)
+            return false;
+
+        for (size_t i = 0; i < keypoints.size(); i++)
+            computeOrbDescriptorAVX2(keypoints[i], image, &pattern[0], descriptors.ptr((int)i));
+        return true;
+#else
+        return false;
+#endif
+    }
+
     for (size_t i = 0; i < keypoints.size(); i++)
         computeOrbDescriptor(keypoints[i], image, &pattern[0], descriptors.ptr((int)i));
+    return true;
 }
 
 void ORBextractor::operator()( InputArray _image, InputArray _mask, vector<KeyPoint>& _keypoints,
@@ -1072,25 +1363,27 @@ void ORBextractor::operator()( InputArray _image, InputArray _mask, vector<KeyPo
     _keypoints.clear();
     _keypoints.reserve(nkeypoints);
 
-    int offset = 0;
+    // Each level writes its own rows of the descriptor matrix
+    vector<int> vOffsets(nlevels+1,0);
     for (int level = 0; level < nlevels; ++level)
+        vOffsets[level+1] = vOffsets[level] + (int)allKeypoints[level].size();
+
+    ParallelFor(0,nlevels,[&](int level)
     {
         vector<KeyPoint>& keypoints = allKeypoints[level];
         int nkeypointsLevel = (int)keypoints.size();
 
         if(nkeypointsLevel==0)
-            continue;
+            return;
 
         // preprocess the resized image
-        Mat workingMat = mvImagePyramid[level].clone();
-        GaussianBlur(workingMat, workingMat, Size(7, 7), 2, 2, BORDER_REFLECT_101);
+        Mat &workingMat = mvBlurBuffer[level];
+        GaussianBlur(mvImagePyramid[level], workingMat, Size(7, 7), 2, 2, BORDER_REFLECT_101+BORDER_ISOLATED);
 
         // Compute the descriptors
-        Mat desc = descriptors.rowRange(offset, offset + nkeypointsLevel);
+        Mat desc = descriptors.rowRange(vOffsets[level], vOffsets[level+1]);
         computeDescriptors(workingMat, keypoints, desc, pattern);
 
-        offset += nkeypointsLevel;
-
         // Scale keypoint coordinates
         if (level != 0)
         {
@@ -1099,9 +1392,11 @@ void ORBextractor::operator()( InputArray _image, InputArray _mask, vector<KeyPo
                  keypointEnd = keypoints.end(); keypoint != keypointEnd; ++keypoint)
                 keypoint->pt *= scale;
         }
-        // And add the keypoints to the output
-        _keypoints.insert(_keypoints.end(), keypoints.begin(), keypoints.end());
-    }
+    });
+
+    // And add the keypoints to the output
+    for (int level = 0; level < nlevels; ++level)
+        _keypoints.insert(_keypoints.end(), allKeypoints[level].begin(), allKeypoints[level].end());
 }
 
 void ORBextractor::ComputePyramid(cv::Mat image)
@@ -1111,7 +1406,9 @@ void ORBextractor::ComputePyramid(cv::Mat image)
         float scale = mvInvScaleFactor[level];
         Size sz(cvRound((float)image.cols*scale), cvRound((float)image.rows*scale));
         Size wholeSize(sz.width + EDGE_THRESHOLD*2, sz.height + EDGE_THRESHOLD*2);
-        Mat temp(wholeSize, image.type()), masktemp;
+        // No allocation unless the image size or type changed
+        Mat &temp = mvPyramidBuffer[level];
+        temp.create(wholeSize, image.type());
         mvImagePyramid[level] = temp(Rect(EDGE_THRESHOLD, EDGE_THRESHOLD, sz.width, sz.height));
 
         // Compute the resized image
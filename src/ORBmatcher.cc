@@ -29,11 +29,136 @@
 
 #include<stdint-gcc.h>
 
+#if defined(__x86_64__) && defined(__GNUC__)
+#include<immintrin.h>
+#endif
+
 using namespace std;
 
 namespace ORB_SLAM2
 {
 
+namespace
+{
+
+typedef void (*DistancesKernel)(const uchar*, const uchar* const*, const int, int*);
+
+// Bit set count operation from
+// http://graphics.stanford.edu/~seander/bithacks.html#CountBitsSetParallel
+void DistancesScalar(const uchar *a, const uchar* const* vpB, const int N, int* vDist)
+{
+    for(int i=0; i<N; i++)
+    {
+        const int32_t *pa = reinterpret_cast<const int32_t*>(a);
+        const int32_t *pb = reinterpret_cast<const int32_t*>(vpB[i]);
+
+        int dist=0;
+
+        for(int j=0; j<8; j++, pa++, pb++)
+        {
+            unsigned  int v = *pa ^ *pb;
+            v = v - ((v >> 1) & 0x55555555);
+            v = (v & 0x33333333) + ((v >> 2) & 0x33333333);
+            dist += (((v + (v >> 4)) & 0xF0F0F0F) * 0x1010101) >> 24;
+        }
+
+        vDist[i] = dist;
+    }
+}
+
+#if defined(__x86_64__) && defined(__GNUC__)
+
+__attribute__((target("popcnt")))
+void DistancesPOPCNT(const uchar *a, const uchar* const* vpB, const int N, int* vDist)
+{
+    const uint64_t *pa = reinterpret_cast<const uint64_t*>(a);
+    const uint64_t a0=pa[0], a1=pa[1], a2=pa[2], a3=pa[3];
+
+    for(int i=0; i<N; i++)
+    {
+        const uint64_t *pb = reinterpret_cast<const uint64_t*>(vpB[i]);
+        vDist[i] = _mm_popcnt_u64(a0^pb[0]) + _mm_popcnt_u64(a1^pb[1]) +
+                   _mm_popcnt_u64(a2^pb[2]) + _mm_popcnt_u64(a3^pb[3]);
+    }
+}
+
+// Sums the four 64-bit counts of a descriptor
+__attribute__((target("avx2")))
+inline int HorizontalSum(const __m256i &cnt)
+{
+    const __m128i s = _mm_add_epi64(_mm256_castsi256_si128(cnt),_mm256_extracti128_si256(cnt,1));
+    return _mm_cvtsi128_si32(_mm_add_epi64(s,_mm_unpackhi_epi64(s,s)));
+}
+
+// Nibble lookup popcount (Mula et al.), the 32 bytes of a descriptor fit one register
+__attribute__((target("avx2")))
+void DistancesAVX2(const uchar *a, const uchar* const* vpB, const int N, int* vDist)
+{
+    const __m256i lut = _mm256_setr_epi8(0,1,1,2,1,2,2,3,1,2,2,3,2,3,3,4,
+                                         0,1,1,2,1,2,2,3,1,2,2,3,2,3,3,4);
+    const __m256i low4 = _mm256_set1_epi8(0x0f);
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a));
+
+    for(int i=0; i<N; i++)
+    {
+        const __m256i x = _mm256_xor_si256(va,_mm256_loadu_si256(reinterpret_cast<const __m256i*>(vpB[i])));
+        const __m256i cnt = _mm256_add_epi8(_mm256_shuffle_epi8(lut,_mm256_and_si256(x,low4)),
+                                            _mm256_shuffle_epi8(lut,_mm256_and_si256(_mm256_srli_epi16(x,4),low4)));
+        vDist[i] = HorizontalSum(_mm256_sad_epu8(cnt,zero));
+    }
+}
+
+#if defined(__clang__) ? (__clang_major__ >= 6) : (__GNUC__ >= 8)
+#define ORB_SLAM2_AVX512_VPOPCNTDQ
+
+// Two descriptors per 512-bit register
+__attribute__((target("avx512f,avx512vpopcntdq")))
+void DistancesAVX512(const uchar *a, const uchar* const* vpB, const int N, int* vDist)
+{
+    const __m512i va = _mm512_maskz_broadcast_i64x4(0xFF,_mm256_loadu_si256(reinterpret_cast<const __m256i*>(a)));
+
+    int i=0;
+    for(; i+1<N; i+=2)
+    {
+        __m512i vb = _mm512_castsi256_si512(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(vpB[i])));
+        vb = _mm512_mask_broadcast_i64x4(vb,0xF0,_mm256_loadu_si256(reinterpret_cast<const __m256i*>(vpB[i+1])));
+        const __m512i cnt = _mm512_popcnt_epi64(_mm512_xor_si512(va,vb));
+        vDist[i] = HorizontalSum(_mm512_maskz_extracti64x4_epi64(0x0F,cnt,0));
+        vDist[i+1] = HorizontalSum(_mm512_maskz_extracti64x4_epi64(0x0F,cnt,1));
+    }
+
+    if(i<N)
+    {
+        const __m512i vb = _mm512_castsi256_si512(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(vpB[i])));
+        const __m512i cnt = _mm512_popcnt_epi64(_mm512_xor_si512(va,vb));
+        vDist[i] = HorizontalSum(_mm512_maskz_extracti64x4_epi64(0x0F,cnt,0));
+    }
+}
+#endif
+
+#endif
+
+DistancesKernel SelectDistancesKernel()
+{
+#if defined(__x86_64__) && defined(__GNUC__)
+    __builtin_cpu_init();
+#ifdef ORB_SLAM2_AVX512_VPOPCNTDQ
+    if(__builtin_cpu_supports("avx512vpopcntdq"))
+        return DistancesAVX512;
+#endif
+    if(__builtin_cpu_supports("avx2"))
+        return DistancesAVX2;
+    if(__builtin_cpu_supports("popcnt"))
+        return DistancesPOPCNT;
+#endif
+    return DistancesScalar;
+}
+
+const DistancesKernel DescriptorDistancesKernel = SelectDistancesKernel();
+
+} // namespace
+
 const int ORBmatcher::TH_HIGH = 100;
 const int ORBmatcher::TH_LOW = 50;
 const int ORBmatcher::HISTO_LENGTH = 30;
@@ -42,44 +167,43 @@ ORBmatcher::ORBmatcher(float nnratio, bool checkOri): mfNNratio(nnratio), mbChec
 {
 }
 
-int ORBmatcher::SearchByProjection(Frame &F, const vector<MapPoint*> &vpMapPoints, const float th)
+int ORBmatcher::SearchByProjection(Frame &F, const vector<MapPoint*> &vpMapPoints, const vector<MapPointProjection> &vProjections, const float th)
 {
     int nmatches=0;
 
     const bool bFactor = th!=1.0;
 
-    for(size_t iMP=0; iMP<vpMapPoints.size(); iMP++)
+    // Candidate descriptors of the current MapPoint
+    vector<const uchar*> vpCandidates;
+    vector<size_t> vCandidateIdx;
+
+    for(size_t iP=0; iP<vProjections.size(); iP++)
     {
-        MapPoint* pMP = vpMapPoints[iMP];
-        if(!pMP->mbTrackInView)
-            continue;
+        const MapPointProjection &proj = vProjections[iP];
+        MapPoint* pMP = vpMapPoints[proj.idx];
 
         if(pMP->isBad())
             continue;
 
-        const int &nPredictedLevel = pMP->mnTrackScaleLevel;
+        const int &nPredictedLevel = proj.level;
 
         // The size of the window will depend on the viewing direction
-        float r = RadiusByViewingCos(pMP->mTrackViewCos);
+        float r = RadiusByViewingCos(proj.viewCos);
 
         if(bFactor)
             r*=th;
 
         const vector<size_t> vIndices =
-                F.GetFeaturesInArea(pMP->mTrackProjX,pMP->mTrackProjY,r*F.mvScaleFactors[nPredictedLevel],nPredictedLevel-1,nPredictedLevel);
+                F.GetFeaturesInArea(proj.u,proj.v,r*F.mvScaleFactors[nPredictedLevel],nPredictedLevel-1,nPredictedLevel);
 
         if(vIndices.empty())
             continue;
 
         const cv::Mat MPdescriptor = pMP->GetDescriptor();
 
-        int bestDist=256;
-        int bestLevel= -1;
-        int bestDist2=256;
-        int bestLevel2 = -1;
-        int bestIdx =-1 ;
+        vpCandidates.clear();
+        vCandidateIdx.clear();
 
-        // Get best and second matches with near keypoints
         for(vector<size_t>::const_iterator vit=vIndices.begin(), vend=vIndices.end(); vit!=vend; vit++)
         {
             const size_t idx = *vit;
@@ -88,35 +212,28 @@ int ORBmatcher::SearchByProjection(Frame &F, const vector<MapPoint*> &vpMapPoint
                 if(F.mvpMapPoints[idx]->Observations()>0)
                     continue;
 
-            if(F.mvuRight[idx]>0)
+            if(F.mpFeatures->mvuRight[idx]>0)
             {
-                const float er = fabs(pMP->mTrackProjXR-F.mvuRight[idx]);
+                const float er = fabs(proj.uR-F.mpFeatures->mvuRight[idx]);
                 if(er>r*F.mvScaleFactors[nPredictedLevel])
                     continue;
             }
 
-            const cv::Mat &d = F.mDescriptors.row(idx);
-
-            const int dist = DescriptorDistance(MPdescriptor,d);
-
-            if(dist<bestDist)
-            {
-                bestDist2=bestDist;
-                bestDist=dist;
-                bestLevel2 = bestLevel;
-                bestLevel = F.mvKeysUn[idx].octave;
-                bestIdx=idx;
-            }
-            else if(dist<bestDist2)
-            {
-                bestLevel2 = F.mvKeysUn[idx].octave;
-                bestDist2=dist;
-            }
+            vpCandidates.push_back(F.mDescriptors.ptr<uchar>(idx));
+            vCandidateIdx.push_back(idx);
         }
 
+        // Get best and second matches with near keypoints
+        int iBest, bestDist, iBest2, bestDist2;
+        SearchBestTwo(MPdescriptor.ptr<uchar>(),vpCandidates.data(),vpCandidates.size(),iBest,bestDist,iBest2,bestDist2);
+
         // Apply ratio to second match (only if best and second are in the same scale level)
         if(bestDist<=TH_HIGH)
         {
+            const size_t bestIdx = vCandidateIdx[iBest];
+            const int bestLevel = F.mpFeatures->mvKeysUn[bestIdx].octave;
+            const int bestLevel2 = iBest2>=0 ? F.mpFeatures->mvKeysUn[vCandidateIdx[iBest2]].octave : -1;
+
             if(bestLevel==bestLevel2 && bestDist>mfNNratio*bestDist2)
                 continue;
 
@@ -137,12 +254,12 @@ float ORBmatcher::RadiusByViewingCos(const float &viewCos)
 }
 
 
-bool ORBmatcher::CheckDistEpipolarLine(const cv::KeyPoint &kp1,const cv::KeyPoint &kp2,const cv::Mat &F12,const KeyFrame* pKF2)
+bool ORBmatcher::CheckDistEpipolarLine(const cv::KeyPoint &kp1,const cv::KeyPoint &kp2,const Eigen::Matrix3f &F12,const KeyFrame* pKF2)
 {
     // Epipolar line in second image l = x1'F12 = [a b c]
-    const float a = kp1.pt.x*F12.at<float>(0,0)+kp1.pt.y*F12.at<float>(1,0)+F12.at<float>(2,0);
-    const float b = kp1.pt.x*F12.at<float>(0,1)+kp1.pt.y*F12.at<float>(1,1)+F12.at<float>(2,1);
-    const float c = kp1.pt.x*F12.at<float>(0,2)+kp1.pt.y*F12.at<float>(1,2)+F12.at<float>(2,2);
+    const float a = kp1.pt.x*F12(0,0)+kp1.pt.y*F12(1,0)+F12(2,0);
+    const float b = kp1.pt.x*F12(0,1)+kp1.pt.y*F12(1,1)+F12(2,1);
+    const float c = kp1.pt.x*F12(0,2)+kp1.pt.y*F12(1,2)+F12(2,2);
 
     const float num = a*kp2.pt.x+b*kp2.pt.y+c;
 
@@ -173,16 +290,19 @@ int ORBmatcher::SearchByBoW(KeyFrame* pKF,Frame &F, vector<MapPoint*> &vpMapPoin
 
     // We perform the matching over ORB that belong to the same vocabulary node (at a certain level)
     DBoW2::FeatureVector::const_iterator KFit = vFeatVecKF.begin();
-    DBoW2::FeatureVector::const_iterator Fit = F.mFeatVec.begin();
+    DBoW2::FeatureVector::const_iterator Fit = F.mpFeatures->mFeatVec.begin();
     DBoW2::FeatureVector::const_iterator KFend = vFeatVecKF.end();
-    DBoW2::FeatureVector::const_iterator Fend = F.mFeatVec.end();
+    DBoW2::FeatureVector::const_iterator Fend = F.mpFeatures->mFeatVec.end();
+
+    vector<const uchar*> vpCandidates;
+    vector<unsigned int> vCandidateIdx;
 
     while(KFit != KFend && Fit != Fend)
     {
         if(KFit->first == Fit->first)
         {
-            const vector<unsigned int> vIndicesKF = KFit->second;
-            const vector<unsigned int> vIndicesF = Fit->second;
+            const vector<unsigned int> &vIndicesKF = KFit->second;
+            const vector<unsigned int> &vIndicesF = Fit->second;
 
             for(size_t iKF=0; iKF<vIndicesKF.size(); iKF++)
             {
@@ -196,11 +316,8 @@ int ORBmatcher::SearchByBoW(KeyFrame* pKF,Frame &F, vector<MapPoint*> &vpMapPoin
                 if(pMP->isBad())
                     continue;                
 
-                const cv::Mat &dKF= pKF->mDescriptors.row(realIdxKF);
-
-                int bestDist1=256;
-                int bestIdxF =-1 ;
-                int bestDist2=256;
+                vpCandidates.clear();
+                vCandidateIdx.clear();
 
                 for(size_t iF=0; iF<vIndicesF.size(); iF++)
                 {
@@ -209,33 +326,26 @@ int ORBmatcher::SearchByBoW(KeyFrame* pKF,Frame &F, vector<MapPoint*> &vpMapPoin
                     if(vpMapPointMatches[realIdxF])
                         continue;
 
-                    const cv::Mat &dF = F.mDescriptors.row(realIdxF);
-
-                    const int dist =  DescriptorDistance(dKF,dF);
-
-                    if(dist<bestDist1)
-                    {
-                        bestDist2=bestDist1;
-                        bestDist1=dist;
-                        bestIdxF=realIdxF;
-                    }
-                    else if(dist<bestDist2)
-                    {
-                        bestDist2=dist;
-                    }
+                    vpCandidates.push_back(F.mDescriptors.ptr<uchar>(realIdxF));
+                    vCandidateIdx.push_back(realIdxF);
                 }
 
+                int iBest, bestDist1, iBest2, bestDist2;
+                SearchBestTwo(pKF->mDescriptors.ptr<uchar>(realIdxKF),vpCandidates.data(),vpCandidates.size(),
+                              iBest,bestDist1,iBest2,bestDist2);
+
                 if(bestDist1<=TH_LOW)
                 {
                     if(static_cast<float>(bestDist1)<mfNNratio*static_cast<float>(bestDist2))
                     {
+                        const unsigned int bestIdxF = vCandidateIdx[iBest];
                         vpMapPointMatches[bestIdxF]=pMP;
 
                         const cv::KeyPoint &kp = pKF->mvKeysUn[realIdxKF];
 
                         if(mbCheckOrientation)
                         {
-                            float rot = kp.angle-F.mvKeys[bestIdxF].angle;
+                            float rot = kp.angle-F.mpFeatures->mvKeys[bestIdxF].angle;
                             if(rot<0.0)
                                 rot+=360.0f;
                             int bin = round(rot*factor);
@@ -259,7 +369,7 @@ int ORBmatcher::SearchByBoW(KeyFrame* pKF,Frame &F, vector<MapPoint*> &vpMapPoin
         }
         else
         {
-            Fit = F.mFeatVec.lower_bound(KFit->first);
+            Fit = F.mpFeatures->mFeatVec.lower_bound(KFit->first);
         }
     }
 
@@ -287,7 +397,7 @@ int ORBmatcher::SearchByBoW(KeyFrame* pKF,Frame &F, vector<MapPoint*> &vpMapPoin
     return nmatches;
 }
 
-int ORBmatcher::SearchByProjection(KeyFrame* pKF, cv::Mat Scw, const vector<MapPoint*> &vpPoints, vector<MapPoint*> &vpMatched, int th)
+int ORBmatcher::SearchByProjection(KeyFrame* pKF, const g2o::Sim3 &Scw, const vector<MapPoint*> &vpPoints, vector<MapPoint*> &vpMatched, int th)
 {
     // Get Calibration Parameters for later projection
     const float &fx = pKF->fx;
@@ -296,11 +406,9 @@ int ORBmatcher::SearchByProjection(KeyFrame* pKF, cv::Mat Scw, const vector<MapP
     const float &cy = pKF->cy;
 
     // Decompose Scw
-    cv::Mat sRcw = Scw.rowRange(0,3).colRange(0,3);
-    const float scw = sqrt(sRcw.row(0).dot(sRcw.row(0)));
-    cv::Mat Rcw = sRcw/scw;
-    cv::Mat tcw = Scw.rowRange(0,3).col(3)/scw;
-    cv::Mat Ow = -Rcw.t()*tcw;
+    const Eigen::Matrix3f Rcw = Scw.rotation().toRotationMatrix().cast<float>();
+    const Eigen::Vector3f tcw = (Scw.translation()/Scw.scale()).cast<float>();
+    const Eigen::Vector3f Ow = -Rcw.transpose()*tcw;
 
     // Set of MapPoints already found in the KeyFrame
     set<MapPoint*> spAlreadyFound(vpMatched.begin(), vpMatched.end());
@@ -308,6 +416,9 @@ int ORBmatcher::SearchByProjection(KeyFrame* pKF, cv::Mat Scw, const vector<MapP
 
     int nmatches=0;
 
+    vector<const uchar*> vpCandidates;
+    vector<size_t> vCandidateIdx;
+
     // For each Candidate MapPoint Project and Match
     for(int iMP=0, iendMP=vpPoints.size(); iMP<iendMP; iMP++)
     {
@@ -318,19 +429,19 @@ int ORBmatcher::SearchByProjection(KeyFrame* pKF, cv::Mat Scw, const vector<MapP
             continue;
 
         // Get 3D Coords.
-        cv::Mat p3Dw = pMP->GetWorldPos();
+        const Eigen::Vector3f p3Dw = pMP->GetWorldPos();
 
         // Transform into Camera Coords.
-        cv::Mat p3Dc = Rcw*p3Dw+tcw;
+        const Eigen::Vector3f p3Dc = Rcw*p3Dw+tcw;
 
         // Depth must be positive
-        if(p3Dc.at<float>(2)<0.0)
+        if(p3Dc(2)<0.0)
             continue;
 
         // Project into Image
-        const float invz = 1/p3Dc.at<float>(2);
-        const float x = p3Dc.at<float>(0)*invz;
-        const float y = p3Dc.at<float>(1)*invz;
+        const float invz = 1/p3Dc(2);
+        const float x = p3Dc(0)*invz;
+        const float y = p3Dc(1)*invz;
 
         const float u = fx*x+cx;
         const float v = fy*y+cy;
@@ -342,14 +453,14 @@ int ORBmatcher::SearchByProjection(KeyFrame* pKF, cv::Mat Scw, const vector<MapP
         // Depth must be inside the scale invariance region of the point
         const float maxDistance = pMP->GetMaxDistanceInvariance();
         const float minDistance = pMP->GetMinDistanceInvariance();
-        cv::Mat PO = p3Dw-Ow;
-        const float dist = cv::norm(PO);
+        const Eigen::Vector3f PO = p3Dw-Ow;
+        const float dist = PO.norm();
 
         if(dist<minDistance || dist>maxDistance)
             continue;
 
         // Viewing angle must be less than 60 deg
-        cv::Mat Pn = pMP->GetNormal();
+        const Eigen::Vector3f Pn = pMP->GetNormal();
 
         if(PO.dot(Pn)<0.5*dist)
             continue;
@@ -367,8 +478,9 @@ int ORBmatcher::SearchByProjection(KeyFrame* pKF, cv::Mat Scw, const vector<MapP
         // Match to the most similar keypoint in the radius
         const cv::Mat dMP = pMP->GetDescriptor();
 
-        int bestDist = 256;
-        int bestIdx = -1;
+        vpCandidates.clear();
+        vCandidateIdx.clear();
+
         for(vector<size_t>::const_iterator vit=vIndices.begin(), vend=vIndices.end(); vit!=vend; vit++)
         {
             const size_t idx = *vit;
@@ -380,20 +492,16 @@ int ORBmatcher::SearchByProjection(KeyFrame* pKF, cv::Mat Scw, const vector<MapP
             if(kpLevel<nPredictedLevel-1 || kpLevel>nPredictedLevel)
                 continue;
 
-            const cv::Mat &dKF = pKF->mDescriptors.row(idx);
-
-            const int dist = DescriptorDistance(dMP,dKF);
-
-            if(dist<bestDist)
-            {
-                bestDist = dist;
-                bestIdx = idx;
-            }
+            vpCandidates.push_back(pKF->mDescriptors.ptr<uchar>(idx));
+            vCandidateIdx.push_back(idx);
         }
 
+        int iBest, bestDist, iBest2, bestDist2;
+        SearchBestTwo(dMP.ptr<uchar>(),vpCandidates.data(),vpCandidates.size(),iBest,bestDist,iBest2,bestDist2);
+
         if(bestDist<=TH_LOW)
         {
-            vpMatched[bestIdx]=pMP;
+            vpMatched[vCandidateIdx[iBest]]=pMP;
             nmatches++;
         }
 
@@ -405,19 +513,22 @@ int ORBmatcher::SearchByProjection(KeyFrame* pKF, cv::Mat Scw, const vector<MapP
 int ORBmatcher::SearchForInitialization(Frame &F1, Frame &F2, vector<cv::Point2f> &vbPrevMatched, vector<int> &vnMatches12, int windowSize)
 {
     int nmatches=0;
-    vnMatches12 = vector<int>(F1.mvKeysUn.size(),-1);
+    vnMatches12 = vector<int>(F1.mpFeatures->mvKeysUn.size(),-1);
 
     vector<int> rotHist[HISTO_LENGTH];
     for(int i=0;i<HISTO_LENGTH;i++)
         rotHist[i].reserve(500);
     const float factor = 1.0f/HISTO_LENGTH;
 
-    vector<int> vMatchedDistance(F2.mvKeysUn.size(),INT_MAX);
-    vector<int> vnMatches21(F2.mvKeysUn.size(),-1);
+    vector<int> vMatchedDistance(F2.mpFeatures->mvKeysUn.size(),INT_MAX);
+    vector<int> vnMatches21(F2.mpFeatures->mvKeysUn.size(),-1);
 
-    for(size_t i1=0, iend1=F1.mvKeysUn.size(); i1<iend1; i1++)
+    vector<const uchar*> vpCandidates;
+    vector<int> vDist;
+
+    for(size_t i1=0, iend1=F1.mpFeatures->mvKeysUn.size(); i1<iend1; i1++)
     {
-        cv::KeyPoint kp1 = F1.mvKeysUn[i1];
+        cv::KeyPoint kp1 = F1.mpFeatures->mvKeysUn[i1];
         int level1 = kp1.octave;
         if(level1>0)
             continue;
@@ -427,19 +538,22 @@ int ORBmatcher::SearchForInitialization(Frame &F1, Frame &F2, vector<cv::Point2f
         if(vIndices2.empty())
             continue;
 
-        cv::Mat d1 = F1.mDescriptors.row(i1);
+        vpCandidates.resize(vIndices2.size());
+        vDist.resize(vIndices2.size());
+        for(size_t j=0; j<vIndices2.size(); j++)
+            vpCandidates[j] = F2.mDescriptors.ptr<uchar>(vIndices2[j]);
+
+        DescriptorDistances(F1.mDescriptors.ptr<uchar>(i1),vpCandidates.data(),vpCandidates.size(),vDist.data());
 
         int bestDist = INT_MAX;
         int bestDist2 = INT_MAX;
         int bestIdx2 = -1;
 
-        for(vector<size_t>::iterator vit=vIndices2.begin(); vit!=vIndices2.end(); vit++)
+        for(size_t j=0; j<vIndices2.size(); j++)
         {
-            size_t i2 = *vit;
-
-            cv::Mat d2 = F2.mDescriptors.row(i2);
+            size_t i2 = vIndices2[j];
 
-            int dist = DescriptorDistance(d1,d2);
+            int dist = vDist[j];
 
             if(vMatchedDistance[i2]<=dist)
                 continue;
@@ -472,7 +586,7 @@ int ORBmatcher::SearchForInitialization(Frame &F1, Frame &F2, vector<cv::Point2f
 
                 if(mbCheckOrientation)
                 {
-                    float rot = F1.mvKeysUn[i1].angle-F2.mvKeysUn[bestIdx2].angle;
+                    float rot = F1.mpFeatures->mvKeysUn[i1].angle-F2.mpFeatures->mvKeysUn[bestIdx2].angle;
                     if(rot<0.0)
                         rot+=360.0f;
                     int bin = round(rot*factor);
@@ -514,7 +628,7 @@ int ORBmatcher::SearchForInitialization(Frame &F1, Frame &F2, vector<cv::Point2f
     //Update prev matched
     for(size_t i1=0, iend1=vnMatches12.size(); i1<iend1; i1++)
         if(vnMatches12[i1]>=0)
-            vbPrevMatched[i1]=F2.mvKeysUn[vnMatches12[i1]].pt;
+            vbPrevMatched[i1]=F2.mpFeatures->mvKeysUn[vnMatches12[i1]].pt;
 
     return nmatches;
 }
@@ -547,6 +661,9 @@ int ORBmatcher::SearchByBoW(KeyFrame *pKF1, KeyFrame *pKF2, vector<MapPoint *> &
     DBoW2::FeatureVector::const_iterator f1end = vFeatVec1.end();
     DBoW2::FeatureVector::const_iterator f2end = vFeatVec2.end();
 
+    vector<const uchar*> vpCandidates;
+    vector<size_t> vCandidateIdx;
+
     while(f1it != f1end && f2it != f2end)
     {
         if(f1it->first == f2it->first)
@@ -561,11 +678,8 @@ int ORBmatcher::SearchByBoW(KeyFrame *pKF1, KeyFrame *pKF2, vector<MapPoint *> &
                 if(pMP1->isBad())
                     continue;
 
-                const cv::Mat &d1 = Descriptors1.row(idx1);
-
-                int bestDist1=256;
-                int bestIdx2 =-1 ;
-                int bestDist2=256;
+                vpCandidates.clear();
+                vCandidateIdx.clear();
 
                 for(size_t i2=0, iend2=f2it->second.size(); i2<iend2; i2++)
                 {
@@ -579,26 +693,19 @@ int ORBmatcher::SearchByBoW(KeyFrame *pKF1, KeyFrame *pKF2, vector<MapPoint *> &
                     if(pMP2->isBad())
                         continue;
 
-                    const cv::Mat &d2 = Descriptors2.row(idx2);
-
-                    int dist = DescriptorDistance(d1,d2);
-
-                    if(dist<bestDist1)
-                    {
-                        bestDist2=bestDist1;
-                        bestDist1=dist;
-                        bestIdx2=idx2;
-                    }
-                    else if(dist<bestDist2)
-                    {
-                        bestDist2=dist;
-                    }
+                    vpCandidates.push_back(Descriptors2.ptr<uchar>(idx2));
+                    vCandidateIdx.push_back(idx2);
                 }
 
+                int iBest, bestDist1, iBest2, bestDist2;
+                SearchBestTwo(Descriptors1.ptr<uchar>(idx1),vpCandidates.data(),vpCandidates.size(),
+                              iBest,bestDist1,iBest2,bestDist2);
+
                 if(bestDist1<TH_LOW)
                 {
                     if(static_cast<float>(bestDist1)<mfNNratio*static_cast<float>(bestDist2))
                     {
+                        const size_t bestIdx2 = vCandidateIdx[iBest];
                         vpMatches12[idx1]=vpMapPoints2[bestIdx2];
                         vbMatched2[bestIdx2]=true;
 
@@ -654,20 +761,21 @@ int ORBmatcher::SearchByBoW(KeyFrame *pKF1, KeyFrame *pKF2, vector<MapPoint *> &
     return nmatches;
 }
 
-int ORBmatcher::SearchForTriangulation(KeyFrame *pKF1, KeyFrame *pKF2, cv::Mat F12,
+int ORBmatcher::SearchForTriangulation(KeyFrame *pKF1, KeyFrame *pKF2, const Eigen::Matrix3f &F12,
                                        vector<pair<size_t, size_t> > &vMatchedPairs, const bool bOnlyStereo)
 {    
     const DBoW2::FeatureVector &vFeatVec1 = pKF1->mFeatVec;
     const DBoW2::FeatureVector &vFeatVec2 = pKF2->mFeatVec;
 
     //Compute epipole in second image
-    cv::Mat Cw = pKF1->GetCameraCenter();
-    cv::Mat R2w = pKF2->GetRotation();
-    cv::Mat t2w = pKF2->GetTranslation();
-    cv::Mat C2 = R2w*Cw+t2w;
-    const float invz = 1.0f/C2.at<float>(2);
-    const float ex =pKF2->fx*C2.at<float>(0)*invz+pKF2->cx;
-    const float ey =pKF2->fy*C2.at<float>(1)*invz+pKF2->cy;
+    const Eigen::Vector3f Cw = pKF1->GetCameraCenter();
+    Eigen::Matrix3f R2w;
+    Eigen::Vector3f t2w;
+    pKF2->GetPose(R2w,t2w);
+    const Eigen::Vector3f C2 = R2w*Cw+t2w;
+    const float invz = 1.0f/C2(2);
+    const float ex =pKF2->fx*C2(0)*invz+pKF2->cx;
+    const float ey =pKF2->fy*C2(1)*invz+pKF2->cy;
 
     // Find matches between not tracked keypoints
     // Matching speed-up by ORB Vocabulary
@@ -688,6 +796,10 @@ int ORBmatcher::SearchForTriangulation(KeyFrame *pKF1, KeyFrame *pKF2, cv::Mat F
     DBoW2::FeatureVector::const_iterator f1end = vFeatVec1.end();
     DBoW2::FeatureVector::const_iterator f2end = vFeatVec2.end();
 
+    vector<const uchar*> vpCandidates;
+    vector<size_t> vCandidateIdx;
+    vector<int> vDist;
+
     while(f1it!=f1end && f2it!=f2end)
     {
         if(f1it->first == f2it->first)
@@ -710,10 +822,8 @@ int ORBmatcher::SearchForTriangulation(KeyFrame *pKF1, KeyFrame *pKF2, cv::Mat F
                 
                 const cv::KeyPoint &kp1 = pKF1->mvKeysUn[idx1];
                 
-                const cv::Mat &d1 = pKF1->mDescriptors.row(idx1);
-                
-                int bestDist = TH_LOW;
-                int bestIdx2 = -1;
+                vpCandidates.clear();
+                vCandidateIdx.clear();
                 
                 for(size_t i2=0, iend2=f2it->second.size(); i2<iend2; i2++)
                 {
@@ -725,19 +835,30 @@ int ORBmatcher::SearchForTriangulation(KeyFrame *pKF1, KeyFrame *pKF2, cv::Mat F
                     if(vbMatched2[idx2] || pMP2)
                         continue;
 
-                    const bool bStereo2 = pKF2->mvuRight[idx2]>=0;
-
                     if(bOnlyStereo)
-                        if(!bStereo2)
+                        if(pKF2->mvuRight[idx2]<0)
                             continue;
                     
-                    const cv::Mat &d2 = pKF2->mDescriptors.row(idx2);
-                    
-                    const int dist = DescriptorDistance(d1,d2);
+                    vpCandidates.push_back(pKF2->mDescriptors.ptr<uchar>(idx2));
+                    vCandidateIdx.push_back(idx2);
+                }
+
+                vDist.resize(vpCandidates.size());
+                DescriptorDistances(pKF1->mDescriptors.ptr<uchar>(idx1),vpCandidates.data(),vpCandidates.size(),vDist.data());
+
+                int bestDist = TH_LOW;
+                int bestIdx2 = -1;
+                
+                for(size_t j=0; j<vCandidateIdx.size(); j++)
+                {
+                    const size_t idx2 = vCandidateIdx[j];
+                    const int dist = vDist[j];
                     
                     if(dist>TH_LOW || dist>bestDist)
                         continue;
 
+                    const bool bStereo2 = pKF2->mvuRight[idx2]>=0;
+
                     const cv::KeyPoint &kp2 = pKF2->mvKeysUn[idx2];
 
                     if(!bStereo1 && !bStereo2)
@@ -824,8 +945,9 @@ int ORBmatcher::SearchForTriangulation(KeyFrame *pKF1, KeyFrame *pKF2, cv::Mat F
 
 int ORBmatcher::Fuse(KeyFrame *pKF, const vector<MapPoint *> &vpMapPoints, const float th)
 {
-    cv::Mat Rcw = pKF->GetRotation();
-    cv::Mat tcw = pKF->GetTranslation();
+    Eigen::Matrix3f Rcw;
+    Eigen::Vector3f tcw;
+    pKF->GetPose(Rcw,tcw);
 
     const float &fx = pKF->fx;
     const float &fy = pKF->fy;
@@ -833,12 +955,15 @@ int ORBmatcher::Fuse(KeyFrame *pKF, const vector<MapPoint *> &vpMapPoints, const
     const float &cy = pKF->cy;
     const float &bf = pKF->mbf;
 
-    cv::Mat Ow = pKF->GetCameraCenter();
+    const Eigen::Vector3f Ow = -Rcw.transpose()*tcw;
 
     int nFused=0;
 
     const int nMPs = vpMapPoints.size();
 
+    vector<const uchar*> vpCandidates;
+    vector<size_t> vCandidateIdx;
+
     for(int i=0; i<nMPs; i++)
     {
         MapPoint* pMP = vpMapPoints[i];
@@ -849,16 +974,16 @@ int ORBmatcher::Fuse(KeyFrame *pKF, const vector<MapPoint *> &vpMapPoints, const
         if(pMP->isBad() || pMP->IsInKeyFrame(pKF))
             continue;
 
-        cv::Mat p3Dw = pMP->GetWorldPos();
-        cv::Mat p3Dc = Rcw*p3Dw + tcw;
+        const Eigen::Vector3f p3Dw = pMP->GetWorldPos();
+        const Eigen::Vector3f p3Dc = Rcw*p3Dw + tcw;
 
         // Depth must be positive
-        if(p3Dc.at<float>(2)<0.0f)
+        if(p3Dc(2)<0.0f)
             continue;
 
-        const float invz = 1/p3Dc.at<float>(2);
-        const float x = p3Dc.at<float>(0)*invz;
-        const float y = p3Dc.at<float>(1)*invz;
+        const float invz = 1/p3Dc(2);
+        const float x = p3Dc(0)*invz;
+        const float y = p3Dc(1)*invz;
 
         const float u = fx*x+cx;
         const float v = fy*y+cy;
@@ -871,15 +996,15 @@ int ORBmatcher::Fuse(KeyFrame *pKF, const vector<MapPoint *> &vpMapPoints, const
 
         const float maxDistance = pMP->GetMaxDistanceInvariance();
         const float minDistance = pMP->GetMinDistanceInvariance();
-        cv::Mat PO = p3Dw-Ow;
-        const float dist3D = cv::norm(PO);
+        const Eigen::Vector3f PO = p3Dw-Ow;
+        const float dist3D = PO.norm();
 
         // Depth must be inside the scale pyramid of the image
         if(dist3D<minDistance || dist3D>maxDistance )
             continue;
 
         // Viewing angle must be less than 60 deg
-        cv::Mat Pn = pMP->GetNormal();
+        const Eigen::Vector3f Pn = pMP->GetNormal();
 
         if(PO.dot(Pn)<0.5*dist3D)
             continue;
@@ -898,8 +1023,9 @@ int ORBmatcher::Fuse(KeyFrame *pKF, const vector<MapPoint *> &vpMapPoints, const
 
         const cv::Mat dMP = pMP->GetDescriptor();
 
-        int bestDist = 256;
-        int bestIdx = -1;
+        vpCandidates.clear();
+        vCandidateIdx.clear();
+
         for(vector<size_t>::const_iterator vit=vIndices.begin(), vend=vIndices.end(); vit!=vend; vit++)
         {
             const size_t idx = *vit;
@@ -937,20 +1063,17 @@ int ORBmatcher::Fuse(KeyFrame *pKF, const vector<MapPoint *> &vpMapPoints, const
                     continue;
             }
 
-            const cv::Mat &dKF = pKF->mDescriptors.row(idx);
-
-            const int dist = DescriptorDistance(dMP,dKF);
-
-            if(dist<bestDist)
-            {
-                bestDist = dist;
-                bestIdx = idx;
-            }
+            vpCandidates.push_back(pKF->mDescriptors.ptr<uchar>(idx));
+            vCandidateIdx.push_back(idx);
         }
 
+        int iBest, bestDist, iBest2, bestDist2;
+        SearchBestTwo(dMP.ptr<uchar>(),vpCandidates.data(),vpCandidates.size(),iBest,bestDist,iBest2,bestDist2);
+
         // If there is already a MapPoint replace otherwise add new measurement
         if(bestDist<=TH_LOW)
         {
+            const size_t bestIdx = vCandidateIdx[iBest];
             MapPoint* pMPinKF = pKF->GetMapPoint(bestIdx);
             if(pMPinKF)
             {
@@ -974,7 +1097,7 @@ int ORBmatcher::Fuse(KeyFrame *pKF, const vector<MapPoint *> &vpMapPoints, const
     return nFused;
 }
 
-int ORBmatcher::Fuse(KeyFrame *pKF, cv::Mat Scw, const vector<MapPoint *> &vpPoints, float th, vector<MapPoint *> &vpReplacePoint)
+int ORBmatcher::Fuse(KeyFrame *pKF, const g2o::Sim3 &Scw, const vector<MapPoint *> &vpPoints, float th, vector<MapPoint *> &vpReplacePoint)
 {
     // Get Calibration Parameters for later projection
     const float &fx = pKF->fx;
@@ -983,11 +1106,9 @@ int ORBmatcher::Fuse(KeyFrame *pKF, cv::Mat Scw, const vector<MapPoint *> &vpPoi
     const float &cy = pKF->cy;
 
     // Decompose Scw
-    cv::Mat sRcw = Scw.rowRange(0,3).colRange(0,3);
-    const float scw = sqrt(sRcw.row(0).dot(sRcw.row(0)));
-    cv::Mat Rcw = sRcw/scw;
-    cv::Mat tcw = Scw.rowRange(0,3).col(3)/scw;
-    cv::Mat Ow = -Rcw.t()*tcw;
+    const Eigen::Matrix3f Rcw = Scw.rotation().toRotationMatrix().cast<float>();
+    const Eigen::Vector3f tcw = (Scw.translation()/Scw.scale()).cast<float>();
+    const Eigen::Vector3f Ow = -Rcw.transpose()*tcw;
 
     // Set of MapPoints already found in the KeyFrame
     const set<MapPoint*> spAlreadyFound = pKF->GetMapPoints();
@@ -996,6 +1117,9 @@ int ORBmatcher::Fuse(KeyFrame *pKF, cv::Mat Scw, const vector<MapPoint *> &vpPoi
 
     const int nPoints = vpPoints.size();
 
+    vector<const uchar*> vpCandidates;
+    vector<size_t> vCandidateIdx;
+
     // For each candidate MapPoint project and match
     for(int iMP=0; iMP<nPoints; iMP++)
     {
@@ -1006,19 +1130,19 @@ int ORBmatcher::Fuse(KeyFrame *pKF, cv::Mat Scw, const vector<MapPoint *> &vpPoi
             continue;
 
         // Get 3D Coords.
-        cv::Mat p3Dw = pMP->GetWorldPos();
+        const Eigen::Vector3f p3Dw = pMP->GetWorldPos();
 
         // Transform into Camera Coords.
-        cv::Mat p3Dc = Rcw*p3Dw+tcw;
+        const Eigen::Vector3f p3Dc = Rcw*p3Dw+tcw;
 
         // Depth must be positive
-        if(p3Dc.at<float>(2)<0.0f)
+        if(p3Dc(2)<0.0f)
             continue;
 
         // Project into Image
-        const float invz = 1.0/p3Dc.at<float>(2);
-        const float x = p3Dc.at<float>(0)*invz;
-        const float y = p3Dc.at<float>(1)*invz;
+        const float invz = 1.0/p3Dc(2);
+        const float x = p3Dc(0)*invz;
+        const float y = p3Dc(1)*invz;
 
         const float u = fx*x+cx;
         const float v = fy*y+cy;
@@ -1030,14 +1154,14 @@ int ORBmatcher::Fuse(KeyFrame *pKF, cv::Mat Scw, const vector<MapPoint *> &vpPoi
         // Depth must be inside the scale pyramid of the image
         const float maxDistance = pMP->GetMaxDistanceInvariance();
         const float minDistance = pMP->GetMinDistanceInvariance();
-        cv::Mat PO = p3Dw-Ow;
-        const float dist3D = cv::norm(PO);
+        const Eigen::Vector3f PO = p3Dw-Ow;
+        const float dist3D = PO.norm();
 
         if(dist3D<minDistance || dist3D>maxDistance)
             continue;
 
         // Viewing angle must be less than 60 deg
-        cv::Mat Pn = pMP->GetNormal();
+        const Eigen::Vector3f Pn = pMP->GetNormal();
 
         if(PO.dot(Pn)<0.5*dist3D)
             continue;
@@ -1057,8 +1181,9 @@ int ORBmatcher::Fuse(KeyFrame *pKF, cv::Mat Scw, const vector<MapPoint *> &vpPoi
 
         const cv::Mat dMP = pMP->GetDescriptor();
 
-        int bestDist = INT_MAX;
-        int bestIdx = -1;
+        vpCandidates.clear();
+        vCandidateIdx.clear();
+
         for(vector<size_t>::const_iterator vit=vIndices.begin(); vit!=vIndices.end(); vit++)
         {
             const size_t idx = *vit;
@@ -1067,20 +1192,17 @@ int ORBmatcher::Fuse(KeyFrame *pKF, cv::Mat Scw, const vector<MapPoint *> &vpPoi
             if(kpLevel<nPredictedLevel-1 || kpLevel>nPredictedLevel)
                 continue;
 
-            const cv::Mat &dKF = pKF->mDescriptors.row(idx);
-
-            int dist = DescriptorDistance(dMP,dKF);
-
-            if(dist<bestDist)
-            {
-                bestDist = dist;
-                bestIdx = idx;
-            }
+            vpCandidates.push_back(pKF->mDescriptors.ptr<uchar>(idx));
+            vCandidateIdx.push_back(idx);
         }
 
+        int iBest, bestDist, iBest2, bestDist2;
+        SearchBestTwo(dMP.ptr<uchar>(),vpCandidates.data(),vpCandidates.size(),iBest,bestDist,iBest2,bestDist2);
+
         // If there is already a MapPoint replace otherwise add new measurement
         if(bestDist<=TH_LOW)
         {
+            const size_t bestIdx = vCandidateIdx[iBest];
             MapPoint* pMPinKF = pKF->GetMapPoint(bestIdx);
             if(pMPinKF)
             {
@@ -1100,7 +1222,7 @@ int ORBmatcher::Fuse(KeyFrame *pKF, cv::Mat Scw, const vector<MapPoint *> &vpPoi
 }
 
 int ORBmatcher::SearchBySim3(KeyFrame *pKF1, KeyFrame *pKF2, vector<MapPoint*> &vpMatches12,
-                             const float &s12, const cv::Mat &R12, const cv::Mat &t12, const float th)
+                             const float &s12, const Eigen::Matrix3f &R12, const Eigen::Vector3f &t12, const float th)
 {
     const float &fx = pKF1->fx;
     const float &fy = pKF1->fy;
@@ -1108,17 +1230,19 @@ int ORBmatcher::SearchBySim3(KeyFrame *pKF1, KeyFrame *pKF2, vector<MapPoint*> &
     const float &cy = pKF1->cy;
 
     // Camera 1 from world
-    cv::Mat R1w = pKF1->GetRotation();
-    cv::Mat t1w = pKF1->GetTranslation();
+    Eigen::Matrix3f R1w;
+    Eigen::Vector3f t1w;
+    pKF1->GetPose(R1w,t1w);
 
     //Camera 2 from world
-    cv::Mat R2w = pKF2->GetRotation();
-    cv::Mat t2w = pKF2->GetTranslation();
+    Eigen::Matrix3f R2w;
+    Eigen::Vector3f t2w;
+    pKF2->GetPose(R2w,t2w);
 
     //Transformation between cameras
-    cv::Mat sR12 = s12*R12;
-    cv::Mat sR21 = (1.0/s12)*R12.t();
-    cv::Mat t21 = -sR21*t12;
+    const Eigen::Matrix3f sR12 = s12*R12;
+    const Eigen::Matrix3f sR21 = (1.0f/s12)*R12.transpose();
+    const Eigen::Vector3f t21 = -sR21*t12;
 
     const vector<MapPoint*> vpMapPoints1 = pKF1->GetMapPointMatches();
     const int N1 = vpMapPoints1.size();
@@ -1144,6 +1268,9 @@ int ORBmatcher::SearchBySim3(KeyFrame *pKF1, KeyFrame *pKF2, vector<MapPoint*> &
     vector<int> vnMatch1(N1,-1);
     vector<int> vnMatch2(N2,-1);
 
+    vector<const uchar*> vpCandidates;
+    vector<size_t> vCandidateIdx;
+
     // Transform from KF1 to KF2 and search
     for(int i1=0; i1<N1; i1++)
     {
@@ -1155,17 +1282,17 @@ int ORBmatcher::SearchBySim3(KeyFrame *pKF1, KeyFrame *pKF2, vector<MapPoint*> &
         if(pMP->isBad())
             continue;
 
-        cv::Mat p3Dw = pMP->GetWorldPos();
-        cv::Mat p3Dc1 = R1w*p3Dw + t1w;
-        cv::Mat p3Dc2 = sR21*p3Dc1 + t21;
+        const Eigen::Vector3f p3Dw = pMP->GetWorldPos();
+        const Eigen::Vector3f p3Dc1 = R1w*p3Dw + t1w;
+        const Eigen::Vector3f p3Dc2 = sR21*p3Dc1 + t21;
 
         // Depth must be positive
-        if(p3Dc2.at<float>(2)<0.0)
+        if(p3Dc2(2)<0.0)
             continue;
 
-        const float invz = 1.0/p3Dc2.at<float>(2);
-        const float x = p3Dc2.at<float>(0)*invz;
-        const float y = p3Dc2.at<float>(1)*invz;
+        const float invz = 1.0/p3Dc2(2);
+        const float x = p3Dc2(0)*invz;
+        const float y = p3Dc2(1)*invz;
 
         const float u = fx*x+cx;
         const float v = fy*y+cy;
@@ -1176,7 +1303,7 @@ int ORBmatcher::SearchBySim3(KeyFrame *pKF1, KeyFrame *pKF2, vector<MapPoint*> &
 
         const float maxDistance = pMP->GetMaxDistanceInvariance();
         const float minDistance = pMP->GetMinDistanceInvariance();
-        const float dist3D = cv::norm(p3Dc2);
+        const float dist3D = p3Dc2.norm();
 
         // Depth must be inside the scale invariance region
         if(dist3D<minDistance || dist3D>maxDistance )
@@ -1196,8 +1323,9 @@ int ORBmatcher::SearchBySim3(KeyFrame *pKF1, KeyFrame *pKF2, vector<MapPoint*> &
         // Match to the most similar keypoint in the radius
         const cv::Mat dMP = pMP->GetDescriptor();
 
-        int bestDist = INT_MAX;
-        int bestIdx = -1;
+        vpCandidates.clear();
+        vCandidateIdx.clear();
+
         for(vector<size_t>::const_iterator vit=vIndices.begin(), vend=vIndices.end(); vit!=vend; vit++)
         {
             const size_t idx = *vit;
@@ -1207,20 +1335,16 @@ int ORBmatcher::SearchBySim3(KeyFrame *pKF1, KeyFrame *pKF2, vector<MapPoint*> &
             if(kp.octave<nPredictedLevel-1 || kp.octave>nPredictedLevel)
                 continue;
 
-            const cv::Mat &dKF = pKF2->mDescriptors.row(idx);
-
-            const int dist = DescriptorDistance(dMP,dKF);
-
-            if(dist<bestDist)
-            {
-                bestDist = dist;
-                bestIdx = idx;
-            }
+            vpCandidates.push_back(pKF2->mDescriptors.ptr<uchar>(idx));
+            vCandidateIdx.push_back(idx);
         }
 
+        int iBest, bestDist, iBest2, bestDist2;
+        SearchBestTwo(dMP.ptr<uchar>(),vpCandidates.data(),vpCandidates.size(),iBest,bestDist,iBest2,bestDist2);
+
         if(bestDist<=TH_HIGH)
         {
-            vnMatch1[i1]=bestIdx;
+            vnMatch1[i1]=vCandidateIdx[iBest];
         }
     }
 
@@ -1235,17 +1359,17 @@ int ORBmatcher::SearchBySim3(KeyFrame *pKF1, KeyFrame *pKF2, vector<MapPoint*> &
         if(pMP->isBad())
             continue;
 
-        cv::Mat p3Dw = pMP->GetWorldPos();
-        cv::Mat p3Dc2 = R2w*p3Dw + t2w;
-        cv::Mat p3Dc1 = sR12*p3Dc2 + t12;
+        const Eigen::Vector3f p3Dw = pMP->GetWorldPos();
+        const Eigen::Vector3f p3Dc2 = R2w*p3Dw + t2w;
+        const Eigen::Vector3f p3Dc1 = sR12*p3Dc2 + t12;
 
         // Depth must be positive
-        if(p3Dc1.at<float>(2)<0.0)
+        if(p3Dc1(2)<0.0)
             continue;
 
-        const float invz = 1.0/p3Dc1.at<float>(2);
-        const float x = p3Dc1.at<float>(0)*invz;
-        const float y = p3Dc1.at<float>(1)*invz;
+        const float invz = 1.0/p3Dc1(2);
+        const float x = p3Dc1(0)*invz;
+        const float y = p3Dc1(1)*invz;
 
         const float u = fx*x+cx;
         const float v = fy*y+cy;
@@ -1256,7 +1380,7 @@ int ORBmatcher::SearchBySim3(KeyFrame *pKF1, KeyFrame *pKF2, vector<MapPoint*> &
 
         const float maxDistance = pMP->GetMaxDistanceInvariance();
         const float minDistance = pMP->GetMinDistanceInvariance();
-        const float dist3D = cv::norm(p3Dc1);
+        const float dist3D = p3Dc1.norm();
 
         // Depth must be inside the scale pyramid of the image
         if(dist3D<minDistance || dist3D>maxDistance)
@@ -1276,8 +1400,9 @@ int ORBmatcher::SearchBySim3(KeyFrame *pKF1, KeyFrame *pKF2, vector<MapPoint*> &
         // Match to the most similar keypoint in the radius
         const cv::Mat dMP = pMP->GetDescriptor();
 
-        int bestDist = INT_MAX;
-        int bestIdx = -1;
+        vpCandidates.clear();
+        vCandidateIdx.clear();
+
         for(vector<size_t>::const_iterator vit=vIndices.begin(), vend=vIndices.end(); vit!=vend; vit++)
         {
             const size_t idx = *vit;
@@ -1287,20 +1412,16 @@ int ORBmatcher::SearchBySim3(KeyFrame *pKF1, KeyFrame *pKF2, vector<MapPoint*> &
             if(kp.octave<nPredictedLevel-1 || kp.octave>nPredictedLevel)
                 continue;
 
-            const cv::Mat &dKF = pKF1->mDescriptors.row(idx);
-
-            const int dist = DescriptorDistance(dMP,dKF);
-
-            if(dist<bestDist)
-            {
-                bestDist = dist;
-                bestIdx = idx;
-            }
+            vpCandidates.push_back(pKF1->mDescriptors.ptr<uchar>(idx));
+            vCandidateIdx.push_back(idx);
         }
 
+        int iBest, bestDist, iBest2, bestDist2;
+        SearchBestTwo(dMP.ptr<uchar>(),vpCandidates.data(),vpCandidates.size(),iBest,bestDist,iBest2,bestDist2);
+
         if(bestDist<=TH_HIGH)
         {
-            vnMatch2[i2]=bestIdx;
+            vnMatch2[i2]=vCandidateIdx[iBest];
         }
     }
 
@@ -1335,18 +1456,21 @@ int ORBmatcher::SearchByProjection(Frame &CurrentFrame, const Frame &LastFrame,
         rotHist[i].reserve(500);
     const float factor = 1.0f/HISTO_LENGTH;
 
-    const cv::Mat Rcw = CurrentFrame.mTcw.rowRange(0,3).colRange(0,3);
-    const cv::Mat tcw = CurrentFrame.mTcw.rowRange(0,3).col(3);
+    const Eigen::Matrix3f Rcw = CurrentFrame.GetRotation();
+    const Eigen::Vector3f tcw = CurrentFrame.GetTranslation();
+
+    const Eigen::Vector3f twc = CurrentFrame.GetCameraCenter();
 
-    const cv::Mat twc = -Rcw.t()*tcw;
+    const Eigen::Matrix3f Rlw = LastFrame.GetRotation();
+    const Eigen::Vector3f tlw = LastFrame.GetTranslation();
 
-    const cv::Mat Rlw = LastFrame.mTcw.rowRange(0,3).colRange(0,3);
-    const cv::Mat tlw = LastFrame.mTcw.rowRange(0,3).col(3);
+    const Eigen::Vector3f tlc = Rlw*twc+tlw;
 
-    const cv::Mat tlc = Rlw*twc+tlw;
+    const bool bForward = tlc(2)>CurrentFrame.mb && !bMono;
+    const bool bBackward = -tlc(2)>CurrentFrame.mb && !bMono;
 
-    const bool bForward = tlc.at<float>(2)>CurrentFrame.mb && !bMono;
-    const bool bBackward = -tlc.at<float>(2)>CurrentFrame.mb && !bMono;
+    vector<const uchar*> vpCandidates;
+    vector<size_t> vCandidateIdx;
 
     for(int i=0; i<LastFrame.N; i++)
     {
@@ -1357,12 +1481,12 @@ int ORBmatcher::SearchByProjection(Frame &CurrentFrame, const Frame &LastFrame,
             if(!LastFrame.mvbOutlier[i])
             {
                 // Project
-                cv::Mat x3Dw = pMP->GetWorldPos();
-                cv::Mat x3Dc = Rcw*x3Dw+tcw;
+                const Eigen::Vector3f x3Dw = pMP->GetWorldPos();
+                const Eigen::Vector3f x3Dc = Rcw*x3Dw+tcw;
 
-                const float xc = x3Dc.at<float>(0);
-                const float yc = x3Dc.at<float>(1);
-                const float invzc = 1.0/x3Dc.at<float>(2);
+                const float xc = x3Dc(0);
+                const float yc = x3Dc(1);
+                const float invzc = 1.0/x3Dc(2);
 
                 if(invzc<0)
                     continue;
@@ -1375,7 +1499,7 @@ int ORBmatcher::SearchByProjection(Frame &CurrentFrame, const Frame &LastFrame,
                 if(v<CurrentFrame.mnMinY || v>CurrentFrame.mnMaxY)
                     continue;
 
-                int nLastOctave = LastFrame.mvKeys[i].octave;
+                int nLastOctave = LastFrame.mpFeatures->mvKeys[i].octave;
 
                 // Search in a window. Size depends on scale
                 float radius = th*CurrentFrame.mvScaleFactors[nLastOctave];
@@ -1394,8 +1518,8 @@ int ORBmatcher::SearchByProjection(Frame &CurrentFrame, const Frame &LastFrame,
 
                 const cv::Mat dMP = pMP->GetDescriptor();
 
-                int bestDist = 256;
-                int bestIdx2 = -1;
+                vpCandidates.clear();
+                vCandidateIdx.clear();
 
                 for(vector<size_t>::const_iterator vit=vIndices2.begin(), vend=vIndices2.end(); vit!=vend; vit++)
                 {
@@ -1404,33 +1528,30 @@ int ORBmatcher::SearchByProjection(Frame &CurrentFrame, const Frame &LastFrame,
                         if(CurrentFrame.mvpMapPoints[i2]->Observations()>0)
                             continue;
 
-                    if(CurrentFrame.mvuRight[i2]>0)
+                    if(CurrentFrame.mpFeatures->mvuRight[i2]>0)
                     {
                         const float ur = u - CurrentFrame.mbf*invzc;
-                        const float er = fabs(ur - CurrentFrame.mvuRight[i2]);
+                        const float er = fabs(ur - CurrentFrame.mpFeatures->mvuRight[i2]);
                         if(er>radius)
                             continue;
                     }
 
-                    const cv::Mat &d = CurrentFrame.mDescriptors.row(i2);
-
-                    const int dist = DescriptorDistance(dMP,d);
-
-                    if(dist<bestDist)
-                    {
-                        bestDist=dist;
-                        bestIdx2=i2;
-                    }
+                    vpCandidates.push_back(CurrentFrame.mDescriptors.ptr<uchar>(i2));
+                    vCandidateIdx.push_back(i2);
                 }
 
+                int iBest, bestDist, iBest2, bestDist2;
+                SearchBestTwo(dMP.ptr<uchar>(),vpCandidates.data(),vpCandidates.size(),iBest,bestDist,iBest2,bestDist2);
+
                 if(bestDist<=TH_HIGH)
                 {
+                    const size_t bestIdx2 = vCandidateIdx[iBest];
                     CurrentFrame.mvpMapPoints[bestIdx2]=pMP;
                     nmatches++;
 
                     if(mbCheckOrientation)
                     {
-                        float rot = LastFrame.mvKeysUn[i].angle-CurrentFrame.mvKeysUn[bestIdx2].angle;
+                        float rot = LastFrame.mpFeatures->mvKeysUn[i].angle-CurrentFrame.mpFeatures->mvKeysUn[bestIdx2].angle;
                         if(rot<0.0)
                             rot+=360.0f;
                         int bin = round(rot*factor);
@@ -1473,9 +1594,9 @@ int ORBmatcher::SearchByProjection(Frame &CurrentFrame, KeyFrame *pKF, const set
 {
     int nmatches = 0;
 
-    const cv::Mat Rcw = CurrentFrame.mTcw.rowRange(0,3).colRange(0,3);
-    const cv::Mat tcw = CurrentFrame.mTcw.rowRange(0,3).col(3);
-    const cv::Mat Ow = -Rcw.t()*tcw;
+    const Eigen::Matrix3f Rcw = CurrentFrame.GetRotation();
+    const Eigen::Vector3f tcw = CurrentFrame.GetTranslation();
+    const Eigen::Vector3f Ow = CurrentFrame.GetCameraCenter();
 
     // Rotation Histogram (to check rotation consistency)
     vector<int> rotHist[HISTO_LENGTH];
@@ -1485,6 +1606,9 @@ int ORBmatcher::SearchByProjection(Frame &CurrentFrame, KeyFrame *pKF, const set
 
     const vector<MapPoint*> vpMPs = pKF->GetMapPointMatches();
 
+    vector<const uchar*> vpCandidates;
+    vector<size_t> vCandidateIdx;
+
     for(size_t i=0, iend=vpMPs.size(); i<iend; i++)
     {
         MapPoint* pMP = vpMPs[i];
@@ -1494,12 +1618,12 @@ int ORBmatcher::SearchByProjection(Frame &CurrentFrame, KeyFrame *pKF, const set
             if(!pMP->isBad() && !sAlreadyFound.count(pMP))
             {
                 //Project
-                cv::Mat x3Dw = pMP->GetWorldPos();
-                cv::Mat x3Dc = Rcw*x3Dw+tcw;
+                const Eigen::Vector3f x3Dw = pMP->GetWorldPos();
+                const Eigen::Vector3f x3Dc = Rcw*x3Dw+tcw;
 
-                const float xc = x3Dc.at<float>(0);
-                const float yc = x3Dc.at<float>(1);
-                const float invzc = 1.0/x3Dc.at<float>(2);
+                const float xc = x3Dc(0);
+                const float yc = x3Dc(1);
+                const float invzc = 1.0/x3Dc(2);
 
                 const float u = CurrentFrame.fx*xc*invzc+CurrentFrame.cx;
                 const float v = CurrentFrame.fy*yc*invzc+CurrentFrame.cy;
@@ -1510,8 +1634,8 @@ int ORBmatcher::SearchByProjection(Frame &CurrentFrame, KeyFrame *pKF, const set
                     continue;
 
                 // Compute predicted scale level
-                cv::Mat PO = x3Dw-Ow;
-                float dist3D = cv::norm(PO);
+                const Eigen::Vector3f PO = x3Dw-Ow;
+                float dist3D = PO.norm();
 
                 const float maxDistance = pMP->GetMaxDistanceInvariance();
                 const float minDistance = pMP->GetMinDistanceInvariance();
@@ -1532,8 +1656,8 @@ int ORBmatcher::SearchByProjection(Frame &CurrentFrame, KeyFrame *pKF, const set
 
                 const cv::Mat dMP = pMP->GetDescriptor();
 
-                int bestDist = 256;
-                int bestIdx2 = -1;
+                vpCandidates.clear();
+                vCandidateIdx.clear();
 
                 for(vector<size_t>::const_iterator vit=vIndices2.begin(); vit!=vIndices2.end(); vit++)
                 {
@@ -1541,25 +1665,22 @@ int ORBmatcher::SearchByProjection(Frame &CurrentFrame, KeyFrame *pKF, const set
                     if(CurrentFrame.mvpMapPoints[i2])
                         continue;
 
-                    const cv::Mat &d = CurrentFrame.mDescriptors.row(i2);
-
-                    const int dist = DescriptorDistance(dMP,d);
-
-                    if(dist<bestDist)
-                    {
-                        bestDist=dist;
-                        bestIdx2=i2;
-                    }
+                    vpCandidates.push_back(CurrentFrame.mDescriptors.ptr<uchar>(i2));
+                    vCandidateIdx.push_back(i2);
                 }
 
+                int iBest, bestDist, iBest2, bestDist2;
+                SearchBestTwo(dMP.ptr<uchar>(),vpCandidates.data(),vpCandidates.size(),iBest,bestDist,iBest2,bestDist2);
+
                 if(bestDist<=ORBdist)
                 {
+                    const size_t bestIdx2 = vCandidateIdx[iBest];
                     CurrentFrame.mvpMapPoints[bestIdx2]=pMP;
                     nmatches++;
 
                     if(mbCheckOrientation)
                     {
-                        float rot = pKF->mvKeysUn[i].angle-CurrentFrame.mvKeysUn[bestIdx2].angle;
+                        float rot = pKF->mvKeysUn[i].angle-CurrentFrame.mpFeatures->mvKeysUn[bestIdx2].angle;
                         if(rot<0.0)
                             rot+=360.0f;
                         int bin = round(rot*factor);
@@ -1641,25 +1762,60 @@ void ORBmatcher::ComputeThreeMaxima(vector<int>* histo, const int L, int &ind1,
     }
 }
 
-
-// Bit set count operation from
-// http://graphics.stanford.edu/~seander/bithacks.html#CountBitsSetParallel
 int ORBmatcher::DescriptorDistance(const cv::Mat &a, const cv::Mat &b)
 {
-    const int *pa = a.ptr<int32_t>();
-    const int *pb = b.ptr<int32_t>();
+    return DescriptorDistance(a.ptr<uchar>(),b.ptr<uchar>());
+}
+
+int ORBmatcher::DescriptorDistance(const uchar *a, const uchar *b)
+{
+    const uint64_t *pa = reinterpret_cast<const uint64_t*>(a);
+    const uint64_t *pb = reinterpret_cast<const uint64_t*>(b);
+
+    return __builtin_popcountll(pa[0]^pb[0]) + __builtin_popcountll(pa[1]^pb[1]) +
+           __builtin_popcountll(pa[2]^pb[2]) + __builtin_popcountll(pa[3]^pb[3]);
+}
+
+void ORBmatcher::DescriptorDistances(const uchar *a, const uchar* const* vpB, const int N, int* vDist)
+{
+    DescriptorDistancesKernel(a,vpB,N,vDist);
+}
+
+void ORBmatcher::SearchBestTwo(const uchar *a, const uchar* const* vpB, const int N,
+                               int &bestIdx, int &bestDist, int &bestIdx2, int &bestDist2)
+{
+    bestIdx = -1;
+    bestDist = 256;
+    bestIdx2 = -1;
+    bestDist2 = 256;
 
-    int dist=0;
+    // Distances are computed in blocks on the stack
+    const int BLOCK = 64;
+    int vDist[BLOCK];
 
-    for(int i=0; i<8; i++, pa++, pb++)
+    for(int i0=0; i0<N; i0+=BLOCK)
     {
-        unsigned  int v = *pa ^ *pb;
-        v = v - ((v >> 1) & 0x55555555);
-        v = (v & 0x33333333) + ((v >> 2) & 0x33333333);
-        dist += (((v + (v >> 4)) & 0xF0F0F0F) * 0x1010101) >> 24;
-    }
+        const int n = min(BLOCK,N-i0);
+        DescriptorDistancesKernel(a,vpB+i0,n,vDist);
+
+        for(int i=0; i<n; i++)
+        {
+            const int dist = vDist[i];
 
-    return dist;
+            if(dist<bestDist)
+            {
+                bestDist2=bestDist;
+                bestIdx2=bestIdx;
+                bestDist=dist;
+                bestIdx=i0+i;
+            }
+            else if(dist<bestDist2)
+            {
+                bestDist2=dist;
+                bestIdx2=i0+i;
+            }
+        }
+    }
 }
 
 } //namespace ORB_SLAM
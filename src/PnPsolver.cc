@@ -55,7 +55,6 @@
 #include <vector>
 #include <cmath>
 #include <opencv2/core/core.hpp>
-#include "Thirdparty/DBoW2/DUtils/Random.h"
 #include <algorithm>
 
 using namespace std;
@@ -64,11 +63,36 @@ namespace ORB_SLAM2
 {
 
 
+PnPsolver::PnPsolver():
+    pws(0), us(0), alphas(0), pcs(0), maximum_number_of_correspondences(0), number_of_correspondences(0), mnInliersi(0),
+    mnIterations(0), mnBestInliers(0), N(0)
+{
+}
+
 PnPsolver::PnPsolver(const Frame &F, const vector<MapPoint*> &vpMapPointMatches):
     pws(0), us(0), alphas(0), pcs(0), maximum_number_of_correspondences(0), number_of_correspondences(0), mnInliersi(0),
     mnIterations(0), mnBestInliers(0), N(0)
 {
+    SetMatches(F,vpMapPointMatches);
+}
+
+void PnPsolver::SetMatches(const Frame &F, const vector<MapPoint*> &vpMapPointMatches)
+{
+    // Restart the RANSAC state
+    number_of_correspondences = 0;
+    mnInliersi = 0;
+    mnIterations = 0;
+    mvbBestInliers.clear();
+    mnBestInliers = 0;
+    mBestTcw.release();
+    mRefinedTcw.release();
+
     mvpMapPointMatches = vpMapPointMatches;
+    mvP2D.clear();
+    mvSigma2.clear();
+    mvP3Dw.clear();
+    mvKeyPointIndices.clear();
+    mvAllIndices.clear();
     mvP2D.reserve(F.mvpMapPoints.size());
     mvSigma2.reserve(F.mvpMapPoints.size());
     mvP3Dw.reserve(F.mvpMapPoints.size());
@@ -84,13 +108,14 @@ PnPsolver::PnPsolver(const Frame &F, const vector<MapPoint*> &vpMapPointMatches)
         {
             if(!pMP->isBad())
             {
-                const cv::KeyPoint &kp = F.mvKeysUn[i];
+                const cv::KeyPoint &kp = F.mpFeatures->mvKeysUn[i];
 
                 mvP2D.push_back(kp.pt);
                 mvSigma2.push_back(F.mvLevelSigma2[kp.octave]);
 
-                cv::Mat Pos = pMP->GetWorldPos();
-                mvP3Dw.push_back(cv::Point3f(Pos.at<float>(0),Pos.at<float>(1), Pos.at<float>(2)));
+                float x, y, z;
+                pMP->GetWorldPos(x,y,z);
+                mvP3Dw.push_back(cv::Point3f(x,y,z));
 
                 mvKeyPointIndices.push_back(i);
                 mvAllIndices.push_back(idx);               
@@ -117,6 +142,12 @@ PnPsolver::~PnPsolver()
   delete [] pcs;
 }
 
+void PnPsolver::SetSeed(const unsigned int seed0, const unsigned int seed1)
+{
+    std::seed_seq seq{seed0, seed1};
+    mRng.seed(seq);
+}
+
 
 void PnPsolver::SetRansacParameters(double probability, int minInliers, int maxIterations, int minSet, float epsilon, float th2)
 {
@@ -190,7 +221,7 @@ cv::Mat PnPsolver::iterate(int nIterations, bool &bNoMore, vector<bool> &vbInlie
         // Get min set of points
         for(short i = 0; i < mRansacMinSet; ++i)
         {
-            int randi = DUtils::Random::RandomInt(0, vAvailableIndices.size()-1);
+            int randi = std::uniform_int_distribution<int>(0, vAvailableIndices.size()-1)(mRng);
 
             int idx = vAvailableIndices[randi];
 
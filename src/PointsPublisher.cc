@@ -0,0 +1,163 @@
+/**
+* This file is part of ORB-SLAM2.
+*
+* Copyright (C) 2014-2016 Raúl Mur-Artal <raulmur at unizar dot es> (University of Zaragoza)
+* For more information see <https://github.com/raulmur/ORB_SLAM2>
+*
+* ORB-SLAM2 is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM2 is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with ORB-SLAM2. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "PointsPublisher.h"
+#include "MapPoint.h"
+
+#include <cmath>
+#include <algorithm>
+
+using namespace std;
+
+namespace ORB_SLAM2
+{
+
+PointsPublisher::PointsPublisher(ros::Publisher *pPublisher, const string &strSettingPath):
+    mpPublisher(pPublisher), mbEnabled(true), mnEveryNFrames(1), mbCameraDistance(false), mnFrames(0),
+    mbPending(false), mbFinishRequested(false)
+{
+    cv::FileStorage fSettings(strSettingPath, cv::FileStorage::READ);
+
+    if(!fSettings["PointsPublisher.enabled"].empty())
+        mbEnabled = (int)fSettings["PointsPublisher.enabled"];
+    if(!fSettings["PointsPublisher.everyNFrames"].empty())
+        mnEveryNFrames = max((int)fSettings["PointsPublisher.everyNFrames"],1);
+    if(!fSettings["PointsPublisher.cameraDistance"].empty())
+        mbCameraDistance = (int)fSettings["PointsPublisher.cameraDistance"];
+
+    cout << endl << "Points Publisher: " << (mbEnabled ? "on" : "off") << endl;
+    if(mbEnabled)
+    {
+        cout << "- publish every " << mnEveryNFrames << " frames" << endl;
+        cout << "- distances from: " << (mbCameraDistance ? "camera centre" : "first row of Tcw") << endl;
+    }
+}
+
+void PointsPublisher::Update(Frame &F)
+{
+    if(!mbEnabled)
+        return;
+
+    if((mnFrames++)%mnEveryNFrames!=0)
+        return;
+
+    mTracked.mTimeStamp = F.mTimeStamp;
+    mTracked.mOrigin[0] = mTracked.mOrigin[1] = mTracked.mOrigin[2] = 0;
+    if(mbCameraDistance)
+    {
+        // Without a pose there are no distances to publish
+        if(!F.HasPose())
+            return;
+
+        const Eigen::Vector3f Ow = F.GetCameraCenter();
+        mTracked.mOrigin[0] = Ow(0);
+        mTracked.mOrigin[1] = Ow(1);
+        mTracked.mOrigin[2] = Ow(2);
+    }
+    else if(F.HasPose())
+    {
+        // Original output: distances to the first three elements of Tcw (first row of Rcw)
+        const Eigen::Matrix3f Rcw = F.GetRotation();
+        mTracked.mOrigin[0] = Rcw(0,0);
+        mTracked.mOrigin[1] = Rcw(0,1);
+        mTracked.mOrigin[2] = Rcw(0,2);
+    }
+
+    vector<float> &vData = mTracked.mvData;
+    vData.clear();
+    vData.reserve(5*F.N);
+    for(int i=0; i<F.N; i++)
+    {
+        MapPoint* pMP = F.mvpMapPoints[i];
+        if(!pMP)
+            continue;
+
+        float x, y, z;
+        pMP->GetWorldPos(x,y,z);
+
+        vData.push_back(F.mpFeatures->mvKeys[i].pt.x);
+        vData.push_back(F.mpFeatures->mvKeys[i].pt.y);
+        vData.push_back(x);
+        vData.push_back(y);
+        vData.push_back(z);
+    }
+
+    {
+        unique_lock<mutex> lock(mMutexPending);
+        swap(mTracked,mPending);
+        mbPending = true;
+    }
+    mcvPending.notify_one();
+}
+
+void PointsPublisher::Run()
+{
+    while(1)
+    {
+        {
+            unique_lock<mutex> lock(mMutexPending);
+            while(!mbPending && !mbFinishRequested)
+                mcvPending.wait(lock);
+
+            if(mbFinishRequested)
+                break;
+
+            swap(mPending,mPublishing);
+            mbPending = false;
+        }
+
+        const vector<float> &vData = mPublishing.mvData;
+        const size_t N = vData.size()/5;
+
+        mMsg.frame_id = mPublishing.mTimeStamp;
+        mMsg.header.stamp = ros::Time(mPublishing.mTimeStamp);
+        mMsg.points.resize(N);
+        mMsg.distances.resize(N);
+
+        for(size_t i=0; i<N; i++)
+        {
+            const float* p = &vData[5*i];
+
+            geometry_msgs::Point &point = mMsg.points[i];
+            point.x = p[0];
+            point.y = p[1];
+            point.z = 0;
+
+            const float dx = p[2]-mPublishing.mOrigin[0];
+            const float dy = p[3]-mPublishing.mOrigin[1];
+            const float dz = p[4]-mPublishing.mOrigin[2];
+            mMsg.distances[i] = sqrt(dx*dx+dy*dy+dz*dz);
+        }
+
+        if(ros::ok())
+            mpPublisher->publish(mMsg);
+    }
+}
+
+void PointsPublisher::RequestFinish()
+{
+    {
+        unique_lock<mutex> lock(mMutexPending);
+        mbFinishRequested = true;
+    }
+    mcvPending.notify_one();
+}
+
+} //namespace ORB_SLAM
@@ -0,0 +1,551 @@
+/**
+* This file is part of ORB-SLAM2.
+*
+* Copyright (C) 2014-2016 Raúl Mur-Artal <raulmur at unizar dot es> (University of Zaragoza)
+* For more information see <https://github.com/raulmur/ORB_SLAM2>
+*
+* ORB-SLAM2 is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM2 is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with ORB-SLAM2. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "PoseSolver.h"
+
+#include <cmath>
+#include <limits>
+#include <Eigen/Cholesky>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+
+namespace ORB_SLAM2
+{
+
+void PoseObservations::clear()
+{
+    X.clear(); Y.clear(); Z.clear();
+    u.clear(); v.clear(); uR.clear();
+    invSigma2.clear();
+    active.clear();
+    chi2.clear();
+    idx.clear();
+}
+
+void PoseObservations::push_back(const Eigen::Vector3f &Xw, const float &u_, const float &v_, const float &uR_,
+                                 const float &invSigma2_, const int idx_)
+{
+    X.push_back(Xw(0)); Y.push_back(Xw(1)); Z.push_back(Xw(2));
+    u.push_back(u_); v.push_back(v_); uR.push_back(uR_);
+    invSigma2.push_back(invSigma2_);
+    active.push_back(1.0);
+    chi2.push_back(0.0);
+    idx.push_back(idx_);
+}
+
+// Pose, calibration and kernel used to evaluate a set of observations
+struct PoseCamera
+{
+    double r[9], t[3];
+    double fx, fy, cx, cy, bf;
+    bool bRobust;
+    double delta;
+};
+
+// Upper triangle of the 6x6 normal matrix, row by row
+static const int HESSIAN_SIZE = 21;
+
+// Residuals and chi2 of the observations, as computeError of the g2o edges. The robust chi2 of the
+// active observations is returned and, with vH and vb not NULL, their normal equations are added:
+// vH += J'*W*J, vb -= J'*W*e, where W is the information times the weight of the Huber kernel.
+// The Jacobian is the one of EdgeSE3ProjectXYZOnlyPose (and EdgeStereoSE3ProjectXYZOnlyPose) for
+// the update [omega upsilon] of the pose.
+template<bool bStereo>
+static double EvaluateObservations(PoseObservations &obs, const PoseCamera &cam, double* vH, double* vb)
+{
+    const int N = obs.size();
+    const double delta2 = cam.delta*cam.delta;
+    double robustChi2 = 0;
+    int i=0;
+
+#ifdef __SSE2__
+    const __m128d r00=_mm_set1_pd(cam.r[0]), r01=_mm_set1_pd(cam.r[1]), r02=_mm_set1_pd(cam.r[2]);
+    const __m128d r10=_mm_set1_pd(cam.r[3]), r11=_mm_set1_pd(cam.r[4]), r12=_mm_set1_pd(cam.r[5]);
+    const __m128d r20=_mm_set1_pd(cam.r[6]), r21=_mm_set1_pd(cam.r[7]), r22=_mm_set1_pd(cam.r[8]);
+    const __m128d t0=_mm_set1_pd(cam.t[0]), t1=_mm_set1_pd(cam.t[1]), t2=_mm_set1_pd(cam.t[2]);
+    const __m128d fx=_mm_set1_pd(cam.fx), fy=_mm_set1_pd(cam.fy), cx=_mm_set1_pd(cam.cx), cy=_mm_set1_pd(cam.cy);
+    const __m128d bf=_mm_set1_pd(cam.bf);
+    const __m128d one=_mm_set1_pd(1.0), zero=_mm_setzero_pd();
+    const __m128d d=_mm_set1_pd(cam.delta), d2=_mm_set1_pd(delta2), twoD=_mm_set1_pd(2.0*cam.delta);
+
+    __m128d accChi2=zero;
+    __m128d accH[HESSIAN_SIZE], accb[6];
+    for(int k=0; k<HESSIAN_SIZE; k++)
+        accH[k]=zero;
+    for(int k=0; k<6; k++)
+        accb[k]=zero;
+
+    for(; i+2<=N; i+=2)
+    {
+        const __m128d X=_mm_loadu_pd(&obs.X[i]), Y=_mm_loadu_pd(&obs.Y[i]), Z=_mm_loadu_pd(&obs.Z[i]);
+
+        // 3D in camera coordinates
+        const __m128d x=_mm_add_pd(_mm_add_pd(_mm_add_pd(_mm_mul_pd(r00,X),_mm_mul_pd(r01,Y)),_mm_mul_pd(r02,Z)),t0);
+        const __m128d y=_mm_add_pd(_mm_add_pd(_mm_add_pd(_mm_mul_pd(r10,X),_mm_mul_pd(r11,Y)),_mm_mul_pd(r12,Z)),t1);
+        const __m128d z=_mm_add_pd(_mm_add_pd(_mm_add_pd(_mm_mul_pd(r20,X),_mm_mul_pd(r21,Y)),_mm_mul_pd(r22,Z)),t2);
+
+        const __m128d invz=_mm_div_pd(one,z);
+        const __m128d u=_mm_add_pd(_mm_mul_pd(_mm_mul_pd(x,invz),fx),cx);
+        const __m128d v=_mm_add_pd(_mm_mul_pd(_mm_mul_pd(y,invz),fy),cy);
+
+        __m128d e[3];
+        e[0]=_mm_sub_pd(_mm_loadu_pd(&obs.u[i]),u);
+        e[1]=_mm_sub_pd(_mm_loadu_pd(&obs.v[i]),v);
+        __m128d sqErr=_mm_add_pd(_mm_mul_pd(e[0],e[0]),_mm_mul_pd(e[1],e[1]));
+        if(bStereo)
+        {
+            e[2]=_mm_sub_pd(_mm_loadu_pd(&obs.uR[i]),_mm_sub_pd(u,_mm_mul_pd(bf,invz)));
+            sqErr=_mm_add_pd(sqErr,_mm_mul_pd(e[2],e[2]));
+        }
+        const __m128d info=_mm_loadu_pd(&obs.invSigma2[i]);
+        const __m128d chi2=_mm_mul_pd(info,sqErr);
+        _mm_storeu_pd(&obs.chi2[i],chi2);
+
+        // Inactive observations are masked out (their error may not be finite)
+        const __m128d active=_mm_cmpneq_pd(_mm_loadu_pd(&obs.active[i]),zero);
+
+        __m128d rho0=chi2, w=one;
+        if(cam.bRobust)
+        {
+            const __m128d sqrtChi2=_mm_sqrt_pd(chi2);
+            const __m128d inlier=_mm_cmple_pd(chi2,d2);
+            rho0=_mm_or_pd(_mm_and_pd(inlier,chi2),_mm_andnot_pd(inlier,_mm_sub_pd(_mm_mul_pd(twoD,sqrtChi2),d2)));
+            w=_mm_or_pd(_mm_and_pd(inlier,one),_mm_andnot_pd(inlier,_mm_div_pd(d,sqrtChi2)));
+        }
+        accChi2=_mm_add_pd(accChi2,_mm_and_pd(active,rho0));
+
+        if(!vH)
+            continue;
+
+        const __m128d W=_mm_and_pd(active,_mm_mul_pd(w,info));
+        const __m128d invz2=_mm_mul_pd(invz,invz);
+        const __m128d xinvz2=_mm_mul_pd(x,invz2), yinvz2=_mm_mul_pd(y,invz2);
+        const __m128d xyinvz2=_mm_mul_pd(x,yinvz2);
+
+        __m128d J[3][6];
+        J[0][0]=_mm_mul_pd(xyinvz2,fx);
+        J[0][1]=_mm_mul_pd(_mm_sub_pd(zero,_mm_add_pd(one,_mm_mul_pd(x,xinvz2))),fx);
+        J[0][2]=_mm_mul_pd(_mm_mul_pd(y,invz),fx);
+        J[0][3]=_mm_mul_pd(_mm_sub_pd(zero,invz),fx);
+        J[0][4]=zero;
+        J[0][5]=_mm_mul_pd(xinvz2,fx);
+
+        J[1][0]=_mm_mul_pd(_mm_add_pd(one,_mm_mul_pd(y,yinvz2)),fy);
+        J[1][1]=_mm_mul_pd(_mm_sub_pd(zero,xyinvz2),fy);
+        J[1][2]=_mm_mul_pd(_mm_sub_pd(zero,_mm_mul_pd(x,invz)),fy);
+        J[1][3]=zero;
+        J[1][4]=_mm_mul_pd(_mm_sub_pd(zero,invz),fy);
+        J[1][5]=_mm_mul_pd(yinvz2,fy);
+
+        const int nRows = bStereo ? 3 : 2;
+        if(bStereo)
+        {
+            J[2][0]=_mm_sub_pd(J[0][0],_mm_mul_pd(bf,yinvz2));
+            J[2][1]=_mm_add_pd(J[0][1],_mm_mul_pd(bf,xinvz2));
+            J[2][2]=J[0][2];
+            J[2][3]=J[0][3];
+            J[2][4]=zero;
+            J[2][5]=_mm_sub_pd(J[0][5],_mm_mul_pd(bf,invz2));
+        }
+
+        // Weighted Jacobian and error
+        __m128d WJ[3][6];
+        for(int r=0; r<nRows; r++)
+        {
+            for(int c=0; c<6; c++)
+                WJ[r][c]=_mm_mul_pd(W,J[r][c]);
+        }
+
+        int k=0;
+        for(int r=0; r<6; r++)
+        {
+            for(int c=r; c<6; c++, k++)
+            {
+                __m128d h=_mm_mul_pd(WJ[0][r],J[0][c]);
+                for(int row=1; row<nRows; row++)
+                    h=_mm_add_pd(h,_mm_mul_pd(WJ[row][r],J[row][c]));
+                accH[k]=_mm_add_pd(accH[k],h);
+            }
+
+            __m128d g=_mm_mul_pd(WJ[0][r],e[0]);
+            for(int row=1; row<nRows; row++)
+                g=_mm_add_pd(g,_mm_mul_pd(WJ[row][r],e[row]));
+            accb[r]=_mm_sub_pd(accb[r],g);
+        }
+    }
+
+    double lanes[2];
+    _mm_storeu_pd(lanes,accChi2);
+    robustChi2 += lanes[0]+lanes[1];
+    if(vH)
+    {
+        for(int k=0; k<HESSIAN_SIZE; k++)
+        {
+            _mm_storeu_pd(lanes,accH[k]);
+            vH[k] += lanes[0]+lanes[1];
+        }
+        for(int k=0; k<6; k++)
+        {
+            _mm_storeu_pd(lanes,accb[k]);
+            vb[k] += lanes[0]+lanes[1];
+        }
+    }
+#endif
+
+    for(; i<N; i++)
+    {
+        const double X = obs.X[i], Y = obs.Y[i], Z = obs.Z[i];
+
+        const double x = cam.r[0]*X+cam.r[1]*Y+cam.r[2]*Z+cam.t[0];
+        const double y = cam.r[3]*X+cam.r[4]*Y+cam.r[5]*Z+cam.t[1];
+        const double z = cam.r[6]*X+cam.r[7]*Y+cam.r[8]*Z+cam.t[2];
+
+        const double invz = 1.0/z;
+        const double u = x*invz*cam.fx+cam.cx;
+        const double v = y*invz*cam.fy+cam.cy;
+
+        double e[3];
+        e[0] = obs.u[i]-u;
+        e[1] = obs.v[i]-v;
+        double sqErr = e[0]*e[0]+e[1]*e[1];
+        if(bStereo)
+        {
+            e[2] = obs.uR[i]-(u-cam.bf*invz);
+            sqErr += e[2]*e[2];
+        }
+        const double chi2 = obs.invSigma2[i]*sqErr;
+        obs.chi2[i] = chi2;
+
+        if(obs.active[i]==0.0)
+            continue;
+
+        double rho0 = chi2, w = 1.0;
+        if(cam.bRobust && chi2>delta2)
+        {
+            const double sqrtChi2 = sqrt(chi2);
+            rho0 = 2.0*cam.delta*sqrtChi2-delta2;
+            w = cam.delta/sqrtChi2;
+        }
+        robustChi2 += rho0;
+
+        if(!vH)
+            continue;
+
+        const double W = w*obs.invSigma2[i];
+        const double invz2 = invz*invz;
+
+        double J[3][6];
+        J[0][0] = x*y*invz2*cam.fx;
+        J[0][1] = -(1.0+x*x*invz2)*cam.fx;
+        J[0][2] = y*invz*cam.fx;
+        J[0][3] = -invz*cam.fx;
+        J[0][4] = 0;
+        J[0][5] = x*invz2*cam.fx;
+
+        J[1][0] = (1.0+y*y*invz2)*cam.fy;
+        J[1][1] = -x*y*invz2*cam.fy;
+        J[1][2] = -x*invz*cam.fy;
+        J[1][3] = 0;
+        J[1][4] = -invz*cam.fy;
+        J[1][5] = y*invz2*cam.fy;
+
+        const int nRows = bStereo ? 3 : 2;
+        if(bStereo)
+        {
+            J[2][0] = J[0][0]-cam.bf*y*invz2;
+            J[2][1] = J[0][1]+cam.bf*x*invz2;
+            J[2][2] = J[0][2];
+            J[2][3] = J[0][3];
+            J[2][4] = 0;
+            J[2][5] = J[0][5]-cam.bf*invz2;
+        }
+
+        int k=0;
+        for(int r=0; r<6; r++)
+        {
+            for(int c=r; c<6; c++, k++)
+            {
+                double h = 0;
+                for(int row=0; row<nRows; row++)
+                    h += J[row][r]*J[row][c];
+                vH[k] += W*h;
+            }
+
+            double g = 0;
+            for(int row=0; row<nRows; row++)
+                g += J[row][r]*e[row];
+            vb[r] -= W*g;
+        }
+    }
+
+    return robustChi2;
+}
+
+static Eigen::Matrix3d Skew(const Eigen::Vector3d &v)
+{
+    Eigen::Matrix3d m;
+    m << 0, -v(2), v(1),
+         v(2), 0, -v(0),
+         -v(1), v(0), 0;
+    return m;
+}
+
+PoseSolver::PoseSolver():
+    mq(Eigen::Quaterniond::Identity()), mt(Eigen::Vector3d::Zero()), fx(0), fy(0), cx(0), cy(0), bf(0),
+    mbRobust(false), mDeltaMono(0), mDeltaStereo(0)
+{
+}
+
+void PoseSolver::SetCalibration(const float &fx_, const float &fy_, const float &cx_, const float &cy_, const float &bf_)
+{
+    fx = fx_;
+    fy = fy_;
+    cx = cx_;
+    cy = cy_;
+    bf = bf_;
+}
+
+void PoseSolver::Clear()
+{
+    mMono.clear();
+    mStereo.clear();
+}
+
+void PoseSolver::AddMonocular(const Eigen::Vector3f &Xw, const float &u, const float &v, const float &invSigma2, const int idx)
+{
+    mMono.push_back(Xw,u,v,0.0f,invSigma2,idx);
+}
+
+void PoseSolver::AddStereo(const Eigen::Vector3f &Xw, const float &u, const float &v, const float &uR, const float &invSigma2, const int idx)
+{
+    mStereo.push_back(Xw,u,v,uR,invSigma2,idx);
+}
+
+void PoseSolver::SetRobustKernel(const double &deltaMono, const double &deltaStereo)
+{
+    mbRobust = true;
+    mDeltaMono = deltaMono;
+    mDeltaStereo = deltaStereo;
+}
+
+void PoseSolver::RemoveRobustKernel()
+{
+    mbRobust = false;
+}
+
+void PoseSolver::SetPose(const Eigen::Matrix3d &Rcw, const Eigen::Vector3d &tcw)
+{
+    mq = Eigen::Quaterniond(Rcw);
+    mq.normalize();
+    mt = tcw;
+}
+
+Eigen::Matrix3d PoseSolver::GetRotation() const
+{
+    return mq.toRotationMatrix();
+}
+
+Eigen::Vector3d PoseSolver::GetTranslation() const
+{
+    return mt;
+}
+
+double PoseSolver::Evaluate(Eigen::Matrix<double,6,6> *H, Eigen::Matrix<double,6,1> *b)
+{
+    PoseCamera cam;
+    const Eigen::Matrix3d R = mq.toRotationMatrix();
+    for(int i=0; i<3; i++)
+    {
+        for(int j=0; j<3; j++)
+            cam.r[3*i+j] = R(i,j);
+        cam.t[i] = mt(i);
+    }
+    cam.fx = fx; cam.fy = fy; cam.cx = cx; cam.cy = cy; cam.bf = bf;
+    cam.bRobust = mbRobust;
+
+    double vH[HESSIAN_SIZE] = {0};
+    double vb[6] = {0};
+    double* pH = H ? vH : NULL;
+    double* pb = H ? vb : NULL;
+
+    cam.delta = mDeltaMono;
+    double chi2 = EvaluateObservations<false>(mMono,cam,pH,pb);
+    cam.delta = mDeltaStereo;
+    chi2 += EvaluateObservations<true>(mStereo,cam,pH,pb);
+
+    if(H)
+    {
+        int k=0;
+        for(int r=0; r<6; r++)
+        {
+            for(int c=r; c<6; c++, k++)
+            {
+                (*H)(r,c) = vH[k];
+                (*H)(c,r) = vH[k];
+            }
+            (*b)(r) = vb[r];
+        }
+    }
+
+    return chi2;
+}
+
+void PoseSolver::Update(const Eigen::Matrix<double,6,1> &x)
+{
+    const Eigen::Vector3d omega = x.head<3>();
+    const Eigen::Vector3d upsilon = x.tail<3>();
+
+    const double theta = omega.norm();
+    const Eigen::Matrix3d Omega = Skew(omega);
+    const Eigen::Matrix3d Omega2 = Omega*Omega;
+
+    Eigen::Matrix3d R, V;
+    if(theta<1e-5)
+    {
+        R = Eigen::Matrix3d::Identity()+Omega+0.5*Omega2;
+        V = Eigen::Matrix3d::Identity()+0.5*Omega+Omega2/6.0;
+    }
+    else
+    {
+        const double theta2 = theta*theta;
+        R = Eigen::Matrix3d::Identity()+sin(theta)/theta*Omega+(1.0-cos(theta))/theta2*Omega2;
+        V = Eigen::Matrix3d::Identity()+(1.0-cos(theta))/theta2*Omega+(theta-sin(theta))/(theta2*theta)*Omega2;
+    }
+
+    mt = R*mt+V*upsilon;
+    mq = Eigen::Quaterniond(R)*mq;
+    mq.normalize();
+}
+
+void PoseSolver::Optimize(const int nIterations)
+{
+    bool bActive = false;
+    for(size_t i=0; i<mMono.size() && !bActive; i++)
+        bActive = mMono.active[i]!=0.0;
+    for(size_t i=0; i<mStereo.size() && !bActive; i++)
+        bActive = mStereo.active[i]!=0.0;
+    if(!bActive)
+        return;
+
+    // Same schedule as g2o::OptimizationAlgorithmLevenberg
+    const double tau = 1e-5;
+    const double goodStepUpperScale = 2./3.;
+    const double goodStepLowerScale = 1./3.;
+    const int maxTrialsAfterFailure = 10;
+
+    double lambda = 0;
+    int ni = 2;
+    int nBad = 0;
+
+    Eigen::Matrix<double,6,6> H;
+    Eigen::Matrix<double,6,1> b;
+    Eigen::LDLT<Eigen::Matrix<double,6,6> > ldlt;
+
+    for(int it=0; it<nIterations; it++)
+    {
+        double currentChi = Evaluate(&H,&b);
+        const double iniChi = currentChi;
+
+        if(it==0)
+        {
+            lambda = tau*H.diagonal().cwiseAbs().maxCoeff();
+            ni = 2;
+            nBad = 0;
+        }
+
+        double rho = 0;
+        int nTrials = 0;
+        do
+        {
+            const Eigen::Quaterniond q0 = mq;
+            const Eigen::Vector3d t0 = mt;
+
+            Eigen::Matrix<double,6,6> Hl = H;
+            Hl.diagonal().array() += lambda;
+            ldlt.compute(Hl);
+            const bool bSolved = ldlt.isPositive();
+            Eigen::Matrix<double,6,1> x = Eigen::Matrix<double,6,1>::Zero();
+            if(bSolved)
+                x = ldlt.solve(b);
+
+            Update(x);
+            double tempChi = Evaluate(NULL,NULL);
+            if(!bSolved)
+                tempChi = numeric_limits<double>::max();
+
+            rho = (currentChi-tempChi)/(x.dot(lambda*x+b)+1e-3);
+
+            if(rho>0 && std::isfinite(tempChi))
+            {
+                const double alpha = min(1.0-pow(2*rho-1,3),goodStepUpperScale);
+                lambda *= max(goodStepLowerScale,alpha);
+                ni = 2;
+                currentChi = tempChi;
+            }
+            else
+            {
+                lambda *= ni;
+                ni *= 2;
+                mq = q0;
+                mt = t0;
+            }
+            nTrials++;
+        }
+        while(rho<0 && nTrials<maxTrialsAfterFailure);
+
+        if(nTrials==maxTrialsAfterFailure || rho==0)
+            break;
+
+        if((iniChi-currentChi)*1e3<iniChi)
+            nBad++;
+        else
+            nBad = 0;
+
+        if(nBad>=3)
+            break;
+    }
+}
+
+double PoseSolver::ComputeChi2Monocular(const size_t i)
+{
+    const Eigen::Vector3d Xc = mq*Eigen::Vector3d(mMono.X[i],mMono.Y[i],mMono.Z[i])+mt;
+    const double invz = 1.0/Xc(2);
+    const double eu = mMono.u[i]-(Xc(0)*invz*fx+cx);
+    const double ev = mMono.v[i]-(Xc(1)*invz*fy+cy);
+    mMono.chi2[i] = mMono.invSigma2[i]*(eu*eu+ev*ev);
+    return mMono.chi2[i];
+}
+
+double PoseSolver::ComputeChi2Stereo(const size_t i)
+{
+    const Eigen::Vector3d Xc = mq*Eigen::Vector3d(mStereo.X[i],mStereo.Y[i],mStereo.Z[i])+mt;
+    const double invz = 1.0/Xc(2);
+    const double u = Xc(0)*invz*fx+cx;
+    const double eu = mStereo.u[i]-u;
+    const double ev = mStereo.v[i]-(Xc(1)*invz*fy+cy);
+    const double eR = mStereo.uR[i]-(u-bf*invz);
+    mStereo.chi2[i] = mStereo.invSigma2[i]*(eu*eu+ev*ev+eR*eR);
+    return mStereo.chi2[i];
+}
+
+} //namespace ORB_SLAM
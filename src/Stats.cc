@@ -0,0 +1,356 @@
+/**
+* This file is part of ORB-SLAM2.
+*
+* Copyright (C) 2014-2016 Raúl Mur-Artal <raulmur at unizar dot es> (University of Zaragoza)
+* For more information see <https://github.com/raulmur/ORB_SLAM2>
+*
+* ORB-SLAM2 is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM2 is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with ORB-SLAM2. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Stats.h"
+
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <stdint.h>
+#include <cstdio>
+
+using namespace std;
+
+namespace ORB_SLAM2
+{
+
+namespace
+{
+
+// Log-linear buckets over microseconds: exact below 16 us, then 8 buckets per power of two
+// (relative error below 12.5%) up to 2^40 us.
+const int LINEAR_BUCKETS = 16;
+const int SUB_BUCKETS = 8;
+const int MAX_EXPONENT = 40;
+const int N_BUCKETS = LINEAR_BUCKETS + (MAX_EXPONENT-4+1)*SUB_BUCKETS;
+
+int BucketIndex(uint64_t us)
+{
+    if(us<LINEAR_BUCKETS)
+        return us;
+    int e = 63-__builtin_clzll(us);
+    if(e>MAX_EXPONENT)
+        return N_BUCKETS-1;
+    const int sub = (us>>(e-3)) & (SUB_BUCKETS-1);
+    return LINEAR_BUCKETS + (e-4)*SUB_BUCKETS + sub;
+}
+
+// Middle of the bucket in microseconds
+double BucketValue(int idx)
+{
+    if(idx<LINEAR_BUCKETS)
+        return idx;
+    const int e = (idx-LINEAR_BUCKETS)/SUB_BUCKETS + 4;
+    const int sub = (idx-LINEAR_BUCKETS)%SUB_BUCKETS;
+    const double lower = (double)(SUB_BUCKETS+sub)*(double)(1ull<<(e-3));
+    return lower + 0.5*(double)(1ull<<(e-3));
+}
+
+// Histograms of one thread. Only that thread writes, readers may merge at any time.
+struct ThreadStats
+{
+    atomic<uint64_t> buckets[Stats::N_STAGES][N_BUCKETS];
+    atomic<uint64_t> sumNs[Stats::N_STAGES];
+    atomic<uint64_t> maxNs[Stats::N_STAGES];
+    atomic<uint64_t> counters[Stats::N_COUNTERS];
+
+    ThreadStats(){
+        Clear();
+    }
+
+    void Clear(){
+        for(int s=0; s<Stats::N_STAGES; s++)
+        {
+            for(int b=0; b<N_BUCKETS; b++)
+                buckets[s][b].store(0,memory_order_relaxed);
+            sumNs[s].store(0,memory_order_relaxed);
+            maxNs[s].store(0,memory_order_relaxed);
+        }
+        for(int c=0; c<Stats::N_COUNTERS; c++)
+            counters[c].store(0,memory_order_relaxed);
+    }
+};
+
+// Registry of the threads that are recording. When a thread exits, its statistics are
+// added to gRetiredStats (the first entry of the registry) and its entry is freed, so
+// threads started for every frame or every loop do not accumulate.
+mutex gMutexRegistry;
+ThreadStats gRetiredStats;
+vector<ThreadStats*> gvpThreadStats(1,&gRetiredStats);
+
+// Owns the statistics of a thread, which are retired by its destructor at thread exit
+struct ThreadStatsOwner
+{
+    ThreadStats* pStats;
+
+    ThreadStatsOwner(): pStats(new ThreadStats())
+    {
+        unique_lock<mutex> lock(gMutexRegistry);
+        gvpThreadStats.push_back(pStats);
+    }
+
+    ~ThreadStatsOwner()
+    {
+        unique_lock<mutex> lock(gMutexRegistry);
+        for(int s=0; s<Stats::N_STAGES; s++)
+        {
+            for(int b=0; b<N_BUCKETS; b++)
+                gRetiredStats.buckets[s][b].fetch_add(pStats->buckets[s][b].load(memory_order_relaxed),memory_order_relaxed);
+            gRetiredStats.sumNs[s].fetch_add(pStats->sumNs[s].load(memory_order_relaxed),memory_order_relaxed);
+            const uint64_t maxNs = pStats->maxNs[s].load(memory_order_relaxed);
+            if(maxNs>gRetiredStats.maxNs[s].load(memory_order_relaxed))
+                gRetiredStats.maxNs[s].store(maxNs,memory_order_relaxed);
+        }
+        for(int c=0; c<Stats::N_COUNTERS; c++)
+            gRetiredStats.counters[c].fetch_add(pStats->counters[c].load(memory_order_relaxed),memory_order_relaxed);
+
+        gvpThreadStats.erase(find(gvpThreadStats.begin(),gvpThreadStats.end(),pStats));
+        delete pStats;
+    }
+};
+
+ThreadStats* GetThreadStats()
+{
+    static thread_local ThreadStatsOwner owner;
+    return owner.pStats;
+}
+
+inline void Add(atomic<uint64_t> &a, uint64_t n)
+{
+    // Single writer: no need for an atomic read-modify-write
+    a.store(a.load(memory_order_relaxed)+n,memory_order_relaxed);
+}
+
+// Periodic save thread
+mutex gMutexPeriodic;
+condition_variable gcvPeriodic;
+thread* gpPeriodicThread = NULL;
+bool gbStopPeriodic = false;
+
+const char* STAGE_NAMES[Stats::N_STAGES] = {
+    "BuildFrame", "TrackFrame", "ExtractORB", "ComputeStereoMatches", "ComputeBoW", "TrackReferenceKeyFrame",
+    "TrackWithMotionModel", "Relocalization", "TrackLocalMap", "PoseOptimization", "NeedNewKeyFrame",
+    "CreateNewKeyFrame",
+    "ProcessNewKeyFrame", "MapPointCulling", "CreateNewMapPoints", "SearchInNeighbors",
+    "LocalBundleAdjustment", "KeyFrameCulling",
+    "DetectLoop", "ComputeSim3", "CorrectLoop", "OptimizeEssentialGraph", "GlobalBundleAdjustment"
+};
+
+const char* COUNTER_NAMES[Stats::N_COUNTERS] = {
+    "Frames", "LostFrames", "Relocalizations", "KeyFrames", "CulledKeyFrames", "Loops"
+};
+
+} // namespace
+
+const char* Stats::StageName(const eStage stage)
+{
+    return STAGE_NAMES[stage];
+}
+
+const char* Stats::CounterName(const eCounter counter)
+{
+    return COUNTER_NAMES[counter];
+}
+
+void Stats::AddTime(const eStage stage, const double ms)
+{
+    ThreadStats* pStats = GetThreadStats();
+    const uint64_t ns = ms>0 ? (uint64_t)(ms*1e6) : 0;
+
+    Add(pStats->buckets[stage][BucketIndex(ns/1000)],1);
+    Add(pStats->sumNs[stage],ns);
+    if(ns>pStats->maxNs[stage].load(memory_order_relaxed))
+        pStats->maxNs[stage].store(ns,memory_order_relaxed);
+}
+
+void Stats::Count(const eCounter counter, const unsigned long n)
+{
+    Add(GetThreadStats()->counters[counter],n);
+}
+
+vector<Stats::StageSummary> Stats::GetStageSummaries()
+{
+    vector<StageSummary> vSummaries(N_STAGES);
+    vector<uint64_t> vBuckets(N_BUCKETS);
+
+    unique_lock<mutex> lock(gMutexRegistry);
+    for(int s=0; s<N_STAGES; s++)
+    {
+        fill(vBuckets.begin(),vBuckets.end(),0);
+        uint64_t count=0, sumNs=0, maxNs=0;
+        for(size_t t=0; t<gvpThreadStats.size(); t++)
+        {
+            ThreadStats* pStats = gvpThreadStats[t];
+            for(int b=0; b<N_BUCKETS; b++)
+            {
+                const uint64_t n = pStats->buckets[s][b].load(memory_order_relaxed);
+                vBuckets[b] += n;
+                count += n;
+            }
+            sumNs += pStats->sumNs[s].load(memory_order_relaxed);
+            maxNs = max(maxNs,pStats->maxNs[s].load(memory_order_relaxed));
+        }
+
+        StageSummary &summary = vSummaries[s];
+        summary.name = STAGE_NAMES[s];
+        summary.count = count;
+        summary.mean = count>0 ? 1e-6*(double)sumNs/count : 0;
+        summary.max = 1e-6*maxNs;
+
+        // Percentiles from the merged histogram (bucket centers, clamped by the maximum)
+        const double percentiles[3] = {0.5, 0.9, 0.99};
+        double* values[3] = {&summary.p50, &summary.p90, &summary.p99};
+        for(int p=0; p<3; p++)
+        {
+            *values[p] = 0;
+            if(count==0)
+                continue;
+            const uint64_t rank = max<uint64_t>(1,(uint64_t)(percentiles[p]*count+0.5));
+            uint64_t acc=0;
+            for(int b=0; b<N_BUCKETS; b++)
+            {
+                acc += vBuckets[b];
+                if(acc>=rank)
+                {
+                    *values[p] = min(1e-3*BucketValue(b),summary.max);
+                    break;
+                }
+            }
+        }
+    }
+
+    return vSummaries;
+}
+
+vector<Stats::CounterSummary> Stats::GetCounterSummaries()
+{
+    vector<CounterSummary> vSummaries(N_COUNTERS);
+
+    unique_lock<mutex> lock(gMutexRegistry);
+    for(int c=0; c<N_COUNTERS; c++)
+    {
+        vSummaries[c].name = COUNTER_NAMES[c];
+        vSummaries[c].count = 0;
+        for(size_t t=0; t<gvpThreadStats.size(); t++)
+            vSummaries[c].count += gvpThreadStats[t]->counters[c].load(memory_order_relaxed);
+    }
+
+    return vSummaries;
+}
+
+void Stats::Reset()
+{
+    unique_lock<mutex> lock(gMutexRegistry);
+    for(size_t t=0; t<gvpThreadStats.size(); t++)
+        gvpThreadStats[t]->Clear();
+}
+
+bool Stats::Save(const string &filename)
+{
+    const vector<StageSummary> vStages = GetStageSummaries();
+    const vector<CounterSummary> vCounters = GetCounterSummaries();
+
+    // Write to a temporary file and rename, so readers never see a partial file
+    const string tmpname = filename + ".tmp";
+    ofstream f(tmpname.c_str());
+    if(!f.is_open())
+        return false;
+
+    f << fixed << setprecision(4);
+
+    const bool bJSON = filename.size()>=5 && filename.compare(filename.size()-5,5,".json")==0;
+    if(bJSON)
+    {
+        f << "{" << endl << "  \"stages\": {" << endl;
+        for(size_t i=0; i<vStages.size(); i++)
+        {
+            const StageSummary &s = vStages[i];
+            f << "    \"" << s.name << "\": {\"count\": " << s.count << ", \"mean\": " << s.mean
+              << ", \"p50\": " << s.p50 << ", \"p90\": " << s.p90 << ", \"p99\": " << s.p99
+              << ", \"max\": " << s.max << "}" << (i+1<vStages.size() ? "," : "") << endl;
+        }
+        f << "  }," << endl << "  \"counters\": {" << endl;
+        for(size_t i=0; i<vCounters.size(); i++)
+            f << "    \"" << vCounters[i].name << "\": " << vCounters[i].count << (i+1<vCounters.size() ? "," : "") << endl;
+        f << "  }" << endl << "}" << endl;
+    }
+    else
+    {
+        f << "name,count,mean_ms,p50_ms,p90_ms,p99_ms,max_ms" << endl;
+        for(size_t i=0; i<vStages.size(); i++)
+        {
+            const StageSummary &s = vStages[i];
+            f << s.name << "," << s.count << "," << s.mean << "," << s.p50 << "," << s.p90 << ","
+              << s.p99 << "," << s.max << endl;
+        }
+        for(size_t i=0; i<vCounters.size(); i++)
+            f << vCounters[i].name << "," << vCounters[i].count << ",,,,," << endl;
+    }
+
+    f.close();
+    if(f.fail())
+        return false;
+
+    return rename(tmpname.c_str(),filename.c_str())==0;
+}
+
+void Stats::StartPeriodicSave(const string &filename, const double period)
+{
+    StopPeriodicSave();
+
+    unique_lock<mutex> lock(gMutexPeriodic);
+    gbStopPeriodic = false;
+    gpPeriodicThread = new thread([filename,period]()
+    {
+        const chrono::duration<double> interval(max(period,0.1));
+        unique_lock<mutex> lock(gMutexPeriodic);
+        while(!gbStopPeriodic)
+        {
+            gcvPeriodic.wait_for(lock,interval);
+            lock.unlock();
+            if(!Stats::Save(filename))
+                cerr << "Failed to save statistics at: " << filename << endl;
+            lock.lock();
+        }
+    });
+}
+
+void Stats::StopPeriodicSave()
+{
+    thread* pThread;
+    {
+        unique_lock<mutex> lock(gMutexPeriodic);
+        if(!gpPeriodicThread)
+            return;
+        gbStopPeriodic = true;
+        pThread = gpPeriodicThread;
+        gpPeriodicThread = NULL;
+    }
+    gcvPeriodic.notify_all();
+    pThread->join();
+    delete pThread;
+}
+
+} //namespace ORB_SLAM
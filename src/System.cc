@@ -22,6 +22,7 @@
 
 #include "System.h"
 #include "Converter.h"
+#include "MapSerializer.h"
 #include "ros/ros.h"
 #include "Frame.h"
 #include "ORB_SLAM2/Points.h"
@@ -33,8 +34,10 @@ namespace ORB_SLAM2
 {
 
 System::System(const string &strVocFile, const string &strSettingsFile, const eSensor sensor,
-               const bool bUseViewer):mSensor(sensor), mpViewer(static_cast<Viewer*>(NULL)), mbReset(false),mbActivateLocalizationMode(false),
-        mbDeactivateLocalizationMode(false)
+               const bool bUseViewer):mSensor(sensor), mpViewer(static_cast<Viewer*>(NULL)),
+        mpPointsPublisher(static_cast<PointsPublisher*>(NULL)), mbReset(false),mbActivateLocalizationMode(false),
+        mbDeactivateLocalizationMode(false), mTrackingState(Tracking::SYSTEM_NOT_READY),
+        mpPipeline(static_cast<TrackingPipeline*>(NULL))
 {
     // Output welcome message
     cout << endl <<
@@ -65,7 +68,10 @@ System::System(const string &strVocFile, const string &strSettingsFile, const eS
     cout << endl << "Loading ORB Vocabulary. This could take a while..." << endl;
 
     mpVocabulary = new ORBVocabulary();
-    bool bVocLoad = mpVocabulary->loadFromTextFile(strVocFile);
+    // Binary vocabularies (see tools/bin_vocabulary) are mapped in place, otherwise parse the text file
+    bool bVocLoad = mpVocabulary->loadFromBinaryFile(strVocFile);
+    if(!bVocLoad)
+        bVocLoad = mpVocabulary->loadFromTextFile(strVocFile);
     if(!bVocLoad)
     {
         cerr << "Wrong path to vocabulary. " << endl;
@@ -89,6 +95,9 @@ System::System(const string &strVocFile, const string &strSettingsFile, const eS
     mpTracker = new Tracking(this, mpVocabulary, mpFrameDrawer, mpMapDrawer,
                              mpMap, mpKeyFrameDatabase, strSettingsFile, mSensor);
 
+    //Start the periodic statistics output if requested
+    StartStats(fsSettings);
+
     //Initialize the Local Mapping thread and launch
     mpLocalMapper = new LocalMapping(mpMap, mSensor==MONOCULAR);
     mptLocalMapping = new thread(&ORB_SLAM2::LocalMapping::Run,mpLocalMapper);
@@ -122,8 +131,10 @@ System::System(const string &strVocFile, const string &strSettingsFile, const eS
 
 // constructor with the node handler for publishing message through ros
 System::System(const string &strVocFile, const string &strSettingsFile, const eSensor sensor,
-              ros::NodeHandle* nodeHandler, const bool bUseViewer):mSensor(sensor), mpViewer(static_cast<Viewer*>(NULL)), mbReset(false),mbActivateLocalizationMode(false),
-        mbDeactivateLocalizationMode(false), nh(*nodeHandler)
+              ros::NodeHandle* nodeHandler, const bool bUseViewer):mSensor(sensor), mpViewer(static_cast<Viewer*>(NULL)),
+        mpPointsPublisher(static_cast<PointsPublisher*>(NULL)), mbReset(false),mbActivateLocalizationMode(false),
+        mbDeactivateLocalizationMode(false), mTrackingState(Tracking::SYSTEM_NOT_READY),
+        mpPipeline(static_cast<TrackingPipeline*>(NULL)), nh(*nodeHandler)
 {
     // Output welcome message
     cout << endl <<
@@ -154,7 +165,10 @@ System::System(const string &strVocFile, const string &strSettingsFile, const eS
     cout << endl << "Loading ORB Vocabulary. This could take a while..." << endl;
 
     mpVocabulary = new ORBVocabulary();
-    bool bVocLoad = mpVocabulary->loadFromTextFile(strVocFile);
+    // Binary vocabularies (see tools/bin_vocabulary) are mapped in place, otherwise parse the text file
+    bool bVocLoad = mpVocabulary->loadFromBinaryFile(strVocFile);
+    if(!bVocLoad)
+        bVocLoad = mpVocabulary->loadFromTextFile(strVocFile);
     if(!bVocLoad)
     {
         cerr << "Wrong path to vocabulary. " << endl;
@@ -178,6 +192,9 @@ System::System(const string &strVocFile, const string &strSettingsFile, const eS
     mpTracker = new Tracking(this, mpVocabulary, mpFrameDrawer, mpMapDrawer,
                              mpMap, mpKeyFrameDatabase, strSettingsFile, mSensor);
 
+    //Start the periodic statistics output if requested
+    StartStats(fsSettings);
+
     //Initialize the Local Mapping thread and launch
     mpLocalMapper = new LocalMapping(mpMap, mSensor==MONOCULAR);
     mptLocalMapping = new thread(&ORB_SLAM2::LocalMapping::Run,mpLocalMapper);
@@ -206,8 +223,14 @@ System::System(const string &strVocFile, const string &strSettingsFile, const eS
 
 
 
-    cout << "got to publish my chatter here" << endl;
+    //Initialize the tracked points publisher and launch
     pub = nh.advertise<ORB_SLAM2::Points>("/orb_slam2/data", 1000);
+    mpPointsPublisher = new PointsPublisher(&pub, strSettingsFile);
+    if(mpPointsPublisher->isEnabled())
+    {
+        mptPointsPublisher = new thread(&PointsPublisher::Run, mpPointsPublisher);
+        mpTracker->SetPointsPublisher(mpPointsPublisher);
+    }
 
 }
 
@@ -220,46 +243,13 @@ cv::Mat System::TrackStereo(const cv::Mat &imLeft, const cv::Mat &imRight, const
         exit(-1);
     }
 
-    // Check mode change
-    {
-        unique_lock<mutex> lock(mMutexMode);
-        if(mbActivateLocalizationMode)
-        {
-            mpLocalMapper->RequestStop();
-
-            // Wait until Local Mapping has effectively stopped
-            while(!mpLocalMapper->isStopped())
-            {
-                usleep(1000);
-            }
-
-            mpTracker->InformOnlyTracking(true);
-            mbActivateLocalizationMode = false;
-        }
-        if(mbDeactivateLocalizationMode)
-        {
-            mpTracker->InformOnlyTracking(false);
-            mpLocalMapper->Release();
-            mbDeactivateLocalizationMode = false;
-        }
-    }
+    WaitForPipeline();
 
-    // Check reset
-    {
-    unique_lock<mutex> lock(mMutexReset);
-    if(mbReset)
-    {
-        mpTracker->Reset();
-        mbReset = false;
-    }
-    }
+    CheckModeAndReset();
 
     cv::Mat Tcw = mpTracker->GrabImageStereo(imLeft,imRight,timestamp);
 
-    unique_lock<mutex> lock2(mMutexState);
-    mTrackingState = mpTracker->mState;
-    mTrackedMapPoints = mpTracker->mCurrentFrame.mvpMapPoints;
-    mTrackedKeyPointsUn = mpTracker->mCurrentFrame.mvKeysUn;
+    UpdateTrackingState();
     return Tcw;
 }
 
@@ -271,57 +261,166 @@ cv::Mat System::TrackRGBD(const cv::Mat &im, const cv::Mat &depthmap, const doub
         exit(-1);
     }
 
-    // Check mode change
+    WaitForPipeline();
+
+    CheckModeAndReset();
+
+    cv::Mat Tcw = mpTracker->GrabImageRGBD(im,depthmap,timestamp);
+
+    UpdateTrackingState();
+    return Tcw;
+}
+
+cv::Mat System::TrackMonocular(const cv::Mat &im, const double &timestamp)
+{
+    if(mSensor!=MONOCULAR)
     {
-        unique_lock<mutex> lock(mMutexMode);
-        if(mbActivateLocalizationMode)
-        {
-            mpLocalMapper->RequestStop();
+        cerr << "ERROR: you called TrackMonocular but input sensor was not set to Monocular." << endl;
+        exit(-1);
+    }
 
-            // Wait until Local Mapping has effectively stopped
-            while(!mpLocalMapper->isStopped())
-            {
-                usleep(1000);
-            }
+    WaitForPipeline();
 
-            mpTracker->InformOnlyTracking(true);
-            mbActivateLocalizationMode = false;
+    CheckModeAndReset();
+
+    cv::Mat Tcw = mpTracker->GrabImageMonocular(im,timestamp);
+
+    UpdateTrackingState();
+
+    return Tcw;
+}
+
+cv::Mat System::LumaPlane(const cv::Mat &im, const eImageFormat format)
+{
+    if(format==NV12)
+    {
+        if(im.channels()!=1 || im.rows%3!=0)
+        {
+            cerr << "ERROR: NV12 buffer must have a single channel and rows*3/2 rows." << endl;
+            return cv::Mat();
         }
-        if(mbDeactivateLocalizationMode)
+        return im.rowRange(0,im.rows*2/3);
+    }
+    else if(format==YUYV)
+    {
+        if(im.type()!=CV_8UC2)
         {
-            mpTracker->InformOnlyTracking(false);
-            mpLocalMapper->Release();
-            mbDeactivateLocalizationMode = false;
+            cerr << "ERROR: YUYV buffer must be CV_8UC2." << endl;
+            return cv::Mat();
         }
+        cv::Mat luma;
+        cv::extractChannel(im,luma,0);
+        return luma;
     }
 
-    // Check reset
-    {
-    unique_lock<mutex> lock(mMutexReset);
-    if(mbReset)
+    return im;
+}
+
+void System::EnablePipelining(const int nMaxFrames, const PoseCallback &callback)
+{
+    // Frames already queued go through the previous pipeline
+    if(mpPipeline)
+        delete mpPipeline;
+
+    mPoseCallback = callback;
+    mpPipeline = new TrackingPipeline(bind(&System::BuildPipelineFrame,this,placeholders::_1),
+                                      bind(&System::TrackPipelineFrame,this,placeholders::_1),nMaxFrames);
+}
+
+future<cv::Mat> System::TrackStereoAsync(const cv::Mat &imLeft, const cv::Mat &imRight, const double &timestamp)
+{
+    if(mSensor!=STEREO)
     {
-        mpTracker->Reset();
-        mbReset = false;
+        cerr << "ERROR: you called TrackStereoAsync but input sensor was not set to STEREO." << endl;
+        exit(-1);
     }
+
+    if(!mpPipeline)
+        EnablePipelining();
+
+    return mpPipeline->Push(imLeft,imRight,timestamp);
+}
+
+future<cv::Mat> System::TrackRGBDAsync(const cv::Mat &im, const cv::Mat &depthmap, const double &timestamp)
+{
+    if(mSensor!=RGBD)
+    {
+        cerr << "ERROR: you called TrackRGBDAsync but input sensor was not set to RGBD." << endl;
+        exit(-1);
     }
 
-    cv::Mat Tcw = mpTracker->GrabImageRGBD(im,depthmap,timestamp);
+    if(!mpPipeline)
+        EnablePipelining();
 
-    unique_lock<mutex> lock2(mMutexState);
-    mTrackingState = mpTracker->mState;
-    mTrackedMapPoints = mpTracker->mCurrentFrame.mvpMapPoints;
-    mTrackedKeyPointsUn = mpTracker->mCurrentFrame.mvKeysUn;
-    return Tcw;
+    return mpPipeline->Push(im,depthmap,timestamp);
 }
 
-cv::Mat System::TrackMonocular(const cv::Mat &im, const double &timestamp)
+future<cv::Mat> System::TrackMonocularAsync(const cv::Mat &im, const double &timestamp)
 {
     if(mSensor!=MONOCULAR)
     {
-        cerr << "ERROR: you called TrackMonocular but input sensor was not set to Monocular." << endl;
+        cerr << "ERROR: you called TrackMonocularAsync but input sensor was not set to Monocular." << endl;
         exit(-1);
     }
 
+    if(!mpPipeline)
+        EnablePipelining();
+
+    return mpPipeline->Push(im,cv::Mat(),timestamp);
+}
+
+void System::WaitForPipeline()
+{
+    if(mpPipeline)
+        mpPipeline->WaitUntilIdle();
+}
+
+void System::BuildPipelineFrame(PipelineFrame &f)
+{
+    // Mode changes and resets need the tracker idle, as the synchronous calls do between frames.
+    // So does the monocular initialization, where the extractor depends on the tracking state.
+    bool bInitializing = false;
+    bool bWait = ModeOrResetPending();
+    if(mSensor==MONOCULAR)
+    {
+        const int state = GetTrackingState();
+        bWait = bWait || (state!=Tracking::OK && state!=Tracking::LOST);
+    }
+
+    if(bWait)
+    {
+        mpPipeline->WaitUntilBackEndIdle();
+        CheckModeAndReset();
+        bInitializing = mpTracker->mState==Tracking::NOT_INITIALIZED || mpTracker->mState==Tracking::NO_IMAGES_YET;
+    }
+
+    f.frame = mpTracker->BuildFrame(f.im,f.im2,f.timestamp,bInitializing,f.imGray);
+}
+
+void System::TrackPipelineFrame(PipelineFrame &f)
+{
+    // The reset itself is done by the front-end before building the next frame, when the tracker is
+    // idle. A frame built before it is not tracked against the map that is about to be cleared.
+    bool bReset;
+    {
+        unique_lock<mutex> lock(mMutexReset);
+        bReset = mbReset;
+    }
+
+    if(bReset)
+        f.Tcw = cv::Mat();
+    else
+    {
+        f.Tcw = mpTracker->TrackFrame(f.frame,f.imGray);
+        UpdateTrackingState();
+    }
+
+    if(mPoseCallback)
+        mPoseCallback(f.timestamp,f.Tcw);
+}
+
+void System::CheckModeAndReset()
+{
     // Check mode change
     {
         unique_lock<mutex> lock(mMutexMode);
@@ -330,10 +429,7 @@ cv::Mat System::TrackMonocular(const cv::Mat &im, const double &timestamp)
             mpLocalMapper->RequestStop();
 
             // Wait until Local Mapping has effectively stopped
-            while(!mpLocalMapper->isStopped())
-            {
-                usleep(1000);
-            }
+            mpLocalMapper->WaitUntilStopped();
 
             mpTracker->InformOnlyTracking(true);
             mbActivateLocalizationMode = false;
@@ -355,15 +451,26 @@ cv::Mat System::TrackMonocular(const cv::Mat &im, const double &timestamp)
         mbReset = false;
     }
     }
+}
 
-    cv::Mat Tcw = mpTracker->GrabImageMonocular(im,timestamp);
+bool System::ModeOrResetPending()
+{
+    {
+        unique_lock<mutex> lock(mMutexMode);
+        if(mbActivateLocalizationMode || mbDeactivateLocalizationMode)
+            return true;
+    }
+
+    unique_lock<mutex> lock(mMutexReset);
+    return mbReset;
+}
 
-    unique_lock<mutex> lock2(mMutexState);
+void System::UpdateTrackingState()
+{
+    unique_lock<mutex> lock(mMutexState);
     mTrackingState = mpTracker->mState;
     mTrackedMapPoints = mpTracker->mCurrentFrame.mvpMapPoints;
-    mTrackedKeyPointsUn = mpTracker->mCurrentFrame.mvKeysUn;
-
-    return Tcw;
+    mTrackedKeyPointsUn = mpTracker->mCurrentFrame.mpFeatures->mvKeysUn;
 }
 
 void System::ActivateLocalizationMode()
@@ -378,6 +485,11 @@ void System::DeactivateLocalizationMode()
     mbDeactivateLocalizationMode = true;
 }
 
+void System::WaitForLocalMapping()
+{
+    mpLocalMapper->WaitUntilIdle();
+}
+
 bool System::MapChanged()
 {
     static int n=0;
@@ -399,19 +511,37 @@ void System::Reset()
 
 void System::Shutdown()
 {
+    // Track the frames still in the pipeline
+    if(mpPipeline)
+    {
+        delete mpPipeline;
+        mpPipeline = static_cast<TrackingPipeline*>(NULL);
+    }
+
     mpLocalMapper->RequestFinish();
     mpLoopCloser->RequestFinish();
     if(mpViewer)
     {
         mpViewer->RequestFinish();
-        while(!mpViewer->isFinished())
-            usleep(5000);
+        mpViewer->WaitUntilFinished();
+    }
+
+    if(mpPointsPublisher && mpPointsPublisher->isEnabled())
+    {
+        mpPointsPublisher->RequestFinish();
+        if(mptPointsPublisher->joinable())
+            mptPointsPublisher->join();
     }
 
     // Wait until all thread have effectively stopped
-    while(!mpLocalMapper->isFinished() || !mpLoopCloser->isFinished() || mpLoopCloser->isRunningGBA())
+    mpLocalMapper->WaitUntilFinished();
+    mpLoopCloser->WaitUntilFinished();
+
+    // Final statistics
+    if(!mStrStatsFile.empty())
     {
-        usleep(5000);
+        Stats::StopPeriodicSave();
+        Stats::Save(mStrStatsFile);
     }
 
     if(mpViewer)
@@ -432,7 +562,11 @@ void System::SaveTrajectoryTUM(const string &filename)
 
     // Transform all keyframes so that the first keyframe is at the origin.
     // After a loop closure the first keyframe might not be at the origin.
-    cv::Mat Two = vpKFs[0]->GetPoseInverse();
+    Eigen::Matrix3f Row;
+    Eigen::Vector3f tow;
+    vpKFs[0]->GetPose(Row,tow);
+    const Eigen::Matrix3f Rwo = Row.transpose();
+    const Eigen::Vector3f two = -Rwo*tow;
 
     ofstream f;
     f.open(filename.c_str());
@@ -447,38 +581,121 @@ void System::SaveTrajectoryTUM(const string &filename)
     list<ORB_SLAM2::KeyFrame*>::iterator lRit = mpTracker->mlpReferences.begin();
     list<double>::iterator lT = mpTracker->mlFrameTimes.begin();
     list<bool>::iterator lbL = mpTracker->mlbLost.begin();
-    for(list<cv::Mat>::iterator lit=mpTracker->mlRelativeFramePoses.begin(),
-        lend=mpTracker->mlRelativeFramePoses.end();lit!=lend;lit++, lRit++, lT++, lbL++)
+    list<Eigen::Vector3f>::iterator ltr = mpTracker->mlRelativeFrameTranslations.begin();
+    for(list<Eigen::Matrix3f>::iterator lRr=mpTracker->mlRelativeFrameRotations.begin(),
+        lend=mpTracker->mlRelativeFrameRotations.end();lRr!=lend;lRr++, ltr++, lRit++, lT++, lbL++)
     {
         if(*lbL)
             continue;
 
         KeyFrame* pKF = *lRit;
 
-        cv::Mat Trw = cv::Mat::eye(4,4,CV_32F);
+        Eigen::Matrix3f Rrw = Eigen::Matrix3f::Identity();
+        Eigen::Vector3f trw = Eigen::Vector3f::Zero();
 
         // If the reference keyframe was culled, traverse the spanning tree to get a suitable keyframe.
         while(pKF->isBad())
         {
-            Trw = Trw*pKF->mTcp;
+            trw += Rrw*pKF->mtcp;
+            Rrw = Rrw*pKF->mRcp;
             pKF = pKF->GetParent();
         }
 
-        Trw = Trw*pKF->GetPose()*Two;
+        // Trw = Trw*Tkw*Two
+        Eigen::Matrix3f Rkw;
+        Eigen::Vector3f tkw;
+        pKF->GetPose(Rkw,tkw);
+        trw += Rrw*tkw;
+        Rrw = Rrw*Rkw;
+        trw += Rrw*two;
+        Rrw = Rrw*Rwo;
 
-        cv::Mat Tcw = (*lit)*Trw;
-        cv::Mat Rwc = Tcw.rowRange(0,3).colRange(0,3).t();
-        cv::Mat twc = -Rwc*Tcw.rowRange(0,3).col(3);
+        const Eigen::Matrix3f Rcw = (*lRr)*Rrw;
+        const Eigen::Vector3f tcw = (*lRr)*trw+(*ltr);
+        const Eigen::Matrix3f Rwc = Rcw.transpose();
+        const Eigen::Vector3f twc = -Rwc*tcw;
 
         vector<float> q = Converter::toQuaternion(Rwc);
 
-        f << setprecision(6) << *lT << " " <<  setprecision(9) << twc.at<float>(0) << " " << twc.at<float>(1) << " " << twc.at<float>(2) << " " << q[0] << " " << q[1] << " " << q[2] << " " << q[3] << endl;
+        f << setprecision(6) << *lT << " " <<  setprecision(9) << twc(0) << " " << twc(1) << " " << twc(2) << " " << q[0] << " " << q[1] << " " << q[2] << " " << q[3] << endl;
     }
     f.close();
     cout << endl << "trajectory saved!" << endl;
 }
 
 
+void System::StartStats(cv::FileStorage &fsSettings)
+{
+    fsSettings["Stats.file"] >> mStrStatsFile;
+    if(mStrStatsFile.empty())
+        return;
+
+    float period = fsSettings["Stats.period"];
+    if(period<=0)
+        period = 10;
+
+    cout << "Saving statistics to " << mStrStatsFile << " every " << period << " s" << endl;
+    Stats::StartPeriodicSave(mStrStatsFile,period);
+}
+
+vector<Stats::StageSummary> System::GetStageStats()
+{
+    return Stats::GetStageSummaries();
+}
+
+vector<Stats::CounterSummary> System::GetCounterStats()
+{
+    return Stats::GetCounterSummaries();
+}
+
+void System::ResetStats()
+{
+    Stats::Reset();
+}
+
+bool System::SaveStats(const string &filename)
+{
+    return Stats::Save(filename);
+}
+
+bool System::SaveMap(const string &filename)
+{
+    cout << endl << "Saving map to " << filename << " ..." << endl;
+
+    unique_lock<mutex> lock(mpMap->mMutexMapUpdate);
+    if(!MapSerializer::Save(filename,mpMap))
+    {
+        cerr << "Failed to save map at: " << filename << endl;
+        return false;
+    }
+
+    return true;
+}
+
+bool System::LoadMap(const string &filename)
+{
+    cout << endl << "Loading map from " << filename << " ..." << endl;
+
+    {
+        unique_lock<mutex> lock(mpMap->mMutexMapUpdate);
+
+        mpKeyFrameDatabase->clear();
+        mpMap->clear();
+
+        if(!MapSerializer::Load(filename,mpMap,mpKeyFrameDatabase,mpVocabulary,
+                                mpTracker->GetK(),mpTracker->GetDistCoef(),mpTracker->GetBf()))
+        {
+            cerr << "Failed to load map at: " << filename << endl;
+            return false;
+        }
+    }
+
+    mpTracker->InformMapLoaded();
+    mpMap->InformNewBigChange();
+
+    return true;
+}
+
 void System::SaveKeyFrameTrajectoryTUM(const string &filename)
 {
     cout << endl << "Saving keyframe trajectory to " << filename << " ..." << endl;
@@ -503,10 +720,10 @@ void System::SaveKeyFrameTrajectoryTUM(const string &filename)
         if(pKF->isBad())
             continue;
 
-        cv::Mat R = pKF->GetRotation().t();
+        Eigen::Matrix3f R = pKF->GetRotation().transpose();
         vector<float> q = Converter::toQuaternion(R);
-        cv::Mat t = pKF->GetCameraCenter();
-        f << setprecision(6) << pKF->mTimeStamp << setprecision(7) << " " << t.at<float>(0) << " " << t.at<float>(1) << " " << t.at<float>(2)
+        Eigen::Vector3f t = pKF->GetCameraCenter();
+        f << setprecision(6) << pKF->mTimeStamp << setprecision(7) << " " << t(0) << " " << t(1) << " " << t(2)
           << " " << q[0] << " " << q[1] << " " << q[2] << " " << q[3] << endl;
 
     }
@@ -529,7 +746,11 @@ void System::SaveTrajectoryKITTI(const string &filename)
 
     // Transform all keyframes so that the first keyframe is at the origin.
     // After a loop closure the first keyframe might not be at the origin.
-    cv::Mat Two = vpKFs[0]->GetPoseInverse();
+    Eigen::Matrix3f Row;
+    Eigen::Vector3f tow;
+    vpKFs[0]->GetPose(Row,tow);
+    const Eigen::Matrix3f Rwo = Row.transpose();
+    const Eigen::Vector3f two = -Rwo*tow;
 
     ofstream f;
     f.open(filename.c_str());
@@ -543,28 +764,39 @@ void System::SaveTrajectoryKITTI(const string &filename)
     // which is true when tracking failed (lbL).
     list<ORB_SLAM2::KeyFrame*>::iterator lRit = mpTracker->mlpReferences.begin();
     list<double>::iterator lT = mpTracker->mlFrameTimes.begin();
-    for(list<cv::Mat>::iterator lit=mpTracker->mlRelativeFramePoses.begin(), lend=mpTracker->mlRelativeFramePoses.end();lit!=lend;lit++, lRit++, lT++)
+    list<Eigen::Vector3f>::iterator ltr = mpTracker->mlRelativeFrameTranslations.begin();
+    for(list<Eigen::Matrix3f>::iterator lRr=mpTracker->mlRelativeFrameRotations.begin(), lend=mpTracker->mlRelativeFrameRotations.end();lRr!=lend;lRr++, ltr++, lRit++, lT++)
     {
         ORB_SLAM2::KeyFrame* pKF = *lRit;
 
-        cv::Mat Trw = cv::Mat::eye(4,4,CV_32F);
+        Eigen::Matrix3f Rrw = Eigen::Matrix3f::Identity();
+        Eigen::Vector3f trw = Eigen::Vector3f::Zero();
 
         while(pKF->isBad())
         {
           //  cout << "bad parent" << endl;
-            Trw = Trw*pKF->mTcp;
+            trw += Rrw*pKF->mtcp;
+            Rrw = Rrw*pKF->mRcp;
             pKF = pKF->GetParent();
         }
 
-        Trw = Trw*pKF->GetPose()*Two;
-
-        cv::Mat Tcw = (*lit)*Trw;
-        cv::Mat Rwc = Tcw.rowRange(0,3).colRange(0,3).t();
-        cv::Mat twc = -Rwc*Tcw.rowRange(0,3).col(3);
-
-        f << setprecision(9) << Rwc.at<float>(0,0) << " " << Rwc.at<float>(0,1)  << " " << Rwc.at<float>(0,2) << " "  << twc.at<float>(0) << " " <<
-             Rwc.at<float>(1,0) << " " << Rwc.at<float>(1,1)  << " " << Rwc.at<float>(1,2) << " "  << twc.at<float>(1) << " " <<
-             Rwc.at<float>(2,0) << " " << Rwc.at<float>(2,1)  << " " << Rwc.at<float>(2,2) << " "  << twc.at<float>(2) << endl;
+        // Trw = Trw*Tkw*Two
+        Eigen::Matrix3f Rkw;
+        Eigen::Vector3f tkw;
+        pKF->GetPose(Rkw,tkw);
+        trw += Rrw*tkw;
+        Rrw = Rrw*Rkw;
+        trw += Rrw*two;
+        Rrw = Rrw*Rwo;
+
+        const Eigen::Matrix3f Rcw = (*lRr)*Rrw;
+        const Eigen::Vector3f tcw = (*lRr)*trw+(*ltr);
+        const Eigen::Matrix3f Rwc = Rcw.transpose();
+        const Eigen::Vector3f twc = -Rwc*tcw;
+
+        f << setprecision(9) << Rwc(0,0) << " " << Rwc(0,1)  << " " << Rwc(0,2) << " "  << twc(0) << " " <<
+             Rwc(1,0) << " " << Rwc(1,1)  << " " << Rwc(1,2) << " "  << twc(1) << " " <<
+             Rwc(2,0) << " " << Rwc(2,1)  << " " << Rwc(2,2) << " "  << twc(2) << endl;
     }
     f.close();
     cout << endl << "trajectory saved!" << endl;
@@ -0,0 +1,167 @@
+/**
+* This file is part of ORB-SLAM2.
+*
+* Copyright (C) 2014-2016 Raúl Mur-Artal <raulmur at unizar dot es> (University of Zaragoza)
+* For more information see <https://github.com/raulmur/ORB_SLAM2>
+*
+* ORB-SLAM2 is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM2 is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with ORB-SLAM2. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "ThreadPool.h"
+
+#include <atomic>
+#include <algorithm>
+#include <exception>
+
+using namespace std;
+
+namespace ORB_SLAM2
+{
+
+namespace
+{
+
+// Indices of a ParallelFor, shared by the caller and the workers that help
+struct ParallelJob
+{
+    atomic<int> next;
+    int end;
+    int total;
+    const function<void(int)> *pFunction;
+
+    mutex mMutexDone;
+    condition_variable mcvDone;
+    int nDone;
+    // First exception thrown by the function, rethrown by the caller
+    exception_ptr pException;
+
+    void Work()
+    {
+        int n = 0;
+        exception_ptr pFirstException;
+        for(int i=next++; i<end; i=next++)
+        {
+            // An index that throws is done too, otherwise the caller would wait forever
+            try
+            {
+                (*pFunction)(i);
+            }
+            catch(...)
+            {
+                if(!pFirstException)
+                    pFirstException = current_exception();
+            }
+            n++;
+        }
+
+        if(n>0)
+        {
+            unique_lock<mutex> lock(mMutexDone);
+            if(pFirstException && !pException)
+                pException = pFirstException;
+            nDone += n;
+            if(nDone==total)
+                mcvDone.notify_all();
+        }
+    }
+};
+
+} // namespace
+
+ThreadPool::ThreadPool(int nThreads): mbFinish(false)
+{
+    if(nThreads<0)
+        nThreads = max((int)thread::hardware_concurrency()-1,0);
+
+    mvThreads.reserve(nThreads);
+    for(int i=0; i<nThreads; i++)
+        mvThreads.push_back(thread(&ThreadPool::Run,this));
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        unique_lock<mutex> lock(mMutexQueue);
+        mbFinish = true;
+    }
+    mcvQueue.notify_all();
+
+    for(size_t i=0; i<mvThreads.size(); i++)
+        mvThreads[i].join();
+}
+
+void ThreadPool::Run()
+{
+    while(1)
+    {
+        function<void()> task;
+        {
+            unique_lock<mutex> lock(mMutexQueue);
+            while(!mbFinish && mqTasks.empty())
+                mcvQueue.wait(lock);
+
+            if(mqTasks.empty())
+                return;
+
+            task = move(mqTasks.front());
+            mqTasks.pop_front();
+        }
+
+        task();
+    }
+}
+
+void ThreadPool::ParallelFor(int begin, int end, const function<void(int)> &f)
+{
+    const int n = end-begin;
+    if(n<=0)
+        return;
+
+    if(n==1 || mvThreads.empty())
+    {
+        for(int i=begin; i<end; i++)
+            f(i);
+        return;
+    }
+
+    shared_ptr<ParallelJob> pJob = make_shared<ParallelJob>();
+    pJob->next = begin;
+    pJob->end = end;
+    pJob->total = n;
+    pJob->pFunction = &f;
+    pJob->nDone = 0;
+
+    // Helpers that start after all indices were taken return immediately
+    const int nHelpers = min((int)mvThreads.size(),n-1);
+    {
+        unique_lock<mutex> lock(mMutexQueue);
+        for(int i=0; i<nHelpers; i++)
+            mqTasks.push_back([pJob](){ pJob->Work(); });
+    }
+    if(nHelpers==1)
+        mcvQueue.notify_one();
+    else
+        mcvQueue.notify_all();
+
+    pJob->Work();
+
+    unique_lock<mutex> lock(pJob->mMutexDone);
+    while(pJob->nDone<n)
+        pJob->mcvDone.wait(lock);
+
+    if(pJob->pException)
+        rethrow_exception(pJob->pException);
+}
+
+} //namespace ORB_SLAM
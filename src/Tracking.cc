@@ -24,13 +24,6 @@
 #include<opencv2/core/core.hpp>
 #include<opencv2/features2d/features2d.hpp>
 
-#include"ros/ros.h"
-#include"std_msgs/String.h"
-#include"sensor_msgs/PointCloud.h"
-#include"geometry_msgs/Point32.h"
-#include"sensor_msgs/ChannelFloat32.h"
-#include"ORB_SLAM2/Points.h"
-
 #include"ORBmatcher.h"
 #include"FrameDrawer.h"
 #include"Converter.h"
@@ -39,12 +32,14 @@
 
 #include"Optimizer.h"
 #include"PnPsolver.h"
+#include"Stats.h"
 
 #include<iostream>
 
 #include<mutex>
 
 #include<math.h>
+#include<cassert>
 #include<vector>
 
 
@@ -55,8 +50,8 @@ namespace ORB_SLAM2
 
 Tracking::Tracking(System *pSys, ORBVocabulary* pVoc, FrameDrawer *pFrameDrawer, MapDrawer *pMapDrawer, Map *pMap, KeyFrameDatabase* pKFDB, const string &strSettingPath, const int sensor):
     mState(NO_IMAGES_YET), mSensor(sensor), mbOnlyTracking(false), mbVO(false), mpORBVocabulary(pVoc),
-    mpKeyFrameDB(pKFDB), mpInitializer(static_cast<Initializer*>(NULL)), mpSystem(pSys), mpViewer(NULL),
-    mpFrameDrawer(pFrameDrawer), mpMapDrawer(pMapDrawer), mpMap(pMap), mnLastRelocFrameId(0)
+    mpKeyFrameDB(pKFDB), mpInitializer(static_cast<Initializer*>(NULL)), mpSystem(pSys), mpViewer(NULL), mpPointsPublisher(NULL),
+    mpFrameDrawer(pFrameDrawer), mpMapDrawer(pMapDrawer), mpMap(pMap), mnLastRelocFrameId(0), mbVelocity(false)
 {
     // Load camera parameters from settings file
 
@@ -126,13 +121,22 @@ Tracking::Tracking(System *pSys, ORBVocabulary* pVoc, FrameDrawer *pFrameDrawer,
     int fIniThFAST = fSettings["ORBextractor.iniThFAST"];
     int fMinThFAST = fSettings["ORBextractor.minThFAST"];
 
-    mpORBextractorLeft = new ORBextractor(nFeatures,fScaleFactor,nLevels,fIniThFAST,fMinThFAST);
+    // Worker threads shared by the extractors and the BoW transform (one per core if not given)
+    int nThreads = -1;
+    if(!fSettings["ThreadPool.nThreads"].empty())
+        nThreads = fSettings["ThreadPool.nThreads"];
+    mpThreadPool = new ThreadPool(nThreads);
+    mpORBVocabulary->SetThreadPool(mpThreadPool);
+
+    mpORBextractorLeft = new ORBextractor(nFeatures,fScaleFactor,nLevels,fIniThFAST,fMinThFAST,mpThreadPool);
+    mpORBextractorRight = static_cast<ORBextractor*>(NULL);
+    mpIniORBextractor = static_cast<ORBextractor*>(NULL);
 
     if(sensor==System::STEREO)
-        mpORBextractorRight = new ORBextractor(nFeatures,fScaleFactor,nLevels,fIniThFAST,fMinThFAST);
+        mpORBextractorRight = new ORBextractor(nFeatures,fScaleFactor,nLevels,fIniThFAST,fMinThFAST,mpThreadPool);
 
     if(sensor==System::MONOCULAR)
-        mpIniORBextractor = new ORBextractor(2*nFeatures,fScaleFactor,nLevels,fIniThFAST,fMinThFAST);
+        mpIniORBextractor = new ORBextractor(2*nFeatures,fScaleFactor,nLevels,fIniThFAST,fMinThFAST,mpThreadPool);
 
     cout << endl  << "ORB Extractor Parameters: " << endl;
     cout << "- Number of Features: " << nFeatures << endl;
@@ -140,6 +144,7 @@ Tracking::Tracking(System *pSys, ORBVocabulary* pVoc, FrameDrawer *pFrameDrawer,
     cout << "- Scale Factor: " << fScaleFactor << endl;
     cout << "- Initial Fast Threshold: " << fIniThFAST << endl;
     cout << "- Minimum Fast Threshold: " << fMinThFAST << endl;
+    cout << "- Extraction Threads: " << mpThreadPool->GetNumThreads() << endl;
 
     if(sensor==System::STEREO || sensor==System::RGBD)
     {
@@ -158,6 +163,18 @@ Tracking::Tracking(System *pSys, ORBVocabulary* pVoc, FrameDrawer *pFrameDrawer,
 
 }
 
+// Defined here, where PnPsolver is complete, to destroy mvpPnPsolvers
+Tracking::~Tracking()
+{
+    // The extractors and the vocabulary use the pool, so they let go of it first
+    delete mpORBextractorLeft;
+    delete mpORBextractorRight;
+    delete mpIniORBextractor;
+    mpORBVocabulary->SetThreadPool(static_cast<ThreadPool*>(NULL));
+
+    delete mpThreadPool;
+}
+
 void Tracking::SetLocalMapper(LocalMapping *pLocalMapper)
 {
     mpLocalMapper=pLocalMapper;
@@ -173,105 +190,105 @@ void Tracking::SetViewer(Viewer *pViewer)
     mpViewer=pViewer;
 }
 
+void Tracking::SetPointsPublisher(PointsPublisher *pPointsPublisher)
+{
+    mpPointsPublisher=pPointsPublisher;
+}
+
 
 cv::Mat Tracking::GrabImageStereo(const cv::Mat &imRectLeft, const cv::Mat &imRectRight, const double &timestamp)
 {
-    mImGray = imRectLeft;
-    cv::Mat imGrayRight = imRectRight;
+    cv::Mat imGray;
+    Frame frame = BuildFrame(imRectLeft,imRectRight,timestamp,false,imGray);
 
-    if(mImGray.channels()==3)
-    {
-        if(mbRGB)
-        {
-            cvtColor(mImGray,mImGray,CV_RGB2GRAY);
-            cvtColor(imGrayRight,imGrayRight,CV_RGB2GRAY);
-        }
-        else
-        {
-            cvtColor(mImGray,mImGray,CV_BGR2GRAY);
-            cvtColor(imGrayRight,imGrayRight,CV_BGR2GRAY);
-        }
-    }
-    else if(mImGray.channels()==4)
-    {
-        if(mbRGB)
-        {
-            cvtColor(mImGray,mImGray,CV_RGBA2GRAY);
-            cvtColor(imGrayRight,imGrayRight,CV_RGBA2GRAY);
-        }
-        else
-        {
-            cvtColor(mImGray,mImGray,CV_BGRA2GRAY);
-            cvtColor(imGrayRight,imGrayRight,CV_BGRA2GRAY);
-        }
-    }
+    return TrackFrame(frame,imGray);
+}
 
-    mCurrentFrame = Frame(mImGray,imGrayRight,timestamp,mpORBextractorLeft,mpORBextractorRight,mpORBVocabulary,mK,mDistCoef,mbf,mThDepth);
 
-    Track();
+cv::Mat Tracking::GrabImageRGBD(const cv::Mat &imRGB,const cv::Mat &imD, const double &timestamp)
+{
+    cv::Mat imGray;
+    Frame frame = BuildFrame(imRGB,imD,timestamp,false,imGray);
 
-    return mCurrentFrame.mTcw.clone();
+    return TrackFrame(frame,imGray);
 }
 
 
-cv::Mat Tracking::GrabImageRGBD(const cv::Mat &imRGB,const cv::Mat &imD, const double &timestamp)
+cv::Mat Tracking::GrabImageMonocular(const cv::Mat &im, const double &timestamp)
 {
-    mImGray = imRGB;
-    cv::Mat imDepth = imD;
+    cv::Mat imGray;
+    Frame frame = BuildFrame(im,cv::Mat(),timestamp,mState==NOT_INITIALIZED || mState==NO_IMAGES_YET,imGray);
 
-    if(mImGray.channels()==3)
+    return TrackFrame(frame,imGray);
+}
+
+Frame Tracking::BuildFrame(const cv::Mat &im, const cv::Mat &im2, const double &timestamp, const bool bInitializing, cv::Mat &imGray)
+{
+    ScopedTimer timer(Stats::BUILD_FRAME);
+
+    imGray = im;
+    ToGray(imGray);
+
+    if(mSensor==System::STEREO)
     {
-        if(mbRGB)
-            cvtColor(mImGray,mImGray,CV_RGB2GRAY);
-        else
-            cvtColor(mImGray,mImGray,CV_BGR2GRAY);
+        cv::Mat imGrayRight = im2;
+        ToGray(imGrayRight);
+
+        return Frame(imGray,imGrayRight,timestamp,mpORBextractorLeft,mpORBextractorRight,mpORBVocabulary,mK,mDistCoef,mbf,mThDepth);
     }
-    else if(mImGray.channels()==4)
+    else if(mSensor==System::RGBD)
     {
-        if(mbRGB)
-            cvtColor(mImGray,mImGray,CV_RGBA2GRAY);
+        cv::Mat imDepth = im2;
+
+        // Raw (CV_16U) and metric (CV_32F) depthmaps are sampled in place and scaled at the keypoints
+        float depthFactor = mDepthMapFactor;
+        if(imDepth.type()!=CV_32F && imDepth.type()!=CV_16U)
+        {
+            imDepth.convertTo(imDepth,CV_32F,mDepthMapFactor);
+            depthFactor = 1.0f;
+        }
+
+        return Frame(imGray,imDepth,timestamp,mpORBextractorLeft,mpORBVocabulary,mK,mDistCoef,mbf,mThDepth,depthFactor);
+    }
+    else
+    {
+        if(bInitializing)
+            return Frame(imGray,timestamp,mpIniORBextractor,mpORBVocabulary,mK,mDistCoef,mbf,mThDepth);
         else
-            cvtColor(mImGray,mImGray,CV_BGRA2GRAY);
+            return Frame(imGray,timestamp,mpORBextractorLeft,mpORBVocabulary,mK,mDistCoef,mbf,mThDepth);
     }
+}
 
-    if((fabs(mDepthMapFactor-1.0f)>1e-5) || imDepth.type()!=CV_32F)
-        imDepth.convertTo(imDepth,CV_32F,mDepthMapFactor);
+cv::Mat Tracking::TrackFrame(Frame &frame, const cv::Mat &imGray)
+{
+    ScopedTimer timer(Stats::TRACK_FRAME);
 
-    mCurrentFrame = Frame(mImGray,imDepth,timestamp,mpORBextractorLeft,mpORBVocabulary,mK,mDistCoef,mbf,mThDepth);
+    mImGray = imGray;
+    mCurrentFrame = std::move(frame);
 
     Track();
 
-    return mCurrentFrame.mTcw.clone();
+    if(!mCurrentFrame.HasPose())
+        return cv::Mat();
+    return Converter::toCvSE3(mCurrentFrame.GetRotation(),mCurrentFrame.GetTranslation());
 }
 
-
-cv::Mat Tracking::GrabImageMonocular(const cv::Mat &im, const double &timestamp)
+void Tracking::ToGray(cv::Mat &im)
 {
-    mImGray = im;
-
-    if(mImGray.channels()==3)
+    if(im.channels()==3)
     {
         if(mbRGB)
-            cvtColor(mImGray,mImGray,CV_RGB2GRAY);
+            cvtColor(im,im,CV_RGB2GRAY);
         else
-            cvtColor(mImGray,mImGray,CV_BGR2GRAY);
+            cvtColor(im,im,CV_BGR2GRAY);
     }
-    else if(mImGray.channels()==4)
+    else if(im.channels()==4)
     {
         if(mbRGB)
-            cvtColor(mImGray,mImGray,CV_RGBA2GRAY);
+            cvtColor(im,im,CV_RGBA2GRAY);
         else
-            cvtColor(mImGray,mImGray,CV_BGRA2GRAY);
+            cvtColor(im,im,CV_BGRA2GRAY);
     }
-
-    if(mState==NOT_INITIALIZED || mState==NO_IMAGES_YET)
-        mCurrentFrame = Frame(mImGray,timestamp,mpIniORBextractor,mpORBVocabulary,mK,mDistCoef,mbf,mThDepth);
-    else
-        mCurrentFrame = Frame(mImGray,timestamp,mpORBextractorLeft,mpORBVocabulary,mK,mDistCoef,mbf,mThDepth);
-
-    Track();
-
-    return mCurrentFrame.mTcw.clone();
 }
 
 void Tracking::Track()
@@ -283,6 +300,8 @@ void Tracking::Track()
 
     mLastProcessedState=mState;
 
+    Stats::Count(Stats::FRAMES);
+
     // Get Map Mutex -> Map cannot be changed
     unique_lock<mutex> lock(mpMap->mMutexMapUpdate);
 
@@ -315,7 +334,7 @@ void Tracking::Track()
                 // Local Mapping might have changed some MapPoints tracked in last frame
                 CheckReplacedInLastFrame();
 
-                if(mVelocity.empty() || mCurrentFrame.mnId<mnLastRelocFrameId+2)
+                if(!mbVelocity || mCurrentFrame.mnId<mnLastRelocFrameId+2)
                 {
                     bOK = TrackReferenceKeyFrame();
                 }
@@ -345,7 +364,7 @@ void Tracking::Track()
                 {
                     // In last frame we tracked enough MapPoints in the map
 
-                    if(!mVelocity.empty())
+                    if(mbVelocity)
                     {
                         bOK = TrackWithMotionModel();
                     }
@@ -366,19 +385,21 @@ void Tracking::Track()
                     bool bOKReloc = false;
                     vector<MapPoint*> vpMPsMM;
                     vector<bool> vbOutMM;
-                    cv::Mat TcwMM;
-                    if(!mVelocity.empty())
+                    Eigen::Matrix3f RcwMM;
+                    Eigen::Vector3f tcwMM;
+                    if(mbVelocity)
                     {
                         bOKMM = TrackWithMotionModel();
                         vpMPsMM = mCurrentFrame.mvpMapPoints;
                         vbOutMM = mCurrentFrame.mvbOutlier;
-                        TcwMM = mCurrentFrame.mTcw.clone();
+                        RcwMM = mCurrentFrame.GetRotation();
+                        tcwMM = mCurrentFrame.GetTranslation();
                     }
                     bOKReloc = Relocalization();
 
                     if(bOKMM && !bOKReloc)
                     {
-                        mCurrentFrame.SetPose(TcwMM);
+                        mCurrentFrame.SetPose(RcwMM,tcwMM);
                         mCurrentFrame.mvpMapPoints = vpMPsMM;
                         mCurrentFrame.mvbOutlier = vbOutMM;
 
@@ -423,7 +444,10 @@ void Tracking::Track()
         if(bOK)
             mState = OK;
         else
+        {
             mState=LOST;
+            Stats::Count(Stats::LOST_FRAMES);
+        }
 
         // Update drawer
         mpFrameDrawer->Update(this);
@@ -432,17 +456,17 @@ void Tracking::Track()
         if(bOK)
         {
             // Update motion model
-            if(!mLastFrame.mTcw.empty())
+            if(mLastFrame.HasPose())
             {
-                cv::Mat LastTwc = cv::Mat::eye(4,4,CV_32F);
-                mLastFrame.GetRotationInverse().copyTo(LastTwc.rowRange(0,3).colRange(0,3));
-                mLastFrame.GetCameraCenter().copyTo(LastTwc.rowRange(0,3).col(3));
-                mVelocity = mCurrentFrame.mTcw*LastTwc;
+                // Tcl = Tcw*Twl
+                mRVelocity = mCurrentFrame.GetRotation()*mLastFrame.GetRotationInverse();
+                mtVelocity = mCurrentFrame.GetRotation()*mLastFrame.GetCameraCenter()+mCurrentFrame.GetTranslation();
+                mbVelocity = true;
             }
             else
-                mVelocity = cv::Mat();
+                mbVelocity = false;
 
-            mpMapDrawer->SetCurrentCameraPose(mCurrentFrame.mTcw);
+            mpMapDrawer->SetCurrentCameraPose(mCurrentFrame.GetRotation(),mCurrentFrame.GetTranslation());
 
             // Clean VO matches
             for(int i=0; i<mCurrentFrame.N; i++)
@@ -493,73 +517,35 @@ void Tracking::Track()
         if(!mCurrentFrame.mpReferenceKF)
             mCurrentFrame.mpReferenceKF = mpReferenceKF;
 
-        mLastFrame = Frame(mCurrentFrame);
+        mLastFrame = mCurrentFrame;
     }
 
     // Store frame pose information to retrieve the complete camera trajectory afterwards.
-    if(!mCurrentFrame.mTcw.empty())
+    if(mCurrentFrame.HasPose())
     {
-        cv::Mat Tcr = mCurrentFrame.mTcw*mCurrentFrame.mpReferenceKF->GetPoseInverse();
-        mlRelativeFramePoses.push_back(Tcr);
+        // Tcr = Tcw*Twr
+        Eigen::Matrix3f Rrw;
+        Eigen::Vector3f trw;
+        mCurrentFrame.mpReferenceKF->GetPose(Rrw,trw);
+        const Eigen::Matrix3f Rcr = mCurrentFrame.GetRotation()*Rrw.transpose();
+        mlRelativeFrameRotations.push_back(Rcr);
+        mlRelativeFrameTranslations.push_back(mCurrentFrame.GetTranslation()-Rcr*trw);
         mlpReferences.push_back(mpReferenceKF);
         mlFrameTimes.push_back(mCurrentFrame.mTimeStamp);
         mlbLost.push_back(mState==LOST);
     }
-    else
+    else if(!mlRelativeFrameRotations.empty())
     {
-        // This can happen if tracking is lost
-        mlRelativeFramePoses.push_back(mlRelativeFramePoses.back());
+        // This can happen if tracking is lost (nothing to repeat if lost since a map was loaded)
+        mlRelativeFrameRotations.push_back(mlRelativeFrameRotations.back());
+        mlRelativeFrameTranslations.push_back(mlRelativeFrameTranslations.back());
         mlpReferences.push_back(mlpReferences.back());
         mlFrameTimes.push_back(mlFrameTimes.back());
         mlbLost.push_back(mState==LOST);
     }
 
-    std::cout << "Tracking.cc: camera pose: " << mCurrentFrame.mTcw << std::endl;
-
-
-    // geometry_msgs::Point32 tracked_points;
-    // tracked_points.data.resize(mCurrentFrame.mvpMapPoints.size());
-    // sensor_msgs::ChannelFloat32 tracked_distances;
-    // tracked_distances.data.resize(mCurrentFrame.mvpMapPoints.size());
-
-    ORB_SLAM2::Points msg;
-    printf("%.20g\n", mCurrentFrame.mTimeStamp);
-    msg.frame_id = mCurrentFrame.mTimeStamp;
-    msg.header.stamp = ros::Time(mCurrentFrame.mTimeStamp);
-
-    //std::vector<geometry_msgs::Point> vect_points;
-    bool show_time = true;
-    for(unsigned i = 0; i < mCurrentFrame.mvpMapPoints.size(); i++)
-    {
-        if(mCurrentFrame.mvpMapPoints[i] != 0)
-        {
-            if(show_time)
-            {
-                //std::cout << "Tracking.cc: image id " << mCurrentFrame.mTimeStamp << std::endl;
-                show_time = false;
-            }
-
-            geometry_msgs::Point cur_point;
-            cur_point.x = mCurrentFrame.mvKeys[i].pt.x;
-            cur_point.y = mCurrentFrame.mvKeys[i].pt.y;
-            cur_point.z = 0;
-            msg.points.push_back(cur_point);
-
-            float distance = sqrt( pow(mCurrentFrame.mTcw.at<float>(0) - mCurrentFrame.mvpMapPoints[i]->GetWorldPos().at<float>(0), 2 ) +
-                                    pow(mCurrentFrame.mTcw.at<float>(1) - mCurrentFrame.mvpMapPoints[i]->GetWorldPos().at<float>(1), 2 ) +
-                                    pow(mCurrentFrame.mTcw.at<float>(2) - mCurrentFrame.mvpMapPoints[i]->GetWorldPos().at<float>(2), 2 ) );
-
-            msg.distances.push_back(distance);
-        }
-    }
-
-    if(ros::ok())
-    {
-      //ROS_INFO("%s", msg.data.c_str());
-
-      mpSystem->pub.publish(msg);
-    }
-
+    if(mpPointsPublisher)
+        mpPointsPublisher->Update(mCurrentFrame);
 }
 
 
@@ -568,7 +554,7 @@ void Tracking::StereoInitialization()
     if(mCurrentFrame.N>500)
     {
         // Set Frame pose to the origin
-        mCurrentFrame.SetPose(cv::Mat::eye(4,4,CV_32F));
+        mCurrentFrame.SetPose(Eigen::Matrix3f::Identity(),Eigen::Vector3f::Zero());
 
         // Create KeyFrame
         KeyFrame* pKFini = new KeyFrame(mCurrentFrame,mpMap,mpKeyFrameDB);
@@ -579,10 +565,10 @@ void Tracking::StereoInitialization()
         // Create MapPoints and asscoiate to KeyFrame
         for(int i=0; i<mCurrentFrame.N;i++)
         {
-            float z = mCurrentFrame.mvDepth[i];
+            float z = mCurrentFrame.mpFeatures->mvDepth[i];
             if(z>0)
             {
-                cv::Mat x3D = mCurrentFrame.UnprojectStereo(i);
+                Eigen::Vector3f x3D = mCurrentFrame.UnprojectStereo(i);
                 MapPoint* pNewMP = new MapPoint(x3D,pKFini,mpMap);
                 pNewMP->AddObservation(pKFini,i);
                 pKFini->AddMapPoint(pNewMP,i);
@@ -598,12 +584,15 @@ void Tracking::StereoInitialization()
 
         mpLocalMapper->InsertKeyFrame(pKFini);
 
-        mLastFrame = Frame(mCurrentFrame);
+        mLastFrame = mCurrentFrame;
         mnLastKeyFrameId=mCurrentFrame.mnId;
         mpLastKeyFrame = pKFini;
 
         mvpLocalKeyFrames.push_back(pKFini);
         mvpLocalMapPoints=mpMap->GetAllMapPoints();
+        mLocalMapPointsSoA.clear();
+        for(size_t i=0; i<mvpLocalMapPoints.size(); i++)
+            mLocalMapPointsSoA.push_back(mvpLocalMapPoints[i]);
         mpReferenceKF = pKFini;
         mCurrentFrame.mpReferenceKF = pKFini;
 
@@ -611,7 +600,7 @@ void Tracking::StereoInitialization()
 
         mpMap->mvpKeyFrameOrigins.push_back(pKFini);
 
-        mpMapDrawer->SetCurrentCameraPose(mCurrentFrame.mTcw);
+        mpMapDrawer->SetCurrentCameraPose(mCurrentFrame.GetRotation(),mCurrentFrame.GetTranslation());
 
         mState=OK;
     }
@@ -623,13 +612,13 @@ void Tracking::MonocularInitialization()
     if(!mpInitializer)
     {
         // Set Reference Frame
-        if(mCurrentFrame.mvKeys.size()>100)
+        if(mCurrentFrame.mpFeatures->mvKeys.size()>100)
         {
-            mInitialFrame = Frame(mCurrentFrame);
-            mLastFrame = Frame(mCurrentFrame);
-            mvbPrevMatched.resize(mCurrentFrame.mvKeysUn.size());
-            for(size_t i=0; i<mCurrentFrame.mvKeysUn.size(); i++)
-                mvbPrevMatched[i]=mCurrentFrame.mvKeysUn[i].pt;
+            mInitialFrame = mCurrentFrame;
+            mLastFrame = mCurrentFrame;
+            mvbPrevMatched.resize(mCurrentFrame.mpFeatures->mvKeysUn.size());
+            for(size_t i=0; i<mCurrentFrame.mpFeatures->mvKeysUn.size(); i++)
+                mvbPrevMatched[i]=mCurrentFrame.mpFeatures->mvKeysUn[i].pt;
 
             if(mpInitializer)
                 delete mpInitializer;
@@ -644,7 +633,7 @@ void Tracking::MonocularInitialization()
     else
     {
         // Try to initialize
-        if((int)mCurrentFrame.mvKeys.size()<=100)
+        if((int)mCurrentFrame.mpFeatures->mvKeys.size()<=100)
         {
             delete mpInitializer;
             mpInitializer = static_cast<Initializer*>(NULL);
@@ -680,11 +669,8 @@ void Tracking::MonocularInitialization()
             }
 
             // Set Frame Poses
-            mInitialFrame.SetPose(cv::Mat::eye(4,4,CV_32F));
-            cv::Mat Tcw = cv::Mat::eye(4,4,CV_32F);
-            Rcw.copyTo(Tcw.rowRange(0,3).colRange(0,3));
-            tcw.copyTo(Tcw.rowRange(0,3).col(3));
-            mCurrentFrame.SetPose(Tcw);
+            mInitialFrame.SetPose(Eigen::Matrix3f::Identity(),Eigen::Vector3f::Zero());
+            mCurrentFrame.SetPose(Converter::toMatrix3f(Rcw),Converter::toVector3f(tcw));
 
             CreateInitialMapMonocular();
         }
@@ -712,7 +698,7 @@ void Tracking::CreateInitialMapMonocular()
             continue;
 
         //Create MapPoint.
-        cv::Mat worldPos(mvIniP3D[i]);
+        Eigen::Vector3f worldPos(mvIniP3D[i].x,mvIniP3D[i].y,mvIniP3D[i].z);
 
         MapPoint* pMP = new MapPoint(worldPos,pKFcur,mpMap);
 
@@ -754,9 +740,10 @@ void Tracking::CreateInitialMapMonocular()
     }
 
     // Scale initial baseline
-    cv::Mat Tc2w = pKFcur->GetPose();
-    Tc2w.col(3).rowRange(0,3) = Tc2w.col(3).rowRange(0,3)*invMedianDepth;
-    pKFcur->SetPose(Tc2w);
+    Eigen::Matrix3f Rc2w;
+    Eigen::Vector3f tc2w;
+    pKFcur->GetPose(Rc2w,tc2w);
+    pKFcur->SetPose(Rc2w,tc2w*invMedianDepth);
 
     // Scale points
     vector<MapPoint*> vpAllMapPoints = pKFini->GetMapPointMatches();
@@ -772,21 +759,25 @@ void Tracking::CreateInitialMapMonocular()
     mpLocalMapper->InsertKeyFrame(pKFini);
     mpLocalMapper->InsertKeyFrame(pKFcur);
 
-    mCurrentFrame.SetPose(pKFcur->GetPose());
+    pKFcur->GetPose(Rc2w,tc2w);
+    mCurrentFrame.SetPose(Rc2w,tc2w);
     mnLastKeyFrameId=mCurrentFrame.mnId;
     mpLastKeyFrame = pKFcur;
 
     mvpLocalKeyFrames.push_back(pKFcur);
     mvpLocalKeyFrames.push_back(pKFini);
     mvpLocalMapPoints=mpMap->GetAllMapPoints();
+    mLocalMapPointsSoA.clear();
+    for(size_t i=0; i<mvpLocalMapPoints.size(); i++)
+        mLocalMapPointsSoA.push_back(mvpLocalMapPoints[i]);
     mpReferenceKF = pKFcur;
     mCurrentFrame.mpReferenceKF = pKFcur;
 
-    mLastFrame = Frame(mCurrentFrame);
+    mLastFrame = mCurrentFrame;
 
     mpMap->SetReferenceMapPoints(mvpLocalMapPoints);
 
-    mpMapDrawer->SetCurrentCameraPose(pKFcur->GetPose());
+    mpMapDrawer->SetCurrentCameraPose(mCurrentFrame.GetRotation(),mCurrentFrame.GetTranslation());
 
     mpMap->mvpKeyFrameOrigins.push_back(pKFini);
 
@@ -813,6 +804,8 @@ void Tracking::CheckReplacedInLastFrame()
 
 bool Tracking::TrackReferenceKeyFrame()
 {
+    ScopedTimer timer(Stats::TRACK_REFERENCE_KF);
+
     // Compute Bag of Words vector
     mCurrentFrame.ComputeBoW();
 
@@ -827,7 +820,7 @@ bool Tracking::TrackReferenceKeyFrame()
         return false;
 
     mCurrentFrame.mvpMapPoints = vpMapPointMatches;
-    mCurrentFrame.SetPose(mLastFrame.mTcw);
+    mCurrentFrame.SetPose(mLastFrame.GetRotation(),mLastFrame.GetTranslation());
 
     Optimizer::PoseOptimization(&mCurrentFrame);
 
@@ -843,7 +836,6 @@ bool Tracking::TrackReferenceKeyFrame()
 
                 mCurrentFrame.mvpMapPoints[i]=static_cast<MapPoint*>(NULL);
                 mCurrentFrame.mvbOutlier[i]=false;
-                pMP->mbTrackInView = false;
                 pMP->mnLastFrameSeen = mCurrentFrame.mnId;
                 nmatches--;
             }
@@ -859,9 +851,13 @@ void Tracking::UpdateLastFrame()
 {
     // Update pose according to reference keyframe
     KeyFrame* pRef = mLastFrame.mpReferenceKF;
-    cv::Mat Tlr = mlRelativeFramePoses.back();
+    const Eigen::Matrix3f &Rlr = mlRelativeFrameRotations.back();
+    const Eigen::Vector3f &tlr = mlRelativeFrameTranslations.back();
 
-    mLastFrame.SetPose(Tlr*pRef->GetPose());
+    Eigen::Matrix3f Rrw;
+    Eigen::Vector3f trw;
+    pRef->GetPose(Rrw,trw);
+    mLastFrame.SetPose(Rlr*Rrw,Rlr*trw+tlr);
 
     if(mnLastKeyFrameId==mLastFrame.mnId || mSensor==System::MONOCULAR || !mbOnlyTracking)
         return;
@@ -872,7 +868,7 @@ void Tracking::UpdateLastFrame()
     vDepthIdx.reserve(mLastFrame.N);
     for(int i=0; i<mLastFrame.N;i++)
     {
-        float z = mLastFrame.mvDepth[i];
+        float z = mLastFrame.mpFeatures->mvDepth[i];
         if(z>0)
         {
             vDepthIdx.push_back(make_pair(z,i));
@@ -903,7 +899,7 @@ void Tracking::UpdateLastFrame()
 
         if(bCreateNew)
         {
-            cv::Mat x3D = mLastFrame.UnprojectStereo(i);
+            Eigen::Vector3f x3D = mLastFrame.UnprojectStereo(i);
             MapPoint* pNewMP = new MapPoint(x3D,mpMap,&mLastFrame,i);
 
             mLastFrame.mvpMapPoints[i]=pNewMP;
@@ -923,13 +919,15 @@ void Tracking::UpdateLastFrame()
 
 bool Tracking::TrackWithMotionModel()
 {
+    ScopedTimer timer(Stats::TRACK_MOTION_MODEL);
+
     ORBmatcher matcher(0.9,true);
 
     // Update last frame pose according to its reference keyframe
     // Create "visual odometry" points if in Localization Mode
     UpdateLastFrame();
 
-    mCurrentFrame.SetPose(mVelocity*mLastFrame.mTcw);
+    mCurrentFrame.SetPose(mRVelocity*mLastFrame.GetRotation(),mRVelocity*mLastFrame.GetTranslation()+mtVelocity);
 
     fill(mCurrentFrame.mvpMapPoints.begin(),mCurrentFrame.mvpMapPoints.end(),static_cast<MapPoint*>(NULL));
 
@@ -966,7 +964,6 @@ bool Tracking::TrackWithMotionModel()
 
                 mCurrentFrame.mvpMapPoints[i]=static_cast<MapPoint*>(NULL);
                 mCurrentFrame.mvbOutlier[i]=false;
-                pMP->mbTrackInView = false;
                 pMP->mnLastFrameSeen = mCurrentFrame.mnId;
                 nmatches--;
             }
@@ -986,6 +983,8 @@ bool Tracking::TrackWithMotionModel()
 
 bool Tracking::TrackLocalMap()
 {
+    ScopedTimer timer(Stats::TRACK_LOCAL_MAP);
+
     // We have an estimation of the camera pose and some map points tracked in the frame.
     // We retrieve the local map and try to find matches to points in the local map.
 
@@ -1033,6 +1032,8 @@ bool Tracking::TrackLocalMap()
 
 bool Tracking::NeedNewKeyFrame()
 {
+    ScopedTimer timer(Stats::NEED_NEW_KF);
+
     if(mbOnlyTracking)
         return false;
 
@@ -1062,7 +1063,7 @@ bool Tracking::NeedNewKeyFrame()
     {
         for(int i =0; i<mCurrentFrame.N; i++)
         {
-            if(mCurrentFrame.mvDepth[i]>0 && mCurrentFrame.mvDepth[i]<mThDepth)
+            if(mCurrentFrame.mpFeatures->mvDepth[i]>0 && mCurrentFrame.mpFeatures->mvDepth[i]<mThDepth)
             {
                 if(mCurrentFrame.mvpMapPoints[i] && !mCurrentFrame.mvbOutlier[i])
                     nTrackedClose++;
@@ -1119,9 +1120,13 @@ bool Tracking::NeedNewKeyFrame()
 
 void Tracking::CreateNewKeyFrame()
 {
+    ScopedTimer timer(Stats::CREATE_NEW_KF);
+
     if(!mpLocalMapper->SetNotStop(true))
         return;
 
+    Stats::Count(Stats::KEYFRAMES);
+
     KeyFrame* pKF = new KeyFrame(mCurrentFrame,mpMap,mpKeyFrameDB);
 
     mpReferenceKF = pKF;
@@ -1129,8 +1134,6 @@ void Tracking::CreateNewKeyFrame()
 
     if(mSensor!=System::MONOCULAR)
     {
-        mCurrentFrame.UpdatePoseMatrices();
-
         // We sort points by the measured depth by the stereo/RGBD sensor.
         // We create all those MapPoints whose depth < mThDepth.
         // If there are less than 100 close points we create the 100 closest.
@@ -1138,7 +1141,7 @@ void Tracking::CreateNewKeyFrame()
         vDepthIdx.reserve(mCurrentFrame.N);
         for(int i=0; i<mCurrentFrame.N; i++)
         {
-            float z = mCurrentFrame.mvDepth[i];
+            float z = mCurrentFrame.mpFeatures->mvDepth[i];
             if(z>0)
             {
                 vDepthIdx.push_back(make_pair(z,i));
@@ -1167,7 +1170,7 @@ void Tracking::CreateNewKeyFrame()
 
                 if(bCreateNew)
                 {
-                    cv::Mat x3D = mCurrentFrame.UnprojectStereo(i);
+                    Eigen::Vector3f x3D = mCurrentFrame.UnprojectStereo(i);
                     MapPoint* pNewMP = new MapPoint(x3D,pKF,mpMap);
                     pNewMP->AddObservation(pKF,i);
                     pKF->AddMapPoint(pNewMP,i);
@@ -1213,28 +1216,28 @@ void Tracking::SearchLocalPoints()
             {
                 pMP->IncreaseVisible();
                 pMP->mnLastFrameSeen = mCurrentFrame.mnId;
-                pMP->mbTrackInView = false;
             }
         }
     }
 
-    int nToMatch=0;
+    // Project all points in frame at once and check its visibility.
+    // The projections refer to mvpLocalMapPoints by index.
+    assert(mLocalMapPointsSoA.size()==mvpLocalMapPoints.size());
+    mCurrentFrame.ProjectInFrustum(mLocalMapPointsSoA,0.5,mvLocalMapProjections);
 
-    // Project points in frame and check its visibility
-    for(vector<MapPoint*>::iterator vit=mvpLocalMapPoints.begin(), vend=mvpLocalMapPoints.end(); vit!=vend; vit++)
+    // Keep the points in the frustum that are not already matched
+    int nToMatch=0;
+    for(size_t i=0; i<mvLocalMapProjections.size(); i++)
     {
-        MapPoint* pMP = *vit;
+        MapPoint* pMP = mvpLocalMapPoints[mvLocalMapProjections[i].idx];
         if(pMP->mnLastFrameSeen == mCurrentFrame.mnId)
             continue;
         if(pMP->isBad())
             continue;
-        // Project (this fills MapPoint variables for matching)
-        if(mCurrentFrame.isInFrustum(pMP,0.5))
-        {
-            pMP->IncreaseVisible();
-            nToMatch++;
-        }
+        pMP->IncreaseVisible();
+        mvLocalMapProjections[nToMatch++] = mvLocalMapProjections[i];
     }
+    mvLocalMapProjections.resize(nToMatch);
 
     if(nToMatch>0)
     {
@@ -1245,7 +1248,7 @@ void Tracking::SearchLocalPoints()
         // If the camera has been relocalised recently, perform a coarser search
         if(mCurrentFrame.mnId<mnLastRelocFrameId+2)
             th=5;
-        matcher.SearchByProjection(mCurrentFrame,mvpLocalMapPoints,th);
+        matcher.SearchByProjection(mCurrentFrame,mvpLocalMapPoints,mvLocalMapProjections,th);
     }
 }
 
@@ -1262,33 +1265,59 @@ void Tracking::UpdateLocalMap()
 void Tracking::UpdateLocalPoints()
 {
     mvpLocalMapPoints.clear();
+    mLocalMapPointsSoA.clear();
 
     for(vector<KeyFrame*>::const_iterator itKF=mvpLocalKeyFrames.begin(), itEndKF=mvpLocalKeyFrames.end(); itKF!=itEndKF; itKF++)
     {
         KeyFrame* pKF = *itKF;
-        const vector<MapPoint*> vpMPs = pKF->GetMapPointMatches();
+
+        // Matches are copied again only if they changed since the keyframe entered the local map
+        LocalKeyFrameMatches &matches = mmLocalKeyFrameMatches[pKF];
+        if(pKF->GetMapPointsVersion()!=matches.nVersion)
+            pKF->GetMapPointMatches(matches.vpMPs,matches.nVersion);
+        matches.nLastFrameId = mCurrentFrame.mnId;
+
+        const vector<MapPoint*> &vpMPs = matches.vpMPs;
 
         for(vector<MapPoint*>::const_iterator itMP=vpMPs.begin(), itEndMP=vpMPs.end(); itMP!=itEndMP; itMP++)
         {
             MapPoint* pMP = *itMP;
-            if(!pMP)
-                continue;
             if(pMP->mnTrackReferenceForFrame==mCurrentFrame.mnId)
                 continue;
             if(!pMP->isBad())
             {
                 mvpLocalMapPoints.push_back(pMP);
+                mLocalMapPointsSoA.push_back(pMP);
                 pMP->mnTrackReferenceForFrame=mCurrentFrame.mnId;
             }
         }
     }
+
+    // Forget the keyframes that left the local map
+    for(map<KeyFrame*,LocalKeyFrameMatches>::iterator mit=mmLocalKeyFrameMatches.begin(); mit!=mmLocalKeyFrameMatches.end();)
+    {
+        if(mit->second.nLastFrameId!=mCurrentFrame.mnId)
+            mmLocalKeyFrameMatches.erase(mit++);
+        else
+            mit++;
+    }
 }
 
+void Tracking::AddKeyFrameVotes(const vector<KeyFrame*> &vpKFs, const int n)
+{
+    for(size_t i=0; i<vpKFs.size(); i++)
+    {
+        map<KeyFrame*,int>::iterator mit = mmLocalKeyFrameVotes.insert(make_pair(vpKFs[i],0)).first;
+        mit->second += n;
+        if(mit->second==0)
+            mmLocalKeyFrameVotes.erase(mit);
+    }
+}
 
 void Tracking::UpdateLocalKeyFrames()
 {
-    // Each map point vote for the keyframes in which it has been observed
-    map<KeyFrame*,int> keyframeCounter;
+    // Tracked map points (a point can be matched to several keypoints)
+    map<MapPoint*,int> mTrackedPoints;
     for(int i=0; i<mCurrentFrame.N; i++)
     {
         if(mCurrentFrame.mvpMapPoints[i])
@@ -1296,9 +1325,7 @@ void Tracking::UpdateLocalKeyFrames()
             MapPoint* pMP = mCurrentFrame.mvpMapPoints[i];
             if(!pMP->isBad())
             {
-                const map<KeyFrame*,size_t> observations = pMP->GetObservations();
-                for(map<KeyFrame*,size_t>::const_iterator it=observations.begin(), itend=observations.end(); it!=itend; it++)
-                    keyframeCounter[it->first]++;
+                mTrackedPoints[pMP]++;
             }
             else
             {
@@ -1307,6 +1334,49 @@ void Tracking::UpdateLocalKeyFrames()
         }
     }
 
+    // Each map point vote for the keyframes in which it has been observed.
+    // Votes are kept from the last frame and only the points that stopped or started being
+    // tracked, or whose observations changed, update them.
+    map<MapPoint*,VotingPoint>::iterator itV = mmVotingPoints.begin();
+    map<MapPoint*,int>::const_iterator itT = mTrackedPoints.begin();
+    while(itV!=mmVotingPoints.end() || itT!=mTrackedPoints.end())
+    {
+        if(itT==mTrackedPoints.end() || (itV!=mmVotingPoints.end() && itV->first<itT->first))
+        {
+            // Not tracked anymore
+            AddKeyFrameVotes(itV->second.vpKFs,-itV->second.nCount);
+            mmVotingPoints.erase(itV++);
+        }
+        else if(itV==mmVotingPoints.end() || itT->first<itV->first)
+        {
+            // Tracked since this frame
+            VotingPoint &vp = mmVotingPoints.insert(itV,make_pair(itT->first,VotingPoint()))->second;
+            itT->first->GetObservingKeyFrames(vp.vpKFs,vp.nVersion);
+            vp.nCount = itT->second;
+            AddKeyFrameVotes(vp.vpKFs,vp.nCount);
+            itT++;
+        }
+        else
+        {
+            VotingPoint &vp = itV->second;
+            if(itT->first->GetObservationsVersion()!=vp.nVersion)
+            {
+                AddKeyFrameVotes(vp.vpKFs,-vp.nCount);
+                itT->first->GetObservingKeyFrames(vp.vpKFs,vp.nVersion);
+                AddKeyFrameVotes(vp.vpKFs,itT->second);
+            }
+            else if(itT->second!=vp.nCount)
+            {
+                AddKeyFrameVotes(vp.vpKFs,itT->second-vp.nCount);
+            }
+            vp.nCount = itT->second;
+            itV++;
+            itT++;
+        }
+    }
+
+    const map<KeyFrame*,int> &keyframeCounter = mmLocalKeyFrameVotes;
+
     if(keyframeCounter.empty())
         return;
 
@@ -1397,6 +1467,8 @@ void Tracking::UpdateLocalKeyFrames()
 
 bool Tracking::Relocalization()
 {
+    ScopedTimer timer(Stats::RELOCALIZATION);
+
     // Compute Bag of Words Vector
     mCurrentFrame.ComputeBoW();
 
@@ -1409,153 +1481,178 @@ bool Tracking::Relocalization()
 
     const int nKFs = vpCandidateKFs.size();
 
-    // We perform first an ORB matching with each candidate
-    // If enough matches are found we setup a PnP solver
-    ORBmatcher matcher(0.75,true);
-
-    vector<PnPsolver*> vpPnPsolvers;
-    vpPnPsolvers.resize(nKFs);
+    while((int)mvpPnPsolvers.size()<nKFs)
+        mvpPnPsolvers.push_back(unique_ptr<PnPsolver>(new PnPsolver()));
 
     vector<vector<MapPoint*> > vvpMapPointMatches;
     vvpMapPointMatches.resize(nKFs);
 
-    vector<bool> vbDiscarded;
-    vbDiscarded.resize(nKFs);
+    // Written concurrently, so not a vector<bool>
+    vector<unsigned char> vbDiscarded(nKFs,false);
 
-    int nCandidates=0;
-
-    for(int i=0; i<nKFs; i++)
+    // We perform first an ORB matching with each candidate (all candidates in parallel)
+    // If enough matches are found we setup a PnP solver
+    mpThreadPool->ParallelFor(0,nKFs,[&](int i)
     {
         KeyFrame* pKF = vpCandidateKFs[i];
         if(pKF->isBad())
+        {
             vbDiscarded[i] = true;
-        else
+            return;
+        }
+
+        ORBmatcher matcher(0.75,true);
+        int nmatches = matcher.SearchByBoW(pKF,mCurrentFrame,vvpMapPointMatches[i]);
+        if(nmatches<15)
         {
-            int nmatches = matcher.SearchByBoW(pKF,mCurrentFrame,vvpMapPointMatches[i]);
-            if(nmatches<15)
-            {
-                vbDiscarded[i] = true;
-                continue;
-            }
-            else
-            {
-                PnPsolver* pSolver = new PnPsolver(mCurrentFrame,vvpMapPointMatches[i]);
-                pSolver->SetRansacParameters(0.99,10,300,4,0.5,5.991);
-                vpPnPsolvers[i] = pSolver;
-                nCandidates++;
-            }
+            vbDiscarded[i] = true;
+            return;
         }
-    }
 
-    // Alternatively perform some iterations of P4P RANSAC
-    // Until we found a camera pose supported by enough inliers
-    bool bMatch = false;
-    ORBmatcher matcher2(0.9,true);
+        PnPsolver* pSolver = mvpPnPsolvers[i].get();
+        pSolver->SetMatches(mCurrentFrame,vvpMapPointMatches[i]);
+        pSolver->SetRansacParameters(0.99,10,300,4,0.5,5.991);
+        pSolver->SetSeed(mCurrentFrame.mnId,i);
+    });
 
-    while(nCandidates>0 && !bMatch)
+    // Perform 5 Ransac Iterations on every candidate concurrently, each one on its own copy of
+    // the frame, until one camera pose is supported by enough inliers. All the candidates finish
+    // the round, then the one with the lowest index that succeeded is kept (as the serial loop over
+    // the candidates did), so the result does not depend on the order in which they run.
+    vector<Frame> vFrames(nKFs);
+    vector<unsigned char> vbSuccess(nKFs,false);
+
+    vector<int> vActive;
+    for(int i=0; i<nKFs; i++)
+        if(!vbDiscarded[i])
+            vActive.push_back(i);
+
+    int nBestKF = -1;
+    while(!vActive.empty() && nBestKF<0)
     {
-        for(int i=0; i<nKFs; i++)
+        mpThreadPool->ParallelFor(0,vActive.size(),[&](int k)
         {
-            if(vbDiscarded[i])
-                continue;
-
-            // Perform 5 Ransac Iterations
-            vector<bool> vbInliers;
-            int nInliers;
+            const int i = vActive[k];
             bool bNoMore;
-
-            PnPsolver* pSolver = vpPnPsolvers[i];
-            cv::Mat Tcw = pSolver->iterate(5,bNoMore,vbInliers,nInliers);
-
+            vbSuccess[i] = RelocalizationRound(vpCandidateKFs[i],mvpPnPsolvers[i].get(),vvpMapPointMatches[i],vFrames[i],bNoMore);
             // If Ransac reachs max. iterations discard keyframe
-            if(bNoMore)
+            vbDiscarded[i] = bNoMore;
+        });
+
+        vector<int> vNext;
+        for(size_t k=0; k<vActive.size(); k++)
+        {
+            const int i = vActive[k];
+            if(vbSuccess[i])
             {
-                vbDiscarded[i]=true;
-                nCandidates--;
+                nBestKF = i;
+                break;
             }
+            if(!vbDiscarded[i])
+                vNext.push_back(i);
+        }
+        vActive.swap(vNext);
+    }
 
-            // If a Camera Pose is computed, optimize
-            if(!Tcw.empty())
-            {
-                Tcw.copyTo(mCurrentFrame.mTcw);
+    if(nBestKF<0)
+    {
+        return false;
+    }
+    else
+    {
+        Frame &F = vFrames[nBestKF];
+        mCurrentFrame.SetPose(F.GetRotation(),F.GetTranslation());
+        mCurrentFrame.mvpMapPoints.swap(F.mvpMapPoints);
+        mCurrentFrame.mvbOutlier.swap(F.mvbOutlier);
+
+        mnLastRelocFrameId = mCurrentFrame.mnId;
+        Stats::Count(Stats::RELOCALIZATIONS);
+        return true;
+    }
 
-                set<MapPoint*> sFound;
+}
 
-                const int np = vbInliers.size();
+bool Tracking::RelocalizationRound(KeyFrame* pKF, PnPsolver* pSolver, const vector<MapPoint*> &vpMapPointMatches,
+                                   Frame &F, bool &bNoMore)
+{
+    ORBmatcher matcher2(0.9,true);
 
-                for(int j=0; j<np; j++)
-                {
-                    if(vbInliers[j])
-                    {
-                        mCurrentFrame.mvpMapPoints[j]=vvpMapPointMatches[i][j];
-                        sFound.insert(vvpMapPointMatches[i][j]);
-                    }
-                    else
-                        mCurrentFrame.mvpMapPoints[j]=NULL;
-                }
+    // Perform 5 Ransac Iterations
+    vector<bool> vbInliers;
+    int nInliers;
+
+    cv::Mat Tcw = pSolver->iterate(5,bNoMore,vbInliers,nInliers);
+
+    // If a Camera Pose is computed, optimize
+    if(!Tcw.empty())
+    {
+        // The frame is copied only for the candidates that give a pose
+        if(F.mvpMapPoints.empty())
+            F = mCurrentFrame;
+        F.SetPose(Converter::toMatrix3f(Tcw.rowRange(0,3).colRange(0,3)),Converter::toVector3f(Tcw.rowRange(0,3).col(3)));
+
+        set<MapPoint*> sFound;
 
-                int nGood = Optimizer::PoseOptimization(&mCurrentFrame);
+        const int np = vbInliers.size();
 
-                if(nGood<10)
-                    continue;
+        for(int j=0; j<np; j++)
+        {
+            if(vbInliers[j])
+            {
+                F.mvpMapPoints[j]=vpMapPointMatches[j];
+                sFound.insert(vpMapPointMatches[j]);
+            }
+            else
+                F.mvpMapPoints[j]=NULL;
+        }
 
-                for(int io =0; io<mCurrentFrame.N; io++)
-                    if(mCurrentFrame.mvbOutlier[io])
-                        mCurrentFrame.mvpMapPoints[io]=static_cast<MapPoint*>(NULL);
+        int nGood = Optimizer::PoseOptimization(&F);
 
-                // If few inliers, search by projection in a coarse window and optimize again
-                if(nGood<50)
+        if(nGood>=10)
+        {
+            for(int io =0; io<F.N; io++)
+                if(F.mvbOutlier[io])
+                    F.mvpMapPoints[io]=static_cast<MapPoint*>(NULL);
+
+            // If few inliers, search by projection in a coarse window and optimize again
+            if(nGood<50)
+            {
+                int nadditional =matcher2.SearchByProjection(F,pKF,sFound,10,100);
+
+                if(nadditional+nGood>=50)
                 {
-                    int nadditional =matcher2.SearchByProjection(mCurrentFrame,vpCandidateKFs[i],sFound,10,100);
+                    nGood = Optimizer::PoseOptimization(&F);
 
-                    if(nadditional+nGood>=50)
+                    // If many inliers but still not enough, search by projection again in a narrower window
+                    // the camera has been already optimized with many points
+                    if(nGood>30 && nGood<50)
                     {
-                        nGood = Optimizer::PoseOptimization(&mCurrentFrame);
-
-                        // If many inliers but still not enough, search by projection again in a narrower window
-                        // the camera has been already optimized with many points
-                        if(nGood>30 && nGood<50)
+                        sFound.clear();
+                        for(int ip =0; ip<F.N; ip++)
+                            if(F.mvpMapPoints[ip])
+                                sFound.insert(F.mvpMapPoints[ip]);
+                        nadditional =matcher2.SearchByProjection(F,pKF,sFound,3,64);
+
+                        // Final optimization
+                        if(nGood+nadditional>=50)
                         {
-                            sFound.clear();
-                            for(int ip =0; ip<mCurrentFrame.N; ip++)
-                                if(mCurrentFrame.mvpMapPoints[ip])
-                                    sFound.insert(mCurrentFrame.mvpMapPoints[ip]);
-                            nadditional =matcher2.SearchByProjection(mCurrentFrame,vpCandidateKFs[i],sFound,3,64);
-
-                            // Final optimization
-                            if(nGood+nadditional>=50)
-                            {
-                                nGood = Optimizer::PoseOptimization(&mCurrentFrame);
+                            nGood = Optimizer::PoseOptimization(&F);
 
-                                for(int io =0; io<mCurrentFrame.N; io++)
-                                    if(mCurrentFrame.mvbOutlier[io])
-                                        mCurrentFrame.mvpMapPoints[io]=NULL;
-                            }
+                            for(int io =0; io<F.N; io++)
+                                if(F.mvbOutlier[io])
+                                    F.mvpMapPoints[io]=NULL;
                         }
                     }
                 }
-
-
-                // If the pose is supported by enough inliers stop ransacs and continue
-                if(nGood>=50)
-                {
-                    bMatch = true;
-                    break;
-                }
             }
-        }
-    }
 
-    if(!bMatch)
-    {
-        return false;
-    }
-    else
-    {
-        mnLastRelocFrameId = mCurrentFrame.mnId;
-        return true;
+            // If the pose is supported by enough inliers stop ransacs and continue
+            if(nGood>=50)
+                return true;
+        }
     }
 
+    return false;
 }
 
 void Tracking::Reset()
@@ -1565,8 +1662,7 @@ void Tracking::Reset()
     if(mpViewer)
     {
         mpViewer->RequestStop();
-        while(!mpViewer->isStopped())
-            usleep(3000);
+        mpViewer->WaitUntilStopped();
     }
 
     // Reset Local Mapping
@@ -1597,11 +1693,19 @@ void Tracking::Reset()
         mpInitializer = static_cast<Initializer*>(NULL);
     }
 
-    mlRelativeFramePoses.clear();
+    mlRelativeFrameRotations.clear();
+    mlRelativeFrameTranslations.clear();
     mlpReferences.clear();
     mlFrameTimes.clear();
     mlbLost.clear();
 
+    mvpLocalKeyFrames.clear();
+    mvpLocalMapPoints.clear();
+    mLocalMapPointsSoA.clear();
+    mmVotingPoints.clear();
+    mmLocalKeyFrameVotes.clear();
+    mmLocalKeyFrameMatches.clear();
+
     if(mpViewer)
         mpViewer->Release();
 }
@@ -1636,6 +1740,7 @@ void Tracking::ChangeCalibration(const string &strSettingPath)
 
     mbf = fSettings["Camera.bf"];
 
+    // Image bounds and the undistortion map are recomputed with the next Frame
     Frame::mbInitialComputations = true;
 }
 
@@ -1644,6 +1749,26 @@ void Tracking::InformOnlyTracking(const bool &flag)
     mbOnlyTracking = flag;
 }
 
+void Tracking::InformMapLoaded()
+{
+    vector<KeyFrame*> vpKFs = mpMap->GetAllKeyFrames();
+    if(vpKFs.empty())
+        return;
+
+    sort(vpKFs.begin(),vpKFs.end(),KeyFrame::lId);
+    KeyFrame* pLastKF = vpKFs.back();
+
+    mpReferenceKF = pLastKF;
+    mpLastKeyFrame = pLastKF;
+    mnLastKeyFrameId = pLastKF->mnFrameId;
+    mnLastRelocFrameId = 0;
+    mbVelocity = false;
+    mpMap->SetReferenceMapPoints(mpMap->GetAllMapPoints());
+
+    // There is no current pose, the next frame will be relocalized
+    mState = LOST;
+}
+
 
 
 } //namespace ORB_SLAM
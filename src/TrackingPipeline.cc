@@ -0,0 +1,172 @@
+/**
+* This file is part of ORB-SLAM2.
+*
+* Copyright (C) 2014-2016 Raúl Mur-Artal <raulmur at unizar dot es> (University of Zaragoza)
+* For more information see <https://github.com/raulmur/ORB_SLAM2>
+*
+* ORB-SLAM2 is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM2 is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with ORB-SLAM2. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "TrackingPipeline.h"
+
+using namespace std;
+
+namespace ORB_SLAM2
+{
+
+TrackingPipeline::TrackingPipeline(const Stage &frontEnd, const Stage &backEnd, const int nMaxFrames):
+    mFrontEnd(frontEnd), mBackEnd(backEnd), mnMaxFrames(max(nMaxFrames,1)), mnFrames(0), mbBackEndBusy(false),
+    mbFinish(false)
+{
+    mtFrontEnd = thread(&TrackingPipeline::RunFrontEnd,this);
+    mtBackEnd = thread(&TrackingPipeline::RunBackEnd,this);
+}
+
+TrackingPipeline::~TrackingPipeline()
+{
+    WaitUntilIdle();
+    {
+        unique_lock<mutex> lock(mMutex);
+        mbFinish = true;
+    }
+    mcvInput.notify_all();
+    mcvBuilt.notify_all();
+    mtFrontEnd.join();
+    mtBackEnd.join();
+}
+
+future<cv::Mat> TrackingPipeline::Push(const cv::Mat &im, const cv::Mat &im2, const double &timestamp)
+{
+    shared_ptr<PipelineFrame> pFrame = make_shared<PipelineFrame>();
+    pFrame->im = im;
+    pFrame->im2 = im2;
+    pFrame->timestamp = timestamp;
+    future<cv::Mat> pose = pFrame->pose.get_future();
+
+    {
+        unique_lock<mutex> lock(mMutex);
+        while(mnFrames>=mnMaxFrames)
+            mcvDone.wait(lock);
+        mdInput.push_back(pFrame);
+        mnFrames++;
+    }
+    mcvInput.notify_one();
+
+    return pose;
+}
+
+void TrackingPipeline::WaitUntilIdle()
+{
+    unique_lock<mutex> lock(mMutex);
+    while(mnFrames>0)
+        mcvDone.wait(lock);
+}
+
+void TrackingPipeline::WaitUntilBackEndIdle()
+{
+    unique_lock<mutex> lock(mMutex);
+    while(!mdBuilt.empty() || mbBackEndBusy)
+        mcvDone.wait(lock);
+}
+
+void TrackingPipeline::RunFrontEnd()
+{
+    while(1)
+    {
+        shared_ptr<PipelineFrame> pFrame;
+        {
+            unique_lock<mutex> lock(mMutex);
+            while(mdInput.empty() && !mbFinish)
+                mcvInput.wait(lock);
+
+            if(mdInput.empty())
+                return;
+
+            pFrame = mdInput.front();
+            mdInput.pop_front();
+        }
+
+        exception_ptr pException;
+        try
+        {
+            mFrontEnd(*pFrame);
+        }
+        catch(...)
+        {
+            pException = current_exception();
+        }
+
+        // The input images are not needed anymore
+        pFrame->im.release();
+        pFrame->im2.release();
+
+        // A frame that could not be built is not tracked: its future gets the exception
+        if(pException)
+        {
+            pFrame->pose.set_exception(pException);
+            {
+                unique_lock<mutex> lock(mMutex);
+                mnFrames--;
+            }
+            mcvDone.notify_all();
+            continue;
+        }
+
+        {
+            unique_lock<mutex> lock(mMutex);
+            mdBuilt.push_back(pFrame);
+        }
+        mcvBuilt.notify_one();
+    }
+}
+
+void TrackingPipeline::RunBackEnd()
+{
+    while(1)
+    {
+        shared_ptr<PipelineFrame> pFrame;
+        {
+            unique_lock<mutex> lock(mMutex);
+            while(mdBuilt.empty() && !mbFinish)
+                mcvBuilt.wait(lock);
+
+            if(mdBuilt.empty())
+                return;
+
+            pFrame = mdBuilt.front();
+            mdBuilt.pop_front();
+            mbBackEndBusy = true;
+        }
+
+        // An exception is passed to the future, the next frames are still tracked
+        try
+        {
+            mBackEnd(*pFrame);
+            pFrame->pose.set_value(pFrame->Tcw);
+        }
+        catch(...)
+        {
+            pFrame->pose.set_exception(current_exception());
+        }
+
+        {
+            unique_lock<mutex> lock(mMutex);
+            mbBackEndBusy = false;
+            mnFrames--;
+        }
+        mcvDone.notify_all();
+    }
+}
+
+} //namespace ORB_SLAM
@@ -155,10 +155,9 @@ void Viewer::Run()
 
         if(Stop())
         {
-            while(isStopped())
-            {
-                usleep(3000);
-            }
+            unique_lock<mutex> lock(mMutexEvents);
+            while(isStopped() && !CheckFinish())
+                mcvEvents.wait(lock);
         }
 
         if(CheckFinish())
@@ -168,10 +167,19 @@ void Viewer::Run()
     SetFinish();
 }
 
+void Viewer::NotifyEvents()
+{
+    unique_lock<mutex> lock(mMutexEvents);
+    mcvEvents.notify_all();
+}
+
 void Viewer::RequestFinish()
 {
-    unique_lock<mutex> lock(mMutexFinish);
-    mbFinishRequested = true;
+    {
+        unique_lock<mutex> lock(mMutexFinish);
+        mbFinishRequested = true;
+    }
+    NotifyEvents();
 }
 
 bool Viewer::CheckFinish()
@@ -182,8 +190,11 @@ bool Viewer::CheckFinish()
 
 void Viewer::SetFinish()
 {
-    unique_lock<mutex> lock(mMutexFinish);
-    mbFinished = true;
+    {
+        unique_lock<mutex> lock(mMutexFinish);
+        mbFinished = true;
+    }
+    NotifyEvents();
 }
 
 bool Viewer::isFinished()
@@ -207,26 +218,41 @@ bool Viewer::isStopped()
 
 bool Viewer::Stop()
 {
-    unique_lock<mutex> lock(mMutexStop);
-    unique_lock<mutex> lock2(mMutexFinish);
-
-    if(mbFinishRequested)
-        return false;
-    else if(mbStopRequested)
     {
+        unique_lock<mutex> lock(mMutexStop);
+        unique_lock<mutex> lock2(mMutexFinish);
+
+        if(mbFinishRequested || !mbStopRequested)
+            return false;
+
         mbStopped = true;
         mbStopRequested = false;
-        return true;
     }
+    NotifyEvents();
+    return true;
+}
 
-    return false;
+void Viewer::Release()
+{
+    {
+        unique_lock<mutex> lock(mMutexStop);
+        mbStopped = false;
+    }
+    NotifyEvents();
+}
 
+void Viewer::WaitUntilStopped()
+{
+    unique_lock<mutex> lock(mMutexEvents);
+    while(!isStopped() && !isFinished())
+        mcvEvents.wait(lock);
 }
 
-void Viewer::Release()
+void Viewer::WaitUntilFinished()
 {
-    unique_lock<mutex> lock(mMutexStop);
-    mbStopped = false;
+    unique_lock<mutex> lock(mMutexEvents);
+    while(!isFinished())
+        mcvEvents.wait(lock);
 }
 
 }
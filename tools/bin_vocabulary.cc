@@ -0,0 +1,70 @@
+/**
+* This file is part of ORB-SLAM2.
+*
+* Copyright (C) 2014-2016 Raúl Mur-Artal <raulmur at unizar dot es> (University of Zaragoza)
+* For more information see <https://github.com/raulmur/ORB_SLAM2>
+*
+* ORB-SLAM2 is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM2 is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with ORB-SLAM2. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Converts the text vocabulary (ORBvoc.txt) into the binary format that
+// System loads in place. Usage: ./bin_vocabulary ORBvoc.txt ORBvoc.bin
+
+#include<iostream>
+#include<chrono>
+
+#include"ORBVocabulary.h"
+
+using namespace std;
+
+int main(int argc, char **argv)
+{
+    if(argc != 3)
+    {
+        cerr << endl << "Usage: ./bin_vocabulary path_to_text_vocabulary path_to_binary_vocabulary" << endl;
+        return 1;
+    }
+
+    ORB_SLAM2::ORBVocabulary voc;
+
+    cout << "Loading text vocabulary " << argv[1] << " ..." << endl;
+    std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+    if(!voc.loadFromTextFile(argv[1]))
+    {
+        cerr << "Failed to open at: " << argv[1] << endl;
+        return 1;
+    }
+    std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+    cout << voc << endl;
+    cout << "Text loading: " << std::chrono::duration_cast<std::chrono::duration<double> >(t1 - t0).count() << " s" << endl;
+
+    if(!voc.saveToBinaryFile(argv[2]))
+    {
+        cerr << "Failed to write at: " << argv[2] << endl;
+        return 1;
+    }
+
+    // Read it back to make sure the file is usable
+    ORB_SLAM2::ORBVocabulary vocBin;
+    t0 = std::chrono::steady_clock::now();
+    if(!vocBin.loadFromBinaryFile(argv[2]) || vocBin.size()!=voc.size())
+    {
+        cerr << "Binary vocabulary could not be read back: " << argv[2] << endl;
+        return 1;
+    }
+    t1 = std::chrono::steady_clock::now();
+    cout << "Binary loading: " << std::chrono::duration_cast<std::chrono::duration<double> >(t1 - t0).count() << " s" << endl;
+
+    return 0;
+}
@@ -0,0 +1,117 @@
+/**
+* This file is part of ORB-SLAM2.
+*
+* Copyright (C) 2014-2016 Raúl Mur-Artal <raulmur at unizar dot es> (University of Zaragoza)
+* For more information see <https://github.com/raulmur/ORB_SLAM2>
+*
+* ORB-SLAM2 is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM2 is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with ORB-SLAM2. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Checks that the AVX2 rBRIEF kernel gives the same descriptors as the scalar code, bit for bit,
+// on random keypoints (subpixel positions, all angles) of a blurred image.
+// Usage: ./orb_descriptor_check [image] [number_of_keypoints] [seed]
+// Without an image, a random one is used. Returns 0 if all descriptors are identical.
+
+#include<iostream>
+#include<cstdlib>
+#include<cstring>
+
+#include<opencv2/core/core.hpp>
+#include<opencv2/imgproc/imgproc.hpp>
+#include<opencv2/highgui/highgui.hpp>
+
+#include"ORBextractor.h"
+
+using namespace std;
+
+int main(int argc, char **argv)
+{
+    if(argc > 4)
+    {
+        cerr << endl << "Usage: ./orb_descriptor_check [image] [number_of_keypoints] [seed]" << endl;
+        return 1;
+    }
+
+    const int nKeypoints = argc > 2 ? atoi(argv[2]) : 1000000;
+    const unsigned int seed = argc > 3 ? atoi(argv[3]) : 0;
+    cv::RNG rng(seed);
+
+    cv::Mat im;
+    if(argc > 1)
+    {
+        im = cv::imread(argv[1],CV_LOAD_IMAGE_GRAYSCALE);
+        if(im.empty())
+        {
+            cerr << "Failed to load image at: " << argv[1] << endl;
+            return 1;
+        }
+    }
+    else
+    {
+        // Random texture with flat areas and gradients, where the tests have ties
+        im.create(480,640,CV_8U);
+        rng.fill(im,cv::RNG::UNIFORM,0,256);
+        im(cv::Rect(100,100,200,100)).setTo(128);
+        for(int x=400; x<600; x++)
+            im(cv::Rect(x,300,1,150)).setTo((x/7)*3%256);
+    }
+
+    // Same preprocessing as the extractor does on each level
+    cv::Mat imBlur;
+    cv::GaussianBlur(im, imBlur, cv::Size(7, 7), 2, 2, cv::BORDER_REFLECT_101);
+
+    // The rotated pattern stays within 19 pixels of the keypoint
+    const float border = 20;
+    if(imBlur.cols <= 2*border+1 || imBlur.rows <= 2*border+1)
+    {
+        cerr << "Image too small" << endl;
+        return 1;
+    }
+
+    vector<cv::KeyPoint> vKeys(nKeypoints);
+    for(int i=0; i<nKeypoints; i++)
+    {
+        cv::KeyPoint &kp = vKeys[i];
+        kp.pt.x = rng.uniform(border,imBlur.cols-border-1);
+        kp.pt.y = rng.uniform(border,imBlur.rows-border-1);
+        // First a sweep over all angles in steps of 0.01 degrees, then random ones
+        kp.angle = i<36000 ? i*0.01f : rng.uniform(0.f,360.f);
+    }
+
+    ORB_SLAM2::ORBextractor extractor(1000,1.2,8,20,7);
+
+    cv::Mat descScalar, descAVX2;
+    extractor.ComputeDescriptors(imBlur,vKeys,descScalar,false);
+    if(!extractor.ComputeDescriptors(imBlur,vKeys,descAVX2,true))
+    {
+        cout << "AVX2 kernel not available in this build or CPU, nothing to check" << endl;
+        return 0;
+    }
+
+    int nMismatches = 0;
+    for(int i=0; i<nKeypoints; i++)
+    {
+        if(memcmp(descScalar.ptr(i),descAVX2.ptr(i),32)==0)
+            continue;
+
+        if(nMismatches<10)
+            cerr << "Mismatch at keypoint (" << vKeys[i].pt.x << ", " << vKeys[i].pt.y << ") angle "
+                 << vKeys[i].angle << endl;
+        nMismatches++;
+    }
+
+    cout << nKeypoints << " keypoints, " << nMismatches << " mismatches" << endl;
+
+    return nMismatches==0 ? 0 : 1;
+}
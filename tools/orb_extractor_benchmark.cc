@@ -0,0 +1,154 @@
+/**
+* This file is part of ORB-SLAM2.
+*
+* Copyright (C) 2014-2016 Raúl Mur-Artal <raulmur at unizar dot es> (University of Zaragoza)
+* For more information see <https://github.com/raulmur/ORB_SLAM2>
+*
+* ORB-SLAM2 is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM2 is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with ORB-SLAM2. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Benchmark of the ORB extractor. Times DistributeOctTree on one pyramid level for typical
+// sizes (random FAST keypoints, the same inputs on every run for a given seed) and prints a
+// hash of the selected keypoints, so that two versions can be compared for speed and output.
+// With an image, also times the whole extraction (pyramid, FAST, quadtree and descriptors).
+// Usage: ./orb_extractor_benchmark [image] [repetitions] [seed]
+
+#include<iostream>
+#include<iomanip>
+#include<algorithm>
+#include<chrono>
+#include<cstdlib>
+
+#include<opencv2/core/core.hpp>
+#include<opencv2/highgui/highgui.hpp>
+
+#include"ORBextractor.h"
+
+using namespace std;
+
+// Gives access to the quadtree of the extractor
+class ExtractorBenchmark : public ORB_SLAM2::ORBextractor
+{
+public:
+    ExtractorBenchmark() : ORB_SLAM2::ORBextractor(1000,1.2,8,20,7) {}
+
+    vector<cv::KeyPoint> Distribute(const vector<cv::KeyPoint> &vKeys, const int width, const int height, const int N)
+    {
+        return DistributeOctTree(vKeys,0,width,0,height,N,0);
+    }
+};
+
+struct LevelSize
+{
+    int width;
+    int height;
+    int nKeys;
+    int N;
+};
+
+// FNV-1a over the positions, responses and order of the keypoints
+static unsigned long long HashKeyPoints(const vector<cv::KeyPoint> &vKeys)
+{
+    unsigned long long h = 14695981039346656037ULL;
+    for(size_t i=0; i<vKeys.size(); i++)
+    {
+        const float v[3] = {vKeys[i].pt.x, vKeys[i].pt.y, vKeys[i].response};
+        const unsigned char* p = reinterpret_cast<const unsigned char*>(v);
+        for(size_t j=0; j<sizeof(v); j++)
+            h = (h^p[j])*1099511628211ULL;
+    }
+    return h;
+}
+
+static double Median(vector<double> v)
+{
+    nth_element(v.begin(),v.begin()+v.size()/2,v.end());
+    return v[v.size()/2];
+}
+
+int main(int argc, char **argv)
+{
+    if(argc > 4)
+    {
+        cerr << endl << "Usage: ./orb_extractor_benchmark [image] [repetitions] [seed]" << endl;
+        return 1;
+    }
+
+    const int nReps = argc > 2 ? max(atoi(argv[2]),1) : 200;
+    const unsigned int seed = argc > 3 ? atoi(argv[3]) : 0;
+
+    // Level 0 of VGA, level 2 of VGA, level 5 of VGA and level 0 of KITTI
+    const LevelSize vSizes[] = {{640,480,3000,200}, {444,333,1500,140}, {257,193,500,80}, {1241,376,6000,400}};
+
+    ExtractorBenchmark extractor;
+
+    cout << fixed << setprecision(1);
+    cout << "DistributeOctTree, median of " << nReps << " runs" << endl;
+    for(const LevelSize &s : vSizes)
+    {
+        // Keypoints at integer positions with FAST-like responses, some of them tied
+        cv::RNG rng(seed);
+        vector<vector<cv::KeyPoint> > vvKeys(nReps);
+        for(int r=0; r<nReps; r++)
+        {
+            vvKeys[r].resize(s.nKeys);
+            for(int i=0; i<s.nKeys; i++)
+                vvKeys[r][i] = cv::KeyPoint(rng.uniform(0,s.width),rng.uniform(0,s.height),7.f,-1,rng.uniform(7,60));
+        }
+
+        vector<double> vTimes(nReps);
+        unsigned long long hash = 0;
+        for(int r=0; r<nReps; r++)
+        {
+            std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+            const vector<cv::KeyPoint> vResult = extractor.Distribute(vvKeys[r],s.width,s.height,s.N);
+            std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+            vTimes[r] = std::chrono::duration_cast<std::chrono::duration<double,std::micro> >(t1 - t0).count();
+            hash = hash*31 + HashKeyPoints(vResult);
+        }
+
+        cout << setw(5) << s.width << "x" << left << setw(5) << s.height << right << setw(6) << s.nKeys
+             << " keys, N=" << left << setw(4) << s.N << right << setw(8) << Median(vTimes) << " us"
+             << "   hash " << hex << hash << dec << endl;
+    }
+
+    if(argc > 1)
+    {
+        cv::Mat im = cv::imread(argv[1],CV_LOAD_IMAGE_GRAYSCALE);
+        if(im.empty())
+        {
+            cerr << "Failed to load image at: " << argv[1] << endl;
+            return 1;
+        }
+
+        // The first run allocates the buffers of the extractor
+        vector<cv::KeyPoint> vKeys;
+        cv::Mat descriptors;
+        extractor(im,cv::Mat(),vKeys,descriptors);
+
+        vector<double> vTimes(nReps);
+        for(int r=0; r<nReps; r++)
+        {
+            std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+            extractor(im,cv::Mat(),vKeys,descriptors);
+            std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+            vTimes[r] = std::chrono::duration_cast<std::chrono::duration<double,std::micro> >(t1 - t0).count();
+        }
+
+        cout << endl << "ORB extraction on " << im.cols << "x" << im.rows << ": " << vKeys.size()
+             << " keypoints, median " << Median(vTimes) << " us" << endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,366 @@
+/**
+* This file is part of ORB-SLAM2.
+*
+* Copyright (C) 2014-2016 Raúl Mur-Artal <raulmur at unizar dot es> (University of Zaragoza)
+* For more information see <https://github.com/raulmur/ORB_SLAM2>
+*
+* ORB-SLAM2 is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM2 is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with ORB-SLAM2. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Compares PoseSolver with the g2o pose optimization it replaces in Optimizer::PoseOptimization
+// (same edges, Huber kernel, Levenberg-Marquardt and 4x10 iteration schedule with outlier
+// rejection) on synthetic frames: random poses, 8 to 850 points at depths of 1 to 16 m, noise
+// scaled with the octave, 15% outliers and an initial pose perturbed by about 1 degree and 5 cm.
+// Even frames are monocular, odd frames stereo (70% of the points with a right coordinate).
+// Usage: ./pose_solver_check [number_of_frames] [seed]
+//
+// Monocular poses agree to about 1e-9. Stereo poses differ by up to about 1e-5, because g2o
+// computes the stereo projection with a single precision inverse depth. The check fails if the
+// difference is above 1e-6 (monocular) or 1e-3 (stereo), or if the inlier count of a frame differs.
+// As for the library, g2o must be built with the same C++ standard: objects that g2o deletes
+// are allocated here, and C++17 aligned new and delete do not mix with the C++11 ones.
+
+#include<iostream>
+#include<iomanip>
+#include<random>
+#include<chrono>
+#include<cstdlib>
+#include<cmath>
+
+#include<Eigen/Core>
+#include<Eigen/Geometry>
+
+#include "Thirdparty/g2o/g2o/core/block_solver.h"
+#include "Thirdparty/g2o/g2o/core/optimization_algorithm_levenberg.h"
+#include "Thirdparty/g2o/g2o/types/types_six_dof_expmap.h"
+#include "Thirdparty/g2o/g2o/core/robust_kernel_impl.h"
+#include "Thirdparty/g2o/g2o/solvers/linear_solver_dense.h"
+
+#include"PoseSolver.h"
+
+using namespace std;
+
+// Observation of a point, without right coordinate if uR<0
+struct Observation
+{
+    Eigen::Vector3f Xw;
+    float u, v, uR;
+    float invSigma2;
+};
+
+struct Result
+{
+    Eigen::Matrix3d R;
+    Eigen::Vector3d t;
+    vector<bool> vbOutlier;
+    int nInliers;
+};
+
+struct Stats
+{
+    Stats() : nFrames(0), maxDiffR(0), maxDiffT(0), nFlagDiffs(0), nInlierDiffs(0), tG2o(0), tSolver(0) {}
+    int nFrames;
+    double maxDiffR, maxDiffT;
+    int nFlagDiffs, nInlierDiffs;
+    double tG2o, tSolver;
+};
+
+const float fx = 520.f, fy = 521.f, cx = 320.f, cy = 240.f, bf = 40.f;
+const float chi2Mono = 5.991f, chi2Stereo = 7.815f;
+
+// Optimizer::PoseOptimization before PoseSolver
+void OptimizeG2o(const vector<Observation> &vObs, const Eigen::Matrix3d &Rcw, const Eigen::Vector3d &tcw, Result &res)
+{
+    g2o::SparseOptimizer optimizer;
+    g2o::BlockSolver_6_3::LinearSolverType * linearSolver = new g2o::LinearSolverDense<g2o::BlockSolver_6_3::PoseMatrixType>();
+    g2o::BlockSolver_6_3 * solver_ptr = new g2o::BlockSolver_6_3(linearSolver);
+    optimizer.setAlgorithm(new g2o::OptimizationAlgorithmLevenberg(solver_ptr));
+
+    g2o::VertexSE3Expmap * vSE3 = new g2o::VertexSE3Expmap();
+    vSE3->setId(0);
+    vSE3->setFixed(false);
+    optimizer.addVertex(vSE3);
+
+    vector<g2o::EdgeSE3ProjectXYZOnlyPose*> vpEdgesMono;
+    vector<size_t> vnIndexEdgeMono;
+    vector<g2o::EdgeStereoSE3ProjectXYZOnlyPose*> vpEdgesStereo;
+    vector<size_t> vnIndexEdgeStereo;
+
+    const float deltaMono = sqrt(chi2Mono);
+    const float deltaStereo = sqrt(chi2Stereo);
+
+    const int N = vObs.size();
+    res.vbOutlier.assign(N,false);
+    for(int i=0; i<N; i++)
+    {
+        const Observation &obs = vObs[i];
+        if(obs.uR<0)
+        {
+            g2o::EdgeSE3ProjectXYZOnlyPose* e = new g2o::EdgeSE3ProjectXYZOnlyPose();
+            e->setVertex(0, dynamic_cast<g2o::OptimizableGraph::Vertex*>(optimizer.vertex(0)));
+            e->setMeasurement(Eigen::Vector2d(obs.u,obs.v));
+            e->setInformation(Eigen::Matrix2d::Identity()*obs.invSigma2);
+            g2o::RobustKernelHuber* rk = new g2o::RobustKernelHuber;
+            e->setRobustKernel(rk);
+            rk->setDelta(deltaMono);
+            e->fx = fx; e->fy = fy; e->cx = cx; e->cy = cy;
+            e->Xw = obs.Xw.cast<double>();
+            optimizer.addEdge(e);
+            vpEdgesMono.push_back(e);
+            vnIndexEdgeMono.push_back(i);
+        }
+        else
+        {
+            g2o::EdgeStereoSE3ProjectXYZOnlyPose* e = new g2o::EdgeStereoSE3ProjectXYZOnlyPose();
+            e->setVertex(0, dynamic_cast<g2o::OptimizableGraph::Vertex*>(optimizer.vertex(0)));
+            e->setMeasurement(Eigen::Vector3d(obs.u,obs.v,obs.uR));
+            e->setInformation(Eigen::Matrix3d::Identity()*obs.invSigma2);
+            g2o::RobustKernelHuber* rk = new g2o::RobustKernelHuber;
+            e->setRobustKernel(rk);
+            rk->setDelta(deltaStereo);
+            e->fx = fx; e->fy = fy; e->cx = cx; e->cy = cy; e->bf = bf;
+            e->Xw = obs.Xw.cast<double>();
+            optimizer.addEdge(e);
+            vpEdgesStereo.push_back(e);
+            vnIndexEdgeStereo.push_back(i);
+        }
+    }
+
+    int nBad=0;
+    for(size_t it=0; it<4; it++)
+    {
+        vSE3->setEstimate(g2o::SE3Quat(Rcw,tcw));
+        optimizer.initializeOptimization(0);
+        optimizer.optimize(10);
+
+        nBad=0;
+        for(size_t i=0; i<vpEdgesMono.size(); i++)
+        {
+            g2o::EdgeSE3ProjectXYZOnlyPose* e = vpEdgesMono[i];
+            const size_t idx = vnIndexEdgeMono[i];
+            if(res.vbOutlier[idx])
+                e->computeError();
+
+            const float chi2 = e->chi2();
+            if(chi2>chi2Mono)
+            {
+                res.vbOutlier[idx]=true;
+                e->setLevel(1);
+                nBad++;
+            }
+            else
+            {
+                res.vbOutlier[idx]=false;
+                e->setLevel(0);
+            }
+
+            if(it==2)
+                e->setRobustKernel(0);
+        }
+
+        for(size_t i=0; i<vpEdgesStereo.size(); i++)
+        {
+            g2o::EdgeStereoSE3ProjectXYZOnlyPose* e = vpEdgesStereo[i];
+            const size_t idx = vnIndexEdgeStereo[i];
+            if(res.vbOutlier[idx])
+                e->computeError();
+
+            const float chi2 = e->chi2();
+            if(chi2>chi2Stereo)
+            {
+                res.vbOutlier[idx]=true;
+                e->setLevel(1);
+                nBad++;
+            }
+            else
+            {
+                res.vbOutlier[idx]=false;
+                e->setLevel(0);
+            }
+
+            if(it==2)
+                e->setRobustKernel(0);
+        }
+
+        if(optimizer.edges().size()<10)
+            break;
+    }
+
+    const g2o::SE3Quat SE3quat = vSE3->estimate();
+    res.R = SE3quat.rotation().toRotationMatrix();
+    res.t = SE3quat.translation();
+    res.nInliers = N-nBad;
+}
+
+// Optimizer::PoseOptimization
+void OptimizePoseSolver(const vector<Observation> &vObs, const Eigen::Matrix3d &Rcw, const Eigen::Vector3d &tcw, Result &res)
+{
+    thread_local ORB_SLAM2::PoseSolver solver;
+    solver.Clear();
+    solver.SetCalibration(fx,fy,cx,cy,bf);
+    solver.SetRobustKernel(sqrt(chi2Mono),sqrt(chi2Stereo));
+
+    const int N = vObs.size();
+    res.vbOutlier.assign(N,false);
+    for(int i=0; i<N; i++)
+    {
+        const Observation &obs = vObs[i];
+        if(obs.uR<0)
+            solver.AddMonocular(obs.Xw,obs.u,obs.v,obs.invSigma2,i);
+        else
+            solver.AddStereo(obs.Xw,obs.u,obs.v,obs.uR,obs.invSigma2,i);
+    }
+
+    ORB_SLAM2::PoseObservations &mono = solver.mMono;
+    ORB_SLAM2::PoseObservations &stereo = solver.mStereo;
+
+    int nBad=0;
+    for(size_t it=0; it<4; it++)
+    {
+        solver.SetPose(Rcw,tcw);
+        solver.Optimize(10);
+
+        nBad=0;
+        for(size_t i=0; i<mono.size(); i++)
+        {
+            const size_t idx = mono.idx[i];
+            const float chi2 = res.vbOutlier[idx] ? solver.ComputeChi2Monocular(i) : mono.chi2[i];
+            res.vbOutlier[idx] = chi2>chi2Mono;
+            mono.active[i] = res.vbOutlier[idx] ? 0 : 1;
+            nBad += res.vbOutlier[idx];
+        }
+
+        for(size_t i=0; i<stereo.size(); i++)
+        {
+            const size_t idx = stereo.idx[i];
+            const float chi2 = res.vbOutlier[idx] ? solver.ComputeChi2Stereo(i) : stereo.chi2[i];
+            res.vbOutlier[idx] = chi2>chi2Stereo;
+            stereo.active[i] = res.vbOutlier[idx] ? 0 : 1;
+            nBad += res.vbOutlier[idx];
+        }
+
+        if(it==2)
+            solver.RemoveRobustKernel();
+
+        if(N<10)
+            break;
+    }
+
+    res.R = solver.GetRotation();
+    res.t = solver.GetTranslation();
+    res.nInliers = N-nBad;
+}
+
+static Eigen::Matrix3d RandomRotation(mt19937 &rng, const double sigma)
+{
+    normal_distribution<double> n(0,sigma);
+    const Eigen::Vector3d w(n(rng),n(rng),n(rng));
+    return Eigen::AngleAxisd(w.norm(),w.normalized()).toRotationMatrix();
+}
+
+// Observations of N random points in front of the camera Rcw,tcw
+static void GenerateFrame(mt19937 &rng, const bool bStereo, const int N, const Eigen::Matrix3d &Rcw,
+                          const Eigen::Vector3d &tcw, vector<Observation> &vObs)
+{
+    normal_distribution<double> n(0,1);
+    uniform_real_distribution<double> U(0,1);
+
+    vObs.resize(N);
+    for(int i=0; i<N; i++)
+    {
+        const Eigen::Vector3d Pc((U(rng)-0.5)*8,(U(rng)-0.5)*6,1+U(rng)*15);
+        const Eigen::Vector3d Pw = Rcw.transpose()*(Pc-tcw);
+        const double sigma = pow(1.2,(int)(rng()%8));
+        const bool bOutlier = U(rng)<0.15;
+
+        const double u = fx*Pc(0)/Pc(2)+cx;
+        const double v = fy*Pc(1)/Pc(2)+cy;
+
+        Observation &obs = vObs[i];
+        obs.Xw = Pw.cast<float>();
+        obs.invSigma2 = 1.0/(sigma*sigma);
+        obs.u = u+n(rng)*sigma+(bOutlier ? (U(rng)-0.5)*60 : 0);
+        obs.v = v+n(rng)*sigma;
+        obs.uR = (bStereo && U(rng)<0.7) ? u-bf/Pc(2)+n(rng)*sigma : -1;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    if(argc > 3)
+    {
+        cerr << endl << "Usage: ./pose_solver_check [number_of_frames] [seed]" << endl;
+        return 1;
+    }
+
+    const int nFrames = argc > 1 ? atoi(argv[1]) : 500;
+    const unsigned int seed = argc > 2 ? atoi(argv[2]) : 1;
+
+    mt19937 rng(seed);
+    normal_distribution<double> n(0,1);
+
+    Stats stats[2];
+    vector<Observation> vObs;
+    for(int f=0; f<nFrames; f++)
+    {
+        const bool bStereo = f%2==1;
+        const Eigen::Matrix3d Rcw = RandomRotation(rng,0.3);
+        const Eigen::Vector3d tcw(n(rng),n(rng),n(rng));
+        // A few frames below the 10 correspondences that stop the outlier rejection
+        const int N = f%50==0 ? 8 : 50+rng()%800;
+        GenerateFrame(rng,bStereo,N,Rcw,tcw,vObs);
+
+        // Initial pose (a float cv::Mat in the tracking)
+        const Eigen::Matrix3d R0 = (RandomRotation(rng,0.02)*Rcw).cast<float>().cast<double>();
+        const Eigen::Vector3d t0 = (tcw+0.05*Eigen::Vector3d(n(rng),n(rng),n(rng))).cast<float>().cast<double>();
+
+        Result resG2o, resSolver;
+        std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+        OptimizeG2o(vObs,R0,t0,resG2o);
+        std::chrono::steady_clock::time_point t2 = std::chrono::steady_clock::now();
+        OptimizePoseSolver(vObs,R0,t0,resSolver);
+        std::chrono::steady_clock::time_point t3 = std::chrono::steady_clock::now();
+
+        Stats &s = stats[bStereo];
+        s.nFrames++;
+        s.tG2o += std::chrono::duration_cast<std::chrono::duration<double,std::milli> >(t2 - t1).count();
+        s.tSolver += std::chrono::duration_cast<std::chrono::duration<double,std::milli> >(t3 - t2).count();
+        s.maxDiffR = max(s.maxDiffR,(resG2o.R-resSolver.R).norm());
+        s.maxDiffT = max(s.maxDiffT,(resG2o.t-resSolver.t).norm());
+        for(int i=0; i<N; i++)
+            s.nFlagDiffs += resG2o.vbOutlier[i]!=resSolver.vbOutlier[i];
+        s.nInlierDiffs += resG2o.nInliers!=resSolver.nInliers;
+    }
+
+    bool bOk = true;
+    const char* names[2] = {"Monocular", "Stereo"};
+    const double maxDiff[2] = {1e-6, 1e-3};
+    for(int k=0; k<2; k++)
+    {
+        const Stats &s = stats[k];
+        if(s.nFrames==0)
+            continue;
+
+        cout << names[k] << ": " << s.nFrames << " frames, max difference rotation " << scientific << setprecision(2)
+             << s.maxDiffR << " translation " << s.maxDiffT << ", " << s.nFlagDiffs << " outlier flags and "
+             << s.nInlierDiffs << " inlier counts differ" << endl;
+        cout << fixed << setprecision(3) << "    g2o " << s.tG2o/s.nFrames << " ms, PoseSolver "
+             << s.tSolver/s.nFrames << " ms per frame" << endl;
+
+        if(s.maxDiffR>maxDiff[k] || s.maxDiffT>maxDiff[k] || s.nInlierDiffs>0)
+            bOk = false;
+    }
+
+    return bOk ? 0 : 1;
+}
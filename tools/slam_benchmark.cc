@@ -0,0 +1,690 @@
+/**
+* This file is part of ORB-SLAM2.
+*
+* Copyright (C) 2014-2016 Raúl Mur-Artal <raulmur at unizar dot es> (University of Zaragoza)
+* For more information see <https://github.com/raulmur/ORB_SLAM2>
+*
+* ORB-SLAM2 is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM2 is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with ORB-SLAM2. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Offline benchmark. Runs a EuRoC, TUM or KITTI sequence as fast as possible (no real-time
+// throttling), with the images decoded ahead of time by a FrameSource, and reports the
+// stage timings, the throughput, the peak memory and the absolute trajectory error (ATE).
+// With --drain, tracking waits for Local Mapping after every frame so that runs are repeatable.
+
+#include<iostream>
+#include<iomanip>
+#include<algorithm>
+#include<fstream>
+#include<sstream>
+#include<chrono>
+#include<cmath>
+#include<cstdlib>
+
+#include<sys/resource.h>
+
+#include<opencv2/core/core.hpp>
+#include<opencv2/imgproc/imgproc.hpp>
+#include<Eigen/Dense>
+
+#include<System.h>
+#include<FrameSource.h>
+
+using namespace std;
+
+// Image files and timestamps of a sequence. vstrImages1 holds the right images (stereo)
+// or the depthmaps (RGB-D) and is empty for monocular input.
+struct Sequence
+{
+    vector<string> vstrImages0;
+    vector<string> vstrImages1;
+    vector<double> vTimestamps;
+};
+
+struct Options
+{
+    string strDataset;
+    string strSensor;
+    string strVocFile;
+    string strSettingsFile;
+    string strSequence;
+    string strTimesFile;
+    string strGroundTruthFile;
+    string strTrajectoryFile;
+    string strStatsFile;
+    string strReportFile;
+    int nPrefetch;
+    int nMaxFrames;
+    double maxDt;
+    bool bPreload;
+    bool bDrain;
+    bool bViewer;
+};
+
+struct ATE
+{
+    int nPairs;
+    double scale;
+    double rmse;
+    double mean;
+    double median;
+    double max;
+};
+
+void Usage();
+bool ParseOptions(int argc, char **argv, Options &opt);
+bool LoadSequence(const Options &opt, Sequence &seq);
+bool LoadRectification(const string &strSettingsFile, cv::Mat &M1l, cv::Mat &M2l, cv::Mat &M1r, cv::Mat &M2r);
+bool LoadTrajectory(const string &strFile, const vector<double> &vFrameTimestamps,
+                    vector<double> &vTimestamps, vector<Eigen::Vector3d> &vPositions);
+bool ComputeATE(const vector<double> &vTimesEst, const vector<Eigen::Vector3d> &vPosEst,
+                const vector<double> &vTimesGt, const vector<Eigen::Vector3d> &vPosGt,
+                const double maxDt, const bool bScale, ATE &ate);
+double PeakRSSMegabytes();
+double Percentile(vector<double> v, const double p);
+
+int main(int argc, char **argv)
+{
+    Options opt;
+    if(!ParseOptions(argc,argv,opt))
+    {
+        Usage();
+        return 1;
+    }
+
+    ORB_SLAM2::System::eSensor sensor;
+    if(opt.strSensor=="mono")
+        sensor = ORB_SLAM2::System::MONOCULAR;
+    else if(opt.strSensor=="stereo")
+        sensor = ORB_SLAM2::System::STEREO;
+    else
+        sensor = ORB_SLAM2::System::RGBD;
+
+    // Retrieve paths to images
+    Sequence seq;
+    if(!LoadSequence(opt,seq))
+        return 1;
+
+    if(opt.nMaxFrames>0 && (int)seq.vTimestamps.size()>opt.nMaxFrames)
+    {
+        seq.vTimestamps.resize(opt.nMaxFrames);
+        seq.vstrImages0.resize(opt.nMaxFrames);
+        if(!seq.vstrImages1.empty())
+            seq.vstrImages1.resize(opt.nMaxFrames);
+    }
+
+    const int nImages = seq.vTimestamps.size();
+
+    // EuRoC stereo images are rectified with the LEFT/RIGHT calibration of the settings file
+    cv::Mat M1l, M2l, M1r, M2r;
+    if(sensor==ORB_SLAM2::System::STEREO && !LoadRectification(opt.strSettingsFile,M1l,M2l,M1r,M2r))
+        return 1;
+
+    // Create SLAM system. It initializes all system threads and gets ready to process frames.
+    ORB_SLAM2::System SLAM(opt.strVocFile,opt.strSettingsFile,sensor,opt.bViewer);
+
+    const int nCapacity = opt.bPreload ? nImages : opt.nPrefetch;
+    ORB_SLAM2::FrameSource source(opt.strSettingsFile,nCapacity);
+    if(!M1l.empty())
+        source.SetRectification(M1l,M2l,M1r,M2r);
+    source.SetFiles(seq.vstrImages0,seq.vstrImages1,seq.vTimestamps);
+
+    if(opt.bPreload)
+    {
+        cout << "Preloading " << nImages << " frames ..." << endl;
+        source.WaitUntilFull();
+    }
+
+    // Only the processing of the sequence is measured
+    SLAM.ResetStats();
+
+    vector<double> vTimesTrack;
+    vTimesTrack.reserve(nImages);
+    double tWaitImages = 0;
+    double tWaitMapping = 0;
+    int nLost = 0;
+
+    cout << endl << "-------" << endl;
+    cout << "Start processing sequence ..." << endl;
+    cout << "Images in the sequence: " << nImages << endl << endl;
+
+    std::chrono::steady_clock::time_point tStart = std::chrono::steady_clock::now();
+
+    // Main loop
+    ORB_SLAM2::InputFrame frame;
+    for(int ni=0; ni<nImages; ni++)
+    {
+        std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+
+        if(!source.Pop(frame) || frame.im.empty())
+        {
+            SLAM.Shutdown();
+            return 1;
+        }
+
+        std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+
+        if(sensor==ORB_SLAM2::System::MONOCULAR)
+            SLAM.TrackMonocular(frame.im,frame.timestamp);
+        else if(sensor==ORB_SLAM2::System::STEREO)
+            SLAM.TrackStereo(frame.im,frame.im2,frame.timestamp);
+        else
+            SLAM.TrackRGBD(frame.im,frame.im2,frame.timestamp);
+
+        std::chrono::steady_clock::time_point t2 = std::chrono::steady_clock::now();
+
+        if(SLAM.GetTrackingState()==ORB_SLAM2::Tracking::LOST)
+            nLost++;
+
+        if(opt.bDrain)
+            SLAM.WaitForLocalMapping();
+
+        std::chrono::steady_clock::time_point t3 = std::chrono::steady_clock::now();
+
+        tWaitImages += std::chrono::duration_cast<std::chrono::duration<double> >(t1 - t0).count();
+        vTimesTrack.push_back(std::chrono::duration_cast<std::chrono::duration<double,std::milli> >(t2 - t1).count());
+        tWaitMapping += std::chrono::duration_cast<std::chrono::duration<double> >(t3 - t2).count();
+    }
+
+    std::chrono::steady_clock::time_point tEnd = std::chrono::steady_clock::now();
+    const double tTotal = std::chrono::duration_cast<std::chrono::duration<double> >(tEnd - tStart).count();
+
+    // Stop all threads
+    SLAM.Shutdown();
+
+    const vector<ORB_SLAM2::Stats::StageSummary> vStages = SLAM.GetStageStats();
+    const vector<ORB_SLAM2::Stats::CounterSummary> vCounters = SLAM.GetCounterStats();
+    if(!opt.strStatsFile.empty())
+        SLAM.SaveStats(opt.strStatsFile);
+
+    // Only keyframes are saved for monocular input (the scale of the other frames is not optimized)
+    if(sensor==ORB_SLAM2::System::MONOCULAR)
+        SLAM.SaveKeyFrameTrajectoryTUM(opt.strTrajectoryFile);
+    else
+        SLAM.SaveTrajectoryTUM(opt.strTrajectoryFile);
+
+    const double peakRSS = PeakRSSMegabytes();
+
+    double meanTrack = 0;
+    for(size_t i=0; i<vTimesTrack.size(); i++)
+        meanTrack += vTimesTrack[i];
+    meanTrack /= max<size_t>(vTimesTrack.size(),1);
+
+    cout << fixed << setprecision(3);
+    cout << endl << "-------" << endl;
+    cout << "Frames: " << nImages << " (" << nLost << " lost)" << endl;
+    cout << "Total time: " << tTotal << " s" << endl;
+    cout << "Throughput: " << nImages/tTotal << " fps" << endl;
+    cout << "Tracking time: mean " << meanTrack << " ms, median " << Percentile(vTimesTrack,0.5)
+         << " ms, p99 " << Percentile(vTimesTrack,0.99) << " ms" << endl;
+    cout << "Waiting for images: " << tWaitImages << " s" << endl;
+    if(opt.bDrain)
+        cout << "Waiting for Local Mapping: " << tWaitMapping << " s" << endl;
+    cout << "Peak RSS: " << peakRSS << " MB" << endl;
+
+    cout << endl << left << setw(22) << "stage" << right << setw(8) << "count" << setw(10) << "mean"
+         << setw(10) << "p50" << setw(10) << "p90" << setw(10) << "p99" << setw(10) << "max" << endl;
+    for(size_t i=0; i<vStages.size(); i++)
+    {
+        const ORB_SLAM2::Stats::StageSummary &s = vStages[i];
+        if(s.count==0)
+            continue;
+        cout << left << setw(22) << s.name << right << setw(8) << s.count << setw(10) << s.mean
+             << setw(10) << s.p50 << setw(10) << s.p90 << setw(10) << s.p99 << setw(10) << s.max << endl;
+    }
+    cout << endl;
+    for(size_t i=0; i<vCounters.size(); i++)
+        cout << left << setw(22) << vCounters[i].name << right << setw(8) << vCounters[i].count << endl;
+
+    // Absolute trajectory error, after aligning the trajectory to the ground truth
+    // (with scale for monocular input)
+    bool bATE = false;
+    ATE ate;
+    if(!opt.strGroundTruthFile.empty())
+    {
+        vector<double> vTimesEst, vTimesGt;
+        vector<Eigen::Vector3d> vPosEst, vPosGt;
+        if(!LoadTrajectory(opt.strTrajectoryFile,vector<double>(),vTimesEst,vPosEst))
+            cerr << "ERROR: Could not read the trajectory " << opt.strTrajectoryFile << endl;
+        else if(!LoadTrajectory(opt.strGroundTruthFile,opt.strDataset=="kitti" ? seq.vTimestamps : vector<double>(),vTimesGt,vPosGt))
+            cerr << "ERROR: Could not read the ground truth " << opt.strGroundTruthFile << endl;
+        else if(!ComputeATE(vTimesEst,vPosEst,vTimesGt,vPosGt,opt.maxDt,sensor==ORB_SLAM2::System::MONOCULAR,ate))
+            cerr << "ERROR: Not enough poses associated with the ground truth" << endl;
+        else
+            bATE = true;
+
+        if(bATE)
+        {
+            cout << endl << "ATE (" << ate.nPairs << (sensor==ORB_SLAM2::System::MONOCULAR ? " keyframes" : " frames")
+                 << ", scale " << ate.scale << "): rmse " << ate.rmse << " m, mean " << ate.mean
+                 << " m, median " << ate.median << " m, max " << ate.max << " m" << endl;
+        }
+    }
+
+    // Machine readable summary, to compare builds
+    if(!opt.strReportFile.empty())
+    {
+        ofstream f(opt.strReportFile.c_str());
+        if(!f.is_open())
+        {
+            cerr << "ERROR: Could not write the report " << opt.strReportFile << endl;
+            return 1;
+        }
+
+        f << fixed << setprecision(6);
+        f << "{" << endl;
+        f << "  \"dataset\": \"" << opt.strDataset << "\"," << endl;
+        f << "  \"sensor\": \"" << opt.strSensor << "\"," << endl;
+        f << "  \"sequence\": \"" << opt.strSequence << "\"," << endl;
+        f << "  \"drain\": " << (opt.bDrain ? "true" : "false") << "," << endl;
+        f << "  \"frames\": " << nImages << "," << endl;
+        f << "  \"lost_frames\": " << nLost << "," << endl;
+        f << "  \"total_s\": " << tTotal << "," << endl;
+        f << "  \"fps\": " << nImages/tTotal << "," << endl;
+        f << "  \"track_mean_ms\": " << meanTrack << "," << endl;
+        f << "  \"track_p50_ms\": " << Percentile(vTimesTrack,0.5) << "," << endl;
+        f << "  \"track_p99_ms\": " << Percentile(vTimesTrack,0.99) << "," << endl;
+        f << "  \"wait_images_s\": " << tWaitImages << "," << endl;
+        f << "  \"wait_mapping_s\": " << tWaitMapping << "," << endl;
+        f << "  \"peak_rss_mb\": " << peakRSS << "," << endl;
+        if(bATE)
+        {
+            f << "  \"ate\": {\"pairs\": " << ate.nPairs << ", \"scale\": " << ate.scale << ", \"rmse\": " << ate.rmse
+              << ", \"mean\": " << ate.mean << ", \"median\": " << ate.median << ", \"max\": " << ate.max << "}," << endl;
+        }
+        f << "  \"stages\": [" << endl;
+        for(size_t i=0; i<vStages.size(); i++)
+        {
+            const ORB_SLAM2::Stats::StageSummary &s = vStages[i];
+            f << "    {\"name\": \"" << s.name << "\", \"count\": " << s.count << ", \"mean\": " << s.mean
+              << ", \"p50\": " << s.p50 << ", \"p90\": " << s.p90 << ", \"p99\": " << s.p99 << ", \"max\": " << s.max << "}"
+              << (i+1<vStages.size() ? "," : "") << endl;
+        }
+        f << "  ]," << endl;
+        f << "  \"counters\": {";
+        for(size_t i=0; i<vCounters.size(); i++)
+            f << (i ? ", " : "") << "\"" << vCounters[i].name << "\": " << vCounters[i].count;
+        f << "}" << endl;
+        f << "}" << endl;
+    }
+
+    return 0;
+}
+
+void Usage()
+{
+    cerr << endl << "Usage: ./slam_benchmark euroc|tum|kitti mono|stereo|rgbd path_to_vocabulary path_to_settings path_to_sequence [options]" << endl
+         << "  --times file          EuRoC timestamps (default: mav0/cam0/data.csv), TUM RGB-D associations (default: associations.txt)" << endl
+         << "  --gt file             ground truth (default: EuRoC state_groundtruth_estimate0/data.csv, TUM groundtruth.txt)" << endl
+         << "  --drain               wait for Local Mapping after every frame (repeatable runs)" << endl
+         << "  --preload             decode the whole sequence before starting" << endl
+         << "  --prefetch N          frames decoded ahead of tracking (default: 16)" << endl
+         << "  --max-frames N        process only the first N frames" << endl
+         << "  --max-dt s            maximum time difference to associate the ground truth (default: 0.02)" << endl
+         << "  --trajectory file     estimated trajectory (default: BenchmarkTrajectory.txt)" << endl
+         << "  --stats file          save the stage statistics (JSON if it ends in .json, CSV otherwise)" << endl
+         << "  --report file         save a JSON summary of the run" << endl
+         << "  --viewer              show the viewer" << endl;
+}
+
+bool ParseOptions(int argc, char **argv, Options &opt)
+{
+    if(argc < 6)
+        return false;
+
+    opt.strDataset = argv[1];
+    opt.strSensor = argv[2];
+    opt.strVocFile = argv[3];
+    opt.strSettingsFile = argv[4];
+    opt.strSequence = argv[5];
+    opt.strTrajectoryFile = "BenchmarkTrajectory.txt";
+    opt.nPrefetch = 16;
+    opt.nMaxFrames = 0;
+    opt.maxDt = 0.02;
+    opt.bPreload = false;
+    opt.bDrain = false;
+    opt.bViewer = false;
+
+    bool bGroundTruth = false;
+    for(int i=6; i<argc; i++)
+    {
+        const string arg = argv[i];
+        const bool bHasValue = i+1<argc;
+        if(arg=="--drain")
+            opt.bDrain = true;
+        else if(arg=="--preload")
+            opt.bPreload = true;
+        else if(arg=="--viewer")
+            opt.bViewer = true;
+        else if(arg=="--times" && bHasValue)
+            opt.strTimesFile = argv[++i];
+        else if(arg=="--gt" && bHasValue)
+        {
+            opt.strGroundTruthFile = argv[++i];
+            bGroundTruth = true;
+        }
+        else if(arg=="--prefetch" && bHasValue)
+            opt.nPrefetch = atoi(argv[++i]);
+        else if(arg=="--max-frames" && bHasValue)
+            opt.nMaxFrames = atoi(argv[++i]);
+        else if(arg=="--max-dt" && bHasValue)
+            opt.maxDt = atof(argv[++i]);
+        else if(arg=="--trajectory" && bHasValue)
+            opt.strTrajectoryFile = argv[++i];
+        else if(arg=="--stats" && bHasValue)
+            opt.strStatsFile = argv[++i];
+        else if(arg=="--report" && bHasValue)
+            opt.strReportFile = argv[++i];
+        else
+        {
+            cerr << "ERROR: Unknown option " << arg << endl;
+            return false;
+        }
+    }
+
+    if(opt.strDataset!="euroc" && opt.strDataset!="tum" && opt.strDataset!="kitti")
+    {
+        cerr << "ERROR: Unknown dataset " << opt.strDataset << endl;
+        return false;
+    }
+
+    if(opt.strSensor!="mono" && opt.strSensor!="stereo" && opt.strSensor!="rgbd")
+    {
+        cerr << "ERROR: Unknown sensor " << opt.strSensor << endl;
+        return false;
+    }
+
+    if((opt.strDataset=="tum" && opt.strSensor=="stereo") || (opt.strDataset!="tum" && opt.strSensor=="rgbd"))
+    {
+        cerr << "ERROR: The " << opt.strDataset << " dataset has no " << opt.strSensor << " sequences" << endl;
+        return false;
+    }
+
+    // KITTI poses are not stored in the sequence folder
+    if(!bGroundTruth)
+    {
+        if(opt.strDataset=="euroc")
+            opt.strGroundTruthFile = opt.strSequence + "/mav0/state_groundtruth_estimate0/data.csv";
+        else if(opt.strDataset=="tum")
+            opt.strGroundTruthFile = opt.strSequence + "/groundtruth.txt";
+
+        ifstream f(opt.strGroundTruthFile.c_str());
+        if(!f.is_open())
+            opt.strGroundTruthFile.clear();
+    }
+
+    return true;
+}
+
+// Splits a line of a csv or space separated file. Returns false for empty lines and comments.
+static bool SplitLine(const string &s, vector<string> &vTokens)
+{
+    vTokens.clear();
+    if(s.empty() || s[0]=='#')
+        return false;
+
+    string line = s;
+    replace(line.begin(),line.end(),',',' ');
+    stringstream ss(line);
+    string token;
+    while(ss >> token)
+        vTokens.push_back(token);
+    return !vTokens.empty();
+}
+
+bool LoadSequence(const Options &opt, Sequence &seq)
+{
+    vector<string> vTokens;
+
+    if(opt.strDataset=="euroc")
+    {
+        // Image names are the timestamps in nanoseconds
+        const string strTimes = opt.strTimesFile.empty() ? opt.strSequence + "/mav0/cam0/data.csv" : opt.strTimesFile;
+        ifstream f(strTimes.c_str());
+        string s;
+        while(getline(f,s))
+        {
+            if(!SplitLine(s,vTokens))
+                continue;
+            seq.vstrImages0.push_back(opt.strSequence + "/mav0/cam0/data/" + vTokens[0] + ".png");
+            if(opt.strSensor=="stereo")
+                seq.vstrImages1.push_back(opt.strSequence + "/mav0/cam1/data/" + vTokens[0] + ".png");
+            seq.vTimestamps.push_back(atof(vTokens[0].c_str())/1e9);
+        }
+    }
+    else if(opt.strDataset=="tum")
+    {
+        const string strFile = opt.strSensor=="rgbd" ?
+                    (opt.strTimesFile.empty() ? opt.strSequence + "/associations.txt" : opt.strTimesFile) :
+                    opt.strSequence + "/rgb.txt";
+        ifstream f(strFile.c_str());
+        string s;
+        while(getline(f,s))
+        {
+            if(!SplitLine(s,vTokens) || vTokens.size()<2)
+                continue;
+            if(opt.strSensor=="rgbd" && vTokens.size()<4)
+                continue;
+            seq.vTimestamps.push_back(atof(vTokens[0].c_str()));
+            seq.vstrImages0.push_back(opt.strSequence + "/" + vTokens[1]);
+            if(opt.strSensor=="rgbd")
+                seq.vstrImages1.push_back(opt.strSequence + "/" + vTokens[3]);
+        }
+    }
+    else
+    {
+        ifstream f((opt.strSequence + "/times.txt").c_str());
+        string s;
+        while(getline(f,s))
+        {
+            if(!SplitLine(s,vTokens))
+                continue;
+            stringstream ss;
+            ss << setfill('0') << setw(6) << seq.vTimestamps.size();
+            seq.vstrImages0.push_back(opt.strSequence + "/image_0/" + ss.str() + ".png");
+            if(opt.strSensor=="stereo")
+                seq.vstrImages1.push_back(opt.strSequence + "/image_1/" + ss.str() + ".png");
+            seq.vTimestamps.push_back(atof(vTokens[0].c_str()));
+        }
+    }
+
+    if(seq.vTimestamps.empty())
+    {
+        cerr << "ERROR: No images found in " << opt.strSequence << endl;
+        return false;
+    }
+
+    return true;
+}
+
+bool LoadRectification(const string &strSettingsFile, cv::Mat &M1l, cv::Mat &M2l, cv::Mat &M1r, cv::Mat &M2r)
+{
+    cv::FileStorage fsSettings(strSettingsFile.c_str(), cv::FileStorage::READ);
+    if(!fsSettings.isOpened())
+    {
+        cerr << "ERROR: Wrong path to settings" << endl;
+        return false;
+    }
+
+    // KITTI images are already rectified
+    if(fsSettings["LEFT.K"].empty())
+        return true;
+
+    cv::Mat K_l, K_r, P_l, P_r, R_l, R_r, D_l, D_r;
+    fsSettings["LEFT.K"] >> K_l;
+    fsSettings["RIGHT.K"] >> K_r;
+
+    fsSettings["LEFT.P"] >> P_l;
+    fsSettings["RIGHT.P"] >> P_r;
+
+    fsSettings["LEFT.R"] >> R_l;
+    fsSettings["RIGHT.R"] >> R_r;
+
+    fsSettings["LEFT.D"] >> D_l;
+    fsSettings["RIGHT.D"] >> D_r;
+
+    int rows_l = fsSettings["LEFT.height"];
+    int cols_l = fsSettings["LEFT.width"];
+    int rows_r = fsSettings["RIGHT.height"];
+    int cols_r = fsSettings["RIGHT.width"];
+
+    if(K_r.empty() || P_l.empty() || P_r.empty() || R_l.empty() || R_r.empty() || D_l.empty() || D_r.empty() ||
+            rows_l==0 || rows_r==0 || cols_l==0 || cols_r==0)
+    {
+        cerr << "ERROR: Calibration parameters to rectify stereo are missing!" << endl;
+        return false;
+    }
+
+    cv::initUndistortRectifyMap(K_l,D_l,R_l,P_l.rowRange(0,3).colRange(0,3),cv::Size(cols_l,rows_l),CV_32F,M1l,M2l);
+    cv::initUndistortRectifyMap(K_r,D_r,R_r,P_r.rowRange(0,3).colRange(0,3),cv::Size(cols_r,rows_r),CV_32F,M1r,M2r);
+
+    return true;
+}
+
+// Reads positions from a TUM (timestamp tx ty tz qx qy qz qw), EuRoC ground truth (timestamp in ns, csv)
+// or KITTI (3x4 matrix per line, timestamps given by vFrameTimestamps) file
+bool LoadTrajectory(const string &strFile, const vector<double> &vFrameTimestamps,
+                    vector<double> &vTimestamps, vector<Eigen::Vector3d> &vPositions)
+{
+    ifstream f(strFile.c_str());
+    if(!f.is_open())
+        return false;
+
+    vector<string> vTokens;
+    string s;
+    while(getline(f,s))
+    {
+        if(!SplitLine(s,vTokens))
+            continue;
+
+        if(!vFrameTimestamps.empty())
+        {
+            if(vTokens.size()<12 || vTimestamps.size()>=vFrameTimestamps.size())
+                continue;
+            vTimestamps.push_back(vFrameTimestamps[vTimestamps.size()]);
+            vPositions.push_back(Eigen::Vector3d(atof(vTokens[3].c_str()),atof(vTokens[7].c_str()),atof(vTokens[11].c_str())));
+        }
+        else
+        {
+            if(vTokens.size()<4)
+                continue;
+            double t = atof(vTokens[0].c_str());
+            if(t>1e12)
+                t /= 1e9;
+            vTimestamps.push_back(t);
+            vPositions.push_back(Eigen::Vector3d(atof(vTokens[1].c_str()),atof(vTokens[2].c_str()),atof(vTokens[3].c_str())));
+        }
+    }
+
+    return !vTimestamps.empty();
+}
+
+// Associates every estimated position with the closest ground truth in time and aligns
+// both trajectories in the least squares sense (Umeyama 1991), with scale if bScale.
+bool ComputeATE(const vector<double> &vTimesEst, const vector<Eigen::Vector3d> &vPosEst,
+                const vector<double> &vTimesGt, const vector<Eigen::Vector3d> &vPosGt,
+                const double maxDt, const bool bScale, ATE &ate)
+{
+    vector<size_t> vOrderGt(vTimesGt.size());
+    for(size_t i=0; i<vOrderGt.size(); i++)
+        vOrderGt[i] = i;
+    sort(vOrderGt.begin(),vOrderGt.end(),[&](size_t a, size_t b){ return vTimesGt[a]<vTimesGt[b]; });
+    vector<double> vSortedTimesGt(vOrderGt.size());
+    for(size_t i=0; i<vOrderGt.size(); i++)
+        vSortedTimesGt[i] = vTimesGt[vOrderGt[i]];
+
+    vector<Eigen::Vector3d> vE, vG;
+    for(size_t i=0; i<vTimesEst.size(); i++)
+    {
+        const double t = vTimesEst[i];
+        vector<double>::const_iterator it = lower_bound(vSortedTimesGt.begin(),vSortedTimesGt.end(),t);
+        size_t best = it-vSortedTimesGt.begin();
+        if(best==vSortedTimesGt.size() || (best>0 && t-vSortedTimesGt[best-1]<vSortedTimesGt[best]-t))
+            best--;
+        if(fabs(vSortedTimesGt[best]-t)>maxDt)
+            continue;
+        vE.push_back(vPosEst[i]);
+        vG.push_back(vPosGt[vOrderGt[best]]);
+    }
+
+    const size_t N = vE.size();
+    if(N<3)
+        return false;
+
+    Eigen::Vector3d muE = Eigen::Vector3d::Zero();
+    Eigen::Vector3d muG = Eigen::Vector3d::Zero();
+    for(size_t i=0; i<N; i++)
+    {
+        muE += vE[i];
+        muG += vG[i];
+    }
+    muE /= N;
+    muG /= N;
+
+    Eigen::Matrix3d Sigma = Eigen::Matrix3d::Zero();
+    double varE = 0;
+    for(size_t i=0; i<N; i++)
+    {
+        Sigma += (vG[i]-muG)*(vE[i]-muE).transpose();
+        varE += (vE[i]-muE).squaredNorm();
+    }
+    Sigma /= N;
+    varE /= N;
+
+    Eigen::JacobiSVD<Eigen::Matrix3d> svd(Sigma, Eigen::ComputeFullU | Eigen::ComputeFullV);
+    Eigen::Matrix3d S = Eigen::Matrix3d::Identity();
+    if(svd.matrixU().determinant()*svd.matrixV().determinant()<0)
+        S(2,2) = -1;
+
+    const Eigen::Matrix3d R = svd.matrixU()*S*svd.matrixV().transpose();
+    const double s = (bScale && varE>0) ? (svd.singularValues().asDiagonal()*S).trace()/varE : 1.0;
+    const Eigen::Vector3d t = muG - s*R*muE;
+
+    vector<double> vErrors(N);
+    double sum = 0, sum2 = 0;
+    for(size_t i=0; i<N; i++)
+    {
+        vErrors[i] = (vG[i]-(s*R*vE[i]+t)).norm();
+        sum += vErrors[i];
+        sum2 += vErrors[i]*vErrors[i];
+    }
+
+    ate.nPairs = N;
+    ate.scale = s;
+    ate.rmse = sqrt(sum2/N);
+    ate.mean = sum/N;
+    ate.median = Percentile(vErrors,0.5);
+    ate.max = *max_element(vErrors.begin(),vErrors.end());
+
+    return true;
+}
+
+double PeakRSSMegabytes()
+{
+    struct rusage usage;
+    if(getrusage(RUSAGE_SELF,&usage)!=0)
+        return 0;
+
+    // ru_maxrss is given in kilobytes on Linux
+    return usage.ru_maxrss/1024.0;
+}
+
+double Percentile(vector<double> v, const double p)
+{
+    if(v.empty())
+        return 0;
+    const size_t k = min<size_t>(v.size()-1,(size_t)(p*v.size()));
+    nth_element(v.begin(),v.begin()+k,v.end());
+    return v[k];
+}